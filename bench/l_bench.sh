@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+# l_bench.sh - Time l per phase on generated trees
+#
+# Usage: l_bench.sh [L_BINARY]
+#
+# Builds a few synthetic trees in a temporary directory (one wide
+# directory, one deep chain, many small directories, and a git repo with
+# modified and untracked files), then runs `l --profile` on each in the
+# default, tree and git-filter modes. The first run against an empty
+# cache is reported as cold; BENCH_RUNS more runs (default 3) follow it
+# as warm. When strace is installed, one extra run per case reports the
+# syscall counts.
+#
+# HOME points at the scratch directory so the real cache is never read
+# or written.
+
+set -e
+
+L=${1:-bin/l}
+RUNS=${BENCH_RUNS:-3}
+
+case "$L" in
+    /*) ;;
+    *) L="$PWD/$L" ;;
+esac
+if [ ! -x "$L" ]; then
+    echo "l_bench: $L is not executable" >&2
+    exit 1
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/l-bench.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT INT TERM
+mkdir -p "$WORK/home/.cache/l"
+export HOME="$WORK/home"
+
+# ============================================================================
+# Trees
+# ============================================================================
+
+echo "l_bench: building trees in $WORK" >&2
+
+# 20000 files in a single directory
+mkdir "$WORK/wide"
+(cd "$WORK/wide" && seq 1 20000 | sed 's/^/f/' | xargs touch)
+
+# 100 nested directories, one file each
+d="$WORK/deep"
+i=0
+while [ $i -lt 100 ]; do
+    d="$d/d$i"
+    i=$((i + 1))
+done
+mkdir -p "$d"
+(cd "$WORK/deep" && find . -type d -exec sh -c 'echo x > "$1/f"' _ {} \;)
+
+# 2000 directories of 10 one-line files
+mkdir "$WORK/small"
+(cd "$WORK/small" && seq 1 20000 | split -l 10 -a 4 - part.)
+(cd "$WORK/small" && for f in part.*; do
+    mkdir "d$f" && (cd "d$f" && split -l 1 -a 2 "../$f" x.) && rm "$f"
+done)
+
+# Git repo: 2000 committed files, 200 modified, 100 untracked
+mkdir -p "$WORK/repo"
+(
+    cd "$WORK/repo"
+    git init -q .
+    i=0
+    while [ $i -lt 20 ]; do
+        mkdir "m$i"
+        seq 1 100 | sed "s|^|m$i/f|" | xargs -n 100 sh -c 'for f; do echo "$f" > "$f.txt"; done' _
+        i=$((i + 1))
+    done
+    git add -A
+    git -c user.name=bench -c user.email=bench@localhost commit -qm init
+    for f in $(git ls-files | awk 'NR % 10 == 0'); do echo changed >> "$f"; done
+    seq 1 100 | sed 's/^/untracked/' | xargs -n 100 sh -c 'for f; do echo "$f" > "m0/$f.txt"; done' _
+)
+
+# ============================================================================
+# Runs
+# ============================================================================
+
+# run NAME ARGS... - one cold run, RUNS warm runs, then strace if present
+run() {
+    name=$1
+    shift
+    rm -f "$HOME/.cache/l/"*
+    echo
+    echo "== $name: l $* (cold)"
+    "$L" --profile "$@" 2>&1 >/dev/null
+    n=1
+    while [ $n -le "$RUNS" ]; do
+        echo "== $name: l $* (warm $n)"
+        "$L" --profile "$@" 2>&1 >/dev/null
+        n=$((n + 1))
+    done
+    if command -v strace >/dev/null 2>&1; then
+        echo "== $name: syscalls"
+        strace -c -f -o "$WORK/strace.out" "$L" "$@" >/dev/null 2>&1 || true
+        head -n 15 "$WORK/strace.out"
+    fi
+}
+
+run wide        "$WORK/wide"
+run deep-tree   -t "$WORK/deep"
+run small-tree  -t "$WORK/small"
+run git-tree    -t "$WORK/repo"
+run git-changed -g "$WORK/repo"
@@ -0,0 +1,87 @@
+/*
+ * scan_bench.c - Compare the scan schedulers on a directory tree
+ *
+ * Usage: scan-bench [-r RUNS] [-j THREADS] [PATH]
+ *
+ * Each scheduler gets one untimed warm-up walk (so both run against a hot
+ * inode cache), then RUNS timed walks. Reports the fastest and median wall
+ * time and fails if the schedulers disagree on the totals.
+ */
+
+#include "common.h"
+#include "scan.h"
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BENCH_MAX_RUNS 100
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static ScanResult bench_scheduler(const char *name, ScanScheduler sched,
+                                  const char *path, int runs) {
+    double times[BENCH_MAX_RUNS];
+    scan_set_scheduler(sched);
+
+    ScanResult r = scan_directory(path, NULL, NULL, NULL, 0);
+    for (int i = 0; i < runs; i++) {
+        double start = now_ms();
+        r = scan_directory(path, NULL, NULL, NULL, 0);
+        times[i] = now_ms() - start;
+    }
+    qsort(times, runs, sizeof(double), cmp_double);
+
+    printf("%-8s  min %8.1f ms  median %8.1f ms  (%ld files, %lld bytes)\n",
+           name, times[0], times[runs / 2], r.file_count, (long long)r.size);
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    int runs = 5;
+    const char *path = "/usr";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:j:")) != -1) {
+        switch (opt) {
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'j':
+#ifdef _OPENMP
+                omp_set_num_threads(atoi(optarg));
+#endif
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r RUNS] [-j THREADS] [PATH]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc) path = argv[optind];
+    if (runs < 1) runs = 1;
+    if (runs > BENCH_MAX_RUNS) runs = BENCH_MAX_RUNS;
+
+#ifdef _OPENMP
+    printf("%s, %d runs, %d threads\n", path, runs, omp_get_max_threads());
+#else
+    printf("%s, %d runs, 1 thread\n", path, runs);
+#endif
+
+    ScanResult tasks = bench_scheduler("tasks", SCAN_SCHED_TASKS, path, runs);
+    ScanResult steal = bench_scheduler("steal", SCAN_SCHED_STEAL, path, runs);
+
+    if (tasks.size != steal.size || tasks.file_count != steal.file_count) {
+        fprintf(stderr, "Error: schedulers disagree on totals\n");
+        return 1;
+    }
+    return 0;
+}
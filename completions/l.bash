@@ -15,13 +15,16 @@ _l() {
         --min-size)
             return 0  # User provides size
             ;;
+        --du-top)
+            return 0  # User provides count
+            ;;
     esac
 
     # Complete options
     if [[ "$cur" == -* ]]; then
         opts="-a -l --long -s --short -t --tree -d --depth -p --path
               -e --expand-all --list --summary --no-icons -c --color-all -g
-              -f --filter --min-size -i --interactive -S -T -N -r
+              -f --filter --min-size -i --interactive --stream --json --ndjson --du-top --profile -S -T -N -r
               -h --help --version --daemon"
         COMPREPLY=( $(compgen -W "$opts" -- "$cur") )
         return 0
@@ -1,11 +1,138 @@
 /*
  * cache.c - Client-side cache operations and directory statistics
+ *
+ * Lookups go to the daemon's mmap'd snapshot index when one is present and
+ * current, falling back to SQLite (serialized by a mutex) otherwise.
+ *
+ * Also owns the content cache, a small per-user database of line counts
+ * and media info that clients read and write themselves, and the revision
+ * cache of git commit counts and the per-repo git status cache stored next
+ * to it.
  */
 
 #include "cache.h"
 #include "scan.h"
+#include "profile.h"
+#include "query.h"
 #include <sqlite3.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <time.h>
+
+/* ============================================================================
+ * Snapshot Index (lock-free)
+ * ============================================================================ */
+
+static void *g_index_map = NULL;
+static size_t g_index_size = 0;
+static CacheIndexView g_index;
+
+static void index_unload(void) {
+    if (g_index_map) munmap(g_index_map, g_index_size);
+    g_index_map = NULL;
+    g_index_size = 0;
+    memset(&g_index, 0, sizeof(g_index));
+}
+
+int cache_index_view(const void *map, size_t size, CacheIndexView *view) {
+    if (size < sizeof(CacheIndexHeader)) return -1;
+    const CacheIndexHeader *hdr = map;
+    if (hdr->magic != CACHE_INDEX_MAGIC || hdr->version != CACHE_INDEX_VERSION ||
+        hdr->nodes == 0 || hdr->nodes > CACHE_INDEX_NONE || hdr->count > hdr->nodes)
+        return -1;
+
+    size_t names_off = sizeof(*hdr) + hdr->nodes * sizeof(CacheIndexNode) +
+                       hdr->count * sizeof(CacheIndexSlot);
+    /* Names must end in NUL so every component read is bounded */
+    if (size <= names_off || ((const char *)map)[size - 1] != '\0') return -1;
+
+    const char *base = map;
+    view->nodes = (const CacheIndexNode *)(base + sizeof(*hdr));
+    view->slots = (const CacheIndexSlot *)(view->nodes + hdr->nodes);
+    view->names = base + names_off;
+    view->node_count = hdr->nodes;
+    view->slot_count = hdr->count;
+    view->names_len = size - names_off;
+    return 0;
+}
+
+/* Whether node n spells path, comparing components from the last one up.
+ * Parents always have lower indices, so a corrupt file can't loop. */
+static int index_node_matches(const CacheIndexView *view, uint64_t n,
+                              const char *path, size_t len) {
+    if (n >= view->node_count) return 0;
+    while (n != 0) {
+        const CacheIndexNode *node = &view->nodes[n];
+        if (node->parent >= n || node->name_off >= view->names_len) return 0;
+        const char *name = view->names + node->name_off;
+        size_t name_len = strlen(name);
+        if (name_len + 1 > len || path[len - name_len - 1] != '/' ||
+            memcmp(path + len - name_len, name, name_len) != 0)
+            return 0;
+        len -= name_len + 1;
+        n = node->parent;
+    }
+    return len == 0 || (len == 1 && path[0] == '/');
+}
+
+int64_t cache_index_find(const CacheIndexView *view, const char *path) {
+    uint32_t hash = (uint32_t)(hash_string64(path) >> 32);
+    size_t len = strlen(path);
+
+    /* Lower bound of hash in the sorted slot array */
+    uint64_t lo = 0, hi = view->slot_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (view->slots[mid].hash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (; lo < view->slot_count && view->slots[lo].hash == hash; lo++) {
+        uint32_t n = view->slots[lo].node;
+        if (index_node_matches(view, n, path, len)) return n;
+    }
+    return -1;
+}
+
+/* Map the snapshot index - returns 0 on success, -1 if missing, stale or
+ * malformed (caller falls back to the database) */
+static int index_load(const char *db_path) {
+    char path[PATH_MAX];
+    cache_get_index_path(path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st, db_st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheIndexHeader) ||
+        (stat(db_path, &db_st) == 0 && GET_MTIME(db_st) > GET_MTIME(st))) {
+        close(fd);
+        return -1;
+    }
+
+    /* Shared, so sizes the daemon rewrites in place show up */
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    if (cache_index_view(map, (size_t)st.st_size, &g_index) != 0) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    g_index_map = map;
+    g_index_size = (size_t)st.st_size;
+    return 0;
+}
+
+static int index_lookup(const char *path, CacheEntry *out) {
+    int64_t n = cache_index_find(&g_index, path);
+    if (n < 0) return 0;
+    out->size = g_index.nodes[n].size;
+    out->file_count = g_index.nodes[n].file_count;
+    return 1;
+}
 
 /* ============================================================================
  * Client-side Cache (read-only)
@@ -15,10 +142,46 @@ static sqlite3 *g_db = NULL;
 static sqlite3_stmt *g_lookup_stmt = NULL;
 static pthread_mutex_t g_db_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Directory sizes answered from the cache, and walked instead, this run */
+static long g_size_hits = 0;
+static long g_size_misses = 0;
+
+/* Add this run's lookups to the shared "HITS MISSES" counter file. The
+ * totals only grow, so rewriting in place never leaves a stale tail. Only
+ * the daemon reports them, so without its socket there is nothing to do. */
+static void hits_record(void) {
+    if (!g_size_hits && !g_size_misses) return;
+
+    char path[PATH_MAX];
+    cache_get_socket_path(path, sizeof(path));
+    if (access(path, F_OK) != 0) return;
+    cache_get_hits_path(path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+    if (flock(fd, LOCK_EX) == 0) {
+        char buf[64];
+        long hits = 0, misses = 0;
+        ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (n > 0) {
+            buf[n] = '\0';
+            if (sscanf(buf, "%ld %ld", &hits, &misses) != 2) hits = misses = 0;
+        }
+        int len = snprintf(buf, sizeof(buf), "%ld %ld\n",
+                           hits + g_size_hits, misses + g_size_misses);
+        ssize_t written = pwrite(fd, buf, (size_t)len, 0);
+        (void)written;  /* Best-effort: a lost update only skews the rate */
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+    g_size_hits = g_size_misses = 0;
+}
+
 int cache_load(void) {
     char path[PATH_MAX];
     cache_get_path(path, sizeof(path));
 
+    if (index_load(path) == 0) return 0;
+
     /* Use READWRITE to allow WAL recovery, but we only read */
     int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX;
     if (sqlite3_open_v2(path, &g_db, flags, NULL) != SQLITE_OK) {
@@ -44,6 +207,7 @@ int cache_load(void) {
 }
 
 int cache_lookup(const char *path, CacheEntry *out) {
+    if (g_index_map) return index_lookup(path, out);
     if (!g_db || !g_lookup_stmt) return 0;
 
     pthread_mutex_lock(&g_db_lock);
@@ -71,6 +235,8 @@ const CacheEntry *cache_lookup_entry(const char *path) {
 }
 
 void cache_unload(void) {
+    if (g_index_map || g_db) hits_record();
+    index_unload();
     if (g_lookup_stmt) {
         sqlite3_finalize(g_lookup_stmt);
         g_lookup_stmt = NULL;
@@ -81,6 +247,148 @@ void cache_unload(void) {
     }
 }
 
+/* ============================================================================
+ * Size Queries (read-only, own connection)
+ * ============================================================================ */
+
+/* Strict descendants of the prefix bound to ?1 ("" for /); '0' is the
+ * character after '/', so this range is exactly the subtree */
+#define SUBTREE_RANGE "path > ?1 || '/' AND path < ?1 || '0'"
+
+typedef struct {
+    CacheRow *rows;
+    int count;
+    int cap;
+} RowList;
+
+/* Step a bound statement to the end, appending each row - returns 0 on success */
+static int rows_collect(RowList *list, sqlite3_stmt *stmt) {
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (list->count == list->cap) {
+            list->cap = list->cap ? list->cap * 2 : 64;
+            list->rows = xrealloc(list->rows, (size_t)list->cap * sizeof(CacheRow));
+        }
+        CacheRow *row = &list->rows[list->count++];
+        row->path = xstrdup((const char *)sqlite3_column_text(stmt, 0));
+        row->size = sqlite3_column_int64(stmt, 1);
+        row->file_count = sqlite3_column_int64(stmt, 2);
+    }
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+static int row_size_cmp(const void *a, const void *b) {
+    const CacheRow *ra = a, *rb = b;
+    if (ra->size != rb->size) return ra->size > rb->size ? -1 : 1;
+    return strcmp(ra->path, rb->path);
+}
+
+/* Descendants at exactly each level from first to last, one probe of the
+ * (depth, path) index per level. Returns 0 on success, 1 if the database
+ * predates the depth column, -1 on error. */
+static int query_by_level(sqlite3 *db, const char *prefix, int64_t first,
+                          int64_t last, int limit, RowList *list) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT MAX(depth) FROM sizes", -1, &stmt, NULL) != SQLITE_OK)
+        return 1;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) < last)
+        last = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(db,
+            "SELECT path, size, file_count FROM sizes "
+            "WHERE depth = ?3 AND " SUBTREE_RANGE " ORDER BY size DESC LIMIT ?2",
+            -1, &stmt, NULL) != SQLITE_OK)
+        return 1;
+
+    int rc = 0;
+    for (int64_t depth = first; rc == 0 && depth <= last; depth++) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, limit);
+        sqlite3_bind_int64(stmt, 3, depth);
+        rc = rows_collect(list, stmt);
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+int cache_query_largest(const char *root, int max_depth, int limit, CacheRow **out) {
+    *out = NULL;
+
+    char db_path[PATH_MAX];
+    cache_get_path(db_path, sizeof(db_path));
+    sqlite3 *db;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 1000);
+
+    const char *prefix = strcmp(root, "/") == 0 ? "" : root;
+    int64_t root_depth = path_depth(root);
+    RowList list = {NULL, 0, 0};
+    sqlite3_stmt *stmt;
+
+    /* The root's own row */
+    int rc = -1;
+    if (sqlite3_prepare_v2(db, "SELECT path, size, file_count FROM sizes WHERE path = ?1",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, root, -1, SQLITE_STATIC);
+        rc = rows_collect(&list, stmt);
+        sqlite3_finalize(stmt);
+    }
+
+    if (rc == 0 && max_depth < 0) {
+        /* Whole subtree: one ranged scan of the primary key */
+        rc = -1;
+        if (sqlite3_prepare_v2(db,
+                "SELECT path, size, file_count FROM sizes "
+                "WHERE " SUBTREE_RANGE " ORDER BY size DESC LIMIT ?2",
+                -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, limit);
+            rc = rows_collect(&list, stmt);
+            sqlite3_finalize(stmt);
+        }
+    } else if (rc == 0 && max_depth > 0) {
+        int64_t last = root_depth + max_depth;
+        rc = query_by_level(db, prefix, root_depth + 1, last, limit, &list);
+        if (rc == 1) {
+            /* Written before the depth column: count slashes while scanning */
+            rc = -1;
+            if (sqlite3_prepare_v2(db,
+                    "SELECT path, size, file_count FROM sizes "
+                    "WHERE " SUBTREE_RANGE " AND "
+                    "length(path) - length(replace(path, '/', '')) <= ?3 "
+                    "ORDER BY size DESC LIMIT ?2",
+                    -1, &stmt, NULL) == SQLITE_OK) {
+                sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 2, limit);
+                sqlite3_bind_int64(stmt, 3, last);
+                rc = rows_collect(&list, stmt);
+                sqlite3_finalize(stmt);
+            }
+        }
+    }
+    sqlite3_close(db);
+
+    if (rc != 0) {
+        cache_rows_free(list.rows, list.count);
+        return -1;
+    }
+
+    qsort(list.rows, (size_t)list.count, sizeof(CacheRow), row_size_cmp);
+    while (list.count > limit) free(list.rows[--list.count].path);
+    *out = list.rows;
+    return list.count;
+}
+
+void cache_rows_free(CacheRow *rows, int count) {
+    for (int i = 0; i < count; i++) free(rows[i].path);
+    free(rows);
+}
+
 /* ============================================================================
  * Directory Statistics (uses shared scan.c implementation)
  * ============================================================================ */
@@ -101,7 +409,7 @@ int cache_lookup_wrapper(const char *path, off_t *size, long *count) {
     return 0;
 }
 
-DirStats get_dir_stats_cached(const char *path) {
+static DirStats dir_stats_cached(const char *path) {
     /* Skip virtual filesystems (proc, sysfs, etc.) - they report fake sizes */
     if (path_is_virtual_fs(path)) {
         return (DirStats){-1, -1};
@@ -118,8 +426,336 @@ DirStats get_dir_stats_cached(const char *path) {
     off_t size;
     long count;
     if (cache_lookup_wrapper(lookup_path, &size, &count)) {
+        PROFILE_COUNT(PROF_SIZE_HIT);
+        #pragma omp atomic
+        g_size_hits++;
         return (DirStats){size, count};
     }
+    PROFILE_COUNT(PROF_SIZE_MISS);
+    #pragma omp atomic
+    g_size_misses++;
+
+    /* Let the daemon walk it, sharing the walk with other clients */
+    DirStats stats;
+    if (query_scan(lookup_path, &stats) == 0) return stats;
+
     /* Use resolved path so subdirectory cache lookups match stored paths */
     return dir_stats_get(lookup_path, cache_lookup_wrapper);
 }
+
+DirStats get_dir_stats_cached(const char *path) {
+    int64_t start = PROFILE_BEGIN();
+    DirStats stats = dir_stats_cached(path);
+    PROFILE_END(PROF_DIR_STATS, start);
+    return stats;
+}
+
+/* ============================================================================
+ * Content Cache (read-write, client-owned)
+ * ============================================================================ */
+
+#define CONTENT_CACHE_MAX_BYTES (32 * 1024 * 1024)  /* Prune past this size */
+#define CONTENT_SETTLE_SECS     2   /* Don't cache files modified this recently */
+
+typedef struct {
+    ContentKey key;
+    int mode;
+    ContentInfo info;
+} ContentPending;
+
+static sqlite3 *g_content_db = NULL;
+static sqlite3_stmt *g_content_get_stmt = NULL;
+static sqlite3_stmt *g_content_put_stmt = NULL;
+static sqlite3_stmt *g_rev_get_stmt = NULL;
+static sqlite3_stmt *g_rev_put_stmt = NULL;
+static sqlite3_stmt *g_status_get_stmt = NULL;
+static sqlite3_stmt *g_status_put_stmt = NULL;
+static int g_content_tried = 0;
+static ContentPending *g_content_pending = NULL;
+static size_t g_content_pending_count = 0;
+static size_t g_content_pending_cap = 0;
+static pthread_mutex_t g_content_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *CONTENT_SCHEMA =
+    "PRAGMA journal_mode=WAL;"
+    "PRAGMA synchronous=OFF;"
+    "CREATE TABLE IF NOT EXISTS content ("
+    "  dev INTEGER NOT NULL,"
+    "  ino INTEGER NOT NULL,"
+    "  size INTEGER NOT NULL,"
+    "  mtime_ns INTEGER NOT NULL,"
+    "  mode INTEGER NOT NULL,"
+    "  content_type INTEGER NOT NULL,"
+    "  line_count INTEGER NOT NULL,"
+    "  word_count INTEGER NOT NULL,"
+    "  stored INTEGER NOT NULL,"
+    "  PRIMARY KEY (dev, ino)"
+    ") WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS revs ("
+    "  key TEXT PRIMARY KEY,"
+    "  count INTEGER NOT NULL,"
+    "  text TEXT,"
+    "  stored INTEGER NOT NULL"
+    ") WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS status ("
+    "  repo TEXT PRIMARY KEY,"
+    "  stamp TEXT NOT NULL,"
+    "  taken_ns INTEGER NOT NULL,"
+    "  data BLOB NOT NULL,"
+    "  stored INTEGER NOT NULL"
+    ");";
+
+/* Drop the older half of the rows once the file grows past the limit */
+static const char *CONTENT_PRUNE =
+    "DELETE FROM content WHERE stored <= ("
+    "  SELECT stored FROM content ORDER BY stored"
+    "  LIMIT 1 OFFSET (SELECT COUNT(*) / 2 FROM content));"
+    "DELETE FROM revs WHERE stored <= ("
+    "  SELECT stored FROM revs ORDER BY stored"
+    "  LIMIT 1 OFFSET (SELECT COUNT(*) / 2 FROM revs));"
+    "DELETE FROM status WHERE stored <= ("
+    "  SELECT stored FROM status ORDER BY stored"
+    "  LIMIT 1 OFFSET (SELECT COUNT(*) / 2 FROM status));"
+    "VACUUM;";
+
+static void content_close(void) {
+    if (g_content_get_stmt) sqlite3_finalize(g_content_get_stmt);
+    if (g_content_put_stmt) sqlite3_finalize(g_content_put_stmt);
+    if (g_rev_get_stmt) sqlite3_finalize(g_rev_get_stmt);
+    if (g_rev_put_stmt) sqlite3_finalize(g_rev_put_stmt);
+    if (g_status_get_stmt) sqlite3_finalize(g_status_get_stmt);
+    if (g_status_put_stmt) sqlite3_finalize(g_status_put_stmt);
+    if (g_content_db) sqlite3_close(g_content_db);
+    g_content_get_stmt = NULL;
+    g_content_put_stmt = NULL;
+    g_rev_get_stmt = NULL;
+    g_rev_put_stmt = NULL;
+    g_status_get_stmt = NULL;
+    g_status_put_stmt = NULL;
+    g_content_db = NULL;
+}
+
+/* Open on first use - caller holds g_content_lock. Returns 0 if open. */
+static int content_open(void) {
+    if (g_content_tried) return g_content_db ? 0 : -1;
+    g_content_tried = 1;
+
+    char path[PATH_MAX];
+    cache_get_content_path(path, sizeof(path));
+
+    /* The daemon may never have run, so the directory may not exist yet */
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/.cache", home ? home : "/tmp");
+    mkdir(dir, 0755);
+    snprintf(dir, sizeof(dir), "%s/.cache/l", home ? home : "/tmp");
+    mkdir(dir, 0755);
+
+    struct stat st;
+    int prune = stat(path, &st) == 0 && st.st_size > CONTENT_CACHE_MAX_BYTES;
+
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+    if (sqlite3_open_v2(path, &g_content_db, flags, NULL) != SQLITE_OK) {
+        content_close();
+        return -1;
+    }
+
+    /* Other l processes may be writing; never stall a listing for long */
+    sqlite3_busy_timeout(g_content_db, 200);
+
+    if (sqlite3_exec(g_content_db, CONTENT_SCHEMA, NULL, NULL, NULL) != SQLITE_OK ||
+        (prune && sqlite3_exec(g_content_db, CONTENT_PRUNE, NULL, NULL, NULL) != SQLITE_OK) ||
+        sqlite3_prepare_v2(g_content_db,
+            "SELECT size, mtime_ns, mode, content_type, line_count, word_count "
+            "FROM content WHERE dev = ?1 AND ino = ?2",
+            -1, &g_content_get_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(g_content_db,
+            "INSERT OR REPLACE INTO content VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)",
+            -1, &g_content_put_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(g_content_db,
+            "SELECT count, text FROM revs WHERE key = ?1",
+            -1, &g_rev_get_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(g_content_db,
+            "INSERT OR REPLACE INTO revs VALUES (?1, ?2, ?3, ?4)",
+            -1, &g_rev_put_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(g_content_db,
+            "SELECT taken_ns, data FROM status WHERE repo = ?1 AND stamp = ?2",
+            -1, &g_status_get_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(g_content_db,
+            "INSERT OR REPLACE INTO status VALUES (?1, ?2, ?3, ?4, ?5)",
+            -1, &g_status_put_stmt, NULL) != SQLITE_OK) {
+        content_close();
+        return -1;
+    }
+    return 0;
+}
+
+int content_cache_lookup(const ContentKey *key, int mode, ContentInfo *out) {
+    pthread_mutex_lock(&g_content_lock);
+    int found = 0;
+    if (content_open() == 0) {
+        sqlite3_stmt *stmt = g_content_get_stmt;
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)key->dev);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)key->ino);
+        if (sqlite3_step(stmt) == SQLITE_ROW &&
+            sqlite3_column_int64(stmt, 0) == (sqlite3_int64)key->size &&
+            sqlite3_column_int64(stmt, 1) == key->mtime_ns &&
+            sqlite3_column_int(stmt, 2) == mode) {
+            out->content_type = sqlite3_column_int(stmt, 3);
+            out->line_count = sqlite3_column_int(stmt, 4);
+            out->word_count = sqlite3_column_int(stmt, 5);
+            found = 1;
+        }
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&g_content_lock);
+    PROFILE_COUNT(found ? PROF_CONTENT_HIT : PROF_CONTENT_MISS);
+    return found;
+}
+
+void content_cache_store(const ContentKey *key, int mode, const ContentInfo *info) {
+    /* A file still being written could change again within the same
+     * timestamp tick; leave it for a later run */
+    int64_t settled = ((int64_t)time(NULL) - CONTENT_SETTLE_SECS) * 1000000000;
+    if (key->mtime_ns > settled) return;
+
+    pthread_mutex_lock(&g_content_lock);
+    if (g_content_pending_count >= g_content_pending_cap) {
+        g_content_pending_cap = g_content_pending_cap ? g_content_pending_cap * 2 : 64;
+        g_content_pending = xrealloc(g_content_pending,
+                                     g_content_pending_cap * sizeof(ContentPending));
+    }
+    g_content_pending[g_content_pending_count++] = (ContentPending){*key, mode, *info};
+    pthread_mutex_unlock(&g_content_lock);
+}
+
+void content_cache_flush(void) {
+    pthread_mutex_lock(&g_content_lock);
+    if (g_content_pending_count > 0 && content_open() == 0 &&
+        sqlite3_exec(g_content_db, "BEGIN", NULL, NULL, NULL) == SQLITE_OK) {
+        sqlite3_stmt *stmt = g_content_put_stmt;
+        sqlite3_int64 now = (sqlite3_int64)time(NULL);
+        for (size_t i = 0; i < g_content_pending_count; i++) {
+            const ContentPending *p = &g_content_pending[i];
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64(stmt, 1, (sqlite3_int64)p->key.dev);
+            sqlite3_bind_int64(stmt, 2, (sqlite3_int64)p->key.ino);
+            sqlite3_bind_int64(stmt, 3, (sqlite3_int64)p->key.size);
+            sqlite3_bind_int64(stmt, 4, p->key.mtime_ns);
+            sqlite3_bind_int(stmt, 5, p->mode);
+            sqlite3_bind_int(stmt, 6, p->info.content_type);
+            sqlite3_bind_int(stmt, 7, p->info.line_count);
+            sqlite3_bind_int(stmt, 8, p->info.word_count);
+            sqlite3_bind_int64(stmt, 9, now);
+            sqlite3_step(stmt);
+        }
+        sqlite3_reset(stmt);
+        /* Another writer holding the lock just means these aren't cached */
+        if (sqlite3_exec(g_content_db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+            sqlite3_exec(g_content_db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    g_content_pending_count = 0;
+    pthread_mutex_unlock(&g_content_lock);
+}
+
+void content_cache_unload(void) {
+    content_cache_flush();
+    pthread_mutex_lock(&g_content_lock);
+    content_close();
+    free(g_content_pending);
+    g_content_pending = NULL;
+    g_content_pending_cap = 0;
+    g_content_tried = 0;
+    pthread_mutex_unlock(&g_content_lock);
+}
+
+/* ============================================================================
+ * Revision Cache
+ * ============================================================================ */
+
+int rev_cache_lookup(const char *key, long *count, char *text, size_t text_len) {
+    pthread_mutex_lock(&g_content_lock);
+    int found = 0;
+    if (content_open() == 0) {
+        sqlite3_stmt *stmt = g_rev_get_stmt;
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            *count = (long)sqlite3_column_int64(stmt, 0);
+            if (text && text_len > 0) {
+                const unsigned char *t = sqlite3_column_text(stmt, 1);
+                snprintf(text, text_len, "%s", t ? (const char *)t : "");
+            }
+            found = 1;
+        }
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&g_content_lock);
+    return found;
+}
+
+void rev_cache_store(const char *key, long count, const char *text) {
+    pthread_mutex_lock(&g_content_lock);
+    if (content_open() == 0) {
+        sqlite3_stmt *stmt = g_rev_put_stmt;
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)count);
+        if (text)
+            sqlite3_bind_text(stmt, 3, text, -1, SQLITE_STATIC);
+        else
+            sqlite3_bind_null(stmt, 3);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)time(NULL));
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&g_content_lock);
+}
+
+/* ============================================================================
+ * Status Cache
+ * ============================================================================ */
+
+int status_cache_lookup(const char *repo, const char *stamp, int64_t *taken_ns,
+                        void **data, size_t *len) {
+    pthread_mutex_lock(&g_content_lock);
+    int found = 0;
+    if (content_open() == 0) {
+        sqlite3_stmt *stmt = g_status_get_stmt;
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, repo, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, stamp, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const void *blob = sqlite3_column_blob(stmt, 1);
+            int blob_len = sqlite3_column_bytes(stmt, 1);
+            if (blob && blob_len > 0) {
+                *taken_ns = sqlite3_column_int64(stmt, 0);
+                *data = xmalloc((size_t)blob_len);
+                memcpy(*data, blob, (size_t)blob_len);
+                *len = (size_t)blob_len;
+                found = 1;
+            }
+        }
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&g_content_lock);
+    return found;
+}
+
+void status_cache_store(const char *repo, const char *stamp, int64_t taken_ns,
+                        const void *data, size_t len) {
+    pthread_mutex_lock(&g_content_lock);
+    if (content_open() == 0) {
+        sqlite3_stmt *stmt = g_status_put_stmt;
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, repo, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, stamp, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 3, taken_ns);
+        sqlite3_bind_blob(stmt, 4, data, (int)len, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 5, (sqlite3_int64)time(NULL));
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    pthread_mutex_unlock(&g_content_lock);
+}
@@ -11,6 +11,7 @@
 #define L_CACHE_H
 
 #include "common.h"
+#include "scan.h"
 
 /* ============================================================================
  * Types
@@ -28,6 +29,65 @@ typedef struct {
     long file_count;   /* Total file count (-1 if error) */
 } DirStats;
 
+/* ============================================================================
+ * Snapshot Index Format
+ *
+ * Written by the daemon next to the database after every save, and mmap'd
+ * read-only by clients so lookups need no locks or SQL. Paths are stored
+ * as a tree of (parent, name) nodes rather than in full, so long shared
+ * prefixes are kept once. Layout:
+ *
+ *   CacheIndexHeader
+ *   CacheIndexNode[nodes]    depth-first in path order; node 0 is "/"
+ *   CacheIndexSlot[count]    one per cached directory, sorted by hash
+ *   char names[]             NUL-terminated path components, each kept once
+ *
+ * Nodes a cached directory only passes through have file_count -1 and no
+ * slot. Records are fixed-width, so the daemon updates sizes in place
+ * between saves (see cache_daemon_live_commit); a reader may briefly see
+ * a new size with the old count.
+ * ============================================================================ */
+
+#define CACHE_INDEX_MAGIC   0x5844494cu  /* "LIDX" */
+#define CACHE_INDEX_VERSION 2
+#define CACHE_INDEX_NONE    UINT32_MAX   /* Parent of node 0 */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nodes;
+    uint64_t count;
+} CacheIndexHeader;
+
+typedef struct {
+    uint32_t parent;      /* Always a lower index, or CACHE_INDEX_NONE */
+    uint32_t name_off;    /* Offset of the last component in names */
+    int64_t size;
+    int64_t file_count;
+} CacheIndexNode;
+
+typedef struct {
+    uint32_t hash;        /* Top half of hash_string64(path) */
+    uint32_t node;
+} CacheIndexSlot;
+
+/* The tables of a mapped index */
+typedef struct {
+    const CacheIndexNode *nodes;
+    const CacheIndexSlot *slots;
+    const char *names;
+    uint64_t node_count;
+    uint64_t slot_count;
+    size_t names_len;
+} CacheIndexView;
+
+/* Check that a mapped index is well-formed and point view at its tables -
+ * returns 0 on success, -1 otherwise */
+int cache_index_view(const void *map, size_t size, CacheIndexView *view);
+
+/* Find path's node - returns its index, or -1 if path isn't cached */
+int64_t cache_index_find(const CacheIndexView *view, const char *path);
+
 /* Cache lookup function type for dir_stats traversal */
 typedef int (*dir_stats_cache_fn)(const char *path, off_t *size, long *count);
 
@@ -41,15 +101,38 @@ void cache_get_path(char *buf, size_t len);
 /* Load cache (read-only) - returns 0 on success, -1 on failure */
 int cache_load(void);
 
-/* Look up a path in the cache (thread-safe) - returns 1 if found, 0 otherwise */
+/* Look up a path in the cache (thread-safe, lock-free when the snapshot
+ * index is available) - returns 1 if found, 0 otherwise */
 int cache_lookup(const char *path, CacheEntry *out);
 
 /* Wrapper that returns pointer (for compatibility) */
 const CacheEntry *cache_lookup_entry(const char *path);
 
-/* Close the cache */
+/* Close the cache. If it was open, this run's size lookups are added to
+ * the hit and miss counters the daemon reports (cache_get_hits_path). */
 void cache_unload(void);
 
+/* ============================================================================
+ * Size Queries - rank cached directories without walking them
+ *
+ * Only directories the daemon cached (at least the file threshold) have
+ * rows, so these answer "what is large under here", not a full du.
+ * ============================================================================ */
+
+typedef struct {
+    char *path;
+    int64_t size;
+    int64_t file_count;
+} CacheRow;
+
+/* The limit largest cached directories under root (root itself included),
+ * at most max_depth levels below it (-1 for no limit), largest first.
+ * root must be a real path. Returns the number of rows stored in *out
+ * (free with cache_rows_free), or -1 if the database can't be read. */
+int cache_query_largest(const char *root, int max_depth, int limit, CacheRow **out);
+
+void cache_rows_free(CacheRow *rows, int count);
+
 /* ============================================================================
  * Directory Statistics
  * ============================================================================ */
@@ -73,6 +156,77 @@ int cache_lookup_wrapper(const char *path, off_t *size, long *count);
 /* Get directory stats with cache lookup */
 DirStats get_dir_stats_cached(const char *path);
 
+/* ============================================================================
+ * Content Cache - per-file line/word counts and media info
+ *
+ * Lives in its own database (see cache_get_content_path) written by
+ * clients, since the daemon replaces the size database on every scan.
+ * Rows are keyed by (dev, ino) and only used while size and mtime_ns still
+ * match and the same kind of analysis was requested.
+ * ============================================================================ */
+
+/* Analysis requested, part of the key (media parsing changes the result) */
+#define CONTENT_MODE(line_counts, media_info) \
+    (((line_counts) ? 1 : 0) | ((media_info) ? 2 : 0))
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime_ns;
+} ContentKey;
+
+typedef struct {
+    int content_type;    /* ContentType */
+    int line_count;
+    int word_count;
+} ContentInfo;
+
+/* Look up cached content info (opens the cache on first use; thread-safe)
+ * Returns 1 if found and still valid, 0 otherwise */
+int content_cache_lookup(const ContentKey *key, int mode, ContentInfo *out);
+
+/* Queue content info for storing (thread-safe) */
+void content_cache_store(const ContentKey *key, int mode, const ContentInfo *info);
+
+/* Write queued entries in one transaction */
+void content_cache_flush(void);
+
+/* Flush and close the content cache */
+void content_cache_unload(void);
+
+/* ============================================================================
+ * Revision Cache - git facts derived from commit hashes
+ *
+ * Kept in the content database. Keys name immutable history (a commit, a
+ * pair of commits), so rows never go stale; callers fold anything mutable,
+ * like the state of the tag refs, into the key itself.
+ * ============================================================================ */
+
+/* Look up a cached fact (thread-safe). text may be NULL.
+ * Returns 1 if found, 0 otherwise */
+int rev_cache_lookup(const char *key, long *count, char *text, size_t text_len);
+
+/* Store a fact (thread-safe; written immediately, there are few per run) */
+void rev_cache_store(const char *key, long count, const char *text);
+
+/* ============================================================================
+ * Status Cache - a repo's parsed git status, reused across runs
+ *
+ * One row per repo root. The caller packs the entries into data and
+ * decides validity: stamp must match exactly, and the caller checks that
+ * nothing in the working tree changed after taken_ns.
+ * ============================================================================ */
+
+/* Look up a snapshot (thread-safe). On success *data is allocated
+ * (caller frees). Returns 1 if found with this stamp, 0 otherwise */
+int status_cache_lookup(const char *repo, const char *stamp, int64_t *taken_ns,
+                        void **data, size_t *len);
+
+/* Replace a repo's snapshot (thread-safe; written immediately) */
+void status_cache_store(const char *repo, const char *stamp, int64_t taken_ns,
+                        const void *data, size_t len);
+
 /* ============================================================================
  * Daemon API (for ld.c) - read-write operations
  *
@@ -87,13 +241,70 @@ int cache_daemon_init(void);
 /* Store a cache entry - returns 0 on success */
 int cache_daemon_store(const char *path, off_t size, long file_count);
 
-/* Get entry count (for status display) */
+/* Record a directory's stamp and direct contents - returns 0 on success */
+int cache_daemon_store_dir(const char *path, const ScanDirState *state);
+
+/* Look up a directory in the previous database. Returns 1 and fills state
+ * (caller frees state->subdirs) if st matches the recorded stamp, else 0 */
+int cache_daemon_reuse(const char *path, const struct stat *st, ScanDirState *state);
+
+/* Copy path's rows, and those of everything below it, from the previous
+ * database into this scan's, so the subtree needn't be read again.
+ * Returns 1 and fills entry with path's totals, or 0 (copying nothing)
+ * if the previous scan didn't cache path (the daemon stores every network
+ * mount root it reads, whatever its size, so mounts are found here) */
+int cache_daemon_carry(const char *path, CacheEntry *entry);
+
+/* sizes rows in the open database, or (during and after a scan) in the one
+ * cache_daemon_save last wrote */
 int cache_daemon_count(void);
 
+/* SQLite write costs since the daemon started, for its metrics file */
+typedef struct {
+    long batches;               /* Writer transactions committed */
+    long rows;                  /* Rows written by them */
+    double batch_seconds;       /* Total time spent in them */
+    double batch_max_seconds;   /* Longest single transaction */
+    double save_seconds;        /* Last cache_daemon_save (table build + index) */
+} CacheWriteStats;
+
+/* Snapshot the write costs (safe from any thread) */
+void cache_daemon_write_stats(CacheWriteStats *out);
+
 /* Finalize and atomically replace main database with temp */
 int cache_daemon_save(void);
 
 /* Clean up (removes temp db if save wasn't called) */
 void cache_daemon_close(void);
 
+/* ============================================================================
+ * Daemon Live Updates (watch mode)
+ *
+ * Between scans the daemon can keep the main database open and update it
+ * in place as changes are reported. cache_daemon_store, _store_dir and
+ * _reuse then operate on the main database; cache_daemon_close closes it.
+ * ============================================================================ */
+
+/* Open the main database for in-place updates - returns 0 on success */
+int cache_daemon_live_open(void);
+
+/* Call fn for every cached directory */
+void cache_daemon_live_foreach(void (*fn)(const char *path, void *ctx), void *ctx);
+
+/* Look up a cached entry - returns 1 if found, 0 otherwise */
+int cache_daemon_live_get(const char *path, CacheEntry *out);
+
+/* Group updates so clients see ancestors and rows change together */
+int cache_daemon_live_begin(void);
+int cache_daemon_live_commit(void);
+
+/* Forget a directory's stamp so the next scan re-reads it */
+int cache_daemon_live_invalidate(const char *path);
+
+/* Remove a directory and everything below it */
+int cache_daemon_live_remove(const char *path);
+
+/* Add a size/count delta to every cached ancestor of path */
+int cache_daemon_live_adjust(const char *path, off_t size_delta, long count_delta);
+
 #endif /* L_CACHE_H */
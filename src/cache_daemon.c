@@ -4,11 +4,40 @@
  * Writes to a temp database during scan, then atomically replaces the
  * main database when complete. This ensures clients always see a
  * consistent snapshot.
+ *
+ * Each sizes row also records its path depth, indexed together with the
+ * path so clients can rank a subtree's directories level by level
+ * (cache_query_largest) straight from the database.
+ *
+ * Alongside the client-visible sizes table, every directory's stamp and
+ * direct contents are kept in a dirs table. The next scan reads them back
+ * from the previous database so unchanged directories need not be re-read.
+ *
+ * In watch mode the daemon instead opens the main database directly and
+ * updates rows in place (see cache_daemon_live_open).
+ *
+ * Every save also writes the sizes table out as the snapshot index
+ * described in cache.h, which clients prefer over SQLite. Live batches
+ * rewrite only the index records they changed, in place, unless a
+ * directory was added or removed.
+ *
+ * During a scan, stores never touch SQLite on the calling thread. Records
+ * collect in per-thread buffers that are handed to a writer thread, which
+ * appends them to unindexed staging tables in large transactions. The
+ * primary-key tables are built from the staging tables in one sorted pass
+ * at save time.
  */
 
 #include "cache.h"
 #include <sqlite3.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /* ============================================================================
  * Daemon-side Cache (read-write)
@@ -16,23 +45,647 @@
 
 static sqlite3 *d_db = NULL;
 static sqlite3_stmt *d_insert_stmt = NULL;
+static sqlite3_stmt *d_dir_insert_stmt = NULL;
+static sqlite3 *d_prev_db = NULL;
+static sqlite3_stmt *d_prev_lookup_stmt = NULL;
+static sqlite3_stmt *d_get_stmt = NULL;
+static sqlite3_stmt *d_adjust_stmt = NULL;
+static int d_live = 0;                 /* d_db is the main database */
 static char d_final_path[PATH_MAX];
 static char d_temp_path[PATH_MAX + 8];  /* +8 for ".tmp" suffix */
+static char d_index_path[PATH_MAX];
+static char d_index_temp_path[PATH_MAX + 8];
 
-int cache_daemon_init(void) {
-    /* Close any existing database */
+static void finalize_stmt(sqlite3_stmt **stmt) {
+    if (*stmt) {
+        sqlite3_finalize(*stmt);
+        *stmt = NULL;
+    }
+}
+
+static void prev_close(void) {
+    finalize_stmt(&d_prev_lookup_stmt);
+    if (d_prev_db) {
+        sqlite3_close(d_prev_db);
+        d_prev_db = NULL;
+    }
+}
+
+static const char *DIR_LOOKUP_SQL =
+    "SELECT dev, ino, mtime, ctime, own_size, own_count, subdirs "
+    "FROM dirs WHERE path = ?";
+
+/* Open the last completed database for stamp lookups (missing or
+ * pre-incremental databases just mean a full scan) */
+static void prev_open(void) {
+    if (sqlite3_open_v2(d_final_path, &d_prev_db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        sqlite3_close(d_prev_db);
+        d_prev_db = NULL;
+        return;
+    }
+    if (sqlite3_prepare_v2(d_prev_db, DIR_LOOKUP_SQL, -1, &d_prev_lookup_stmt, NULL) != SQLITE_OK)
+        prev_close();
+}
+
+/* Prepare the insert statements on d_db, targeting the staging tables
+ * (staging=1) or the real ones - returns 0 on success */
+static int prepare_inserts(int staging) {
+    char insert_sql[128], dir_insert_sql[192];
+    snprintf(insert_sql, sizeof(insert_sql),
+             "INSERT OR REPLACE INTO %s (path, size, file_count, depth) VALUES (?, ?, ?, ?)",
+             staging ? "temp.sizes_load" : "sizes");
+    snprintf(dir_insert_sql, sizeof(dir_insert_sql),
+             "INSERT OR REPLACE INTO %s "
+             "(path, dev, ino, mtime, ctime, own_size, own_count, subdirs) "
+             "VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+             staging ? "temp.dirs_load" : "dirs");
+    if (sqlite3_prepare_v2(d_db, insert_sql, -1, &d_insert_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(d_db, dir_insert_sql, -1, &d_dir_insert_stmt, NULL) != SQLITE_OK) {
+        finalize_stmt(&d_insert_stmt);
+        return -1;
+    }
+    return 0;
+}
+
+static void writer_stop(void);
+static void live_index_close(void);
+
+/* Close d_db along with every statement prepared on it */
+static void db_close(void) {
+    writer_stop();
+    live_index_close();
+    prev_close();
+    finalize_stmt(&d_insert_stmt);
+    finalize_stmt(&d_dir_insert_stmt);
+    finalize_stmt(&d_get_stmt);
+    finalize_stmt(&d_adjust_stmt);
     if (d_db) {
-        if (d_insert_stmt) {
-            sqlite3_finalize(d_insert_stmt);
-            d_insert_stmt = NULL;
-        }
         sqlite3_close(d_db);
         d_db = NULL;
     }
+    d_live = 0;
+}
 
-    /* Get paths */
+static void set_paths(void) {
     cache_get_path(d_final_path, sizeof(d_final_path));
     snprintf(d_temp_path, sizeof(d_temp_path), "%s.tmp", d_final_path);
+    cache_get_index_path(d_index_path, sizeof(d_index_path));
+    snprintf(d_index_temp_path, sizeof(d_index_temp_path), "%s.tmp", d_index_path);
+}
+
+/* Column lists shared by the real tables and their staging copies */
+#define SIZES_COLUMNS \
+    "  path TEXT NOT NULL," \
+    "  size INTEGER NOT NULL," \
+    "  file_count INTEGER NOT NULL," \
+    "  depth INTEGER NOT NULL"
+#define DIRS_COLUMNS \
+    "  path TEXT NOT NULL," \
+    "  dev INTEGER NOT NULL," \
+    "  ino INTEGER NOT NULL," \
+    "  mtime INTEGER NOT NULL," \
+    "  ctime INTEGER NOT NULL," \
+    "  own_size INTEGER NOT NULL," \
+    "  own_count INTEGER NOT NULL," \
+    "  subdirs BLOB"
+
+/* ============================================================================
+ * Row Writes
+ * ============================================================================ */
+
+static int write_size(const char *path, off_t size, long file_count) {
+    sqlite3_stmt *stmt = d_insert_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, size);
+    sqlite3_bind_int64(stmt, 3, file_count);
+    sqlite3_bind_int(stmt, 4, path_depth(path));
+    return sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+}
+
+static int write_dir(const char *path, const ScanDirState *state) {
+    sqlite3_stmt *stmt = d_dir_insert_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)state->dev);
+    sqlite3_bind_int64(stmt, 3, (sqlite3_int64)state->ino);
+    sqlite3_bind_int64(stmt, 4, state->mtime_ns);
+    sqlite3_bind_int64(stmt, 5, state->ctime_ns);
+    sqlite3_bind_int64(stmt, 6, state->own_size);
+    sqlite3_bind_int64(stmt, 7, state->own_count);
+    if (state->subdirs_len)
+        sqlite3_bind_blob(stmt, 8, state->subdirs, (int)state->subdirs_len, SQLITE_STATIC);
+    else
+        sqlite3_bind_null(stmt, 8);
+    return sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+}
+
+/* ============================================================================
+ * Writer Thread (scan mode)
+ * ============================================================================ */
+
+#define STORE_BATCH        1024  /* Records per buffer handed to the writer */
+#define MAX_STORE_THREADS  256
+
+typedef struct {
+    char *path;
+    int is_dir;
+    off_t size;                  /* sizes row */
+    long file_count;
+    ScanDirState state;          /* dirs row (owns state.subdirs) */
+} StoreRecord;
+
+typedef struct StoreBuffer {
+    StoreRecord recs[STORE_BATCH];
+    size_t count;
+    struct StoreBuffer *next;
+} StoreBuffer;
+
+static pthread_t d_writer;
+static int d_writer_running = 0;
+static int d_writer_stopping = 0;
+static int d_writer_busy = 0;
+static StoreBuffer *d_queue = NULL;
+static StoreBuffer *d_queue_tail = NULL;
+static pthread_mutex_t d_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t d_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t d_idle_cond = PTHREAD_COND_INITIALIZER;
+
+/* Written by the writer thread and cache_daemon_save under d_stats_lock */
+static CacheWriteStats d_stats;
+static long d_saved_sizes = 0;  /* sizes rows in the last saved database */
+static pthread_mutex_t d_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Each scan thread fills its own buffer (indexed by OpenMP thread number
+ * in the scan's parallel region); partial buffers are handed over once the
+ * scan has finished. Threads of a network mount's nested team have numbers
+ * of their own that clash with the outer team's, so they share the last
+ * buffer under d_shared_lock. */
+static StoreBuffer *d_buffers[MAX_STORE_THREADS + 1];
+static pthread_mutex_t d_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Serializes direct writes when no writer thread is running (watch mode) */
+static pthread_mutex_t d_sync_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void store_buffer_free(StoreBuffer *buf) {
+    for (size_t i = 0; i < buf->count; i++) {
+        free(buf->recs[i].path);
+        if (buf->recs[i].is_dir) free(buf->recs[i].state.subdirs);
+    }
+    free(buf);
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&d_queue_lock);
+    for (;;) {
+        while (!d_queue && !d_writer_stopping)
+            pthread_cond_wait(&d_queue_cond, &d_queue_lock);
+        if (!d_queue) break;
+
+        StoreBuffer *batch = d_queue;
+        d_queue = d_queue_tail = NULL;
+        d_writer_busy = 1;
+        pthread_mutex_unlock(&d_queue_lock);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        long rows = 0;
+        sqlite3_exec(d_db, "BEGIN", NULL, NULL, NULL);
+        while (batch) {
+            StoreBuffer *next = batch->next;
+            for (size_t i = 0; i < batch->count; i++) {
+                StoreRecord *r = &batch->recs[i];
+                if (r->is_dir) {
+                    if (write_dir(r->path, &r->state) == 0) rows++;
+                } else if (write_size(r->path, r->size, r->file_count) == 0) {
+                    rows++;
+                }
+            }
+            store_buffer_free(batch);
+            batch = next;
+        }
+        sqlite3_exec(d_db, "COMMIT", NULL, NULL, NULL);
+        double elapsed = seconds_since(&start);
+
+        pthread_mutex_lock(&d_stats_lock);
+        d_stats.batches++;
+        d_stats.rows += rows;
+        d_stats.batch_seconds += elapsed;
+        if (elapsed > d_stats.batch_max_seconds) d_stats.batch_max_seconds = elapsed;
+        pthread_mutex_unlock(&d_stats_lock);
+
+        pthread_mutex_lock(&d_queue_lock);
+        d_writer_busy = 0;
+        if (!d_queue) pthread_cond_broadcast(&d_idle_cond);
+    }
+    pthread_mutex_unlock(&d_queue_lock);
+    return NULL;
+}
+
+static int writer_start(void) {
+    d_writer_stopping = 0;
+    if (pthread_create(&d_writer, NULL, writer_main, NULL) != 0) return -1;
+    d_writer_running = 1;
+    return 0;
+}
+
+/* Caller holds d_queue_lock */
+static void queue_push(StoreBuffer *buf) {
+    buf->next = NULL;
+    if (d_queue_tail) d_queue_tail->next = buf;
+    else d_queue = buf;
+    d_queue_tail = buf;
+    pthread_cond_signal(&d_queue_cond);
+}
+
+/* Hand any partially filled per-thread buffers to the writer and wait for
+ * the queue to drain. Only valid once no scan threads are storing. */
+static void writer_flush(void) {
+    if (!d_writer_running) return;
+    pthread_mutex_lock(&d_queue_lock);
+    for (size_t i = 0; i <= MAX_STORE_THREADS; i++) {
+        StoreBuffer *buf = d_buffers[i];
+        d_buffers[i] = NULL;
+        if (buf && buf->count) queue_push(buf);
+        else free(buf);
+    }
+    while (d_queue || d_writer_busy)
+        pthread_cond_wait(&d_idle_cond, &d_queue_lock);
+    pthread_mutex_unlock(&d_queue_lock);
+}
+
+static void writer_stop(void) {
+    if (!d_writer_running) return;
+    writer_flush();
+    pthread_mutex_lock(&d_queue_lock);
+    d_writer_stopping = 1;
+    pthread_cond_signal(&d_queue_cond);
+    pthread_mutex_unlock(&d_queue_lock);
+    pthread_join(d_writer, NULL);
+    d_writer_running = 0;
+}
+
+/* 1 if the calling thread stores through the shared buffer */
+static int store_is_shared(void) {
+#ifdef _OPENMP
+    return omp_get_level() > 1;
+#else
+    return 0;
+#endif
+}
+
+/* Reserve the next record in this thread's buffer (NULL on OOM). Shared
+ * callers hold d_shared_lock until the record is counted. */
+static StoreRecord *store_reserve(StoreBuffer **slot, int shared) {
+#ifdef _OPENMP
+    int tid = shared ? MAX_STORE_THREADS : omp_get_thread_num();
+#else
+    int tid = 0;
+    (void)shared;
+#endif
+    if (tid < 0 || tid > MAX_STORE_THREADS) return NULL;
+    StoreBuffer **buf = &d_buffers[tid];
+
+    if (*buf && (*buf)->count == STORE_BATCH) {
+        pthread_mutex_lock(&d_queue_lock);
+        queue_push(*buf);
+        pthread_mutex_unlock(&d_queue_lock);
+        *buf = NULL;
+    }
+    if (!*buf) {
+        *buf = malloc(sizeof(StoreBuffer));
+        if (!*buf) return NULL;
+        (*buf)->count = 0;
+    }
+    *slot = *buf;
+    return &(*buf)->recs[(*buf)->count];
+}
+
+/* ============================================================================
+ * Snapshot Index
+ * ============================================================================ */
+
+typedef struct {
+    char *path;
+    int64_t size;
+    int64_t file_count;
+} IndexRow;
+
+/* Path order with '/' before every other byte, so a directory's subtree
+ * sorts straight after it ("/a", "/a/b", "/a-b") */
+static int index_path_cmp(const char *a, const char *b) {
+    for (; *a && *a == *b; a++, b++) {}
+    unsigned ca = *a == '/' ? 1 : (unsigned char)*a + 1;
+    unsigned cb = *b == '/' ? 1 : (unsigned char)*b + 1;
+    if (!*a) ca = 0;
+    if (!*b) cb = 0;
+    return ca < cb ? -1 : ca > cb;
+}
+
+static int index_row_cmp(const void *a, const void *b) {
+    return index_path_cmp(((const IndexRow *)a)->path, ((const IndexRow *)b)->path);
+}
+
+static int index_slot_cmp(const void *a, const void *b) {
+    const CacheIndexSlot *sa = a, *sb = b;
+    if (sa->hash != sb->hash) return sa->hash < sb->hash ? -1 : 1;
+    return sa->node < sb->node ? -1 : sa->node > sb->node;
+}
+
+/* Growable tables for building an index */
+typedef struct {
+    CacheIndexNode *nodes;
+    size_t node_count, node_cap;
+    char *names;
+    size_t names_len, names_cap;
+    uint32_t *name_table;     /* Open addressing: names offset + 1, 0 if empty */
+    size_t name_table_cap;
+    size_t name_count;
+} IndexBuild;
+
+static int build_grow(void **buf, size_t *cap, size_t need, size_t elem) {
+    if (need <= *cap) return 0;
+    size_t new_cap = *cap ? *cap : 1024;
+    while (new_cap < need) new_cap *= 2;
+    void *p = realloc(*buf, new_cap * elem);
+    if (!p) return -1;
+    *buf = p;
+    *cap = new_cap;
+    return 0;
+}
+
+/* Offset of name in the pool, adding it the first time it's seen
+ * (a handful like "src" or "node_modules" cover most components) -
+ * returns -1 on failure */
+static int64_t build_name(IndexBuild *b, const char *name, size_t len) {
+    if (b->name_count * 2 >= b->name_table_cap) {
+        size_t cap = b->name_table_cap ? b->name_table_cap * 2 : 4096;
+        uint32_t *table = calloc(cap, sizeof(uint32_t));
+        if (!table) return -1;
+        for (size_t i = 0; i < b->name_table_cap; i++) {
+            uint32_t off = b->name_table[i];
+            if (!off) continue;
+            size_t j = hash_string64(b->names + off - 1) & (cap - 1);
+            while (table[j]) j = (j + 1) & (cap - 1);
+            table[j] = off;
+        }
+        free(b->name_table);
+        b->name_table = table;
+        b->name_table_cap = cap;
+    }
+
+    char key[NAME_MAX + 1];
+    if (len > NAME_MAX) return -1;
+    memcpy(key, name, len);
+    key[len] = '\0';
+
+    size_t mask = b->name_table_cap - 1;
+    size_t j = hash_string64(key) & mask;
+    for (; b->name_table[j]; j = (j + 1) & mask) {
+        uint32_t off = b->name_table[j] - 1;
+        if (strcmp(b->names + off, key) == 0) return off;
+    }
+
+    if (b->names_len + len + 1 >= UINT32_MAX ||
+        build_grow((void **)&b->names, &b->names_cap, b->names_len + len + 1, 1) != 0)
+        return -1;
+    uint32_t off = (uint32_t)b->names_len;
+    memcpy(b->names + off, key, len + 1);
+    b->names_len += len + 1;
+    b->name_table[j] = off + 1;
+    b->name_count++;
+    return off;
+}
+
+/* Append a node - returns its index, or -1 on failure */
+static int64_t build_node(IndexBuild *b, uint32_t parent, const char *name, size_t len) {
+    int64_t name_off = build_name(b, name, len);
+    if (name_off < 0 || b->node_count >= CACHE_INDEX_NONE ||
+        build_grow((void **)&b->nodes, &b->node_cap, b->node_count + 1,
+                   sizeof(CacheIndexNode)) != 0)
+        return -1;
+    b->nodes[b->node_count] = (CacheIndexNode){parent, (uint32_t)name_off, 0, -1};
+    return (int64_t)b->node_count++;
+}
+
+/* Turn rows (sorted by index_path_cmp) into nodes, filling slots with
+ * one entry per row - returns 0 on success */
+static int build_tree(IndexBuild *b, const IndexRow *rows, size_t count,
+                      CacheIndexSlot *slots) {
+    /* Node of each component of the previous path, chain[0] being "/" */
+    uint32_t chain[PATH_MAX / 2 + 1];
+    size_t depth = 0;
+    const char *prev = "";
+
+    if (build_node(b, CACHE_INDEX_NONE, "", 0) != 0) return -1;
+    chain[0] = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const char *path = rows[i].path;
+        if (path[0] != '/') return -1;
+
+        /* Components shared with the previous path keep their nodes */
+        size_t level = 0;
+        const char *p = path, *q = prev;
+        while (level < depth) {
+            const char *pe = strchr(p + 1, '/'), *qe = strchr(q + 1, '/');
+            size_t pl = pe ? (size_t)(pe - p) : strlen(p);
+            size_t ql = qe ? (size_t)(qe - q) : strlen(q);
+            if (pl != ql || memcmp(p, q, pl) != 0) break;
+            level++;
+            p += pl;
+            q += ql;
+        }
+
+        /* New components below them, each starting at a '/' */
+        depth = level;
+        while (p[0] == '/' && p[1]) {
+            const char *end = strchr(p + 1, '/');
+            size_t len = end ? (size_t)(end - p - 1) : strlen(p + 1);
+            int64_t n = build_node(b, chain[depth], p + 1, len);
+            if (n < 0 || depth + 1 >= sizeof(chain) / sizeof(chain[0])) return -1;
+            chain[++depth] = (uint32_t)n;
+            p += len + 1;
+        }
+
+        CacheIndexNode *node = &b->nodes[chain[depth]];
+        node->size = rows[i].size;
+        node->file_count = rows[i].file_count;
+        slots[i] = (CacheIndexSlot){(uint32_t)(hash_string64(path) >> 32), chain[depth]};
+        prev = path;
+    }
+    return 0;
+}
+
+/* Dump the sizes table of d_db to the temp index file - returns 0 on success */
+static int index_write(void) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(d_db, "SELECT path, size, file_count FROM sizes",
+                           -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+
+    IndexRow *rows = NULL;
+    size_t count = 0, cap = 0;
+    int ok = 1;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (build_grow((void **)&rows, &cap, count + 1, sizeof(IndexRow)) != 0) {
+            ok = 0;
+            break;
+        }
+        const char *path = (const char *)sqlite3_column_text(stmt, 0);
+        char *dup = path ? strdup(path) : NULL;
+        if (!dup) { ok = 0; break; }
+        rows[count].path = dup;
+        rows[count].size = sqlite3_column_int64(stmt, 1);
+        rows[count].file_count = sqlite3_column_int64(stmt, 2);
+        count++;
+    }
+    sqlite3_finalize(stmt);
+
+    IndexBuild build = {0};
+    CacheIndexSlot *slots = NULL;
+    if (ok) {
+        qsort(rows, count, sizeof(IndexRow), index_row_cmp);
+        slots = malloc((count ? count : 1) * sizeof(CacheIndexSlot));
+        ok = slots && build_tree(&build, rows, count, slots) == 0;
+    }
+
+    FILE *f = ok ? fopen(d_index_temp_path, "wb") : NULL;
+    if (f) {
+        qsort(slots, count, sizeof(CacheIndexSlot), index_slot_cmp);
+        CacheIndexHeader hdr = {CACHE_INDEX_MAGIC, CACHE_INDEX_VERSION,
+                                build.node_count, count};
+        ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+             fwrite(build.nodes, sizeof(CacheIndexNode), build.node_count, f) == build.node_count &&
+             fwrite(slots, sizeof(CacheIndexSlot), count, f) == count &&
+             fwrite(build.names, 1, build.names_len, f) == build.names_len;
+        if (fclose(f) != 0) ok = 0;
+        if (!ok) unlink(d_index_temp_path);
+    } else {
+        ok = 0;
+    }
+
+    free(build.nodes);
+    free(build.names);
+    free(build.name_table);
+    free(slots);
+    for (size_t i = 0; i < count; i++) free(rows[i].path);
+    free(rows);
+    return ok ? 0 : -1;
+}
+
+/* Publish the temp index written by index_write */
+static int index_publish(void) {
+    if (rename(d_index_temp_path, d_index_path) != 0) {
+        unlink(d_index_temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Live Index Patches (watch mode)
+ *
+ * The published index stays mapped while watching. Rows a batch changes
+ * are noted here and their records rewritten in place at commit; a batch
+ * that adds or removes a directory rewrites the whole index instead.
+ * ============================================================================ */
+
+typedef struct {
+    uint32_t node;
+    char *path;
+} IndexPatch;
+
+static int d_live_fd = -1;
+static void *d_live_map = NULL;
+static size_t d_live_size = 0;
+static CacheIndexView d_live_view;
+static IndexPatch *d_patches = NULL;
+static size_t d_patch_count = 0, d_patch_cap = 0;
+static int d_index_reshape = 0;      /* Next commit must rewrite the index */
+
+static void live_patches_clear(void) {
+    for (size_t i = 0; i < d_patch_count; i++) free(d_patches[i].path);
+    d_patch_count = 0;
+}
+
+static void live_index_close(void) {
+    if (d_live_map) munmap(d_live_map, d_live_size);
+    if (d_live_fd >= 0) close(d_live_fd);
+    d_live_map = NULL;
+    d_live_size = 0;
+    d_live_fd = -1;
+    live_patches_clear();
+    free(d_patches);
+    d_patches = NULL;
+    d_patch_cap = 0;
+    d_index_reshape = 0;
+}
+
+/* Map the published index for patching; without one (or with an old
+ * format) the next commit writes it afresh */
+static void live_index_open(void) {
+    live_index_close();
+    struct stat st;
+    d_live_fd = open(d_index_path, O_RDWR);
+    if (d_live_fd >= 0 && fstat(d_live_fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, d_live_fd, 0);
+        if (map != MAP_FAILED) {
+            d_live_map = map;
+            d_live_size = (size_t)st.st_size;
+        }
+    }
+    if (!d_live_map || cache_index_view(d_live_map, d_live_size, &d_live_view) != 0) {
+        live_index_close();
+        d_index_reshape = 1;
+    }
+}
+
+/* Note that path's row changed (caller holds d_sync_lock) */
+static void live_index_touch(const char *path) {
+    if (d_index_reshape) return;
+    int64_t n = d_live_map ? cache_index_find(&d_live_view, path) : -1;
+    char *dup = n >= 0 ? strdup(path) : NULL;
+    if (!dup || build_grow((void **)&d_patches, &d_patch_cap, d_patch_count + 1,
+                           sizeof(IndexPatch)) != 0) {
+        free(dup);
+        d_index_reshape = 1;
+        return;
+    }
+    d_patches[d_patch_count++] = (IndexPatch){(uint32_t)n, dup};
+}
+
+/* Write the noted rows' current values into the mapped index - returns 0
+ * on success */
+static int live_index_patch(void) {
+    for (size_t i = 0; i < d_patch_count; i++) {
+        CacheEntry entry;
+        if (!cache_daemon_live_get(d_patches[i].path, &entry)) return -1;
+        off_t off = (off_t)(sizeof(CacheIndexHeader) +
+                            d_patches[i].node * sizeof(CacheIndexNode) +
+                            offsetof(CacheIndexNode, size));
+        int64_t rec[2] = {entry.size, entry.file_count};
+        if (pwrite(d_live_fd, rec, sizeof(rec), off) != (ssize_t)sizeof(rec)) return -1;
+    }
+    live_patches_clear();
+    /* Clients ignore an index older than the database */
+    return futimens(d_live_fd, NULL);
+}
+
+int cache_daemon_init(void) {
+    /* Close any existing database */
+    db_close();
+
+    /* Get paths */
+    set_paths();
 
     /* Ensure directory exists */
     char dir[PATH_MAX];
@@ -58,66 +711,246 @@ int cache_daemon_init(void) {
     sqlite3_exec(d_db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
     sqlite3_exec(d_db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
 
-    /* Create table */
+    /* Unindexed staging tables (temp schema, dropped with the connection);
+     * the real tables are built from them in cache_daemon_save */
     const char *create_sql =
-        "CREATE TABLE sizes ("
-        "  path TEXT PRIMARY KEY NOT NULL,"
-        "  size INTEGER NOT NULL,"
-        "  file_count INTEGER NOT NULL"
-        ") WITHOUT ROWID";
+        "CREATE TEMP TABLE sizes_load (" SIZES_COLUMNS ");"
+        "CREATE TEMP TABLE dirs_load (" DIRS_COLUMNS ")";
     if (sqlite3_exec(d_db, create_sql, NULL, NULL, NULL) != SQLITE_OK) {
         sqlite3_close(d_db);
         d_db = NULL;
         return -1;
     }
 
-    /* Prepare insert statement */
-    const char *insert_sql =
-        "INSERT INTO sizes (path, size, file_count) VALUES (?, ?, ?)";
-    if (sqlite3_prepare_v2(d_db, insert_sql, -1, &d_insert_stmt, NULL) != SQLITE_OK) {
-        sqlite3_close(d_db);
-        d_db = NULL;
+    /* Prepare insert statements */
+    if (prepare_inserts(1) != 0 || writer_start() != 0) {
+        db_close();
         return -1;
     }
 
+    prev_open();
     return 0;
 }
 
 int cache_daemon_store(const char *path, off_t size, long file_count) {
     if (!d_db || !d_insert_stmt) return -1;
 
-    sqlite3_reset(d_insert_stmt);
-    sqlite3_bind_text(d_insert_stmt, 1, path, -1, SQLITE_STATIC);
-    sqlite3_bind_int64(d_insert_stmt, 2, size);
-    sqlite3_bind_int64(d_insert_stmt, 3, file_count);
+    if (!d_writer_running) {
+        pthread_mutex_lock(&d_sync_lock);
+        int rc = write_size(path, size, file_count);
+        if (rc == 0 && d_live) live_index_touch(path);
+        pthread_mutex_unlock(&d_sync_lock);
+        return rc;
+    }
 
-    return sqlite3_step(d_insert_stmt) == SQLITE_DONE ? 0 : -1;
+    int shared = store_is_shared();
+    if (shared) pthread_mutex_lock(&d_shared_lock);
+    StoreBuffer *buf;
+    StoreRecord *r = store_reserve(&buf, shared);
+    int rc = -1;
+    if (r && (r->path = strdup(path))) {
+        r->is_dir = 0;
+        r->size = size;
+        r->file_count = file_count;
+        buf->count++;
+        rc = 0;
+    }
+    if (shared) pthread_mutex_unlock(&d_shared_lock);
+    return rc;
 }
 
-int cache_daemon_count(void) {
-    if (!d_db) return 0;
+int cache_daemon_store_dir(const char *path, const ScanDirState *state) {
+    if (!d_db || !d_dir_insert_stmt) return -1;
+
+    if (!d_writer_running) {
+        pthread_mutex_lock(&d_sync_lock);
+        int rc = write_dir(path, state);
+        pthread_mutex_unlock(&d_sync_lock);
+        return rc;
+    }
+
+    int shared = store_is_shared();
+    if (shared) pthread_mutex_lock(&d_shared_lock);
+    StoreBuffer *buf;
+    StoreRecord *r = store_reserve(&buf, shared);
+    int rc = -1;
+    if (r && (r->path = strdup(path))) {
+        r->is_dir = 1;
+        r->state = *state;
+        r->state.subdirs = NULL;
+        if (state->subdirs_len && !(r->state.subdirs = malloc(state->subdirs_len))) {
+            free(r->path);
+        } else {
+            if (state->subdirs_len)
+                memcpy(r->state.subdirs, state->subdirs, state->subdirs_len);
+            buf->count++;
+            rc = 0;
+        }
+    }
+    if (shared) pthread_mutex_unlock(&d_shared_lock);
+    return rc;
+}
+
+int cache_daemon_reuse(const char *path, const struct stat *st, ScanDirState *state) {
+    if (!d_prev_lookup_stmt) return 0;
+
+    sqlite3_stmt *stmt = d_prev_lookup_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_ROW) return 0;
+
+    ScanDirState cur;
+    scan_state_stamp(&cur, st);
+    if (sqlite3_column_int64(stmt, 0) != (sqlite3_int64)cur.dev ||
+        sqlite3_column_int64(stmt, 1) != (sqlite3_int64)cur.ino ||
+        sqlite3_column_int64(stmt, 2) != cur.mtime_ns ||
+        sqlite3_column_int64(stmt, 3) != cur.ctime_ns) {
+        return 0;
+    }
+
+    *state = cur;
+    state->own_size = (off_t)sqlite3_column_int64(stmt, 4);
+    state->own_count = (long)sqlite3_column_int64(stmt, 5);
+    state->subdirs = NULL;
+    state->subdirs_len = 0;
+
+    int len = sqlite3_column_bytes(stmt, 6);
+    if (len > 0) {
+        const void *blob = sqlite3_column_blob(stmt, 6);
+        state->subdirs = malloc(len);
+        if (!state->subdirs) return 0;
+        memcpy(state->subdirs, blob, len);
+        state->subdirs_len = (size_t)len;
+        /* Guard against a truncated list walking off the end */
+        if (state->subdirs[len - 1] != '\0') {
+            free(state->subdirs);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Rows for path's subtree, path included; '0' is the character after '/' */
+#define SUBTREE_WHERE "WHERE path = ?1 OR (path > ?1 || '/' AND path < ?1 || '0')"
+
+int cache_daemon_carry(const char *path, CacheEntry *entry) {
+    if (!d_prev_db) return 0;
+
+    sqlite3_stmt *root, *sizes, *dirs;
+    if (sqlite3_prepare_v2(d_prev_db, "SELECT size, file_count FROM sizes WHERE path = ?1",
+                           -1, &root, NULL) != SQLITE_OK)
+        return 0;
+    sqlite3_bind_text(root, 1, path, -1, SQLITE_STATIC);
+    int found = sqlite3_step(root) == SQLITE_ROW;
+    if (found) {
+        entry->size = sqlite3_column_int64(root, 0);
+        entry->file_count = sqlite3_column_int64(root, 1);
+    }
+    sqlite3_finalize(root);
+    if (!found) return 0;
+
+    if (sqlite3_prepare_v2(d_prev_db, "SELECT path, size, file_count FROM sizes "
+                           SUBTREE_WHERE, -1, &sizes, NULL) != SQLITE_OK)
+        return 0;
+    if (sqlite3_prepare_v2(d_prev_db, "SELECT path, dev, ino, mtime, ctime, own_size, "
+                           "own_count, subdirs FROM dirs " SUBTREE_WHERE,
+                           -1, &dirs, NULL) != SQLITE_OK) {
+        sqlite3_finalize(sizes);
+        return 0;
+    }
+
+    sqlite3_bind_text(sizes, 1, path, -1, SQLITE_STATIC);
+    while (sqlite3_step(sizes) == SQLITE_ROW) {
+        cache_daemon_store((const char *)sqlite3_column_text(sizes, 0),
+                           (off_t)sqlite3_column_int64(sizes, 1),
+                           (long)sqlite3_column_int64(sizes, 2));
+    }
+    sqlite3_finalize(sizes);
+
+    sqlite3_bind_text(dirs, 1, path, -1, SQLITE_STATIC);
+    while (sqlite3_step(dirs) == SQLITE_ROW) {
+        ScanDirState state;
+        state.dev = (dev_t)sqlite3_column_int64(dirs, 1);
+        state.ino = (ino_t)sqlite3_column_int64(dirs, 2);
+        state.mtime_ns = sqlite3_column_int64(dirs, 3);
+        state.ctime_ns = sqlite3_column_int64(dirs, 4);
+        state.own_size = (off_t)sqlite3_column_int64(dirs, 5);
+        state.own_count = (long)sqlite3_column_int64(dirs, 6);
+        /* Copied by the store before the next step invalidates it */
+        state.subdirs = (char *)sqlite3_column_blob(dirs, 7);
+        state.subdirs_len = (size_t)sqlite3_column_bytes(dirs, 7);
+        cache_daemon_store_dir((const char *)sqlite3_column_text(dirs, 0), &state);
+    }
+    sqlite3_finalize(dirs);
+    return 1;
+}
+
+static long count_sizes(void) {
+    long count = 0;
     sqlite3_stmt *stmt;
-    int count = 0;
     if (sqlite3_prepare_v2(d_db, "SELECT COUNT(*) FROM sizes", -1, &stmt, NULL) == SQLITE_OK) {
         if (sqlite3_step(stmt) == SQLITE_ROW) {
-            count = sqlite3_column_int(stmt, 0);
+            count = (long)sqlite3_column_int64(stmt, 0);
         }
         sqlite3_finalize(stmt);
     }
     return count;
 }
 
+int cache_daemon_count(void) {
+    /* A scan's staging table holds every store, replaced rows included;
+     * only the keyed table cache_daemon_save builds has the real count */
+    if (!d_db || d_writer_running) {
+        pthread_mutex_lock(&d_stats_lock);
+        int count = (int)d_saved_sizes;
+        pthread_mutex_unlock(&d_stats_lock);
+        return count;
+    }
+    return (int)count_sizes();
+}
+
+void cache_daemon_write_stats(CacheWriteStats *out) {
+    pthread_mutex_lock(&d_stats_lock);
+    *out = d_stats;
+    pthread_mutex_unlock(&d_stats_lock);
+}
+
 int cache_daemon_save(void) {
     if (!d_db) return -1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    /* Finalize statements and close database */
-    if (d_insert_stmt) {
-        sqlite3_finalize(d_insert_stmt);
-        d_insert_stmt = NULL;
+    /* Drain the writer, then build the keyed tables in one sorted pass
+     * (sorted inserts append to the b-tree instead of splitting pages) */
+    writer_stop();
+    prev_close();
+    finalize_stmt(&d_insert_stmt);
+    finalize_stmt(&d_dir_insert_stmt);
+    const char *build_sql =
+        "BEGIN;"
+        "CREATE TABLE sizes (" SIZES_COLUMNS ", PRIMARY KEY (path)) WITHOUT ROWID;"
+        "CREATE TABLE dirs (" DIRS_COLUMNS ", PRIMARY KEY (path)) WITHOUT ROWID;"
+        "INSERT OR REPLACE INTO sizes SELECT * FROM temp.sizes_load ORDER BY path, rowid;"
+        "INSERT OR REPLACE INTO dirs SELECT * FROM temp.dirs_load ORDER BY path, rowid;"
+        "CREATE INDEX sizes_depth ON sizes (depth, path);"
+        "COMMIT;"
+        "DROP TABLE temp.sizes_load;"
+        "DROP TABLE temp.dirs_load";
+    if (sqlite3_exec(d_db, build_sql, NULL, NULL, NULL) != SQLITE_OK) {
+        db_close();
+        unlink(d_temp_path);
+        return -1;
     }
     sqlite3_wal_checkpoint_v2(d_db, NULL, SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
-    sqlite3_close(d_db);
-    d_db = NULL;
+    int have_index = index_write() == 0;
+    long saved = count_sizes();
+    db_close();
+
+    double elapsed = seconds_since(&start);
+    pthread_mutex_lock(&d_stats_lock);
+    d_stats.save_seconds = elapsed;
+    d_saved_sizes = saved;
+    pthread_mutex_unlock(&d_stats_lock);
 
     /* Clean up WAL/SHM files from temp database */
     char wal_path[PATH_MAX + 16], shm_path[PATH_MAX + 16];
@@ -129,21 +962,19 @@ int cache_daemon_save(void) {
     /* Atomic replace: rename temp to final */
     if (rename(d_temp_path, d_final_path) != 0) {
         unlink(d_temp_path);
+        unlink(d_index_temp_path);
         return -1;
     }
 
+    /* Index goes second: clients ignore an index older than the database */
+    if (have_index) index_publish();
+    else unlink(d_index_path);
+
     return 0;
 }
 
 void cache_daemon_close(void) {
-    if (d_insert_stmt) {
-        sqlite3_finalize(d_insert_stmt);
-        d_insert_stmt = NULL;
-    }
-    if (d_db) {
-        sqlite3_close(d_db);
-        d_db = NULL;
-    }
+    db_close();
     /* Clean up temp files if save wasn't called */
     unlink(d_temp_path);
     char wal_path[PATH_MAX + 16], shm_path[PATH_MAX + 16];
@@ -152,3 +983,124 @@ void cache_daemon_close(void) {
     unlink(wal_path);
     unlink(shm_path);
 }
+
+/* ============================================================================
+ * Live Updates (watch mode)
+ * ============================================================================ */
+
+int cache_daemon_live_open(void) {
+    db_close();
+    set_paths();
+
+    /* Serialized: scan tasks look up and write rows from several threads */
+    if (sqlite3_open_v2(d_final_path, &d_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX,
+                        NULL) != SQLITE_OK) {
+        db_close();
+        return -1;
+    }
+    sqlite3_busy_timeout(d_db, 1000);
+
+    const char *get_sql = "SELECT size, file_count FROM sizes WHERE path = ?";
+    const char *adjust_sql =
+        "UPDATE sizes SET size = size + ?2, file_count = file_count + ?3 WHERE path = ?1";
+    if (prepare_inserts(0) != 0 ||
+        sqlite3_prepare_v2(d_db, DIR_LOOKUP_SQL, -1, &d_prev_lookup_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(d_db, get_sql, -1, &d_get_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(d_db, adjust_sql, -1, &d_adjust_stmt, NULL) != SQLITE_OK) {
+        db_close();
+        return -1;
+    }
+    d_live = 1;
+    live_index_open();
+    return 0;
+}
+
+void cache_daemon_live_foreach(void (*fn)(const char *path, void *ctx), void *ctx) {
+    if (!d_db) return;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(d_db, "SELECT path FROM sizes", -1, &stmt, NULL) != SQLITE_OK)
+        return;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        fn((const char *)sqlite3_column_text(stmt, 0), ctx);
+    sqlite3_finalize(stmt);
+}
+
+int cache_daemon_live_get(const char *path, CacheEntry *out) {
+    if (!d_get_stmt) return 0;
+    sqlite3_reset(d_get_stmt);
+    sqlite3_bind_text(d_get_stmt, 1, path, -1, SQLITE_STATIC);
+    if (sqlite3_step(d_get_stmt) != SQLITE_ROW) return 0;
+    out->size = sqlite3_column_int64(d_get_stmt, 0);
+    out->file_count = sqlite3_column_int64(d_get_stmt, 1);
+    return 1;
+}
+
+int cache_daemon_live_begin(void) {
+    if (!d_db) return -1;
+    return sqlite3_exec(d_db, "BEGIN IMMEDIATE", NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
+
+int cache_daemon_live_commit(void) {
+    if (!d_db) return -1;
+    if (sqlite3_exec(d_db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    /* Checkpoint first so the database isn't left newer than the index */
+    sqlite3_wal_checkpoint_v2(d_db, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+    if (!d_index_reshape && live_index_patch() == 0) return 0;
+
+    if (index_write() == 0) index_publish();
+    else unlink(d_index_path);
+    live_index_open();
+    return 0;
+}
+
+/* Run a statement binding path to ?1 once */
+static int exec_with_path(const char *sql, const char *path) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(d_db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+int cache_daemon_live_invalidate(const char *path) {
+    if (!d_db) return -1;
+    return exec_with_path("DELETE FROM dirs WHERE path = ?1", path);
+}
+
+int cache_daemon_live_remove(const char *path) {
+    if (!d_db) return -1;
+    int a = exec_with_path("DELETE FROM sizes " SUBTREE_WHERE, path);
+    int b = exec_with_path("DELETE FROM dirs " SUBTREE_WHERE, path);
+    pthread_mutex_lock(&d_sync_lock);
+    d_index_reshape = 1;
+    pthread_mutex_unlock(&d_sync_lock);
+    return (a == 0 && b == 0) ? 0 : -1;
+}
+
+int cache_daemon_live_adjust(const char *path, off_t size_delta, long count_delta) {
+    if (!d_adjust_stmt) return -1;
+    if (size_delta == 0 && count_delta == 0) return 0;
+
+    char cur[PATH_MAX];
+    snprintf(cur, sizeof(cur), "%s", path);
+
+    char *slash;
+    while ((slash = strrchr(cur, '/')) != NULL && slash != cur) {
+        /* File counts stop at a .git directory, matching scan_finalize */
+        if (path_is_git_dir(cur)) count_delta = 0;
+        *slash = '\0';
+
+        sqlite3_reset(d_adjust_stmt);
+        sqlite3_bind_text(d_adjust_stmt, 1, cur, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(d_adjust_stmt, 2, size_delta);
+        sqlite3_bind_int64(d_adjust_stmt, 3, count_delta);
+        if (sqlite3_step(d_adjust_stmt) != SQLITE_DONE) return -1;
+        if (sqlite3_changes(d_db) > 0) {
+            pthread_mutex_lock(&d_sync_lock);
+            live_index_touch(cur);
+            pthread_mutex_unlock(&d_sync_lock);
+        }
+    }
+    return 0;
+}
@@ -34,6 +34,14 @@ const char *STYLE_ITALIC     = "\033[3m";
 
 static int g_scan_interval = L_SCAN_INTERVAL;
 static int g_file_threshold = L_FILE_COUNT_THRESHOLD;
+static int g_full_rescan = L_FULL_RESCAN_CYCLES;
+static int g_watch = 0;
+static int g_threads = 0;
+static int g_work_stealing = 0;
+static int g_network_scan = 0;
+static int g_network_threads = L_NETWORK_SCAN_THREADS;
+static int g_network_rescan = L_NETWORK_RESCAN_CYCLES;
+static int g_quiet = 0;
 static int g_config_loaded = 0;
 
 static void config_load(void) {
@@ -61,6 +69,22 @@ static void config_load(void) {
             g_scan_interval = val;
         } else if (strcmp(line, "file_threshold") == 0) {
             g_file_threshold = val;
+        } else if (strcmp(line, "full_rescan") == 0) {
+            g_full_rescan = val;
+        } else if (strcmp(line, "watch") == 0) {
+            g_watch = val;
+        } else if (strcmp(line, "threads") == 0) {
+            g_threads = val;
+        } else if (strcmp(line, "work_stealing") == 0) {
+            g_work_stealing = val;
+        } else if (strcmp(line, "network_scan") == 0) {
+            g_network_scan = val;
+        } else if (strcmp(line, "network_threads") == 0) {
+            g_network_threads = val;
+        } else if (strcmp(line, "network_rescan") == 0) {
+            g_network_rescan = val;
+        } else if (strcmp(line, "quiet") == 0) {
+            g_quiet = val;
         }
     }
     fclose(f);
@@ -76,6 +100,46 @@ int config_get_threshold(void) {
     return g_file_threshold;
 }
 
+int config_get_full_rescan(void) {
+    config_load();
+    return g_full_rescan;
+}
+
+int config_get_watch(void) {
+    config_load();
+    return g_watch;
+}
+
+int config_get_threads(void) {
+    config_load();
+    return g_threads;
+}
+
+int config_get_work_stealing(void) {
+    config_load();
+    return g_work_stealing;
+}
+
+int config_get_network_scan(void) {
+    config_load();
+    return g_network_scan;
+}
+
+int config_get_network_threads(void) {
+    config_load();
+    return g_network_threads;
+}
+
+int config_get_network_rescan(void) {
+    config_load();
+    return g_network_rescan;
+}
+
+int config_get_quiet(void) {
+    config_load();
+    return g_quiet;
+}
+
 /* ============================================================================
  * Memory Allocation
  * ============================================================================ */
@@ -105,6 +169,51 @@ char *xstrdup(const char *s) {
     return dup;
 }
 
+/* ============================================================================
+ * Arena Allocation
+ * ============================================================================ */
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+void arena_init(Arena *arena) {
+    arena->head = NULL;
+}
+
+char *arena_strdup(Arena *arena, const char *s) {
+    size_t len = strlen(s) + 1;
+    ArenaBlock *block = arena->head;
+
+    if (!block || block->size - block->used < len) {
+        /* Oversized strings get a block of their own */
+        size_t size = len > L_ARENA_BLOCK_SIZE ? len : L_ARENA_BLOCK_SIZE;
+        block = xmalloc(sizeof(ArenaBlock) + size);
+        block->next = arena->head;
+        block->used = 0;
+        block->size = size;
+        arena->head = block;
+    }
+
+    char *dup = block->data + block->used;
+    memcpy(dup, s, len);
+    block->used += len;
+    return dup;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
 /* ============================================================================
  * Hashing
  * ============================================================================ */
@@ -118,6 +227,17 @@ unsigned int hash_string(const char *str) {
     return hash % L_HASH_SIZE;
 }
 
+/* FNV-1a */
+uint64_t hash_string64(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    unsigned char c;
+    while ((c = (unsigned char)*str++)) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /* ============================================================================
  * Path Utilities
  * ============================================================================ */
@@ -134,6 +254,14 @@ int path_is_git_dir(const char *path) {
     return strcmp(name, ".git") == 0;
 }
 
+int path_depth(const char *path) {
+    int depth = 0;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' && p[1] && p[1] != '/') depth++;
+    }
+    return depth;
+}
+
 int path_is_git_root(const char *path) {
     char git_path[PATH_MAX];
     snprintf(git_path, sizeof(git_path), "%s/.git", path);
@@ -230,20 +358,43 @@ void cache_get_path(char *buf, size_t len) {
     snprintf(buf, len, "%s/.cache/l/sizes-v2.db", home ? home : "/tmp");
 }
 
-int path_is_network_fs(const char *path) {
-#ifdef __linux__
-    /* Network filesystem magic numbers */
-    #define NFS_SUPER_MAGIC     0x6969
-    #define LUSTRE_SUPER_MAGIC  0x0BD00BD0
-    #define GPFS_SUPER_MAGIC    0x47504653
-    #define CIFS_MAGIC_NUMBER   0xFF534D42
-    #define SMB_SUPER_MAGIC     0x517B
-    #define CEPH_SUPER_MAGIC    0x00C36400
-    #define AFS_SUPER_MAGIC     0x5346414F
+void cache_get_index_path(char *buf, size_t len) {
+    const char *home = getenv("HOME");
+    snprintf(buf, len, "%s/.cache/l/sizes-v2.idx", home ? home : "/tmp");
+}
 
-    struct statfs st;
-    if (statfs(path, &st) != 0) return 0;
-    switch ((unsigned long)st.f_type) {
+void cache_get_content_path(char *buf, size_t len) {
+    const char *home = getenv("HOME");
+    snprintf(buf, len, "%s/.cache/l/content-v1.db", home ? home : "/tmp");
+}
+
+void cache_get_metrics_path(char *buf, size_t len) {
+    const char *home = getenv("HOME");
+    snprintf(buf, len, "%s/.cache/l/metrics.prom", home ? home : "/tmp");
+}
+
+void cache_get_hits_path(char *buf, size_t len) {
+    const char *home = getenv("HOME");
+    snprintf(buf, len, "%s/.cache/l/client-hits", home ? home : "/tmp");
+}
+
+void cache_get_socket_path(char *buf, size_t len) {
+    const char *home = getenv("HOME");
+    snprintf(buf, len, "%s/.cache/l/query.sock", home ? home : "/tmp");
+}
+
+#ifdef __linux__
+/* Network filesystem magic numbers */
+#define NFS_SUPER_MAGIC     0x6969
+#define LUSTRE_SUPER_MAGIC  0x0BD00BD0
+#define GPFS_SUPER_MAGIC    0x47504653
+#define CIFS_MAGIC_NUMBER   0xFF534D42
+#define SMB_SUPER_MAGIC     0x517B
+#define CEPH_SUPER_MAGIC    0x00C36400
+#define AFS_SUPER_MAGIC     0x5346414F
+
+static int statfs_is_network(const struct statfs *st) {
+    switch ((unsigned long)st->f_type) {
         case NFS_SUPER_MAGIC:
         case LUSTRE_SUPER_MAGIC:
         case GPFS_SUPER_MAGIC:
@@ -253,26 +404,32 @@ int path_is_network_fs(const char *path) {
         case AFS_SUPER_MAGIC:
             return 1;
     }
+    return 0;
+}
+#endif
+
+int path_is_network_fs(const char *path) {
+#ifdef __linux__
+    struct statfs st;
+    return statfs(path, &st) == 0 && statfs_is_network(&st);
 #else
     (void)path;  /* macOS/BSD: assume local (cache daemon handles slow dirs) */
-#endif
     return 0;
+#endif
 }
 
-int path_is_virtual_fs(const char *path) {
 #ifdef __linux__
-    /* Virtual/pseudo filesystem magic numbers */
-    #define PROC_SUPER_MAGIC    0x9fa0
-    #define SYSFS_MAGIC         0x62656572
-    #define DEVTMPFS_MAGIC      0x01021994
-    #define DEBUGFS_MAGIC       0x64626720
-    #define SECURITYFS_MAGIC    0x73636673
-    #define CGROUP_SUPER_MAGIC  0x27e0eb
-    #define CGROUP2_SUPER_MAGIC 0x63677270
-
-    struct statfs st;
-    if (statfs(path, &st) != 0) return 0;
-    switch ((unsigned long)st.f_type) {
+/* Virtual/pseudo filesystem magic numbers */
+#define PROC_SUPER_MAGIC    0x9fa0
+#define SYSFS_MAGIC         0x62656572
+#define DEVTMPFS_MAGIC      0x01021994
+#define DEBUGFS_MAGIC       0x64626720
+#define SECURITYFS_MAGIC    0x73636673
+#define CGROUP_SUPER_MAGIC  0x27e0eb
+#define CGROUP2_SUPER_MAGIC 0x63677270
+
+static int statfs_is_virtual(const struct statfs *st) {
+    switch ((unsigned long)st->f_type) {
         case PROC_SUPER_MAGIC:
         case SYSFS_MAGIC:
         case DEVTMPFS_MAGIC:
@@ -282,8 +439,38 @@ int path_is_virtual_fs(const char *path) {
         case CGROUP2_SUPER_MAGIC:
             return 1;
     }
+    return 0;
+}
+#endif
+
+int path_is_virtual_fs(const char *path) {
+#ifdef __linux__
+    struct statfs st;
+    return statfs(path, &st) == 0 && statfs_is_virtual(&st);
 #else
     (void)path;
+    return 0;
 #endif
+}
+
+int fd_is_virtual_fs(int fd) {
+#ifdef __linux__
+    struct statfs st;
+    return fstatfs(fd, &st) == 0 && statfs_is_virtual(&st);
+#else
+    (void)fd;
     return 0;
+#endif
+}
+
+FsKind fd_fs_kind(int fd) {
+#ifdef __linux__
+    struct statfs st;
+    if (fstatfs(fd, &st) != 0) return FS_LOCAL;
+    if (statfs_is_virtual(&st)) return FS_VIRTUAL;
+    if (statfs_is_network(&st)) return FS_NETWORK;
+#else
+    (void)fd;
+#endif
+    return FS_LOCAL;
 }
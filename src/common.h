@@ -24,17 +24,28 @@
 #if defined(__APPLE__) && defined(__MACH__)
     #define PLATFORM_MACOS 1
     #define GET_MTIME(st) ((st).st_mtimespec.tv_sec)
+    #define GET_MTIME_NS(st) TIMESPEC_NS((st).st_mtimespec)
+    #define GET_CTIME_NS(st) TIMESPEC_NS((st).st_ctimespec)
 #elif defined(__linux__)
     #define PLATFORM_LINUX 1
     #define GET_MTIME(st) ((st).st_mtim.tv_sec)
+    #define GET_MTIME_NS(st) TIMESPEC_NS((st).st_mtim)
+    #define GET_CTIME_NS(st) TIMESPEC_NS((st).st_ctim)
 #elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
     #define PLATFORM_BSD 1
     #define GET_MTIME(st) ((st).st_mtimespec.tv_sec)
+    #define GET_MTIME_NS(st) TIMESPEC_NS((st).st_mtimespec)
+    #define GET_CTIME_NS(st) TIMESPEC_NS((st).st_ctimespec)
 #else
     #define PLATFORM_GENERIC 1
     #define GET_MTIME(st) ((st).st_mtime)
+    #define GET_MTIME_NS(st) ((int64_t)(st).st_mtime * 1000000000)
+    #define GET_CTIME_NS(st) ((int64_t)(st).st_ctime * 1000000000)
 #endif
 
+/* Nanosecond timestamp from a struct timespec */
+#define TIMESPEC_NS(ts) ((int64_t)(ts).tv_sec * 1000000000 + (ts).tv_nsec)
+
 #ifndef PATH_MAX
     #define PATH_MAX 4096
 #endif
@@ -82,11 +93,22 @@
 /* Daemon constants (defaults, can be overridden by config) */
 #define L_SCAN_INTERVAL         3600    /* 60 minutes between scans */
 #define L_FILE_COUNT_THRESHOLD  1000    /* Cache directories with >= this many files */
+#define L_FULL_RESCAN_CYCLES    24      /* Full walk every N scans (others incremental) */
 #define L_MAX_LOG_SIZE          (1024 * 1024)  /* 1MB max log size */
+#define L_NETWORK_SCAN_THREADS  32      /* Concurrent directory reads per network mount */
+#define L_NETWORK_RESCAN_CYCLES 6       /* Re-read network mounts every N scans */
 
 /* Daemon configuration (reads from ~/.cache/l/config) */
 int config_get_interval(void);   /* Scan interval in seconds */
 int config_get_threshold(void);  /* Min files to cache a directory */
+int config_get_full_rescan(void); /* Scans between full (non-incremental) walks */
+int config_get_watch(void);       /* 1 to watch for changes between scans */
+int config_get_threads(void);     /* Scan threads, 0 = daemon default */
+int config_get_work_stealing(void); /* 1 to use the work-stealing scanner */
+int config_get_network_scan(void);  /* 1 to scan network mounts (skipped otherwise) */
+int config_get_network_threads(void); /* Concurrent reads per network mount */
+int config_get_network_rescan(void);  /* Scans between re-reads of network mounts */
+int config_get_quiet(void);       /* 1 to leave per-directory lines out of the log */
 
 /* Error codes */
 #define L_OK                    0
@@ -137,11 +159,28 @@ void *xmalloc(size_t size);
 void *xrealloc(void *ptr, size_t size);
 char *xstrdup(const char *s);
 
+/* ============================================================================
+ * Arena Allocation (bump allocator for short strings, freed all at once)
+ * ============================================================================ */
+
+#define L_ARENA_BLOCK_SIZE      16384
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;            /* Most recent block, NULL if empty */
+} Arena;
+
+void arena_init(Arena *arena);
+char *arena_strdup(Arena *arena, const char *s);  /* Dies on OOM, like xstrdup */
+void arena_free(Arena *arena);
+
 /* ============================================================================
  * Hashing
  * ============================================================================ */
 
 unsigned int hash_string(const char *str);
+uint64_t hash_string64(const char *str);  /* FNV-1a, full 64-bit (not bucketed) */
 
 /* ============================================================================
  * Path Utilities
@@ -153,6 +192,9 @@ void path_join(char *dest, size_t dest_len, const char *dir, const char *name);
 /* Check if path is or ends with .git */
 int path_is_git_dir(const char *path);
 
+/* Number of components in an absolute path ("/" is 0, "/a/b" is 2) */
+int path_depth(const char *path);
+
 /* Check if directory is a git repository root (contains .git) */
 int path_is_git_root(const char *path);
 
@@ -171,7 +213,34 @@ int path_is_network_fs(const char *path);
 /* Check if path is on a virtual filesystem (proc, sysfs, etc.) */
 int path_is_virtual_fs(const char *path);
 
+/* Same check for an open file or directory */
+int fd_is_virtual_fs(int fd);
+
+/* Both checks for an open file or directory from a single fstatfs */
+typedef enum {
+    FS_LOCAL,
+    FS_VIRTUAL,
+    FS_NETWORK
+} FsKind;
+
+FsKind fd_fs_kind(int fd);
+
 /* Get cache database path */
 void cache_get_path(char *buf, size_t len);
 
+/* Get cache snapshot index path (see cache.h) */
+void cache_get_index_path(char *buf, size_t len);
+
+/* Get content cache database path (see cache.h) */
+void cache_get_content_path(char *buf, size_t len);
+
+/* Get daemon metrics file path (Prometheus text format, written by l-cached) */
+void cache_get_metrics_path(char *buf, size_t len);
+
+/* Get client cache hit counter file path (see cache_unload) */
+void cache_get_hits_path(char *buf, size_t len);
+
+/* Get the daemon's query socket path (see query.h) */
+void cache_get_socket_path(char *buf, size_t len);
+
 #endif /* L_COMMON_H */
@@ -275,6 +275,13 @@ static void config_save(int interval, int threshold) {
 
     fprintf(f, "scan_interval=%d\n", interval);
     fprintf(f, "file_threshold=%d\n", threshold);
+    fprintf(f, "full_rescan=%d\n", config_get_full_rescan());
+    if (config_get_watch())
+        fprintf(f, "watch=%d\n", config_get_watch());
+    if (config_get_threads())
+        fprintf(f, "threads=%d\n", config_get_threads());
+    if (config_get_work_stealing())
+        fprintf(f, "work_stealing=%d\n", config_get_work_stealing());
     fclose(f);
 }
 
@@ -498,6 +505,18 @@ static void cache_clear(void) {
     unlink(cache_path);
     unlink(wal_path);
     unlink(shm_path);
+
+    char index_path[PATH_MAX];
+    cache_get_index_path(index_path, sizeof(index_path));
+    unlink(index_path);
+
+    char content_path[PATH_MAX];
+    cache_get_content_path(content_path, sizeof(content_path));
+    snprintf(wal_path, sizeof(wal_path), "%s-wal", content_path);
+    snprintf(shm_path, sizeof(shm_path), "%s-shm", content_path);
+    unlink(content_path);
+    unlink(wal_path);
+    unlink(shm_path);
 }
 
 /* ============================================================================
@@ -611,6 +630,14 @@ static void print_status(void) {
         lines_after_cache++;
     }
 
+    /* Metrics file */
+    char metrics_path[PATH_MAX];
+    cache_get_metrics_path(metrics_path, sizeof(metrics_path));
+    if (stat(metrics_path, &st) == 0) {
+        printf("  %s○%s Metrics   %s%s%s\n", COLOR_GREY, COLOR_RESET, COLOR_GREY, metrics_path, COLOR_RESET);
+        lines_after_cache++;
+    }
+
     /* Config */
     printf("  %s○%s Config    %sscan every %dm, cache dirs with ≥%d files%s\n",
            COLOR_GREY, COLOR_RESET, COLOR_GREY,
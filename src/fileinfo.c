@@ -1,8 +1,9 @@
 /*
- * fileinfo.c - File type detection, line counting, and image parsing
+ * fileinfo.c - File type detection, line counting, and media parsing
  */
 
 #include "fileinfo.h"
+#include "profile.h"
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <strings.h>
@@ -58,10 +59,15 @@ static FileType get_symlink_target_type(const struct stat *target_st) {
  * ============================================================================ */
 
 FileType detect_file_type(const char *path, struct stat *st, char **symlink_target) {
+    return detect_file_type_at(AT_FDCWD, path, path, st, symlink_target);
+}
+
+FileType detect_file_type_at(int dir_fd, const char *name, const char *path,
+                             struct stat *st, char **symlink_target) {
     struct stat lst;
     *symlink_target = NULL;
 
-    if (lstat(path, &lst) != 0) return FTYPE_UNKNOWN;
+    if (fstatat(dir_fd, name, &lst, AT_SYMLINK_NOFOLLOW) != 0) return FTYPE_UNKNOWN;
     *st = lst;
 
     if (S_ISLNK(lst.st_mode)) {
@@ -69,7 +75,7 @@ FileType detect_file_type(const char *path, struct stat *st, char **symlink_targ
         if (!*symlink_target) return FTYPE_SYMLINK_BROKEN;
 
         struct stat target_st;
-        if (stat(path, &target_st) != 0) return FTYPE_SYMLINK_BROKEN;
+        if (fstatat(dir_fd, name, &target_st, 0) != 0) return FTYPE_SYMLINK_BROKEN;
 
         *st = target_st;
         return get_symlink_target_type(&target_st);
@@ -140,29 +146,287 @@ static int has_binary_extension(const char *path) {
 }
 
 /* ============================================================================
- * Image Dimension Parsing
+ * Media Probe
+ *
+ * The media parsers share one open file per entry. The first PROBE_HEAD
+ * bytes are read when it's opened and, for larger files, the last
+ * PROBE_TAIL on first use (MP4 moov boxes and PDF cross-references tend
+ * to live there); anything else is a pread of just the bytes asked for.
+ * The buffers are per thread, so entries can be probed in parallel.
  * ============================================================================ */
 
-/* Get image dimensions from file header. Returns megapixels * 10, or -1 on failure. */
-int get_image_megapixels(const char *path) {
-    const char *dot = strrchr(path, '/');
-    dot = dot ? strrchr(dot, '.') : strrchr(path, '.');
+#define PROBE_HEAD (64 * 1024)
+#define PROBE_TAIL (64 * 1024)
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    const char *ext;            /* After the last '.' in the name */
+    const unsigned char *head;
+    size_t head_len;
+    const unsigned char *tail;  /* NULL until first used */
+    uint64_t tail_off;
+    size_t tail_len;
+} MediaProbe;
+
+static __thread unsigned char g_probe_head[PROBE_HEAD];
+static __thread unsigned char g_probe_tail[PROBE_TAIL];
+
+/* Open path and read its head - returns 0 on success, -1 if it can't be
+ * media (no extension, not a regular file) or can't be read */
+static int probe_open(MediaProbe *p, const char *path) {
+    const char *name = strrchr(path, '/');
+    const char *dot = strrchr(name ? name : path, '.');
     if (!dot) return -1;
-    dot++;
 
-    FILE *f = fopen(path, "rb");
-    if (!f) return -1;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    ssize_t n;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (n = pread(fd, g_probe_head, PROBE_HEAD, 0)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    p->fd = fd;
+    p->size = (uint64_t)st.st_size;
+    p->ext = dot + 1;
+    p->head = g_probe_head;
+    p->head_len = (size_t)n;
+    p->tail = NULL;
+    p->tail_off = 0;
+    p->tail_len = 0;
+    return 0;
+}
+
+static void probe_close(MediaProbe *p) {
+    close(p->fd);
+    p->fd = -1;
+}
+
+/* The last bytes of the file (all of it if it fits in the head) - returns
+ * NULL if they can't be read */
+static const unsigned char *probe_tail(MediaProbe *p, uint64_t *off, size_t *len) {
+    if (p->size <= p->head_len) {
+        *off = 0;
+        *len = p->head_len;
+        return p->head;
+    }
+    if (!p->tail) {
+        uint64_t tail_off = p->size > PROBE_TAIL ? p->size - PROBE_TAIL : 0;
+        ssize_t n = pread(p->fd, g_probe_tail, (size_t)(p->size - tail_off), (off_t)tail_off);
+        if (n <= 0) return NULL;
+        p->tail = g_probe_tail;
+        p->tail_off = tail_off;
+        p->tail_len = (size_t)n;
+    }
+    *off = p->tail_off;
+    *len = p->tail_len;
+    return p->tail;
+}
+
+/* Copy up to len bytes at off into buf - returns the number copied,
+ * short at the end of the file */
+static size_t probe_read(MediaProbe *p, uint64_t off, void *buf, size_t len) {
+    if (off >= p->size) return 0;
+    if (len > p->size - off) len = (size_t)(p->size - off);
+    if (off + len <= p->head_len) {
+        memcpy(buf, p->head + off, len);
+        return len;
+    }
+
+    uint64_t tail_off;
+    size_t tail_len;
+    if (p->size > PROBE_HEAD && off >= p->size - PROBE_TAIL) {
+        const unsigned char *tail = probe_tail(p, &tail_off, &tail_len);
+        if (tail && off >= tail_off && off + len <= tail_off + tail_len) {
+            memcpy(buf, tail + (off - tail_off), len);
+            return len;
+        }
+    }
+
+    ssize_t n = pread(p->fd, buf, len, (off_t)off);
+    return n > 0 ? (size_t)n : 0;
+}
+
+static uint32_t read_be32(const unsigned char *b) {
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+/* Offset of the first ISOBMFF box of the given type in [off, end), its
+ * size in *size - returns -1 if there is none before a malformed box */
+static int64_t isobmff_find(MediaProbe *p, uint64_t off, uint64_t end,
+                            const char *type, uint32_t *size) {
+    unsigned char box[8];
+    while (off < end && probe_read(p, off, box, 8) == 8) {
+        uint32_t box_size = read_be32(box);
+        if (box_size < 8) break;
+        if (memcmp(box + 4, type, 4) == 0) {
+            *size = box_size;
+            return (int64_t)off;
+        }
+        off += box_size;
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Image Dimension Parsing
+ * ============================================================================ */
+
+/* HEIC/HEIF: dimensions in the ispe box, under meta > iprp > ipco */
+static void heif_dimensions(MediaProbe *p, int *width, int *height) {
+    uint32_t meta_size, iprp_size, ipco_size, ispe_size;
+    int64_t meta = isobmff_find(p, 0, p->size, "meta", &meta_size);
+    if (meta < 0) return;
+    /* meta is a full box: skip its 4-byte version/flags */
+    int64_t iprp = isobmff_find(p, meta + 12, meta + meta_size, "iprp", &iprp_size);
+    if (iprp < 0) return;
+    int64_t ipco = isobmff_find(p, iprp + 8, iprp + iprp_size, "ipco", &ipco_size);
+    if (ipco < 0) return;
+    int64_t ispe = isobmff_find(p, ipco + 8, ipco + ipco_size, "ispe", &ispe_size);
+    if (ispe < 0) return;
+
+    /* ispe: 4-byte version/flags, 4-byte width, 4-byte height */
+    unsigned char ispe_data[12];
+    if (probe_read(p, ispe + 8, ispe_data, 12) == 12) {
+        *width = (int)read_be32(ispe_data + 4);
+        *height = (int)read_be32(ispe_data + 8);
+    }
+}
+
+/* CR3 (Canon RAW v3): the largest tkhd (track header) under moov > trak */
+static void cr3_dimensions(MediaProbe *p, int *width, int *height) {
+    uint32_t moov_size;
+    int64_t moov = isobmff_find(p, 0, p->size, "moov", &moov_size);
+    if (moov < 0) return;
 
-    unsigned char header[32];
-    size_t n = fread(header, 1, sizeof(header), f);
-    if (n < 24) { fclose(f); return -1; }
+    uint64_t moov_end = moov + moov_size;
+    unsigned char box[8];
+    for (uint64_t off = moov + 8; off < moov_end && probe_read(p, off, box, 8) == 8; ) {
+        uint32_t trak_size = read_be32(box);
+        if (trak_size < 8) break;
+
+        uint32_t tkhd_box;
+        int64_t tkhd_off = memcmp(box + 4, "trak", 4) == 0
+            ? isobmff_find(p, off + 8, off + trak_size, "tkhd", &tkhd_box) : -1;
+        if (tkhd_off >= 0) {
+            /* tkhd: version(1) + flags(3) + times... + width(4) + height(4) at end
+             * Width/height are 16.16 fixed point */
+            unsigned char tkhd[92];
+            size_t tkhd_size = tkhd_box - 8;
+            if (tkhd_size > sizeof(tkhd)) tkhd_size = sizeof(tkhd);
+            if (probe_read(p, tkhd_off + 8, tkhd, tkhd_size) >= 84) {
+                int version = tkhd[0];
+                size_t off_wh = (version == 1) ? 84 : 76;
+                if (off_wh + 8 <= tkhd_size) {
+                    uint32_t w = read_be32(tkhd + off_wh) >> 16;
+                    uint32_t h = read_be32(tkhd + off_wh + 4) >> 16;
+                    if ((int)w > *width) *width = w;
+                    if ((int)h > *height) *height = h;
+                }
+            }
+        }
+        off += trak_size;
+    }
+}
+
+/* TIFF-based RAW formats (CR2, NEF, ARW, DNG, ORF, RW2, PEF, SRW, ...):
+ * the largest dimensions in any IFD, since RAW files have several */
+static void tiff_dimensions(MediaProbe *p, int *width, int *height) {
+    int little_endian = (p->head[0] == 'I');
+
+    #define TIFF_READ16(buf, off) (little_endian ? \
+        ((buf)[off] | ((buf)[(off)+1] << 8)) : \
+        (((buf)[off] << 8) | (buf)[(off)+1]))
+    #define TIFF_READ32(buf, off) (little_endian ? \
+        ((uint32_t)(buf)[off] | ((uint32_t)(buf)[(off)+1] << 8) | \
+         ((uint32_t)(buf)[(off)+2] << 16) | ((uint32_t)(buf)[(off)+3] << 24)) : \
+        read_be32((buf) + (off)))
+
+    uint32_t ifd_offsets[32];
+    int ifd_count = 0;
+    ifd_offsets[ifd_count++] = TIFF_READ32(p->head, 4);
+
+    while (ifd_count > 0 && ifd_count < 32) {
+        uint32_t ifd_offset = ifd_offsets[--ifd_count];
+        if (ifd_offset == 0 || ifd_offset > 100000000) continue;
+
+        unsigned char ifd_header[2];
+        if (probe_read(p, ifd_offset, ifd_header, 2) != 2) continue;
+
+        int entry_count = TIFF_READ16(ifd_header, 0);
+        if (entry_count <= 0 || entry_count > 1000) continue;
+
+        /* All of the IFD's entries in one read */
+        unsigned char entries[1000 * 12];
+        uint64_t entry_pos = (uint64_t)ifd_offset + 2;
+        int entries_read = (int)(probe_read(p, entry_pos, entries, (size_t)entry_count * 12) / 12);
+        int cur_width = 0, cur_height = 0;
+
+        for (int i = 0; i < entries_read; i++) {
+            const unsigned char *entry = entries + i * 12;
+            uint16_t tag = TIFF_READ16(entry, 0);
+            uint16_t type = TIFF_READ16(entry, 2);
+            uint32_t count = TIFF_READ32(entry, 4);
+            uint32_t value_offset = TIFF_READ32(entry, 8);
+
+            /* For SHORT (type 3), value is at different position based on endianness */
+            uint32_t value = value_offset;
+            if (type == 3 && count == 1) {
+                value = little_endian ? (uint32_t)TIFF_READ16(entry, 8) : (value_offset >> 16);
+            }
+
+            if (tag == 0x0100) cur_width = value;       /* ImageWidth */
+            else if (tag == 0x0101) cur_height = value; /* ImageLength */
+            else if (tag == 0x014A && ifd_count < 30) { /* SubIFDs */
+                if (count == 1) {
+                    ifd_offsets[ifd_count++] = value_offset;
+                } else {
+                    /* Multiple SubIFD offsets stored at value_offset */
+                    unsigned char offs[30 * 4];
+                    size_t want = count < (uint32_t)(30 - ifd_count) ? count : (size_t)(30 - ifd_count);
+                    size_t got = probe_read(p, value_offset, offs, want * 4) / 4;
+                    for (size_t j = 0; j < got; j++)
+                        ifd_offsets[ifd_count++] = TIFF_READ32(offs, j * 4);
+                }
+            }
+            else if (tag == 0x8769 && ifd_count < 30) { /* EXIF IFD */
+                ifd_offsets[ifd_count++] = value_offset;
+            }
+        }
+
+        /* Keep largest dimensions found */
+        if (cur_width > *width) *width = cur_width;
+        if (cur_height > *height) *height = cur_height;
+
+        /* Read next IFD offset */
+        unsigned char next_ifd[4];
+        if (entries_read == entry_count &&
+            probe_read(p, entry_pos + (uint64_t)entry_count * 12, next_ifd, 4) == 4) {
+            uint32_t next = TIFF_READ32(next_ifd, 0);
+            if (next != 0 && next < 100000000 && ifd_count < 30) {
+                ifd_offsets[ifd_count++] = next;
+            }
+        }
+    }
+    #undef TIFF_READ16
+    #undef TIFF_READ32
+}
+
+/* Megapixels * 10 from the probed file's header, or -1 on failure */
+static int probe_image_megapixels(MediaProbe *p) {
+    const unsigned char *header = p->head;
+    size_t n = p->head_len;
+    if (n < 24) return -1;
 
     int width = 0, height = 0;
 
     /* PNG: 89 50 4E 47 0D 0A 1A 0A, width at 16, height at 20 (big-endian) */
     if (header[0] == 0x89 && header[1] == 'P' && header[2] == 'N' && header[3] == 'G') {
-        width = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
-        height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+        width = (int)read_be32(header + 16);
+        height = (int)read_be32(header + 20);
     }
     /* GIF: 47 49 46, width at 6, height at 8 (little-endian) */
     else if (header[0] == 'G' && header[1] == 'I' && header[2] == 'F') {
@@ -171,24 +435,24 @@ int get_image_megapixels(const char *path) {
     }
     /* JPEG: FF D8 FF, need to find SOF marker */
     else if (header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF) {
-        fseek(f, 2, SEEK_SET);
+        uint64_t off = 2;
         unsigned char buf[10];
-        while (fread(buf, 1, 2, f) == 2) {
+        while (probe_read(p, off, buf, 2) == 2) {
             if (buf[0] != 0xFF) break;
             int marker = buf[1];
             /* SOF0, SOF1, SOF2 markers contain dimensions */
             if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2) {
-                if (fread(buf, 1, 7, f) == 7) {
+                if (probe_read(p, off + 2, buf, 7) == 7) {
                     height = (buf[3] << 8) | buf[4];
                     width = (buf[5] << 8) | buf[6];
                 }
                 break;
             }
             /* Skip other segments */
-            if (fread(buf, 1, 2, f) != 2) break;
+            if (probe_read(p, off + 2, buf, 2) != 2) break;
             int len = (buf[0] << 8) | buf[1];
             if (len < 2) break;
-            fseek(f, len - 2, SEEK_CUR);
+            off += 2 + (uint64_t)len;
         }
     }
     /* BMP: 42 4D, width at 18, height at 22 (little-endian, signed for height) */
@@ -197,217 +461,23 @@ int get_image_megapixels(const char *path) {
         int h = header[22] | (header[23] << 8) | (header[24] << 16) | (header[25] << 24);
         height = h < 0 ? -h : h;  /* Height can be negative (top-down DIB) */
     }
-    /* HEIC/HEIF: ftyp box with heic/mif1 brand, dimensions in ispe box */
-    else if (n >= 12 && memcmp(header + 4, "ftyp", 4) == 0 &&
+    /* HEIC/HEIF: ftyp box with heic/mif1 brand */
+    else if (memcmp(header + 4, "ftyp", 4) == 0 &&
              (memcmp(header + 8, "heic", 4) == 0 ||
               memcmp(header + 8, "mif1", 4) == 0 ||
               memcmp(header + 8, "msf1", 4) == 0 ||
               memcmp(header + 8, "heix", 4) == 0)) {
-        /* Navigate box structure to find ispe box */
-            fseek(f, 0, SEEK_SET);
-            unsigned char box[8];
-            while (fread(box, 1, 8, f) == 8) {
-                uint32_t size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                if (size < 8) break;
-
-                /* meta box contains iprp which contains ipco which contains ispe */
-                if (memcmp(box + 4, "meta", 4) == 0) {
-                    /* meta is a full box, skip 4-byte version/flags */
-                    long meta_end = ftell(f) - 8 + size;
-                    fseek(f, 4, SEEK_CUR);
-
-                    /* Search within meta for iprp */
-                    while (ftell(f) < meta_end && fread(box, 1, 8, f) == 8) {
-                        uint32_t inner_size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                        if (inner_size < 8) break;
-
-                        if (memcmp(box + 4, "iprp", 4) == 0) {
-                            long iprp_end = ftell(f) - 8 + inner_size;
-
-                            /* Search within iprp for ipco */
-                            while (ftell(f) < iprp_end && fread(box, 1, 8, f) == 8) {
-                                uint32_t ipco_size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                                if (ipco_size < 8) break;
-
-                                if (memcmp(box + 4, "ipco", 4) == 0) {
-                                    long ipco_end = ftell(f) - 8 + ipco_size;
-
-                                    /* Search within ipco for ispe */
-                                    while (ftell(f) < ipco_end && fread(box, 1, 8, f) == 8) {
-                                        uint32_t ispe_size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                                        if (ispe_size < 8) break;
-
-                                        if (memcmp(box + 4, "ispe", 4) == 0) {
-                                            /* ispe: 4-byte version/flags, 4-byte width, 4-byte height */
-                                            unsigned char ispe_data[12];
-                                            if (fread(ispe_data, 1, 12, f) == 12) {
-                                                width = (ispe_data[4] << 24) | (ispe_data[5] << 16) |
-                                                        (ispe_data[6] << 8) | ispe_data[7];
-                                                height = (ispe_data[8] << 24) | (ispe_data[9] << 16) |
-                                                         (ispe_data[10] << 8) | ispe_data[11];
-                                            }
-                                            break;
-                                        }
-                                        fseek(f, ispe_size - 8, SEEK_CUR);
-                                    }
-                                    break;
-                                }
-                                fseek(f, ipco_size - 8, SEEK_CUR);
-                            }
-                            break;
-                        }
-                        fseek(f, inner_size - 8, SEEK_CUR);
-                    }
-                    break;
-                }
-                fseek(f, size - 8, SEEK_CUR);
-            }
+        heif_dimensions(p, &width, &height);
     }
-    /* TIFF-based RAW formats: CR2, NEF, ARW, DNG, ORF, RW2, PEF, SRW, etc.
-     * TIFF header: "II" (little-endian) or "MM" (big-endian) + magic 42 */
+    /* TIFF header: "II" (little-endian) or "MM" (big-endian) + magic 42 */
     else if ((header[0] == 'I' && header[1] == 'I' && header[2] == 0x2A && header[3] == 0x00) ||
              (header[0] == 'M' && header[1] == 'M' && header[2] == 0x00 && header[3] == 0x2A)) {
-        int little_endian = (header[0] == 'I');
-
-        #define TIFF_READ16(buf, off) (little_endian ? \
-            ((buf)[off] | ((buf)[(off)+1] << 8)) : \
-            (((buf)[off] << 8) | (buf)[(off)+1]))
-        #define TIFF_READ32(buf, off) (little_endian ? \
-            ((buf)[off] | ((buf)[(off)+1] << 8) | ((buf)[(off)+2] << 16) | ((buf)[(off)+3] << 24)) : \
-            (((buf)[off] << 24) | ((buf)[(off)+1] << 16) | ((buf)[(off)+2] << 8) | (buf)[(off)+3]))
-
-        uint32_t ifd_offsets[32];
-        int ifd_count = 0;
-        ifd_offsets[ifd_count++] = TIFF_READ32(header, 4);
-
-        /* Traverse IFDs to find largest dimensions (RAW files have multiple IFDs) */
-        while (ifd_count > 0 && ifd_count < 32) {
-            uint32_t ifd_offset = ifd_offsets[--ifd_count];
-            if (ifd_offset == 0 || ifd_offset > 100000000) continue;
-
-            fseek(f, ifd_offset, SEEK_SET);
-            unsigned char ifd_header[2];
-            if (fread(ifd_header, 1, 2, f) != 2) continue;
-
-            int entry_count = TIFF_READ16(ifd_header, 0);
-            if (entry_count <= 0 || entry_count > 1000) continue;
-
-            int cur_width = 0, cur_height = 0;
-            long entry_pos = ftell(f);
-
-            for (int i = 0; i < entry_count; i++) {
-                fseek(f, entry_pos + i * 12, SEEK_SET);
-                unsigned char entry[12];
-                if (fread(entry, 1, 12, f) != 12) break;
-
-                uint16_t tag = TIFF_READ16(entry, 0);
-                uint16_t type = TIFF_READ16(entry, 2);
-                uint32_t count = TIFF_READ32(entry, 4);
-                uint32_t value_offset = TIFF_READ32(entry, 8);
-
-                /* For SHORT (type 3), value is at different position based on endianness */
-                uint32_t value = value_offset;
-                if (type == 3 && count == 1) {
-                    value = little_endian ? (uint32_t)TIFF_READ16(entry, 8) : (value_offset >> 16);
-                }
-
-                if (tag == 0x0100) cur_width = value;       /* ImageWidth */
-                else if (tag == 0x0101) cur_height = value; /* ImageLength */
-                else if (tag == 0x014A && ifd_count < 30) { /* SubIFDs */
-                    if (count == 1) {
-                        ifd_offsets[ifd_count++] = value_offset;
-                    } else {
-                        /* Multiple SubIFD offsets stored at value_offset */
-                        long saved = ftell(f);
-                        fseek(f, value_offset, SEEK_SET);
-                        for (uint32_t j = 0; j < count && ifd_count < 30; j++) {
-                            unsigned char off_buf[4];
-                            if (fread(off_buf, 1, 4, f) != 4) break;
-                            ifd_offsets[ifd_count++] = TIFF_READ32(off_buf, 0);
-                        }
-                        fseek(f, saved, SEEK_SET);
-                    }
-                }
-                else if (tag == 0x8769 && ifd_count < 30) { /* EXIF IFD */
-                    ifd_offsets[ifd_count++] = value_offset;
-                }
-            }
-
-            /* Keep largest dimensions found */
-            if (cur_width > width) width = cur_width;
-            if (cur_height > height) height = cur_height;
-
-            /* Read next IFD offset */
-            fseek(f, entry_pos + entry_count * 12, SEEK_SET);
-            unsigned char next_ifd[4];
-            if (fread(next_ifd, 1, 4, f) == 4) {
-                uint32_t next = TIFF_READ32(next_ifd, 0);
-                if (next != 0 && next < 100000000 && ifd_count < 30) {
-                    ifd_offsets[ifd_count++] = next;
-                }
-            }
-        }
-        #undef TIFF_READ16
-        #undef TIFF_READ32
-    }
-    /* CR3 (Canon RAW v3): ISOBMFF container with 'crx ' brand
-     * Dimensions are in tkhd (track header) boxes inside moov > trak */
-    else if (n >= 12 && memcmp(header + 4, "ftyp", 4) == 0 &&
-             memcmp(header + 8, "crx ", 4) == 0) {
-        fseek(f, 0, SEEK_SET);
-        unsigned char box[8];
-        while (fread(box, 1, 8, f) == 8) {
-            uint32_t size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-            if (size < 8) break;
-
-            if (memcmp(box + 4, "moov", 4) == 0) {
-                long moov_end = ftell(f) - 8 + size;
-                while (ftell(f) < moov_end && fread(box, 1, 8, f) == 8) {
-                    uint32_t trak_size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                    if (trak_size < 8) break;
-
-                    if (memcmp(box + 4, "trak", 4) == 0) {
-                        long trak_end = ftell(f) - 8 + trak_size;
-                        /* Search for tkhd inside trak */
-                        while (ftell(f) < trak_end && fread(box, 1, 8, f) == 8) {
-                            uint32_t inner_size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                            if (inner_size < 8) break;
-
-                            if (memcmp(box + 4, "tkhd", 4) == 0) {
-                                /* tkhd: version(1) + flags(3) + times... + width(4) + height(4) at end
-                                 * Width/height are 16.16 fixed point */
-                                unsigned char tkhd[92];
-                                size_t tkhd_size = inner_size - 8;
-                                if (tkhd_size > sizeof(tkhd)) tkhd_size = sizeof(tkhd);
-                                if (fread(tkhd, 1, tkhd_size, f) >= 84) {
-                                    int version = tkhd[0];
-                                    size_t off = (version == 1) ? 84 : 76;
-                                    if (off + 8 <= tkhd_size) {
-                                        uint32_t w = (tkhd[off] << 24) | (tkhd[off+1] << 16) |
-                                                     (tkhd[off+2] << 8) | tkhd[off+3];
-                                        uint32_t h = (tkhd[off+4] << 24) | (tkhd[off+5] << 16) |
-                                                     (tkhd[off+6] << 8) | tkhd[off+7];
-                                        w >>= 16; h >>= 16; /* 16.16 fixed point */
-                                        if ((int)w > width) width = w;
-                                        if ((int)h > height) height = h;
-                                    }
-                                }
-                                break;
-                            }
-                            fseek(f, inner_size - 8, SEEK_CUR);
-                        }
-                        fseek(f, trak_end, SEEK_SET);
-                    } else {
-                        fseek(f, trak_size - 8, SEEK_CUR);
-                    }
-                }
-                break;
-            }
-            fseek(f, size - 8, SEEK_CUR);
-        }
+        tiff_dimensions(p, &width, &height);
+    }
+    /* CR3: ISOBMFF container with 'crx ' brand */
+    else if (memcmp(header + 4, "ftyp", 4) == 0 && memcmp(header + 8, "crx ", 4) == 0) {
+        cr3_dimensions(p, &width, &height);
     }
-
-    fclose(f);
 
     if (width <= 0 || height <= 0) return -1;
 
@@ -416,55 +486,41 @@ int get_image_megapixels(const char *path) {
     return (int)(mp * 10 + 0.5);
 }
 
+/* Get image dimensions from file header. Returns megapixels * 10, or -1 on failure. */
+int get_image_megapixels(const char *path) {
+    MediaProbe p;
+    if (probe_open(&p, path) != 0) return -1;
+    int mp = probe_image_megapixels(&p);
+    probe_close(&p);
+    return mp;
+}
+
 /* ============================================================================
  * Audio Duration Parsing
  * ============================================================================ */
 
-/* Check if file has an audio/video extension that uses ISOBMFF container */
-static int has_isobmff_audio_extension(const char *path) {
-    const char *dot = strrchr(path, '/');
-    dot = dot ? strrchr(dot, '.') : strrchr(path, '.');
-    if (!dot) return 0;
-    dot++;
-
-    static const char *exts[] = {
-        "m4b", "m4a", "mp4", "m4v", "mov", "3gp", "3g2",
-        "aac",  /* AAC in ADTS container won't work, but .aac could be ISOBMFF */
-        NULL
-    };
-    for (const char **e = exts; *e; e++) {
-        if (strcasecmp(dot, *e) == 0) return 1;
+static int ext_matches(const char *ext, const char *const *exts) {
+    for (const char *const *e = exts; *e; e++) {
+        if (strcasecmp(ext, *e) == 0) return 1;
     }
     return 0;
 }
 
-/* Forward declaration for Matroska parser */
-static int get_matroska_duration(const char *path);
-
-/* Check if file has a WAV extension */
-static int has_wav_extension(const char *path) {
-    const char *dot = strrchr(path, '/');
-    dot = dot ? strrchr(dot, '.') : strrchr(path, '.');
-    if (!dot) return 0;
-    dot++;
-    return strcasecmp(dot, "wav") == 0;
-}
+/* Audio/video extensions that use the ISOBMFF container */
+static const char *const ISOBMFF_AUDIO_EXTS[] = {
+    "m4b", "m4a", "mp4", "m4v", "mov", "3gp", "3g2",
+    "aac",  /* AAC in ADTS container won't work, but .aac could be ISOBMFF */
+    NULL
+};
+static const char *const WAV_EXTS[] = { "wav", NULL };
+static const char *const MATROSKA_EXTS[] = { "mkv", "webm", "mka", NULL };
 
 /* Get duration from WAV (RIFF) file. Returns duration in seconds, or -1. */
-static int get_wav_duration(const char *path) {
-    if (!has_wav_extension(path)) return -1;
-
-    FILE *f = fopen(path, "rb");
-    if (!f) return -1;
-
-    /* Read RIFF header: "RIFF" + size(4) + "WAVE" = 12 bytes */
-    unsigned char header[12];
-    if (fread(header, 1, 12, f) < 12 ||
-        memcmp(header, "RIFF", 4) != 0 ||
-        memcmp(header + 8, "WAVE", 4) != 0) {
-        fclose(f);
+static int wav_duration(MediaProbe *p) {
+    /* RIFF header: "RIFF" + size(4) + "WAVE" = 12 bytes */
+    if (p->head_len < 12 || memcmp(p->head, "RIFF", 4) != 0 ||
+        memcmp(p->head + 8, "WAVE", 4) != 0)
         return -1;
-    }
 
     uint32_t byte_rate = 0;
     uint32_t data_size = 0;
@@ -472,286 +528,214 @@ static int get_wav_duration(const char *path) {
 
     /* Walk chunks looking for "fmt " and "data" */
     unsigned char chunk_hdr[8];
-    while (fread(chunk_hdr, 1, 8, f) == 8) {
+    for (uint64_t off = 12; probe_read(p, off, chunk_hdr, 8) == 8; ) {
         uint32_t chunk_size = chunk_hdr[4] | (chunk_hdr[5] << 8) |
-                              (chunk_hdr[6] << 16) | (chunk_hdr[7] << 24);
+                              (chunk_hdr[6] << 16) | ((uint32_t)chunk_hdr[7] << 24);
 
         if (memcmp(chunk_hdr, "fmt ", 4) == 0) {
             if (chunk_size < 16) break;
             unsigned char fmt[16];
-            if (fread(fmt, 1, 16, f) < 16) break;
+            if (probe_read(p, off + 8, fmt, 16) < 16) break;
             /* byte_rate is at offset 8 in fmt chunk (little-endian) */
-            byte_rate = fmt[8] | (fmt[9] << 8) | (fmt[10] << 16) | (fmt[11] << 24);
+            byte_rate = fmt[8] | (fmt[9] << 8) | (fmt[10] << 16) | ((uint32_t)fmt[11] << 24);
             found_fmt = 1;
-            /* Skip remainder of fmt chunk */
-            if (chunk_size > 16) fseek(f, chunk_size - 16, SEEK_CUR);
         } else if (memcmp(chunk_hdr, "data", 4) == 0) {
             data_size = chunk_size;
             found_data = 1;
             break;
-        } else {
-            fseek(f, chunk_size, SEEK_CUR);
         }
 
         /* Chunks are word-aligned: skip padding byte if chunk_size is odd */
-        if (chunk_size & 1) fseek(f, 1, SEEK_CUR);
+        off += 8 + (uint64_t)chunk_size + (chunk_size & 1);
     }
 
-    fclose(f);
-
     if (!found_fmt || !found_data || byte_rate == 0) return -1;
     return (int)(data_size / byte_rate);
 }
 
-/* Get audio/video duration from ISOBMFF container (M4B, M4A, MP4, MOV, etc.)
- * Returns duration in seconds, or -1 on failure. */
-int get_audio_duration(const char *path) {
-    /* Try WAV (RIFF) */
-    int dur = get_wav_duration(path);
-    if (dur >= 0) return dur;
-
-    /* Try Matroska (MKV, WebM) */
-    dur = get_matroska_duration(path);
-    if (dur >= 0) return dur;
-
-    if (!has_isobmff_audio_extension(path)) return -1;
-
-    FILE *f = fopen(path, "rb");
-    if (!f) return -1;
-
-    unsigned char header[12];
-    if (fread(header, 1, 12, f) < 12) {
-        fclose(f);
-        return -1;
-    }
-
-    /* Verify ftyp box */
-    if (memcmp(header + 4, "ftyp", 4) != 0) {
-        fclose(f);
-        return -1;
-    }
-
-    /* Skip past ftyp box */
-    uint32_t ftyp_size = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
-    if (ftyp_size < 8) {
-        fclose(f);
-        return -1;
-    }
-    fseek(f, ftyp_size, SEEK_SET);
-
-    /* Search for moov box */
-    unsigned char box[8];
-    while (fread(box, 1, 8, f) == 8) {
-        uint32_t size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-        if (size < 8) break;
-
-        if (memcmp(box + 4, "moov", 4) == 0) {
-            long moov_end = ftell(f) - 8 + size;
-
-            /* Search within moov for mvhd */
-            while (ftell(f) < moov_end && fread(box, 1, 8, f) == 8) {
-                uint32_t inner_size = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
-                if (inner_size < 8) break;
-
-                if (memcmp(box + 4, "mvhd", 4) == 0) {
-                    /* mvhd box found - read version to determine layout */
-                    unsigned char mvhd[28];
-                    size_t mvhd_read = fread(mvhd, 1, 28, f);
-                    if (mvhd_read < 20) break;
-
-                    int version = mvhd[0];
-                    uint32_t timescale;
-                    uint64_t duration;
-
-                    if (version == 0) {
-                        /* Version 0: 4-byte fields
-                         * [0] version, [1-3] flags
-                         * [4-7] creation_time, [8-11] modification_time
-                         * [12-15] timescale, [16-19] duration */
-                        timescale = (mvhd[12] << 24) | (mvhd[13] << 16) | (mvhd[14] << 8) | mvhd[15];
-                        duration = (mvhd[16] << 24) | (mvhd[17] << 16) | (mvhd[18] << 8) | mvhd[19];
-                    } else {
-                        /* Version 1: 8-byte time fields
-                         * [0] version, [1-3] flags
-                         * [4-11] creation_time, [12-19] modification_time
-                         * [20-23] timescale, [24-31] duration */
-                        if (mvhd_read < 28) break;
-                        timescale = (mvhd[20] << 24) | (mvhd[21] << 16) | (mvhd[22] << 8) | mvhd[23];
-                        duration = ((uint64_t)mvhd[24] << 56) | ((uint64_t)mvhd[25] << 48) |
-                                   ((uint64_t)mvhd[26] << 40) | ((uint64_t)mvhd[27] << 32);
-                        /* Need to read 4 more bytes for full duration */
-                        unsigned char dur_rest[4];
-                        if (fread(dur_rest, 1, 4, f) == 4) {
-                            duration |= (dur_rest[0] << 24) | (dur_rest[1] << 16) |
-                                        (dur_rest[2] << 8) | dur_rest[3];
-                        }
-                    }
-
-                    fclose(f);
-                    if (timescale == 0) return -1;
-                    return (int)(duration / timescale);
-                }
-                fseek(f, inner_size - 8, SEEK_CUR);
-            }
-            break;
-        }
-        fseek(f, size - 8, SEEK_CUR);
-    }
-
-    fclose(f);
-    return -1;
-}
-
-/* Check if file has a Matroska/WebM extension */
-static int has_matroska_extension(const char *path) {
-    const char *dot = strrchr(path, '/');
-    dot = dot ? strrchr(dot, '.') : strrchr(path, '.');
-    if (!dot) return 0;
-    dot++;
-
-    static const char *exts[] = { "mkv", "webm", "mka", NULL };
-    for (const char **e = exts; *e; e++) {
-        if (strcasecmp(dot, *e) == 0) return 1;
-    }
-    return 0;
-}
-
-/* Read EBML variable-length integer, return number of bytes read (0 on error) */
-static int read_ebml_vint(FILE *f, uint64_t *value, int strip_marker) {
-    int c = fgetc(f);
-    if (c == EOF) return 0;
+/* Read an EBML variable-length integer at *off, advancing past it -
+ * returns its length in bytes (0 on error) */
+static int read_ebml_vint(MediaProbe *p, uint64_t *off, uint64_t *value, int strip_marker) {
+    unsigned char b[8];
+    if (probe_read(p, *off, b, 1) != 1) return 0;
 
     /* Find leading 1 bit to determine length */
     int len = 1;
     uint8_t mask = 0x80;
-    while (len <= 8 && !(c & mask)) {
+    while (len <= 8 && !(b[0] & mask)) {
         mask >>= 1;
         len++;
     }
     if (len > 8) return 0;
+    if (len > 1 && probe_read(p, *off + 1, b + 1, len - 1) != (size_t)(len - 1)) return 0;
 
-    *value = strip_marker ? (c & (mask - 1)) : c;
-    for (int i = 1; i < len; i++) {
-        c = fgetc(f);
-        if (c == EOF) return 0;
-        *value = (*value << 8) | c;
-    }
+    *value = strip_marker ? (b[0] & (mask - 1)) : b[0];
+    for (int i = 1; i < len; i++)
+        *value = (*value << 8) | b[i];
+    *off += len;
     return len;
 }
 
 /* Read EBML element ID */
-static int read_ebml_id(FILE *f, uint64_t *id) {
-    return read_ebml_vint(f, id, 0);
+static int read_ebml_id(MediaProbe *p, uint64_t *off, uint64_t *id) {
+    return read_ebml_vint(p, off, id, 0);
 }
 
 /* Read EBML element size */
-static int read_ebml_size(FILE *f, uint64_t *size) {
-    return read_ebml_vint(f, size, 1);
+static int read_ebml_size(MediaProbe *p, uint64_t *off, uint64_t *size) {
+    return read_ebml_vint(p, off, size, 1);
 }
 
 /* Get duration from Matroska/WebM file. Returns duration in seconds, or -1. */
-static int get_matroska_duration(const char *path) {
-    if (!has_matroska_extension(path)) return -1;
-
-    FILE *f = fopen(path, "rb");
-    if (!f) return -1;
-
+static int matroska_duration(MediaProbe *p) {
     /* Verify EBML header (ID 0x1A45DFA3) */
-    unsigned char header[4];
-    if (fread(header, 1, 4, f) < 4 ||
-        header[0] != 0x1A || header[1] != 0x45 ||
-        header[2] != 0xDF || header[3] != 0xA3) {
-        fclose(f);
+    const unsigned char *header = p->head;
+    if (p->head_len < 4 || header[0] != 0x1A || header[1] != 0x45 ||
+        header[2] != 0xDF || header[3] != 0xA3)
         return -1;
-    }
 
     /* Skip EBML header content */
-    uint64_t header_size;
-    if (!read_ebml_size(f, &header_size)) { fclose(f); return -1; }
-    fseek(f, header_size, SEEK_CUR);
+    uint64_t off = 4, header_size;
+    if (!read_ebml_size(p, &off, &header_size)) return -1;
+    off += header_size;
 
     /* Look for Segment element (ID 0x18538067) */
     uint64_t id, size;
-    if (!read_ebml_id(f, &id) || id != 0x18538067) { fclose(f); return -1; }
-    if (!read_ebml_size(f, &size)) { fclose(f); return -1; }
+    if (!read_ebml_id(p, &off, &id) || id != 0x18538067) return -1;
+    if (!read_ebml_size(p, &off, &size)) return -1;
 
-    long segment_end = ftell(f) + (long)size;
+    uint64_t segment_end = off + size;
     double duration = -1;
     uint64_t timecode_scale = 1000000; /* Default: 1ms */
 
     /* Search for Info element within Segment */
-    while (ftell(f) < segment_end) {
-        long elem_start = ftell(f);
-        if (!read_ebml_id(f, &id)) break;
-        if (!read_ebml_size(f, &size)) break;
+    while (off < segment_end) {
+        uint64_t elem_start = off;
+        if (!read_ebml_id(p, &off, &id)) break;
+        if (!read_ebml_size(p, &off, &size)) break;
 
         if (id == 0x1549A966) { /* Info element */
-            long info_end = ftell(f) + (long)size;
+            uint64_t info_end = off + size;
 
             /* Search within Info for Duration and TimecodeScale */
-            while (ftell(f) < info_end) {
-                if (!read_ebml_id(f, &id)) break;
-                if (!read_ebml_size(f, &size)) break;
+            while (off < info_end) {
+                if (!read_ebml_id(p, &off, &id)) break;
+                if (!read_ebml_size(p, &off, &size)) break;
 
+                unsigned char buf[8];
                 if (id == 0x2AD7B1 && size <= 8) { /* TimecodeScale */
+                    size_t got = probe_read(p, off, buf, (size_t)size);
                     timecode_scale = 0;
-                    for (uint64_t i = 0; i < size; i++) {
-                        int c = fgetc(f);
-                        if (c == EOF) break;
-                        timecode_scale = (timecode_scale << 8) | c;
-                    }
+                    for (size_t i = 0; i < got; i++)
+                        timecode_scale = (timecode_scale << 8) | buf[i];
                 } else if (id == 0x4489 && size == 8) { /* Duration (float) */
-                    unsigned char buf[8];
-                    if (fread(buf, 1, 8, f) == 8) {
+                    if (probe_read(p, off, buf, 8) == 8) {
                         uint64_t bits = 0;
                         for (int i = 0; i < 8; i++)
                             bits = (bits << 8) | buf[i];
                         memcpy(&duration, &bits, 8);
                     }
                 } else if (id == 0x4489 && size == 4) { /* Duration (float32) */
-                    unsigned char buf[4];
-                    if (fread(buf, 1, 4, f) == 4) {
-                        uint32_t bits = (buf[0] << 24) | (buf[1] << 16) |
-                                        (buf[2] << 8) | buf[3];
+                    if (probe_read(p, off, buf, 4) == 4) {
+                        uint32_t bits = read_be32(buf);
                         float f32;
                         memcpy(&f32, &bits, 4);
                         duration = f32;
                     }
-                } else {
-                    fseek(f, size, SEEK_CUR);
                 }
+                off += size;
             }
             break; /* Found Info, done */
-        } else {
-            /* Skip unknown elements, but limit skip for "unknown size" */
-            if (size > 0x00FFFFFFFFFFFFFF) {
-                /* Unknown size marker - scan forward */
-                break;
-            }
-            fseek(f, size, SEEK_CUR);
         }
 
+        /* Skip unknown elements, but not ones of "unknown size" */
+        if (size > 0x00FFFFFFFFFFFFFF) break;
+        off += size;
+
         /* Safety: prevent infinite loop */
-        if (ftell(f) <= elem_start) break;
+        if (off <= elem_start) break;
     }
 
-    fclose(f);
-
     if (duration < 0) return -1;
     /* Duration is in timecode units; convert to seconds */
     return (int)((duration * timecode_scale) / 1000000000.0);
 }
 
+/* Get duration from ISOBMFF container (M4B, M4A, MP4, MOV, etc.): the
+ * mvhd box under moov. Returns duration in seconds, or -1 on failure. */
+static int isobmff_duration(MediaProbe *p) {
+    /* Verify ftyp box */
+    if (p->head_len < 12 || memcmp(p->head + 4, "ftyp", 4) != 0) return -1;
+    uint32_t ftyp_size = read_be32(p->head);
+    if (ftyp_size < 8) return -1;
+
+    /* moov is often after the media data, at the end of the file */
+    uint32_t moov_size, mvhd_size;
+    int64_t moov = isobmff_find(p, ftyp_size, p->size, "moov", &moov_size);
+    if (moov < 0) return -1;
+    int64_t mvhd = isobmff_find(p, moov + 8, moov + moov_size, "mvhd", &mvhd_size);
+    if (mvhd < 0) return -1;
+
+    /* mvhd box found - read version to determine layout */
+    unsigned char mvhd_data[32];
+    size_t mvhd_read = probe_read(p, mvhd + 8, mvhd_data, sizeof(mvhd_data));
+    if (mvhd_read < 20) return -1;
+
+    int version = mvhd_data[0];
+    uint32_t timescale;
+    uint64_t duration;
+
+    if (version == 0) {
+        /* Version 0: 4-byte fields
+         * [0] version, [1-3] flags
+         * [4-7] creation_time, [8-11] modification_time
+         * [12-15] timescale, [16-19] duration */
+        timescale = read_be32(mvhd_data + 12);
+        duration = read_be32(mvhd_data + 16);
+    } else {
+        /* Version 1: 8-byte time fields
+         * [0] version, [1-3] flags
+         * [4-11] creation_time, [12-19] modification_time
+         * [20-23] timescale, [24-31] duration */
+        if (mvhd_read < 28) return -1;
+        timescale = read_be32(mvhd_data + 20);
+        duration = (uint64_t)read_be32(mvhd_data + 24) << 32;
+        if (mvhd_read == 32) duration |= read_be32(mvhd_data + 28);
+    }
+
+    if (timescale == 0) return -1;
+    return (int)(duration / timescale);
+}
+
+/* Duration in seconds of the probed file, or -1 on failure */
+static int probe_audio_duration(MediaProbe *p) {
+    if (ext_matches(p->ext, WAV_EXTS)) return wav_duration(p);
+    if (ext_matches(p->ext, MATROSKA_EXTS)) return matroska_duration(p);
+    if (ext_matches(p->ext, ISOBMFF_AUDIO_EXTS)) return isobmff_duration(p);
+    return -1;
+}
+
+/* Get audio/video duration from WAV, Matroska or ISOBMFF (M4B, M4A, MP4,
+ * MOV, etc.) files. Returns duration in seconds, or -1 on failure. */
+int get_audio_duration(const char *path) {
+    MediaProbe p;
+    if (probe_open(&p, path) != 0) return -1;
+    int dur = probe_audio_duration(&p);
+    probe_close(&p);
+    return dur;
+}
+
 /* ============================================================================
  * PDF Page Counting
+ *
+ * The page count is the /Count of the page tree root. The fast path
+ * follows startxref to the trailer's /Root, then to the catalog's /Pages,
+ * reading and inflating only what lies on the way: classic xref tables
+ * and xref streams, with objects either plain or in object streams. When
+ * that fails (encryption, damage, indirect /Length), the whole file is
+ * scanned for /Type /Pages dictionaries instead.
  * ============================================================================ */
 
-static int has_pdf_extension(const char *path) {
-    const char *ext = strrchr(path, '.');
-    if (!ext) return 0;
-    return strcasecmp(ext, ".pdf") == 0;
-}
-
 /* Search buffer for /Type /Pages objects and extract /Count values.
  * Returns the maximum count found, or -1 if none found. */
 static int pdf_search_pages_count(const char *data, size_t size) {
@@ -865,36 +849,457 @@ static char *pdf_inflate(const unsigned char *src, size_t src_len, size_t *out_s
     return dst;
 }
 
-/* Get page count from PDF file.
- * Returns page count, or -1 on failure.
- *
- * PDFs store page count in the document catalog's /Pages dictionary.
- * Modern PDFs often compress objects in ObjStm streams with FlateDecode.
- */
-int get_pdf_page_count(const char *path) {
-    if (!has_pdf_extension(path)) return -1;
+#define PDF_MAX_SECTIONS    16    /* Cross-reference sections followed via /Prev */
+#define PDF_MAX_SUBSECTIONS 256   /* Per classic section */
+#define PDF_OBJ_READ        (64 * 1024)  /* Bytes read for one object */
+#define PDF_MAX_STREAM      (16 * 1024 * 1024)
+
+/* One cross-reference section: a classic table's subsections, or an xref
+ * stream's decoded rows */
+typedef struct {
+    int is_stream;
+    int sub_count;
+    uint64_t sub_start[PDF_MAX_SUBSECTIONS];
+    uint64_t sub_len[PDF_MAX_SUBSECTIONS];
+    uint64_t sub_off[PDF_MAX_SUBSECTIONS];  /* Classic: file offset of entries */
+    unsigned char *rows;                     /* Stream: decoded entries */
+    size_t row_count;
+    int w[3];
+} PdfSection;
+
+typedef struct {
+    MediaProbe *probe;
+    PdfSection *sections;
+    int count;
+    uint64_t root;          /* Newest trailer's /Root */
+    uint64_t stm_num;       /* Object stream decoded in stm_data */
+    uint64_t stm_first;     /* Its /First */
+    char *stm_data;
+    size_t stm_len;
+} PdfXref;
+
+static int pdf_is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+}
 
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) return -1;
+static int pdf_is_delim(char c) {
+    return pdf_is_space(c) || c == '/' || c == '<' || c == '>' || c == '[' ||
+           c == ']' || c == '(' || c == ')' || c == '%';
+}
 
-    struct stat st;
-    if (fstat(fd, &st) != 0 || st.st_size < 100) {
-        close(fd);
-        return -1;
+/* Parse an unsigned integer after optional whitespace - returns the
+ * position after it, or NULL */
+static const char *pdf_uint(const char *s, const char *end, uint64_t *out) {
+    while (s < end && pdf_is_space(*s)) s++;
+    if (s >= end || *s < '0' || *s > '9') return NULL;
+    uint64_t v = 0;
+    for (int digits = 0; s < end && *s >= '0' && *s <= '9'; s++) {
+        if (++digits > 15) return NULL;
+        v = v * 10 + (uint64_t)(*s - '0');
     }
+    *out = v;
+    return s;
+}
 
-    size_t size = (size_t)st.st_size;
-    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+/* Find the name key in [s, end) - returns the position after it, or NULL */
+static const char *pdf_key(const char *s, const char *end, const char *key) {
+    size_t len = strlen(key);
+    while (s < end) {
+        const char *hit = memmem(s, (size_t)(end - s), key, len);
+        if (!hit) return NULL;
+        const char *after = hit + len;
+        if (after >= end || pdf_is_delim(*after)) return after;
+        s = hit + 1;
+    }
+    return NULL;
+}
 
-    if (data == MAP_FAILED) return -1;
+/* A direct integer value for key - returns 0 on success, -1 if the key is
+ * missing or its value is an indirect reference */
+static int pdf_int(const char *s, const char *end, const char *key, uint64_t *out) {
+    const char *v = pdf_key(s, end, key);
+    if (!v || !(v = pdf_uint(v, end, out))) return -1;
+    uint64_t gen;
+    const char *r = pdf_uint(v, end, &gen);
+    if (r) {
+        while (r < end && pdf_is_space(*r)) r++;
+        if (r < end && *r == 'R') return -1;
+    }
+    return 0;
+}
+
+/* The object number of key's "N G R" reference - returns 0 on success */
+static int pdf_ref(const char *s, const char *end, const char *key, uint64_t *num) {
+    const char *v = pdf_key(s, end, key);
+    uint64_t gen;
+    if (!v || !(v = pdf_uint(v, end, num)) || !(v = pdf_uint(v, end, &gen))) return -1;
+    while (v < end && pdf_is_space(*v)) v++;
+    return v < end && *v == 'R' ? 0 : -1;
+}
+
+/* Parse up to max integers of key's [ ... ] array - returns how many */
+static int pdf_array(const char *s, const char *end, const char *key,
+                     uint64_t *out, int max) {
+    const char *v = pdf_key(s, end, key);
+    if (!v) return 0;
+    while (v < end && pdf_is_space(*v)) v++;
+    if (v >= end || *v != '[') return 0;
+    v++;
+    int n = 0;
+    while (n < max && (v = pdf_uint(v, end, &out[n])) != NULL) n++;
+    return n;
+}
+
+/* Read the object at off into buf (NUL-terminated) and find its dictionary
+ * text, up to "stream" or "endobj" - returns its end, or NULL */
+static const char *pdf_read_object(MediaProbe *p, uint64_t off, char *buf,
+                                   const char **dict_start) {
+    size_t n = probe_read(p, off, buf, PDF_OBJ_READ - 1);
+    buf[n] = '\0';
+    const char *end = buf + n;
+    uint64_t num, gen;
+    const char *s = pdf_uint(buf, end, &num);
+    if (!s || !(s = pdf_uint(s, end, &gen))) return NULL;
+    while (s < end && pdf_is_space(*s)) s++;
+    if (end - s < 3 || memcmp(s, "obj", 3) != 0) return NULL;
+    s += 3;
+
+    const char *stop = memmem(s, (size_t)(end - s), "stream", 6);
+    const char *endobj = memmem(s, (size_t)(end - s), "endobj", 6);
+    if (!stop || (endobj && endobj < stop)) stop = endobj;
+    *dict_start = s;
+    return stop ? stop : end;
+}
+
+/* Read and decode the stream of the object whose dictionary is
+ * [dict, dict_end) at off, buf holding the bytes read from off - returns
+ * the data (caller frees), or NULL */
+static char *pdf_read_stream(MediaProbe *p, uint64_t off, const char *buf,
+                             const char *dict, const char *dict_end, size_t *len) {
+    uint64_t length;
+    if (pdf_int(dict, dict_end, "/Length", &length) != 0 || length == 0 ||
+        length > PDF_MAX_STREAM)
+        return NULL;
+    const char *filter = pdf_key(dict, dict_end, "/Filter");
+    int flate = 0;
+    if (filter) {
+        while (filter < dict_end && (pdf_is_space(*filter) || *filter == '[')) filter++;
+        flate = dict_end - filter >= 12 && memcmp(filter, "/FlateDecode", 12) == 0;
+        if (!flate) return NULL;
+    }
+
+    /* Data starts after "stream" and its end of line */
+    if (dict_end[0] != 's') return NULL;
+    uint64_t data_off = off + (uint64_t)(dict_end - buf) + 6;
+    char eol[2];
+    size_t got = probe_read(p, data_off, eol, 2);
+    if (got >= 1 && eol[0] == '\r') data_off += (got == 2 && eol[1] == '\n') ? 2 : 1;
+    else if (got >= 1 && eol[0] == '\n') data_off++;
+
+    unsigned char *raw = malloc((size_t)length);
+    if (!raw) return NULL;
+    if (probe_read(p, data_off, raw, (size_t)length) != length) {
+        free(raw);
+        return NULL;
+    }
+    if (!flate) {
+        *len = (size_t)length;
+        return (char *)raw;
+    }
+    char *out = pdf_inflate(raw, (size_t)length, len);
+    free(raw);
+    return out;
+}
+
+/* Undo a PNG predictor (/Predictor 10-15) on rows of columns bytes, in
+ * place - returns the decoded length, or 0 on failure */
+static size_t pdf_unpredict(unsigned char *data, size_t len, size_t columns) {
+    size_t stride = columns + 1;
+    if (columns == 0 || len % stride != 0) return 0;
+    size_t rows = len / stride;
+    unsigned char *out = data;  /* Each output row lands before its input */
+    for (size_t r = 0; r < rows; r++) {
+        const unsigned char *in = data + r * stride;
+        int filter = in[0];
+        unsigned char *cur = out + r * columns;
+        const unsigned char *prev = r ? cur - columns : NULL;
+        for (size_t i = 0; i < columns; i++) {
+            unsigned a = i ? cur[i - 1] : 0;
+            unsigned b = prev ? prev[i] : 0;
+            unsigned c = (i && prev) ? prev[i - 1] : 0;
+            unsigned x = in[i + 1];
+            switch (filter) {
+            case 0: break;
+            case 1: x += a; break;
+            case 2: x += b; break;
+            case 3: x += (a + b) / 2; break;
+            case 4: {
+                int pa = abs((int)b - (int)c), pb = abs((int)a - (int)c);
+                int pc = abs((int)a + (int)b - 2 * (int)c);
+                x += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                break;
+            }
+            default: return 0;
+            }
+            cur[i] = (unsigned char)x;
+        }
+    }
+    return rows * columns;
+}
+
+/* Parse a classic "xref" table at off and the trailer after it */
+static int pdf_parse_table(PdfXref *x, PdfSection *sec, uint64_t off,
+                           char *buf, uint64_t *prev, uint64_t *xref_stm) {
+    uint64_t cursor = off + 4;
+    for (;;) {
+        size_t n = probe_read(x->probe, cursor, buf, 64);
+        const char *s = buf, *end = buf + n;
+        while (s < end && pdf_is_space(*s)) s++;
+        if (end - s >= 7 && memcmp(s, "trailer", 7) == 0) {
+            cursor += (uint64_t)(s - buf);
+            break;
+        }
+        uint64_t start, count;
+        if (sec->sub_count >= PDF_MAX_SUBSECTIONS ||
+            !(s = pdf_uint(s, end, &start)) || !(s = pdf_uint(s, end, &count)))
+            return -1;
+        while (s < end && pdf_is_space(*s)) s++;
+        if (s >= end) return -1;
+        int k = sec->sub_count++;
+        sec->sub_start[k] = start;
+        sec->sub_len[k] = count;
+        sec->sub_off[k] = cursor + (uint64_t)(s - buf);
+        cursor = sec->sub_off[k] + count * 20;
+    }
+
+    size_t n = probe_read(x->probe, cursor, buf, PDF_OBJ_READ - 1);
+    buf[n] = '\0';
+    const char *end = buf + n;
+    const char *close = memmem(buf, n, "startxref", 9);
+    if (close) end = close;
+    if (!x->root) pdf_ref(buf, end, "/Root", &x->root);
+    if (pdf_int(buf, end, "/Prev", prev) != 0) *prev = 0;
+    if (pdf_int(buf, end, "/XRefStm", xref_stm) != 0) *xref_stm = 0;
+    return 0;
+}
+
+/* Parse an xref stream object at off */
+static int pdf_parse_stream(PdfXref *x, PdfSection *sec, uint64_t off,
+                            char *buf, uint64_t *prev) {
+    const char *dict;
+    const char *dict_end = pdf_read_object(x->probe, off, buf, &dict);
+    if (!dict_end || !pdf_key(dict, dict_end, "/XRef")) return -1;
 
-    /* Verify PDF header */
-    if (memcmp(data, "%PDF-", 5) != 0) {
-        munmap(data, size);
+    uint64_t w[3], size, index[2 * PDF_MAX_SUBSECTIONS];
+    if (pdf_array(dict, dict_end, "/W", w, 3) != 3 ||
+        pdf_int(dict, dict_end, "/Size", &size) != 0)
         return -1;
+    int index_len = pdf_array(dict, dict_end, "/Index", index, 2 * PDF_MAX_SUBSECTIONS);
+    if (index_len == 0) {
+        index[0] = 0;
+        index[1] = size;
+        index_len = 2;
+    }
+    if (index_len % 2 != 0 || w[0] > 8 || w[1] > 8 || w[2] > 8) return -1;
+    if (!x->root) pdf_ref(dict, dict_end, "/Root", &x->root);
+    if (pdf_int(dict, dict_end, "/Prev", prev) != 0) *prev = 0;
+
+    size_t row = (size_t)(w[0] + w[1] + w[2]), len;
+    char *data = pdf_read_stream(x->probe, off, buf, dict, dict_end, &len);
+    if (!data || row == 0) {
+        free(data);
+        return -1;
+    }
+    uint64_t predictor = 1, columns = 1;
+    const char *parms = pdf_key(dict, dict_end, "/DecodeParms");
+    if (parms) {
+        pdf_int(parms, dict_end, "/Predictor", &predictor);
+        pdf_int(parms, dict_end, "/Columns", &columns);
+    }
+    if (predictor >= 10) len = pdf_unpredict((unsigned char *)data, len, (size_t)columns);
+
+    sec->is_stream = 1;
+    sec->rows = (unsigned char *)data;
+    sec->row_count = len / row;
+    for (int i = 0; i < 3; i++) sec->w[i] = (int)w[i];
+    uint64_t first_row = 0;
+    for (int i = 0; i < index_len; i += 2) {
+        int k = sec->sub_count++;
+        sec->sub_start[k] = index[i];
+        sec->sub_len[k] = index[i + 1];
+        sec->sub_off[k] = first_row;
+        first_row += index[i + 1];
+    }
+    return 0;
+}
+
+/* Follow the chain of cross-reference sections back from startxref -
+ * returns 0 if at least one was read */
+static int pdf_xref_load(PdfXref *x, char *buf) {
+    uint64_t tail_off;
+    size_t tail_len;
+    const unsigned char *tail = probe_tail(x->probe, &tail_off, &tail_len);
+    if (!tail) return -1;
+
+    /* The last startxref, within the final kilobyte */
+    size_t window = tail_len < 1024 ? tail_len : 1024;
+    const char *t = (const char *)tail + tail_len - window;
+    const char *hit = NULL;
+    for (const char *s = t, *h; (h = memmem(s, (size_t)(t + window - s), "startxref", 9)); s = h + 1)
+        hit = h;
+    uint64_t off;
+    if (!hit || !pdf_uint(hit + 9, t + window, &off)) return -1;
+
+    x->sections = calloc(PDF_MAX_SECTIONS, sizeof(PdfSection));
+    if (!x->sections) return -1;
+    uint64_t pending_stm = 0;
+    while (x->count < PDF_MAX_SECTIONS && (off || pending_stm)) {
+        uint64_t at = pending_stm ? pending_stm : off;
+        PdfSection *sec = &x->sections[x->count];
+        char word[8];
+        size_t n = probe_read(x->probe, at, word, sizeof(word));
+        uint64_t prev = 0, xref_stm = 0;
+        int rc;
+        if (n >= 4 && memcmp(word, "xref", 4) == 0)
+            rc = pdf_parse_table(x, sec, at, buf, &prev, &xref_stm);
+        else
+            rc = pdf_parse_stream(x, sec, at, buf, &prev);
+        if (rc != 0) break;
+        x->count++;
+
+        /* A hybrid file's xref stream is searched before its /Prev */
+        if (pending_stm) {
+            pending_stm = 0;
+        } else {
+            off = prev;
+            pending_stm = xref_stm;
+        }
+        if (off && off >= x->probe->size) off = 0;
     }
+    return x->count > 0 ? 0 : -1;
+}
+
+static void pdf_xref_free(PdfXref *x) {
+    for (int i = 0; i < x->count; i++) free(x->sections[i].rows);
+    free(x->sections);
+    free(x->stm_data);
+}
+
+static uint64_t pdf_field(const unsigned char *b, int width) {
+    uint64_t v = 0;
+    for (int i = 0; i < width; i++) v = (v << 8) | b[i];
+    return v;
+}
 
+/* Where object num lives: 1 with its offset in *a, 2 with its object
+ * stream in *a and index in *b - returns 0 if it isn't listed in use */
+static int pdf_locate(PdfXref *x, uint64_t num, uint64_t *a, uint64_t *b) {
+    for (int i = 0; i < x->count; i++) {
+        PdfSection *sec = &x->sections[i];
+        for (int k = 0; k < sec->sub_count; k++) {
+            if (num < sec->sub_start[k] || num - sec->sub_start[k] >= sec->sub_len[k])
+                continue;
+            uint64_t idx = num - sec->sub_start[k];
+            if (!sec->is_stream) {
+                /* "oooooooooo ggggg n" - always 20 bytes */
+                char entry[20];
+                if (probe_read(x->probe, sec->sub_off[k] + idx * 20, entry, 20) != 20)
+                    return 0;
+                if (entry[17] != 'n') break;  /* Free here: look further back */
+                uint64_t off;
+                if (!pdf_uint(entry, entry + 10, &off)) return 0;
+                *a = off;
+                return 1;
+            }
+
+            uint64_t r = sec->sub_off[k] + idx;
+            if (r >= sec->row_count) return 0;
+            const unsigned char *row = sec->rows + r * (size_t)(sec->w[0] + sec->w[1] + sec->w[2]);
+            int type = sec->w[0] ? (int)pdf_field(row, sec->w[0]) : 1;
+            if (type != 1 && type != 2) break;
+            *a = pdf_field(row + sec->w[0], sec->w[1]);
+            *b = pdf_field(row + sec->w[0] + sec->w[1], sec->w[2]);
+            return type;
+        }
+    }
+    return 0;
+}
+
+/* Dictionary text of object num into buf - returns its end, or NULL */
+static const char *pdf_object(PdfXref *x, uint64_t num, char *buf, const char **dict) {
+    uint64_t a, b = 0;
+    int type = pdf_locate(x, num, &a, &b);
+    if (type == 1) return pdf_read_object(x->probe, a, buf, dict);
+    if (type != 2) return NULL;
+
+    /* In object stream a: "num offset" pairs, then the objects from /First.
+     * Catalog and page tree root usually share one, so keep it decoded. */
+    if (x->stm_num != a || !x->stm_data) {
+        free(x->stm_data);
+        x->stm_data = NULL;
+        uint64_t stm_off, unused;
+        if (pdf_locate(x, a, &stm_off, &unused) != 1) return NULL;
+        const char *stm_dict;
+        const char *stm_end = pdf_read_object(x->probe, stm_off, buf, &stm_dict);
+        if (!stm_end || pdf_int(stm_dict, stm_end, "/First", &x->stm_first) != 0) return NULL;
+        x->stm_data = pdf_read_stream(x->probe, stm_off, buf, stm_dict, stm_end, &x->stm_len);
+        x->stm_num = a;
+        if (!x->stm_data) return NULL;
+        if (x->stm_first > x->stm_len) {
+            free(x->stm_data);
+            x->stm_data = NULL;
+            return NULL;
+        }
+    }
+
+    const char *data = x->stm_data;
+    const char *s = data, *header_end = data + x->stm_first;
+    uint64_t obj, rel, start = 0, stop = x->stm_len - x->stm_first;
+    int found = 0;
+    while ((s = pdf_uint(s, header_end, &obj)) != NULL &&
+           (s = pdf_uint(s, header_end, &rel)) != NULL) {
+        if (found) {
+            stop = rel;
+            break;
+        }
+        if (obj == num) {
+            start = rel;
+            found = 1;
+        }
+    }
+    if (!found || start >= stop || stop > x->stm_len - x->stm_first) return NULL;
+
+    size_t len = (size_t)(stop - start);
+    if (len > PDF_OBJ_READ - 1) len = PDF_OBJ_READ - 1;
+    memcpy(buf, header_end + start, len);
+    buf[len] = '\0';
+    *dict = buf;
+    return buf + len;
+}
+
+/* Page count from the page tree root, or -1 if it can't be reached */
+static int pdf_fast_page_count(MediaProbe *p) {
+    PdfXref x = {0};
+    x.probe = p;
+    int pages = -1;
+    char *buf = malloc(PDF_OBJ_READ);
+    const char *dict, *end;
+    uint64_t tree, count;
+    if (buf && pdf_xref_load(&x, buf) == 0 && x.root &&
+        (end = pdf_object(&x, x.root, buf, &dict)) != NULL &&
+        pdf_ref(dict, end, "/Pages", &tree) == 0 &&
+        (end = pdf_object(&x, tree, buf, &dict)) != NULL &&
+        pdf_int(dict, end, "/Count", &count) == 0 && count <= INT_MAX)
+        pages = (int)count;
+    pdf_xref_free(&x);
+    free(buf);
+    return pages;
+}
+
+/* Page count from scanning all of data for /Type /Pages dictionaries,
+ * including those in compressed object streams - returns the largest
+ * /Count found, or -1 */
+static int pdf_scan_page_count(const char *data, size_t size) {
     /* First try uncompressed search */
     int page_count = pdf_search_pages_count(data, size);
 
@@ -958,10 +1363,37 @@ int get_pdf_page_count(const char *path) {
         }
     }
 
-    munmap(data, size);
     return page_count;
 }
 
+/* Page count of the probed file, or -1 on failure */
+static int probe_pdf_page_count(MediaProbe *p) {
+    if (strcasecmp(p->ext, "pdf") != 0 || p->size < 100 || p->head_len < 5 ||
+        memcmp(p->head, "%PDF-", 5) != 0)
+        return -1;
+
+    int pages = pdf_fast_page_count(p);
+    if (pages >= 0) return pages;
+
+    /* Small files are already in the head */
+    if (p->size <= p->head_len) return pdf_scan_page_count((const char *)p->head, p->head_len);
+    size_t size = (size_t)p->size;
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, p->fd, 0);
+    if (data == MAP_FAILED) return -1;
+    pages = pdf_scan_page_count(data, size);
+    munmap(data, size);
+    return pages;
+}
+
+/* Get page count from PDF file. Returns page count, or -1 on failure. */
+int get_pdf_page_count(const char *path) {
+    MediaProbe p;
+    if (probe_open(&p, path) != 0) return -1;
+    int pages = probe_pdf_page_count(&p);
+    probe_close(&p);
+    return pages;
+}
+
 /* ============================================================================
  * File Type Name Detection
  * ============================================================================ */
@@ -1044,9 +1476,33 @@ void type_stats_init(TypeStats *stats) {
     memset(stats, 0, sizeof(*stats));
 }
 
-void type_stats_add(TypeStats *stats, const char *type_name,
+void type_tally_init(TypeTally *tally) {
+    memset(tally, 0, sizeof(*tally));
+}
+
+/* Entry for type_name, added if there's room; NULL once the table is full */
+static TypeStat *type_tally_entry(TypeTally *tally, const char *type_name) {
+    TypeStats *stats = &tally->stats;
+    unsigned int slot = (unsigned int)hash_string64(type_name) & (TYPE_TALLY_SLOTS - 1);
+
+    while (tally->slots[slot]) {
+        TypeStat *ts = &stats->entries[tally->slots[slot] - 1];
+        if (ts->name == type_name || strcmp(ts->name, type_name) == 0) return ts;
+        slot = (slot + 1) & (TYPE_TALLY_SLOTS - 1);
+    }
+
+    if (stats->count >= MAX_TYPE_STATS) return NULL;
+    TypeStat *ts = &stats->entries[stats->count++];
+    memset(ts, 0, sizeof(*ts));
+    ts->name = type_name;
+    tally->slots[slot] = (unsigned char)stats->count;
+    return ts;
+}
+
+void type_tally_add(TypeTally *tally, const char *type_name,
                     int lines, ContentType content_type) {
     if (!type_name) type_name = "Other";
+    TypeStats *stats = &tally->stats;
 
     stats->total_files++;
 
@@ -1056,59 +1512,29 @@ void type_stats_add(TypeStats *stats, const char *type_name,
         stats->total_lines += lines;
     }
 
-    /* Find existing entry */
-    for (int i = 0; i < stats->count; i++) {
-        if (strcmp(stats->entries[i].name, type_name) == 0) {
-            stats->entries[i].file_count++;
-            if (has_lines) {
-                stats->entries[i].line_count += lines;
-                stats->entries[i].has_lines = 1;
-            }
-            return;
-        }
-    }
-
-    /* Add new entry */
-    if (stats->count < MAX_TYPE_STATS) {
-        stats->entries[stats->count].name = type_name;
-        stats->entries[stats->count].file_count = 1;
-        stats->entries[stats->count].line_count = has_lines ? lines : 0;
-        stats->entries[stats->count].has_lines = has_lines;
-        stats->count++;
+    TypeStat *ts = type_tally_entry(tally, type_name);
+    if (!ts) return;
+    ts->file_count++;
+    if (has_lines) {
+        ts->line_count += lines;
+        ts->has_lines = 1;
     }
 }
 
-static void type_stats_from_tree_recursive(TypeStats *stats, const TreeNode *node,
-                                            const FileTypes *ft, const Shebangs *sb,
-                                            int show_hidden) {
-    const FileEntry *fe = &node->entry;
-
-    /* Skip hidden files if not showing them */
-    if (!show_hidden && fe->name[0] == '.') return;
-
-    /* Skip ignored files (.git, gitignored, etc.) */
-    if (fe->is_ignored) return;
-
-    /* Process files */
-    if (fe->type == FTYPE_FILE || fe->type == FTYPE_EXEC ||
-        fe->type == FTYPE_SYMLINK || fe->type == FTYPE_SYMLINK_EXEC) {
-        const char *type_name = get_file_type_name(fe->path, ft, sb);
-        type_stats_add(stats, type_name, fe->line_count, fe->content_type);
-    }
-
-    /* Recurse into children */
-    for (size_t i = 0; i < node->child_count; i++) {
-        type_stats_from_tree_recursive(stats, &node->children[i], ft, sb, show_hidden);
+void type_tally_merge(TypeTally *dst, const TypeTally *src) {
+    dst->stats.total_files += src->stats.total_files;
+    dst->stats.total_lines += src->stats.total_lines;
+
+    for (int i = 0; i < src->stats.count; i++) {
+        const TypeStat *from = &src->stats.entries[i];
+        TypeStat *ts = type_tally_entry(dst, from->name);
+        if (!ts) continue;
+        ts->file_count += from->file_count;
+        ts->line_count += from->line_count;
+        ts->has_lines |= from->has_lines;
     }
 }
 
-void type_stats_from_tree(TypeStats *stats, const TreeNode *node,
-                          const FileTypes *ft, const Shebangs *sb,
-                          int show_hidden) {
-    type_stats_init(stats);
-    type_stats_from_tree_recursive(stats, node, ft, sb, show_hidden);
-}
-
 static int type_stat_cmp(const void *a, const void *b) {
     const TypeStat *ta = a, *tb = b;
     /* Sort by file count descending, then by line count */
@@ -1116,7 +1542,8 @@ static int type_stat_cmp(const void *a, const void *b) {
     if (tb->file_count < ta->file_count) return -1;
     if (tb->line_count > ta->line_count) return 1;
     if (tb->line_count < ta->line_count) return -1;
-    return 0;
+    /* Ties by name, so the order doesn't depend on which file came first */
+    return strcmp(ta->name, tb->name);
 }
 
 void type_stats_sort(TypeStats *stats) {
@@ -1127,39 +1554,32 @@ void type_stats_sort(TypeStats *stats) {
  * Content Metadata Computation
  * ============================================================================ */
 
-void fileinfo_compute_content(struct FileEntry *fe, int do_line_count, int do_media_info) {
+static void compute_content(struct FileEntry *fe, int do_line_count, int do_media_info) {
     if (!fe || !fe->path) return;
 
-    /* Try media info first if requested */
-    if (do_media_info) {
-        int mp = get_image_megapixels(fe->path);
-        if (mp >= 0) {
-            fe->line_count = mp;
-            fe->content_type = CONTENT_IMAGE;
-            return;
-        }
-
-        int dur = get_audio_duration(fe->path);
-        if (dur >= 0) {
-            fe->line_count = dur;
-            fe->content_type = CONTENT_AUDIO;
-            return;
-        }
-
-        int pages = get_pdf_page_count(fe->path);
-        if (pages >= 0) {
-            fe->line_count = pages;
-            fe->content_type = CONTENT_PDF;
+    /* Try media info first if requested, opening the file once for all
+     * three parsers */
+    MediaProbe probe;
+    if (do_media_info && probe_open(&probe, fe->path) == 0) {
+        int value;
+        ContentType type = CONTENT_BINARY;
+        if ((value = probe_image_megapixels(&probe)) >= 0) type = CONTENT_IMAGE;
+        else if ((value = probe_audio_duration(&probe)) >= 0) type = CONTENT_AUDIO;
+        else if ((value = probe_pdf_page_count(&probe)) >= 0) type = CONTENT_PDF;
+        probe_close(&probe);
+        if (type != CONTENT_BINARY) {
+            fe->line_count = value;
+            fe->content_type = type;
             return;
         }
     }
 
     /* Try text line count if requested */
     if (do_line_count) {
-        int lines = count_file_lines(fe->path);
-        if (lines >= 0) {
+        int lines, words;
+        if (count_file_text(fe->path, &lines, &words) == 0) {
             fe->line_count = lines;
-            fe->word_count = count_file_words(fe->path);
+            fe->word_count = words;
             fe->content_type = CONTENT_TEXT;
             return;
         }
@@ -1171,56 +1591,168 @@ void fileinfo_compute_content(struct FileEntry *fe, int do_line_count, int do_me
     fe->content_type = CONTENT_BINARY;
 }
 
+void fileinfo_compute_content(struct FileEntry *fe, int do_line_count, int do_media_info) {
+    int64_t start = PROFILE_BEGIN();
+    compute_content(fe, do_line_count, do_media_info);
+    PROFILE_END(PROF_CONTENT, start);
+}
+
 /* ============================================================================
- * Line Counting
+ * Line and Word Counting
+ *
+ * One pass counts both newlines and word starts (a non-space byte after a
+ * space, or at the start of the file). The vector kernels classify each
+ * block and the block shifted back by one byte, so no state is carried
+ * between lanes; per-lane byte counters are widened every 255 blocks.
  * ============================================================================ */
 
-int count_file_lines(const char *path) {
-    if (has_binary_extension(path)) return -1;
-
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) return -1;
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <emmintrin.h>
+#include <immintrin.h>
+#define TEXT_SSE2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define TEXT_AVX2 1
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TEXT_NEON 1
+#endif
+
+static int text_is_space(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
 
-    struct stat st;
-    if (fstat(fd, &st) != 0 || st.st_size == 0) {
-        close(fd);
-        return st.st_size == 0 ? 0 : -1;
+/* Scalar counting of data[i, size); data[i - 1] is the previous byte */
+static void text_count_scalar(const unsigned char *data, size_t i, size_t size,
+                              uint64_t *lines, uint64_t *words) {
+    int prev_space = i == 0 || text_is_space(data[i - 1]);
+    for (; i < size; i++) {
+        unsigned char c = data[i];
+        int space = text_is_space(c);
+        *lines += (c == '\n');
+        *words += (!space && prev_space);
+        prev_space = space;
     }
+}
 
-    /* For very large files, use mmap for better performance */
-    size_t size = (size_t)st.st_size;
-    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-
-    if (data == MAP_FAILED) return -1;
+#ifdef TEXT_SSE2
+static __m128i sse2_is_space(__m128i v) {
+    /* Unsigned v - '\t' <= 4 covers \t \n \v \f \r */
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+    return _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
 
-    /* Hint to OS about sequential access */
-    madvise(data, size, MADV_SEQUENTIAL);
+static uint64_t sse2_sum(__m128i acc) {
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, _mm_sad_epu8(acc, _mm_setzero_si128()));
+    return lanes[0] + lanes[1];
+}
 
-    /* Check for binary content at start */
-    size_t check_len = size < L_BINARY_CHECK_SIZE ? size : L_BINARY_CHECK_SIZE;
-    if (memchr(data, '\0', check_len) != NULL) {
-        munmap(data, size);
-        return -1;
+/* Returns the offset where the scalar tail should resume (i >= 1) */
+static size_t text_count_sse2(const unsigned char *data, size_t i, size_t size,
+                              uint64_t *lines, uint64_t *words) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (i + 16 <= size) {
+        __m128i acc_l = _mm_setzero_si128(), acc_w = _mm_setzero_si128();
+        for (int n = 0; n < 255 && i + 16 <= size; n++, i += 16) {
+            __m128i cur = _mm_loadu_si128((const __m128i *)(data + i));
+            __m128i prev = _mm_loadu_si128((const __m128i *)(data + i - 1));
+            acc_l = _mm_sub_epi8(acc_l, _mm_cmpeq_epi8(cur, nl));
+            acc_w = _mm_sub_epi8(acc_w, _mm_andnot_si128(sse2_is_space(cur),
+                                                         sse2_is_space(prev)));
+        }
+        *lines += sse2_sum(acc_l);
+        *words += sse2_sum(acc_w);
     }
+    return i;
+}
+#endif
+
+#ifdef TEXT_AVX2
+__attribute__((target("avx2")))
+static __m256i avx2_is_space(__m256i v) {
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+    return _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
 
-    /* Count newlines using memchr (typically SIMD-optimized by libc) */
-    long count = 0;
-    const char *p = data;
-    const char *end = data + size;
+__attribute__((target("avx2")))
+static uint64_t avx2_sum(__m256i acc) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_sad_epu8(acc, _mm256_setzero_si256()));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
 
-    while ((p = memchr(p, '\n', end - p)) != NULL) {
-        count++;
-        p++;
+__attribute__((target("avx2")))
+static size_t text_count_avx2(const unsigned char *data, size_t i, size_t size,
+                              uint64_t *lines, uint64_t *words) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (i + 32 <= size) {
+        __m256i acc_l = _mm256_setzero_si256(), acc_w = _mm256_setzero_si256();
+        for (int n = 0; n < 255 && i + 32 <= size; n++, i += 32) {
+            __m256i cur = _mm256_loadu_si256((const __m256i *)(data + i));
+            __m256i prev = _mm256_loadu_si256((const __m256i *)(data + i - 1));
+            acc_l = _mm256_sub_epi8(acc_l, _mm256_cmpeq_epi8(cur, nl));
+            acc_w = _mm256_sub_epi8(acc_w, _mm256_andnot_si256(avx2_is_space(cur),
+                                                               avx2_is_space(prev)));
+        }
+        *lines += avx2_sum(acc_l);
+        *words += avx2_sum(acc_w);
     }
+    return i;
+}
+#endif
 
-    munmap(data, size);
+#ifdef TEXT_NEON
+static uint8x16_t neon_is_space(uint8x16_t v) {
+    uint8x16_t ctrl = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4));
+    return vorrq_u8(ctrl, vceqq_u8(v, vdupq_n_u8(' ')));
+}
 
-    /* Clamp to INT_MAX for return value */
-    return count > INT_MAX ? INT_MAX : (int)count;
+static size_t text_count_neon(const unsigned char *data, size_t i, size_t size,
+                              uint64_t *lines, uint64_t *words) {
+    const uint8x16_t nl = vdupq_n_u8('\n');
+    while (i + 16 <= size) {
+        uint8x16_t acc_l = vdupq_n_u8(0), acc_w = vdupq_n_u8(0);
+        for (int n = 0; n < 255 && i + 16 <= size; n++, i += 16) {
+            uint8x16_t cur = vld1q_u8(data + i);
+            uint8x16_t prev = vld1q_u8(data + i - 1);
+            acc_l = vsubq_u8(acc_l, vceqq_u8(cur, nl));
+            acc_w = vsubq_u8(acc_w, vbicq_u8(neon_is_space(prev), neon_is_space(cur)));
+        }
+        *lines += vaddlvq_u8(acc_l);
+        *words += vaddlvq_u8(acc_w);
+    }
+    return i;
+}
+#endif
+
+/* Count newlines and words in a buffer with the best available kernel */
+static void text_count(const unsigned char *data, size_t size,
+                       uint64_t *lines, uint64_t *words) {
+    *lines = 0;
+    *words = 0;
+    if (size == 0) return;
+
+    /* The first byte has no predecessor to load, so it is counted here */
+    text_count_scalar(data, 0, 1, lines, words);
+    size_t i = 1;
+#if defined(TEXT_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        i = text_count_avx2(data, i, size, lines, words);
+#endif
+#if defined(TEXT_SSE2)
+    i = text_count_sse2(data, i, size, lines, words);
+#elif defined(TEXT_NEON)
+    i = text_count_neon(data, i, size, lines, words);
+#endif
+    text_count_scalar(data, i, size, lines, words);
 }
 
-int count_file_words(const char *path) {
+/* Map a file for counting. Returns 1 with data/size set (caller munmaps),
+ * 0 for an empty file, -1 if unreadable or binary. */
+static int text_map(const char *path, const unsigned char **data, size_t *size) {
     if (has_binary_extension(path)) return -1;
 
     int fd = open(path, O_RDONLY);
@@ -1232,42 +1764,54 @@ int count_file_words(const char *path) {
         return st.st_size == 0 ? 0 : -1;
     }
 
-    size_t size = (size_t)st.st_size;
-    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    *size = (size_t)st.st_size;
+    void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
     close(fd);
 
-    if (data == MAP_FAILED) return -1;
+    if (map == MAP_FAILED) return -1;
 
-    madvise(data, size, MADV_SEQUENTIAL);
+    /* Hint to OS about sequential access */
+    madvise(map, *size, MADV_SEQUENTIAL);
 
     /* Check for binary content at start */
-    size_t check_len = size < L_BINARY_CHECK_SIZE ? size : L_BINARY_CHECK_SIZE;
-    if (memchr(data, '\0', check_len) != NULL) {
-        munmap(data, size);
+    size_t check_len = *size < L_BINARY_CHECK_SIZE ? *size : L_BINARY_CHECK_SIZE;
+    if (memchr(map, '\0', check_len) != NULL) {
+        munmap(map, *size);
         return -1;
     }
 
-    /* Count words (transitions from whitespace to non-whitespace) */
-    long count = 0;
-    int in_word = 0;
-    const unsigned char *p = (const unsigned char *)data;
-    const unsigned char *end = p + size;
-
-    while (p < end) {
-        unsigned char c = *p++;
-        int is_space = (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
-                        c == '\v' || c == '\f');
-        if (!is_space && !in_word) {
-            count++;
-            in_word = 1;
-        } else if (is_space) {
-            in_word = 0;
-        }
+    *data = map;
+    return 1;
+}
+
+static int clamp_count(uint64_t count) {
+    return count > INT_MAX ? INT_MAX : (int)count;
+}
+
+int count_file_text(const char *path, int *lines, int *words) {
+    const unsigned char *data;
+    size_t size;
+    int rc = text_map(path, &data, &size);
+    if (rc < 0) return -1;
+
+    uint64_t nlines = 0, nwords = 0;
+    if (rc > 0) {
+        text_count(data, size, &nlines, &nwords);
+        munmap((void *)data, size);
     }
+    *lines = clamp_count(nlines);
+    *words = clamp_count(nwords);
+    return 0;
+}
 
-    munmap(data, size);
+int count_file_lines(const char *path) {
+    int lines, words;
+    return count_file_text(path, &lines, &words) == 0 ? lines : -1;
+}
 
-    return count > INT_MAX ? INT_MAX : (int)count;
+int count_file_words(const char *path) {
+    int lines, words;
+    return count_file_text(path, &lines, &words) == 0 ? words : -1;
 }
 
 /* ============================================================================
@@ -1276,13 +1820,6 @@ int count_file_words(const char *path) {
 
 #include "tree.h"
 
-void fileinfo_compute_type_stats(struct FileEntry *fe, const struct TreeNode *node,
-                                  const FileTypes *ft, const Shebangs *sb,
-                                  int show_hidden) {
-    type_stats_from_tree(&fe->type_stats, node, ft, sb, show_hidden);
-    fe->has_type_stats = (fe->type_stats.total_files > 0);
-}
-
 void fileinfo_compute_git_dir_status(struct FileEntry *fe, GitCache *git) {
     fe->git_dir_status = git_get_dir_summary(git, fe->path);
     fe->has_git_dir_status = 1;
@@ -1301,95 +1838,46 @@ static void format_count_local(long count, char *buf, size_t len) {
 
 void fileinfo_compute_git_repo_info(struct FileEntry *fe, GitCache *git) {
     if (!fe->is_git_root) return;
+    RepoInfo *ri = file_entry_repo(fe);
 
     /* Branch and upstream status */
     GitBranchInfo gi;
     if (git_get_branch_info(fe->path, &gi)) {
-        fe->branch = gi.branch;  /* Takes ownership */
-        fe->has_upstream = gi.has_upstream;
-        fe->out_of_sync = gi.out_of_sync;
-        fe->ahead = gi.ahead;
-        fe->behind = gi.behind;
+        free(ri->branch);
+        ri->branch = gi.branch;  /* Takes ownership */
+        ri->has_upstream = gi.has_upstream;
+        ri->out_of_sync = gi.out_of_sync;
+        ri->ahead = gi.ahead;
+        ri->behind = gi.behind;
 
         /* Get short hash */
         char hash[64] = "";
         char ref[128];
-        snprintf(ref, sizeof(ref), "refs/heads/%s", fe->branch);
+        snprintf(ref, sizeof(ref), "refs/heads/%s", ri->branch);
         if (git_read_ref(fe->path, ref, hash, sizeof(hash))) {
-            snprintf(fe->short_hash, sizeof(fe->short_hash), "%.7s", hash);
+            snprintf(ri->short_hash, sizeof(ri->short_hash), "%.7s", hash);
         }
     }
 
     /* Commit count */
-    char cmd[PATH_MAX + 64];
-    snprintf(cmd, sizeof(cmd), "git -C '%s' rev-list --count HEAD 2>/dev/null", fe->path);
-    FILE *fp = popen(cmd, "r");
-    if (fp) {
-        char buf[32];
-        if (fgets(buf, sizeof(buf), fp)) {
-            buf[strcspn(buf, "\n")] = '\0';
-            long count = atol(buf);
-            if (count > 0) {
-                format_count_local(count, fe->commit_count, sizeof(fe->commit_count));
-            }
-        }
-        pclose(fp);
-    }
-
-    /* Latest tag with distance */
-    snprintf(cmd, sizeof(cmd), "git -C '%s' describe --tags 2>/dev/null", fe->path);
-    fp = popen(cmd, "r");
-    if (fp) {
-        char tag_buf[256];
-        if (fgets(tag_buf, sizeof(tag_buf), fp)) {
-            tag_buf[strcspn(tag_buf, "\n")] = '\0';
-            if (tag_buf[0]) {
-                /* Format: tag-name or tag-name-N-gHASH */
-                /* Find the last two dashes to extract distance */
-                char *last_dash = strrchr(tag_buf, '-');
-                char *second_last = NULL;
-                if (last_dash && last_dash > tag_buf && last_dash[1] == 'g') {
-                    /* Looks like -gHASH suffix, find the distance before it */
-                    *last_dash = '\0';
-                    second_last = strrchr(tag_buf, '-');
-                    if (second_last && second_last > tag_buf) {
-                        char *endptr;
-                        long dist = strtol(second_last + 1, &endptr, 10);
-                        if (*endptr == '\0' && dist > 0) {
-                            /* Valid distance found */
-                            fe->tag_distance = (int)dist;
-                            *second_last = '\0';
-                        } else {
-                            /* Not a valid distance, restore */
-                            *last_dash = '-';
-                        }
-                    } else {
-                        *last_dash = '-';
-                    }
-                }
-                free(fe->tag);
-                fe->tag = xstrdup(tag_buf);
-            }
+    char head[80];
+    if (git_read_head(fe->path, head, sizeof(head))) {
+        long count = git_count_commits(fe->path, NULL, head);
+        if (count > 0) {
+            format_count_local(count, ri->commit_count, sizeof(ri->commit_count));
         }
-        pclose(fp);
-    }
-
-    /* Remote URL */
-    snprintf(cmd, sizeof(cmd), "git -C '%s' remote get-url origin 2>/dev/null", fe->path);
-    fp = popen(cmd, "r");
-    if (fp) {
-        char remote_buf[512];
-        if (fgets(remote_buf, sizeof(remote_buf), fp)) {
-            remote_buf[strcspn(remote_buf, "\n")] = '\0';
-            if (remote_buf[0]) {
-                free(fe->remote);
-                fe->remote = xstrdup(remote_buf);
-            }
-        }
-        pclose(fp);
+    }
+
+    /* Latest tag with distance, and remote URL (usually set while building
+     * the tree) */
+    if (!ri->tag) {
+        ri->tag = git_get_latest_tag(fe->path, &ri->tag_distance);
+    }
+    if (!ri->remote) {
+        ri->remote = git_get_remote_url(fe->path);
     }
 
     /* Repo status */
-    fe->repo_status = git_get_dir_summary(git, fe->path);
+    ri->repo_status = git_get_dir_summary(git, fe->path);
     fe->has_git_repo_info = 1;
 }
@@ -26,12 +26,19 @@ typedef enum {
  * ============================================================================ */
 
 FileType detect_file_type(const char *path, struct stat *st, char **symlink_target);
+
+/* Same, looking name up relative to the open directory dir_fd (path is
+ * the entry's full path, used to resolve symlink targets) */
+FileType detect_file_type_at(int dir_fd, const char *name, const char *path,
+                             struct stat *st, char **symlink_target);
 const char *get_file_color(FileType type, int is_cwd, int is_ignored, int is_tty, int color_all);
 
 /* ============================================================================
  * Line Counting and Media Parsing
  * ============================================================================ */
 
+/* Count lines and words in one pass - returns 0, or -1 if binary/unreadable */
+int count_file_text(const char *path, int *lines, int *words);
 int count_file_lines(const char *path);
 int count_file_words(const char *path);
 int get_image_megapixels(const char *path);
@@ -74,21 +81,27 @@ typedef struct {
     long total_lines;       /* Total lines (text files only) */
 } TypeStats;
 
-/* Forward declare TreeNode (defined in ui.h) */
-struct TreeNode;
+/* Accumulator for building TypeStats from many files: entries are found
+ * through a hash of the type name instead of a scan */
+#define TYPE_TALLY_SLOTS 256  /* Power of two, more than MAX_TYPE_STATS */
+
+typedef struct {
+    TypeStats stats;
+    unsigned char slots[TYPE_TALLY_SLOTS];  /* Entry index + 1, 0 if free */
+} TypeTally;
 
 /* Initialize empty TypeStats */
 void type_stats_init(TypeStats *stats);
 
-/* Add a file to type statistics */
-void type_stats_add(TypeStats *stats, const char *type_name,
+/* Initialize an empty tally */
+void type_tally_init(TypeTally *tally);
+
+/* Add a file to a tally */
+void type_tally_add(TypeTally *tally, const char *type_name,
                     int lines, ContentType content_type);
 
-/* Compute type stats from a tree node recursively.
- * NOTE: Tree must be fully expanded (use max_depth = L_MAX_DEPTH). */
-void type_stats_from_tree(TypeStats *stats, const struct TreeNode *node,
-                          const FileTypes *ft, const Shebangs *sb,
-                          int show_hidden);
+/* Add every type counted in src to dst */
+void type_tally_merge(TypeTally *dst, const TypeTally *src);
 
 /* Sort type stats by line count descending (text files first) */
 void type_stats_sort(TypeStats *stats);
@@ -99,16 +112,8 @@ void type_stats_sort(TypeStats *stats);
 
 #include "git.h"
 
-/* Compute type statistics for a directory.
- * Populates fe->type_stats and sets fe->has_type_stats = 1.
- * Requires: node is a fully-expanded directory tree. */
-void fileinfo_compute_type_stats(struct FileEntry *fe, const struct TreeNode *node,
-                                  const FileTypes *ft, const Shebangs *sb,
-                                  int show_hidden);
-
 /* Compute git repository info for a git root.
- * Populates fe->branch, fe->tag, fe->remote, fe->short_hash, fe->commit_count,
- * fe->has_upstream, fe->out_of_sync, fe->repo_status, and sets fe->has_git_repo_info = 1.
+ * Fills in every field of fe->repo (allocating it) and sets fe->has_git_repo_info = 1.
  * Requires: fe->is_git_root is true. */
 void fileinfo_compute_git_repo_info(struct FileEntry *fe, GitCache *git);
 
@@ -3,7 +3,12 @@
  */
 
 #include "git.h"
+#include "cache.h"
+#include "gitdiff.h"
+#include "profile.h"
 #include <ctype.h>
+#include <time.h>
+#include <zlib.h>
 
 #ifdef HAVE_LIBGIT2
 #include <git2.h>
@@ -15,12 +20,18 @@
 #define TOSTRING(x) STRINGIFY(x)
 #define SCANF_PATH "%" TOSTRING(PATH_SCANF_WIDTH) "[^\n]"
 
+static void git_dirs_clear(GitCache *cache);
+
 /* ============================================================================
  * GitCache Functions
  * ============================================================================ */
 
 void git_cache_init(GitCache *cache) {
     memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->dirs = NULL;
+    cache->dir_capacity = 0;
+    cache->dir_count = 0;
+    cache->dirs_valid = 0;
 #ifdef _OPENMP
     omp_init_lock(&cache->lock);
 #endif
@@ -37,27 +48,20 @@ void git_cache_free(GitCache *cache) {
         }
         cache->buckets[i] = NULL;
     }
+    git_dirs_clear(cache);
 #ifdef _OPENMP
     omp_destroy_lock(&cache->lock);
 #endif
 }
 
-void git_cache_add(GitCache *cache, const char *path, const char *status) {
+/* Insert a status entry unless present - caller holds the lock */
+static void git_cache_insert(GitCache *cache, const char *path, const char *status) {
     unsigned int h = hash_string(path);
 
-#ifdef _OPENMP
-    omp_set_lock(&cache->lock);
-#endif
-
     /* Check if already exists - skip duplicates */
     GitStatusNode *existing = cache->buckets[h];
     while (existing) {
-        if (strcmp(existing->path, path) == 0) {
-#ifdef _OPENMP
-            omp_unset_lock(&cache->lock);
-#endif
-            return;  /* Already in cache */
-        }
+        if (strcmp(existing->path, path) == 0) return;  /* Already in cache */
         existing = existing->next;
     }
 
@@ -69,6 +73,15 @@ void git_cache_add(GitCache *cache, const char *path, const char *status) {
     node->lines_removed = 0;
     node->next = cache->buckets[h];
     cache->buckets[h] = node;
+    cache->dirs_valid = 0;
+}
+
+void git_cache_add(GitCache *cache, const char *path, const char *status) {
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#endif
+
+    git_cache_insert(cache, path, status);
 
 #ifdef _OPENMP
     omp_unset_lock(&cache->lock);
@@ -111,6 +124,25 @@ GitStatusNode *git_cache_get_node(GitCache *cache, const char *path) {
     return NULL;
 }
 
+int git_cache_copy(GitCache *cache, const char *path, char status[3],
+                   int *added, int *removed) {
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#endif
+
+    GitStatusNode *node = git_cache_get_node(cache, path);
+    if (node) {
+        memcpy(status, node->status, 3);
+        *added = node->lines_added;
+        *removed = node->lines_removed;
+    }
+
+#ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+#endif
+    return node != NULL;
+}
+
 void git_cache_set_diff(GitCache *cache, const char *path, int added, int removed) {
 #ifdef _OPENMP
     omp_set_lock(&cache->lock);
@@ -120,6 +152,7 @@ void git_cache_set_diff(GitCache *cache, const char *path, int added, int remove
     if (node) {
         node->lines_added = added;
         node->lines_removed = removed;
+        cache->dirs_valid = 0;
     }
 
 #ifdef _OPENMP
@@ -127,142 +160,237 @@ void git_cache_set_diff(GitCache *cache, const char *path, int added, int remove
 #endif
 }
 
-GitSummary git_get_dir_summary(GitCache *cache, const char *dir_path) {
-    GitSummary summary = {0, 0, 0, 0};
-    size_t dir_len = strlen(dir_path);
+/* ============================================================================
+ * Directory Index
+ *
+ * Directory queries used to scan every status node per call, which made
+ * output O(directories x entries). Instead, each status node is folded into
+ * all of its ancestor directories once, and queries become a hash lookup.
+ * Keys are the path up to each '/', so "/a/b/c" contributes to "", "/a" and
+ * "/a/b", matching the old prefix test (path[dir_len] == '/').
+ * ============================================================================ */
 
-    /* Iterate through all buckets */
-    for (int i = 0; i < L_HASH_SIZE; i++) {
-        GitStatusNode *node = cache->buckets[i];
-        while (node) {
-            /* Check if this path is under dir_path */
-            if (strncmp(node->path, dir_path, dir_len) == 0 &&
-                node->path[dir_len] == '/') {
-                const char *status = node->status;
-                if (strcmp(status, "!!") == 0) {
-                    /* Ignored - skip */
-                } else if (strcmp(status, "??") == 0) {
-                    summary.untracked++;
-                } else {
-                    /* Check staged (index) and working tree separately */
-                    if (status[0] != ' ' && status[0] != '?' && status[0] != '!') {
-                        summary.staged++;
-                    }
-                    if (status[1] == 'M') {
-                        summary.modified++;
-                    } else if (status[1] == 'D') {
-                        summary.deleted++;
-                    }
-                }
-            }
-            node = node->next;
+#define GIT_DIR_INITIAL_CAPACITY 1024
+
+static void git_summary_add(GitSummary *summary, const char *status) {
+    if (strcmp(status, "!!") == 0) {
+        /* Ignored - skip */
+    } else if (strcmp(status, "??") == 0) {
+        summary->untracked++;
+    } else {
+        /* Check staged (index) and working tree separately */
+        if (status[0] != ' ' && status[0] != '?' && status[0] != '!') {
+            summary->staged++;
+        }
+        if (status[1] == 'M') {
+            summary->modified++;
+        } else if (status[1] == 'D') {
+            summary->deleted++;
         }
     }
-    return summary;
 }
 
-/* Internal: walk deleted entries under dir_path, accumulating count or lines */
-static int git_walk_deleted(GitCache *cache, const char *dir_path,
-                            int count_files, int direct_only) {
-    if (!cache) return 0;
+static void git_dirs_clear(GitCache *cache) {
+    for (size_t i = 0; i < cache->dir_capacity; i++) {
+        GitDirAggregate *dir = cache->dirs[i];
+        while (dir) {
+            GitDirAggregate *next = dir->next;
+            free(dir->path);
+            free(dir);
+            dir = next;
+        }
+    }
+    free(cache->dirs);
+    cache->dirs = NULL;
+    cache->dir_capacity = 0;
+    cache->dir_count = 0;
+    cache->dirs_valid = 0;
+}
 
-    int result = 0;
-    size_t dir_len = strlen(dir_path);
+static void git_dirs_grow(GitCache *cache) {
+    size_t new_cap = cache->dir_capacity * 2;
+    GitDirAggregate **dirs = xmalloc(new_cap * sizeof(GitDirAggregate *));
+    memset(dirs, 0, new_cap * sizeof(GitDirAggregate *));
+    for (size_t i = 0; i < cache->dir_capacity; i++) {
+        GitDirAggregate *dir = cache->dirs[i];
+        while (dir) {
+            GitDirAggregate *next = dir->next;
+            size_t slot = dir->hash & (new_cap - 1);
+            dir->next = dirs[slot];
+            dirs[slot] = dir;
+            dir = next;
+        }
+    }
+    free(cache->dirs);
+    cache->dirs = dirs;
+    cache->dir_capacity = new_cap;
+}
+
+static GitDirAggregate *git_dirs_find(GitCache *cache, const char *path,
+                                      size_t len, uint64_t hash) {
+    if (!cache->dirs) return NULL;
+    GitDirAggregate *dir = cache->dirs[hash & (cache->dir_capacity - 1)];
+    while (dir) {
+        if (dir->hash == hash && strncmp(dir->path, path, len) == 0 &&
+            dir->path[len] == '\0') {
+            return dir;
+        }
+        dir = dir->next;
+    }
+    return NULL;
+}
+
+/* Find or create the aggregate for the first len bytes of path */
+static GitDirAggregate *git_dirs_get(GitCache *cache, const char *path,
+                                     size_t len, uint64_t hash) {
+    GitDirAggregate *dir = git_dirs_find(cache, path, len, hash);
+    if (dir) return dir;
+
+    if (cache->dir_count >= cache->dir_capacity) git_dirs_grow(cache);
+
+    dir = xmalloc(sizeof(GitDirAggregate));
+    memset(dir, 0, sizeof(GitDirAggregate));
+    dir->path = xmalloc(len + 1);
+    memcpy(dir->path, path, len);
+    dir->path[len] = '\0';
+    dir->hash = hash;
+    size_t slot = hash & (cache->dir_capacity - 1);
+    dir->next = cache->dirs[slot];
+    cache->dirs[slot] = dir;
+    cache->dir_count++;
+    return dir;
+}
+
+static void git_dirs_build(GitCache *cache) {
+    git_dirs_clear(cache);
+    cache->dir_capacity = GIT_DIR_INITIAL_CAPACITY;
+    cache->dirs = xmalloc(cache->dir_capacity * sizeof(GitDirAggregate *));
+    memset(cache->dirs, 0, cache->dir_capacity * sizeof(GitDirAggregate *));
 
     for (int i = 0; i < L_HASH_SIZE; i++) {
-        GitStatusNode *node = cache->buckets[i];
-        while (node) {
-            if (node->status[1] == 'D' &&
-                strncmp(node->path, dir_path, dir_len) == 0 &&
-                node->path[dir_len] == '/') {
-                /* If direct_only, skip nested paths */
-                if (!direct_only || strchr(node->path + dir_len + 1, '/') == NULL) {
-                    result += count_files ? 1 : node->lines_removed;
+        for (GitStatusNode *node = cache->buckets[i]; node; node = node->next) {
+            const char *path = node->path;
+            const char *last = strrchr(path, '/');
+            if (!last) continue;
+
+            const char *filename = last + 1;
+            int deleted = (node->status[1] == 'D');
+
+            /* FNV-1a over the prefix, extended as we walk (same as hash_string64) */
+            uint64_t hash = 14695981039346656037ULL;
+            const char *p = path;
+            for (const char *slash = strchr(path, '/'); slash;
+                 slash = strchr(slash + 1, '/')) {
+                for (; p < slash; p++) {
+                    hash ^= (unsigned char)*p;
+                    hash *= 1099511628211ULL;
+                }
+                GitDirAggregate *dir = git_dirs_get(cache, path, (size_t)(slash - path), hash);
+                git_summary_add(&dir->summary, node->status);
+                if (deleted) dir->deleted_lines_recursive += node->lines_removed;
+
+                if (slash != last) continue;
+
+                /* Direct child */
+                if (deleted) {
+                    dir->deleted_direct++;
+                    dir->deleted_lines_direct += node->lines_removed;
+                }
+                if (filename[0] == '.') {
+                    git_summary_add(&dir->hidden_summary, node->status);
+                    if (node->status[0] != '\0' && strcmp(node->status, "!!") != 0) {
+                        dir->has_hidden_status = 1;
+                    }
                 }
             }
-            node = node->next;
         }
     }
-    return result;
+    cache->dirs_valid = 1;
+}
+
+/* Copy the aggregate for dir_path into *out (zeroed if the directory has
+ * no status entries). Rebuilds the index first if the cache changed. */
+static void git_dirs_query(GitCache *cache, const char *dir_path, GitDirAggregate *out) {
+    memset(out, 0, sizeof(*out));
+    if (!cache || !dir_path) return;
+
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#endif
+
+    if (!cache->dirs_valid) git_dirs_build(cache);
+    GitDirAggregate *dir = git_dirs_find(cache, dir_path, strlen(dir_path),
+                                         hash_string64(dir_path));
+    if (dir) {
+        *out = *dir;
+        out->path = NULL;
+        out->next = NULL;
+    }
+
+#ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+#endif
+}
+
+GitSummary git_get_dir_summary(GitCache *cache, const char *dir_path) {
+    GitDirAggregate dir;
+    git_dirs_query(cache, dir_path, &dir);
+    return dir.summary;
 }
 
 int git_count_deleted_direct(GitCache *cache, const char *dir_path) {
-    return git_walk_deleted(cache, dir_path, 1, 1);
+    GitDirAggregate dir;
+    git_dirs_query(cache, dir_path, &dir);
+    return dir.deleted_direct;
 }
 
 int git_deleted_lines_direct(GitCache *cache, const char *dir_path) {
-    return git_walk_deleted(cache, dir_path, 0, 1);
+    GitDirAggregate dir;
+    git_dirs_query(cache, dir_path, &dir);
+    return dir.deleted_lines_direct;
 }
 
 int git_deleted_lines_recursive(GitCache *cache, const char *dir_path) {
-    return git_walk_deleted(cache, dir_path, 0, 0);
+    GitDirAggregate dir;
+    git_dirs_query(cache, dir_path, &dir);
+    return dir.deleted_lines_recursive;
 }
 
 int git_dir_has_hidden_status(GitCache *cache, const char *dir_path) {
-    if (!cache || !dir_path) return 0;
-
-    size_t dir_len = strlen(dir_path);
-
-    for (int i = 0; i < L_HASH_SIZE; i++) {
-        GitStatusNode *node = cache->buckets[i];
-        while (node) {
-            /* Check if this is a direct child of dir_path */
-            if (strncmp(node->path, dir_path, dir_len) == 0 &&
-                node->path[dir_len] == '/' &&
-                strchr(node->path + dir_len + 1, '/') == NULL) {
-                /* Get the filename (part after dir_path/) */
-                const char *filename = node->path + dir_len + 1;
-                /* Check if it's hidden and has git status */
-                if (filename[0] == '.' &&
-                    node->status[0] != '\0' &&
-                    strcmp(node->status, "!!") != 0) {
-                    return 1;
-                }
-            }
-            node = node->next;
-        }
-    }
-    return 0;
+    GitDirAggregate dir;
+    git_dirs_query(cache, dir_path, &dir);
+    return dir.has_hidden_status;
 }
 
 GitSummary git_get_hidden_dir_summary(GitCache *cache, const char *dir_path) {
-    GitSummary summary = {0, 0, 0, 0};
-    if (!cache || !dir_path) return summary;
+    GitDirAggregate dir;
+    git_dirs_query(cache, dir_path, &dir);
+    return dir.hidden_summary;
+}
 
-    size_t dir_len = strlen(dir_path);
+void git_diff_bounds(GitCache *cache, int *max_added, int *max_removed) {
+    *max_added = 0;
+    *max_removed = 0;
+    if (!cache) return;
 
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#endif
+
+    /* A directory shows at most the lines of every deleted file below it */
+    int deleted_total = 0;
     for (int i = 0; i < L_HASH_SIZE; i++) {
-        GitStatusNode *node = cache->buckets[i];
-        while (node) {
-            /* Check if this is a direct child of dir_path */
-            if (strncmp(node->path, dir_path, dir_len) == 0 &&
-                node->path[dir_len] == '/' &&
-                strchr(node->path + dir_len + 1, '/') == NULL) {
-                /* Get the filename (part after dir_path/) */
-                const char *filename = node->path + dir_len + 1;
-                /* Only count hidden files */
-                if (filename[0] == '.') {
-                    const char *status = node->status;
-                    if (strcmp(status, "!!") == 0) {
-                        /* Ignored - skip */
-                    } else if (strcmp(status, "??") == 0) {
-                        summary.untracked++;
-                    } else {
-                        if (status[0] != ' ' && status[0] != '?' && status[0] != '!') {
-                            summary.staged++;
-                        }
-                        if (status[1] == 'M') {
-                            summary.modified++;
-                        } else if (status[1] == 'D') {
-                            summary.deleted++;
-                        }
-                    }
-                }
-            }
-            node = node->next;
+        for (GitStatusNode *node = cache->buckets[i]; node; node = node->next) {
+            if (node->lines_added > *max_added) *max_added = node->lines_added;
+            if (node->lines_removed > *max_removed) *max_removed = node->lines_removed;
+            if (node->status[1] == 'D') deleted_total += node->lines_removed;
         }
     }
-    return summary;
+    if (deleted_total > *max_removed) *max_removed = deleted_total;
+
+#ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+#endif
 }
 
 int git_path_in_ignored(GitCache *cache, const char *path, const char *git_root) {
@@ -293,13 +421,81 @@ int git_path_in_ignored(GitCache *cache, const char *path, const char *git_root)
  * Git Branch Functions
  * ============================================================================ */
 
+/* Linked worktrees: .git is a file pointing at .git/worktrees/<name>, and
+ * that directory names the shared one in "commondir" */
+int git_resolve_dirs(const char *repo_path, char *git_dir, size_t git_dir_len,
+                            char *common_dir, size_t common_dir_len) {
+    char git_path[PATH_MAX];
+    snprintf(git_path, sizeof(git_path), "%s/.git", repo_path);
+
+    /* Check if .git is a file (worktree/submodule) or directory (normal repo) */
+    struct stat st;
+    if (stat(git_path, &st) != 0) return 0;
+
+    if (S_ISREG(st.st_mode)) {
+        /* .git is a file containing "gitdir: <path>", relative to the repo */
+        FILE *gf = fopen(git_path, "r");
+        if (!gf) return 0;
+
+        char buf[PATH_MAX];
+        char *gitdir = NULL;
+        if (fgets(buf, sizeof(buf), gf)) {
+            const char *prefix = "gitdir: ";
+            if (strncmp(buf, prefix, strlen(prefix)) == 0) {
+                gitdir = buf + strlen(prefix);
+                gitdir[strcspn(gitdir, "\r\n")] = '\0';
+            }
+        }
+        fclose(gf);
+        if (!gitdir || !gitdir[0]) return 0;
+
+        if (gitdir[0] == '/')
+            snprintf(git_dir, git_dir_len, "%s", gitdir);
+        else
+            path_join(git_dir, git_dir_len, repo_path, gitdir);
+    } else {
+        snprintf(git_dir, git_dir_len, "%s", git_path);
+    }
+
+    snprintf(common_dir, common_dir_len, "%s", git_dir);
+
+    char commondir_path[PATH_MAX];
+    path_join(commondir_path, sizeof(commondir_path), git_dir, "commondir");
+    FILE *cf = fopen(commondir_path, "r");
+    if (cf) {
+        char buf[PATH_MAX];
+        if (fgets(buf, sizeof(buf), cf)) {
+            buf[strcspn(buf, "\r\n")] = '\0';
+            if (buf[0] == '/')
+                snprintf(common_dir, common_dir_len, "%s", buf);
+            else if (buf[0])
+                path_join(common_dir, common_dir_len, git_dir, buf);
+        }
+        fclose(cf);
+    }
+    return 1;
+}
+
+/* Check for a full hex object id (SHA-1 or SHA-256) */
+static int git_is_hash(const char *s) {
+    size_t len = 0;
+    while (isxdigit((unsigned char)s[len])) len++;
+    return s[len] == '\0' && (len == 40 || len == 64);
+}
+
 int git_read_ref(const char *repo_path, const char *ref_name, char *hash, size_t hash_len) {
+    char git_dir[PATH_MAX], common_dir[PATH_MAX];
     char ref_path[PATH_MAX];
     char line[256];
     hash[0] = '\0';
 
+    if (!git_resolve_dirs(repo_path, git_dir, sizeof(git_dir),
+                          common_dir, sizeof(common_dir))) {
+        return 0;
+    }
+
     /* Try loose ref file first */
-    snprintf(ref_path, sizeof(ref_path), "%s/.git/%s", repo_path, ref_name);
+    path_join(ref_path, sizeof(ref_path), common_dir, ref_name);
     FILE *f = fopen(ref_path, "r");
     if (f) {
         if (fgets(hash, hash_len, f)) {
@@ -311,7 +507,7 @@ int git_read_ref(const char *repo_path, const char *ref_name, char *hash, size_t
     }
 
     /* Fall back to packed-refs */
-    snprintf(ref_path, sizeof(ref_path), "%s/.git/packed-refs", repo_path);
+    path_join(ref_path, sizeof(ref_path), common_dir, "packed-refs");
     f = fopen(ref_path, "r");
     if (!f) return 0;
 
@@ -335,62 +531,220 @@ int git_read_ref(const char *repo_path, const char *ref_name, char *hash, size_t
     return 0;
 }
 
-char *git_get_branch(const char *repo_path) {
-    char git_path[PATH_MAX];
+/* Read the first line of HEAD into buf (newline stripped) */
+static int git_read_head_line(const char *repo_path, char *buf, size_t len) {
+    char git_dir[PATH_MAX], common_dir[PATH_MAX];
+    if (!git_resolve_dirs(repo_path, git_dir, sizeof(git_dir),
+                          common_dir, sizeof(common_dir))) {
+        return 0;
+    }
+
     char head_path[PATH_MAX];
-    snprintf(git_path, sizeof(git_path), "%s/.git", repo_path);
+    path_join(head_path, sizeof(head_path), git_dir, "HEAD");
+    FILE *f = fopen(head_path, "r");
+    if (!f) return 0;
 
-    /* Check if .git is a file (worktree) or directory (normal repo) */
-    struct stat st;
-    if (stat(git_path, &st) != 0) return NULL;
+    int ok = fgets(buf, (int)len, f) != NULL;
+    fclose(f);
+    if (ok) buf[strcspn(buf, "\r\n")] = '\0';
+    return ok && buf[0];
+}
 
-    if (S_ISREG(st.st_mode)) {
-        /* Worktree: .git is a file containing "gitdir: /path/to/git/dir" */
-        FILE *gf = fopen(git_path, "r");
-        if (!gf) return NULL;
+int git_read_head(const char *repo_path, char *hash, size_t hash_len) {
+    char buf[L_GIT_HEAD_BUF_SIZE];
+    hash[0] = '\0';
+    if (!git_read_head_line(repo_path, buf, sizeof(buf))) return 0;
 
-        char gitdir_buf[PATH_MAX];
-        char *gitdir = NULL;
-        if (fgets(gitdir_buf, sizeof(gitdir_buf), gf)) {
-            const char *prefix = "gitdir: ";
-            if (strncmp(gitdir_buf, prefix, strlen(prefix)) == 0) {
-                gitdir = gitdir_buf + strlen(prefix);
-                size_t len = strlen(gitdir);
-                if (len > 0 && gitdir[len - 1] == '\n') gitdir[len - 1] = '\0';
-            }
+    const char *prefix = "ref: ";
+    if (strncmp(buf, prefix, strlen(prefix)) == 0) {
+        if (!git_read_ref(repo_path, buf + strlen(prefix), hash, hash_len)) return 0;
+    } else {
+        snprintf(hash, hash_len, "%s", buf);
+    }
+    return git_is_hash(hash);
+}
+
+char *git_get_branch(const char *repo_path) {
+    char buf[L_GIT_HEAD_BUF_SIZE];
+    if (!git_read_head_line(repo_path, buf, sizeof(buf))) return NULL;
+
+    /* Format: "ref: refs/heads/branch-name" */
+    const char *prefix = "ref: refs/heads/";
+    if (strncmp(buf, prefix, strlen(prefix)) == 0) {
+        return xstrdup(buf + strlen(prefix));
+    }
+    /* Detached HEAD - show short hash */
+    if (strlen(buf) > 7) buf[7] = '\0';
+    return xstrdup(buf);
+}
+
+/* ============================================================================
+ * Revision Walks
+ *
+ * Commit counts and describe output depend only on history, so results are
+ * kept in the revision cache keyed by commit hash. With libgit2 the walks run
+ * in-process; otherwise a single git process is spawned on a cache miss.
+ * ============================================================================ */
+
+#ifdef HAVE_LIBGIT2
+
+static long git_rev_count_uncached(const char *repo_path, const char *hide, const char *push) {
+    git_repository *repo = NULL;
+    git_revwalk *walk = NULL;
+    git_oid oid;
+    long count = -1;
+
+    if (git_repository_open(&repo, repo_path) != 0) return -1;
+    if (git_revwalk_new(&walk, repo) == 0 &&
+        git_oid_fromstr(&oid, push) == 0 && git_revwalk_push(walk, &oid) == 0) {
+        if (!hide || (git_oid_fromstr(&oid, hide) == 0 && git_revwalk_hide(walk, &oid) == 0)) {
+            count = 0;
+            while (git_revwalk_next(&oid, walk) == 0) count++;
         }
-        fclose(gf);
-        if (!gitdir) return NULL;
+    }
+    git_revwalk_free(walk);
+    git_repository_free(repo);
+    return count;
+}
 
-        snprintf(head_path, sizeof(head_path), "%s/HEAD", gitdir);
-    } else {
-        /* Normal repo: .git is a directory */
-        snprintf(head_path, sizeof(head_path), "%s/.git/HEAD", repo_path);
+static int git_describe_uncached(const char *repo_path, char *out, size_t out_len) {
+    git_repository *repo = NULL;
+    git_object *head = NULL;
+    git_describe_result *result = NULL;
+    git_buf buf = {0};
+    int ok = 0;
+
+    out[0] = '\0';
+    if (git_repository_open(&repo, repo_path) != 0) return 0;
+
+    git_describe_options opts = GIT_DESCRIBE_OPTIONS_INIT;
+    opts.describe_strategy = GIT_DESCRIBE_TAGS;
+    git_describe_format_options fmt = GIT_DESCRIBE_FORMAT_OPTIONS_INIT;
+
+    if (git_revparse_single(&head, repo, "HEAD") == 0) {
+        /* No reachable tag is an answer too (empty output), not a failure */
+        ok = 1;
+        if (git_describe_commit(&result, head, &opts) == 0 &&
+            git_describe_format(&buf, result, &fmt) == 0) {
+            snprintf(out, out_len, "%s", buf.ptr);
+        }
     }
+    git_buf_dispose(&buf);
+    git_describe_result_free(result);
+    git_object_free(head);
+    git_repository_free(repo);
+    return ok;
+}
 
-    FILE *f = fopen(head_path, "r");
-    if (!f) return NULL;
+#else
 
-    char buf[L_GIT_HEAD_BUF_SIZE];
-    char *branch = NULL;
-    if (fgets(buf, sizeof(buf), f)) {
-        /* Format: "ref: refs/heads/branch-name\n" */
-        const char *prefix = "ref: refs/heads/";
-        if (strncmp(buf, prefix, strlen(prefix)) == 0) {
-            char *start = buf + strlen(prefix);
-            size_t len = strlen(start);
-            if (len > 0 && start[len - 1] == '\n') start[len - 1] = '\0';
-            branch = xstrdup(start);
+/* Run a git command in repo_path and read the first output line */
+static int git_read_command(const char *repo_path, const char *args, char *out, size_t out_len) {
+    out[0] = '\0';
+    char *escaped = shell_escape(repo_path);
+    if (!escaped) return 0;
+
+    char cmd[L_SHELL_CMD_BUF_SIZE];
+    snprintf(cmd, sizeof(cmd), "git -C '%s' %s 2>/dev/null", escaped, args);
+    free(escaped);
+
+    FILE *fp = popen(cmd, "r");
+    if (!fp) return 0;
+    if (fgets(out, (int)out_len, fp)) out[strcspn(out, "\r\n")] = '\0';
+    /* Exit status distinguishes "no tag" from "git failed" */
+    return pclose(fp) == 0;
+}
+
+static long git_rev_count_uncached(const char *repo_path, const char *hide, const char *push) {
+    char args[256];
+    char buf[32];
+    if (hide)
+        snprintf(args, sizeof(args), "rev-list --count %s..%s", hide, push);
+    else
+        snprintf(args, sizeof(args), "rev-list --count %s", push);
+    if (!git_read_command(repo_path, args, buf, sizeof(buf)) || !buf[0]) return -1;
+    return atol(buf);
+}
+
+static int git_describe_uncached(const char *repo_path, char *out, size_t out_len) {
+    git_read_command(repo_path, "describe --tags", out, out_len);
+    /* Fails when no tag is reachable; only an unreadable HEAD is an error */
+    return 1;
+}
+
+#endif /* HAVE_LIBGIT2 */
+
+long git_count_commits(const char *repo_path, const char *exclude, const char *rev) {
+    if (!rev || !git_is_hash(rev) || (exclude && !git_is_hash(exclude))) return -1;
+
+    char key[160];
+    if (exclude)
+        snprintf(key, sizeof(key), "count:%s..%s", exclude, rev);
+    else
+        snprintf(key, sizeof(key), "count:%s", rev);
+
+    long count;
+    if (rev_cache_lookup(key, &count, NULL, 0)) return count;
+
+    count = git_rev_count_uncached(repo_path, exclude, rev);
+    if (count >= 0) rev_cache_store(key, count, NULL);
+    return count;
+}
+
+/* Fold the tag refs' state into the describe key: a new tag changes the
+ * answer without moving HEAD (loose tags touch refs/tags, packed ones
+ * rewrite packed-refs) */
+static void git_tag_stamp(const char *repo_path, char *stamp, size_t len) {
+    char git_dir[PATH_MAX], common_dir[PATH_MAX], path[PATH_MAX];
+    struct stat st;
+    long long tags = 0, packed = 0;
+
+    if (git_resolve_dirs(repo_path, git_dir, sizeof(git_dir), common_dir, sizeof(common_dir))) {
+        path_join(path, sizeof(path), common_dir, "refs/tags");
+        if (stat(path, &st) == 0) tags = (long long)GET_MTIME_NS(st);
+        path_join(path, sizeof(path), common_dir, "packed-refs");
+        if (stat(path, &st) == 0) packed = (long long)GET_MTIME_NS(st) ^ (long long)st.st_size;
+    }
+    snprintf(stamp, len, "%llx.%llx", tags, packed);
+}
+
+char *git_get_latest_tag(const char *repo_path, int *distance) {
+    if (distance) *distance = 0;
+
+    char head[80];
+    if (!git_read_head(repo_path, head, sizeof(head))) return NULL;
+
+    char stamp[64];
+    git_tag_stamp(repo_path, stamp, sizeof(stamp));
+    char key[192];
+    snprintf(key, sizeof(key), "describe:%s:%s", head, stamp);
+
+    char buf[256];
+    long unused;
+    if (!rev_cache_lookup(key, &unused, buf, sizeof(buf))) {
+        if (!git_describe_uncached(repo_path, buf, sizeof(buf))) return NULL;
+        rev_cache_store(key, 0, buf);
+    }
+    if (!buf[0]) return NULL;
+
+    /* Format: tag-name or tag-name-N-gHASH */
+    char *last_dash = strrchr(buf, '-');
+    if (last_dash && last_dash > buf && last_dash[1] == 'g') {
+        /* Looks like -gHASH suffix, find the distance before it */
+        *last_dash = '\0';
+        char *second_last = strrchr(buf, '-');
+        char *endptr = NULL;
+        long dist = second_last && second_last > buf
+            ? strtol(second_last + 1, &endptr, 10) : 0;
+        if (endptr && *endptr == '\0' && dist > 0) {
+            if (distance) *distance = (int)dist;
+            *second_last = '\0';
         } else {
-            /* Detached HEAD - show short hash */
-            size_t len = strlen(buf);
-            if (len > 0 && buf[len - 1] == '\n') buf[len - 1] = '\0';
-            if (len > 7) buf[7] = '\0';  /* Truncate to short hash */
-            branch = xstrdup(buf);
+            /* Not a valid distance, restore */
+            *last_dash = '-';
         }
     }
-    fclose(f);
-    return branch;
+    return xstrdup(buf);
 }
 
 int git_get_branch_info(const char *repo_path, GitBranchInfo *info) {
@@ -405,7 +759,7 @@ int git_get_branch_info(const char *repo_path, GitBranchInfo *info) {
 
     info->branch = branch;
 
-    char local_hash[64], remote_hash[64];
+    char local_hash[80], remote_hash[80];
     char local_ref[128], remote_ref[128];
     snprintf(local_ref, sizeof(local_ref), "refs/heads/%s", branch);
     snprintf(remote_ref, sizeof(remote_ref), "refs/remotes/origin/%s", branch);
@@ -416,51 +770,25 @@ int git_get_branch_info(const char *repo_path, GitBranchInfo *info) {
     if (info->has_upstream) {
         info->out_of_sync = (strcmp(local_hash, remote_hash) != 0);
         if (info->out_of_sync) {
-            char cmd[PATH_MAX + 128];
-            char buf[64];
-            snprintf(cmd, sizeof(cmd),
-                     "git -C '%s' rev-list --count origin/%s..%s 2>/dev/null",
-                     repo_path, branch, branch);
-            FILE *fp = popen(cmd, "r");
-            if (fp) {
-                if (fgets(buf, sizeof(buf), fp))
-                    info->ahead = atoi(buf);
-                pclose(fp);
-            }
-            snprintf(cmd, sizeof(cmd),
-                     "git -C '%s' rev-list --count %s..origin/%s 2>/dev/null",
-                     repo_path, branch, branch);
-            fp = popen(cmd, "r");
-            if (fp) {
-                if (fgets(buf, sizeof(buf), fp))
-                    info->behind = atoi(buf);
-                pclose(fp);
-            }
+            long ahead = git_count_commits(repo_path, remote_hash, local_hash);
+            long behind = git_count_commits(repo_path, local_hash, remote_hash);
+            if (ahead > 0) info->ahead = (int)ahead;
+            if (behind > 0) info->behind = (int)behind;
         }
     }
 
     return 1;
 }
 
-char *git_get_latest_tag(const char *repo_path) {
-    char cmd[PATH_MAX + 64];
-    snprintf(cmd, sizeof(cmd), "git -C '%s' describe --tags --abbrev=0 2>/dev/null", repo_path);
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return NULL;
-
-    char buf[256];
-    char *result = NULL;
-    if (fgets(buf, sizeof(buf), fp)) {
-        buf[strcspn(buf, "\r\n")] = '\0';
-        if (buf[0]) result = xstrdup(buf);
+char *git_get_remote_url(const char *repo_path) {
+    char git_dir[PATH_MAX], common_dir[PATH_MAX];
+    if (!git_resolve_dirs(repo_path, git_dir, sizeof(git_dir),
+                          common_dir, sizeof(common_dir))) {
+        return NULL;
     }
-    pclose(fp);
-    return result;
-}
 
-char *git_get_remote_url(const char *repo_path) {
     char config_path[PATH_MAX];
-    snprintf(config_path, sizeof(config_path), "%s/.git/config", repo_path);
+    path_join(config_path, sizeof(config_path), common_dir, "config");
 
     FILE *f = fopen(config_path, "r");
     if (!f) return NULL;
@@ -529,11 +857,9 @@ char *git_remote_to_web_url(const char *remote) {
 }
 
 /* ============================================================================
- * Shell Escape (for non-libgit2 fallback)
+ * Shell Escape (for git subprocess fallbacks)
  * ============================================================================ */
 
-#ifndef HAVE_LIBGIT2
-
 char *shell_escape(const char *path) {
     /* Count single quotes to determine buffer size */
     size_t quotes = 0;
@@ -567,7 +893,365 @@ char *shell_escape(const char *path) {
     return escaped;
 }
 
-#endif /* !HAVE_LIBGIT2 */
+/* ============================================================================
+ * Diff Stats
+ *
+ * Line counts are only computed for files the status pass reported changed
+ * in the working tree. gitdiff does this in-process and in parallel; results
+ * land in the list and reach the cache under a single lock.
+ * ============================================================================ */
+
+typedef struct {
+    GitDiffStat *items;
+    size_t count;
+    size_t capacity;
+} GitDiffList;
+
+/* Statuses that `git diff --numstat` (index vs working tree) reports */
+static int git_status_has_worktree_diff(const char *status) {
+    return status[1] == 'M' || status[1] == 'D' ||
+           (status[0] == ' ' && status[1] == 'A');  /* Intent-to-add */
+}
+
+static void git_diff_list_add(GitDiffList *list, const char *path, char status) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->items = xrealloc(list->items, list->capacity * sizeof(GitDiffStat));
+    }
+    list->items[list->count++] = (GitDiffStat){xstrdup(path), status, 0, 0, 0};
+}
+
+static void git_diff_list_clear(GitDiffList *list) {
+    for (size_t i = 0; i < list->count; i++)
+        free(list->items[i].path);
+    list->count = 0;
+}
+
+static void git_diff_list_free(GitDiffList *list) {
+    git_diff_list_clear(list);
+    free(list->items);
+    list->items = NULL;
+    list->capacity = 0;
+}
+
+static void git_cache_set_diffs(GitCache *cache, const char *repo_path,
+                                const GitDiffList *list) {
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#endif
+
+    for (size_t i = 0; i < list->count; i++) {
+        const GitDiffStat *stat = &list->items[i];
+        if (!stat->valid) continue;
+        char full_path[PATH_MAX];
+        path_join(full_path, sizeof(full_path), repo_path, stat->path);
+        GitStatusNode *node = git_cache_get_node(cache, full_path);
+        if (node) {
+            node->lines_added = stat->added;
+            node->lines_removed = stat->removed;
+        }
+    }
+    cache->dirs_valid = 0;
+
+#ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+#endif
+}
+
+/* Fallback: replace the list with `git diff --numstat` output */
+static void git_numstat_shell(const char *repo_path, GitDiffList *list) {
+    git_diff_list_clear(list);
+
+    char *escaped = shell_escape(repo_path);
+    if (!escaped) return;
+
+    char cmd[L_SHELL_CMD_BUF_SIZE];
+    snprintf(cmd, sizeof(cmd), "git -C '%s' diff --numstat 2>/dev/null", escaped);
+    free(escaped);
+
+    FILE *fp = popen(cmd, "r");
+    if (!fp) return;
+
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), fp)) {
+        int added, removed;
+        char path[PATH_SCANF_WIDTH + 1];
+
+        /* Binary files show "-" counts and are skipped */
+        if (sscanf(line, "%d\t%d\t" SCANF_PATH, &added, &removed, path) == 3) {
+            git_diff_list_add(list, path, 'M');
+            GitDiffStat *stat = &list->items[list->count - 1];
+            stat->added = added;
+            stat->removed = removed;
+            stat->valid = 1;
+        }
+    }
+    pclose(fp);
+}
+
+static void git_populate_diff_stats(GitCache *cache, const char *repo_path,
+                                    GitDiffList *list) {
+    if (list->count == 0) return;
+    if (gitdiff_numstat(repo_path, list->items, list->count) != 0) {
+        git_numstat_shell(repo_path, list);
+    }
+    git_cache_set_diffs(cache, repo_path, list);
+}
+
+/* ============================================================================
+ * Status Snapshots
+ *
+ * A repo's parsed status is saved to the status cache and replayed on the
+ * next run while nothing it depends on has changed. The stamp covers the
+ * index, HEAD and the ignore/config files. gitdiff_worktree_changed then
+ * checks that no tracked file, and no directory holding an entry, was
+ * touched after the snapshot was taken. That catches edits, creations and
+ * deletions without walking ignored trees.
+ * ============================================================================ */
+
+#define GIT_SNAPSHOT_MAGIC   "LGS1"
+#define GIT_SNAPSHOT_MAX     (16 * 1024 * 1024)  /* Skip saving larger sets */
+
+typedef struct {
+    char *path;                  /* Relative to the repo root, no trailing slash */
+    char status[3];
+} GitSnapEntry;
+
+typedef struct {
+    GitSnapEntry *items;
+    size_t count;
+    size_t capacity;
+} GitSnapshot;
+
+static int git_read_status(const char *repo_path, GitSnapshot *snap);
+
+static void git_snapshot_add(GitSnapshot *snap, const char *path, const char *status) {
+    if (snap->count >= snap->capacity) {
+        snap->capacity = snap->capacity ? snap->capacity * 2 : 256;
+        snap->items = xrealloc(snap->items, snap->capacity * sizeof(GitSnapEntry));
+    }
+    GitSnapEntry *e = &snap->items[snap->count++];
+    e->path = xstrdup(path);
+    size_t len = strlen(e->path);
+    if (len > 0 && e->path[len - 1] == '/') e->path[len - 1] = '\0';
+    e->status[0] = status[0];
+    e->status[1] = status[0] ? status[1] : '\0';
+    e->status[2] = '\0';
+}
+
+static void git_snapshot_free(GitSnapshot *snap) {
+    for (size_t i = 0; i < snap->count; i++)
+        free(snap->items[i].path);
+    free(snap->items);
+    snap->items = NULL;
+    snap->count = snap->capacity = 0;
+}
+
+/* Add every entry to the cache under one lock */
+static void git_snapshot_apply(GitCache *cache, const char *repo_path, const GitSnapshot *snap) {
+#ifdef _OPENMP
+    omp_set_lock(&cache->lock);
+#endif
+
+    for (size_t i = 0; i < snap->count; i++) {
+        char full_path[PATH_MAX];
+        path_join(full_path, sizeof(full_path), repo_path, snap->items[i].path);
+        git_cache_insert(cache, full_path, snap->items[i].status);
+    }
+
+#ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+#endif
+}
+
+/* Everything status reads besides the working tree itself. Returns 0 if
+ * the repo has no index yet (nothing worth caching). */
+static int git_status_stamp(const char *repo_path, char *stamp, size_t len) {
+    char git_dir[PATH_MAX], common_dir[PATH_MAX], path[PATH_MAX];
+    if (!git_resolve_dirs(repo_path, git_dir, sizeof(git_dir), common_dir, sizeof(common_dir)))
+        return 0;
+
+    struct stat st;
+    path_join(path, sizeof(path), git_dir, "index");
+    if (stat(path, &st) != 0) return 0;
+    long long index_mtime = (long long)GET_MTIME_NS(st);
+    long long index_size = (long long)st.st_size;
+
+    char head[80];
+    if (!git_read_head(repo_path, head, sizeof(head))) snprintf(head, sizeof(head), "unborn");
+
+    long long exclude = 0, config = 0, global = 0;
+    path_join(path, sizeof(path), common_dir, "info/exclude");
+    if (stat(path, &st) == 0) exclude = (long long)GET_MTIME_NS(st);
+    path_join(path, sizeof(path), common_dir, "config");
+    if (stat(path, &st) == 0) config = (long long)GET_MTIME_NS(st);
+
+    /* Default core.excludesFile */
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && xdg[0]) snprintf(path, sizeof(path), "%s/git/ignore", xdg);
+    else snprintf(path, sizeof(path), "%s/.config/git/ignore", home ? home : "");
+    if (stat(path, &st) == 0) global = (long long)GET_MTIME_NS(st);
+
+    snprintf(stamp, len, "%s:%llx:%llx:%llx:%llx:%llx",
+             head, index_mtime, index_size, exclude, config, global);
+    return 1;
+}
+
+/* Snapshot time, rounded down a second so coarse filesystem timestamps of
+ * changes made while status runs still compare as "after" */
+static int64_t git_snapshot_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((int64_t)ts.tv_sec - 1) * 1000000000;
+}
+
+/* Serialized form (before compression):
+ *   magic[4] has_diffs[1] entry_count[4] diff_count[4]
+ *   entries: status[2] len[2] path[len]
+ *   diffs:   added[4] removed[4] len[2] path[len] */
+static void git_snapshot_save(const char *repo_path, const char *stamp, int64_t taken_ns,
+                              const GitSnapshot *snap, const GitDiffList *diffs) {
+    size_t raw_len = 4 + 1 + 4 + 4;
+    for (size_t i = 0; i < snap->count; i++)
+        raw_len += 2 + 2 + strlen(snap->items[i].path);
+    size_t diff_count = 0;
+    if (diffs) {
+        for (size_t i = 0; i < diffs->count; i++) {
+            if (!diffs->items[i].valid) continue;
+            raw_len += 4 + 4 + 2 + strlen(diffs->items[i].path);
+            diff_count++;
+        }
+    }
+    if (raw_len > GIT_SNAPSHOT_MAX) return;
+
+    unsigned char *raw = xmalloc(raw_len);
+    unsigned char *p = raw;
+    uint32_t n32 = (uint32_t)snap->count, d32 = (uint32_t)diff_count;
+    memcpy(p, GIT_SNAPSHOT_MAGIC, 4); p += 4;
+    *p++ = diffs ? 1 : 0;
+    memcpy(p, &n32, 4); p += 4;
+    memcpy(p, &d32, 4); p += 4;
+    for (size_t i = 0; i < snap->count; i++) {
+        uint16_t len = (uint16_t)strlen(snap->items[i].path);
+        memcpy(p, snap->items[i].status, 2); p += 2;
+        memcpy(p, &len, 2); p += 2;
+        memcpy(p, snap->items[i].path, len); p += len;
+    }
+    for (size_t i = 0; diffs && i < diffs->count; i++) {
+        const GitDiffStat *d = &diffs->items[i];
+        if (!d->valid) continue;
+        int32_t added = d->added, removed = d->removed;
+        uint16_t len = (uint16_t)strlen(d->path);
+        memcpy(p, &added, 4); p += 4;
+        memcpy(p, &removed, 4); p += 4;
+        memcpy(p, &len, 2); p += 2;
+        memcpy(p, d->path, len); p += len;
+    }
+
+    /* Stored as raw length + zlib stream; paths compress well */
+    uLongf packed_len = compressBound((uLong)raw_len);
+    unsigned char *packed = xmalloc(4 + packed_len);
+    uint32_t r32 = (uint32_t)raw_len;
+    memcpy(packed, &r32, 4);
+    if (compress2(packed + 4, &packed_len, raw, (uLong)raw_len, 1) == Z_OK) {
+        status_cache_store(repo_path, stamp, taken_ns, packed, 4 + packed_len);
+    }
+    free(packed);
+    free(raw);
+}
+
+/* Decode a saved snapshot. Returns 1 on success */
+static int git_snapshot_decode(const unsigned char *blob, size_t blob_len,
+                               GitSnapshot *snap, GitDiffList *diffs, int *has_diffs) {
+    uint32_t raw32;
+    if (blob_len < 4) return 0;
+    memcpy(&raw32, blob, 4);
+    if (raw32 < 13 || raw32 > GIT_SNAPSHOT_MAX) return 0;
+
+    uLongf raw_len = raw32;
+    unsigned char *raw = xmalloc(raw_len);
+    if (uncompress(raw, &raw_len, blob + 4, (uLong)(blob_len - 4)) != Z_OK ||
+        raw_len != raw32 || memcmp(raw, GIT_SNAPSHOT_MAGIC, 4) != 0) {
+        free(raw);
+        return 0;
+    }
+
+    const unsigned char *p = raw + 4, *end = raw + raw_len;
+    uint32_t n32, d32;
+    *has_diffs = *p++;
+    memcpy(&n32, p, 4); p += 4;
+    memcpy(&d32, p, 4); p += 4;
+
+    char path[PATH_MAX];
+    for (uint32_t i = 0; i < n32; i++) {
+        uint16_t len;
+        if (end - p < 4) goto fail;
+        char status[3] = {(char)p[0], (char)p[1], '\0'};
+        memcpy(&len, p + 2, 2);
+        p += 4;
+        if ((size_t)(end - p) < len || len >= sizeof(path)) goto fail;
+        memcpy(path, p, len);
+        path[len] = '\0';
+        p += len;
+        git_snapshot_add(snap, path, status);
+    }
+    for (uint32_t i = 0; i < d32; i++) {
+        int32_t added, removed;
+        uint16_t len;
+        if (end - p < 10) goto fail;
+        memcpy(&added, p, 4);
+        memcpy(&removed, p + 4, 4);
+        memcpy(&len, p + 8, 2);
+        p += 10;
+        if ((size_t)(end - p) < len || len >= sizeof(path)) goto fail;
+        memcpy(path, p, len);
+        path[len] = '\0';
+        p += len;
+        git_diff_list_add(diffs, path, 'M');
+        GitDiffStat *d = &diffs->items[diffs->count - 1];
+        d->added = added;
+        d->removed = removed;
+        d->valid = 1;
+    }
+    free(raw);
+    return 1;
+
+fail:
+    free(raw);
+    return 0;
+}
+
+/* Replay a saved snapshot if it's still valid. Returns 1 if used */
+static int git_snapshot_restore(GitCache *cache, const char *repo_path, const char *stamp,
+                                int include_diff_stats) {
+    void *blob = NULL;
+    size_t blob_len = 0;
+    int64_t taken_ns = 0;
+    if (!status_cache_lookup(repo_path, stamp, &taken_ns, &blob, &blob_len)) return 0;
+
+    GitSnapshot snap = {NULL, 0, 0};
+    GitDiffList diffs = {NULL, 0, 0};
+    int has_diffs = 0;
+    int ok = git_snapshot_decode(blob, blob_len, &snap, &diffs, &has_diffs) &&
+             (has_diffs || !include_diff_stats);
+    free(blob);
+
+    if (ok) {
+        const char **paths = xmalloc((snap.count ? snap.count : 1) * sizeof(char *));
+        for (size_t i = 0; i < snap.count; i++) paths[i] = snap.items[i].path;
+        ok = !gitdiff_worktree_changed(repo_path, taken_ns, paths, snap.count);
+        free(paths);
+    }
+    if (ok) {
+        git_snapshot_apply(cache, repo_path, &snap);
+        if (include_diff_stats) git_cache_set_diffs(cache, repo_path, &diffs);
+    }
+
+    git_snapshot_free(&snap);
+    git_diff_list_free(&diffs);
+    return ok;
+}
 
 /* ============================================================================
  * Git Repository Functions
@@ -601,37 +1285,13 @@ int git_find_root(const char *path, char *root, size_t root_len) {
     return workdir != NULL;
 }
 
-/* Shell-based diff stats (faster than libgit2's patch-based approach) */
-static void git_populate_diff_stats_shell(GitCache *cache, const char *repo_path) {
-    char cmd[L_SHELL_CMD_BUF_SIZE];
-    char line[PATH_MAX + 64];
-
-    snprintf(cmd, sizeof(cmd),
-             "git -C '%s' diff --numstat 2>/dev/null", repo_path);
-
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return;
-
-    while (fgets(line, sizeof(line), fp)) {
-        int added, removed;
-        char path[PATH_SCANF_WIDTH + 1];
-
-        if (sscanf(line, "%d\t%d\t" SCANF_PATH, &added, &removed, path) == 3) {
-            char full_path[PATH_MAX];
-            path_join(full_path, sizeof(full_path), repo_path, path);
-            git_cache_set_diff(cache, full_path, added, removed);
-        }
-    }
-    pclose(fp);
-}
-
-void git_populate_repo(GitCache *cache, const char *repo_path, int include_diff_stats) {
+static int git_read_status(const char *repo_path, GitSnapshot *snap) {
     git_repository *repo = NULL;
     git_status_list *status_list = NULL;
     git_status_options opts = {0};
     opts.version = GIT_STATUS_OPTIONS_VERSION;
 
-    if (git_repository_open(&repo, repo_path) != 0) return;
+    if (git_repository_open(&repo, repo_path) != 0) return 0;
 
     /* Match behavior of: git status --porcelain -uall --ignored=matching */
     opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
@@ -642,7 +1302,7 @@ void git_populate_repo(GitCache *cache, const char *repo_path, int include_diff_
 
     if (git_status_list_new(&status_list, repo, &opts) != 0) {
         git_repository_free(repo);
-        return;
+        return 0;
     }
 
     size_t count = git_status_list_entrycount(status_list);
@@ -686,37 +1346,24 @@ void git_populate_repo(GitCache *cache, const char *repo_path, int include_diff_
             status[1] = '?';
         }
 
-        /* Build absolute path and remove trailing slash (directories end with /) */
-        char full_path[PATH_MAX];
-        path_join(full_path, sizeof(full_path), repo_path, path);
-        size_t len = strlen(full_path);
-        if (len > 0 && full_path[len - 1] == '/') full_path[len - 1] = '\0';
-
-        git_cache_add(cache, full_path, status);
+        git_snapshot_add(snap, path, status);
     }
 
     git_status_list_free(status_list);
     git_repository_free(repo);
-
-    /* Use shell for diff stats (faster than libgit2's patch iteration) */
-    if (include_diff_stats) {
-        git_populate_diff_stats_shell(cache, repo_path);
-    }
+    return 1;
 }
 
 #else
 
 /* Fallback: shell out to git command */
 
-static void git_parse_status_output(FILE *fp, GitCache *cache, const char *repo_path) {
+static void git_parse_status_output(FILE *fp, GitSnapshot *snap) {
     char line[PATH_MAX + 8];
     while (fgets(line, sizeof(line), fp)) {
         size_t len = strlen(line);
         if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
 
-        /* Stop at separator (used when combining with diff --numstat) */
-        if (strcmp(line, "---") == 0) break;
-
         if (len < 4) continue;  /* Need at least "XY path" */
 
         char status[3] = {line[0], line[1], '\0'};
@@ -726,13 +1373,7 @@ static void git_parse_status_output(FILE *fp, GitCache *cache, const char *repo_
         const char *arrow = strstr(path, " -> ");
         if (arrow) path = arrow + 4;
 
-        /* Build absolute path and remove trailing slash (directories from git end with /) */
-        char full_path[PATH_MAX];
-        path_join(full_path, sizeof(full_path), repo_path, path);
-        len = strlen(full_path);
-        if (len > 0 && full_path[len - 1] == '/') full_path[len - 1] = '\0';
-
-        git_cache_add(cache, full_path, status);
+        git_snapshot_add(snap, path, status);
     }
 }
 
@@ -757,47 +1398,58 @@ int git_find_root(const char *path, char *root, size_t root_len) {
     return found;
 }
 
-void git_populate_repo(GitCache *cache, const char *repo_path, int include_diff_stats) {
+static int git_read_status(const char *repo_path, GitSnapshot *snap) {
     char *escaped = shell_escape(repo_path);
-    if (!escaped) return;  /* Path too long or malformed */
+    if (!escaped) return 0;  /* Path too long or malformed */
 
     char cmd[L_SHELL_CMD_BUF_SIZE];
+    snprintf(cmd, sizeof(cmd),
+             "git -C '%s' status --porcelain -uall --ignored=matching 2>/dev/null", escaped);
+    free(escaped);
 
-    /* Combine status and diff in one subprocess when diff stats needed:
-     * Use --- separator to distinguish the two outputs */
-    if (include_diff_stats) {
-        snprintf(cmd, sizeof(cmd),
-                 "git -C '%s' status --porcelain -uall --ignored=matching 2>/dev/null && "
-                 "echo '---' && "
-                 "git -C '%s' diff --numstat 2>/dev/null", escaped, escaped);
-    } else {
-        snprintf(cmd, sizeof(cmd),
-                 "git -C '%s' status --porcelain -uall --ignored=matching 2>/dev/null", escaped);
+    FILE *fp = popen(cmd, "r");
+    if (!fp) return 0;
+    git_parse_status_output(fp, snap);
+    return pclose(fp) == 0;
+}
+
+#endif /* HAVE_LIBGIT2 */
+
+static void git_populate(GitCache *cache, const char *repo_path, int include_diff_stats) {
+    char stamp[256];
+    if (git_status_stamp(repo_path, stamp, sizeof(stamp)) &&
+        git_snapshot_restore(cache, repo_path, stamp, include_diff_stats)) {
+        PROFILE_COUNT(PROF_STATUS_HIT);
+        return;
     }
+    PROFILE_COUNT(PROF_STATUS_MISS);
 
-    FILE *fp = popen(cmd, "r");
-    if (fp) {
-        /* Parse status output until separator */
-        git_parse_status_output(fp, cache, repo_path);
-
-        /* If we included diff stats, parse them after the separator */
-        if (include_diff_stats) {
-            char line[PATH_MAX + 64];
-            while (fgets(line, sizeof(line), fp)) {
-                int added, removed;
-                char path[PATH_SCANF_WIDTH + 1];
-
-                if (sscanf(line, "%d\t%d\t" SCANF_PATH, &added, &removed, path) == 3) {
-                    char full_path[PATH_MAX];
-                    path_join(full_path, sizeof(full_path), repo_path, path);
-                    git_cache_set_diff(cache, full_path, added, removed);
-                }
-            }
+    int64_t taken_ns = git_snapshot_clock();
+    GitSnapshot snap = {NULL, 0, 0};
+    GitDiffList diffs = {NULL, 0, 0};
+    int ok = git_read_status(repo_path, &snap);
+    git_snapshot_apply(cache, repo_path, &snap);
+
+    if (include_diff_stats) {
+        for (size_t i = 0; i < snap.count; i++) {
+            if (git_status_has_worktree_diff(snap.items[i].status))
+                git_diff_list_add(&diffs, snap.items[i].path, snap.items[i].status[1]);
         }
-        pclose(fp);
+        git_populate_diff_stats(cache, repo_path, &diffs);
     }
 
-    free(escaped);
+    /* Stamp again: git status may have refreshed the index */
+    if (ok && git_status_stamp(repo_path, stamp, sizeof(stamp))) {
+        git_snapshot_save(repo_path, stamp, taken_ns, &snap,
+                          include_diff_stats ? &diffs : NULL);
+    }
+
+    git_snapshot_free(&snap);
+    git_diff_list_free(&diffs);
 }
 
-#endif /* HAVE_LIBGIT2 */
+void git_populate_repo(GitCache *cache, const char *repo_path, int include_diff_stats) {
+    int64_t start = PROFILE_BEGIN();
+    git_populate(cache, repo_path, include_diff_stats);
+    PROFILE_END(PROF_GIT, start);
+}
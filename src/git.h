@@ -23,13 +23,6 @@ typedef struct GitStatusNode {
     struct GitStatusNode *next;
 } GitStatusNode;
 
-typedef struct {
-    GitStatusNode *buckets[L_HASH_SIZE];
-#ifdef _OPENMP
-    omp_lock_t lock;
-#endif
-} GitCache;
-
 /* Git status summary for directories */
 typedef struct {
     int modified;
@@ -38,6 +31,31 @@ typedef struct {
     int deleted;
 } GitSummary;
 
+/* Per-directory aggregates over every status entry below a directory */
+typedef struct GitDirAggregate {
+    char *path;
+    uint64_t hash;
+    GitSummary summary;          /* All entries under the directory */
+    GitSummary hidden_summary;   /* Hidden direct children only */
+    int has_hidden_status;       /* A hidden direct child has non-ignored status */
+    int deleted_direct;          /* Deleted direct children */
+    int deleted_lines_direct;
+    int deleted_lines_recursive;
+    struct GitDirAggregate *next;
+} GitDirAggregate;
+
+typedef struct {
+    GitStatusNode *buckets[L_HASH_SIZE];
+    /* Directory index, rebuilt on the first query after the entries change */
+    GitDirAggregate **dirs;
+    size_t dir_capacity;
+    size_t dir_count;
+    int dirs_valid;
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+} GitCache;
+
 /* ============================================================================
  * GitCache Functions
  * ============================================================================ */
@@ -60,6 +78,11 @@ const char *git_cache_get(GitCache *cache, const char *path);
 /* Look up diff stats for a path (returns node, or NULL if not found) */
 GitStatusNode *git_cache_get_node(GitCache *cache, const char *path);
 
+/* Copy a path's status and diff stats under the lock, for readers that
+ * may run while other repos are populated. Returns 1 if found, 0 otherwise */
+int git_cache_copy(GitCache *cache, const char *path, char status[3],
+                   int *added, int *removed);
+
 /* ============================================================================
  * Git Repository Functions
  * ============================================================================ */
@@ -68,6 +91,12 @@ GitStatusNode *git_cache_get_node(GitCache *cache, const char *path);
  * Returns 1 if found, 0 otherwise */
 int git_find_root(const char *path, char *root, size_t root_len);
 
+/* Resolve the directories a repo's metadata lives in: git_dir holds HEAD
+ * and the index; common_dir holds objects, refs, packed-refs and config
+ * (they differ for linked worktrees). Returns 1 on success, 0 otherwise */
+int git_resolve_dirs(const char *repo_path, char *git_dir, size_t git_dir_len,
+                     char *common_dir, size_t common_dir_len);
+
 /* Populate cache with all file statuses from a repository.
  * If include_diff_stats is true, also populate lines added/removed. */
 void git_populate_repo(GitCache *cache, const char *repo_path, int include_diff_stats);
@@ -90,6 +119,10 @@ int git_dir_has_hidden_status(GitCache *cache, const char *dir_path);
 /* Get git status summary for hidden direct children of a directory */
 GitSummary git_get_hidden_dir_summary(GitCache *cache, const char *dir_path);
 
+/* Upper bounds on the lines added and removed any entry or directory in
+ * the cache can show (for sizing diff columns before the tree is built) */
+void git_diff_bounds(GitCache *cache, int *max_added, int *max_removed);
+
 /* Check if a path is inside an ignored directory (walks up ancestors) */
 int git_path_in_ignored(GitCache *cache, const char *path, const char *git_root);
 
@@ -117,11 +150,20 @@ typedef struct {
  * Returns 1 if on a branch, 0 otherwise. Caller must free info->branch. */
 int git_get_branch_info(const char *repo_path, GitBranchInfo *info);
 
-/* Get the latest tag reachable from HEAD.
+/* Resolve HEAD to a full commit hash. Returns 1 if found, 0 otherwise */
+int git_read_head(const char *repo_path, char *hash, size_t hash_len);
+
+/* Count commits reachable from rev but not from exclude (NULL for all), as
+ * `git rev-list --count exclude..rev`. Both are full hashes. Cached per
+ * hash pair across runs. Returns -1 on failure. */
+long git_count_commits(const char *repo_path, const char *exclude, const char *rev);
+
+/* Get the latest tag reachable from HEAD, and the number of commits since
+ * it in *distance (0 at the tag; distance may be NULL). Cached per HEAD.
  * Returns allocated string or NULL. Caller must free. */
-char *git_get_latest_tag(const char *repo_path);
+char *git_get_latest_tag(const char *repo_path, int *distance);
 
-/* Get origin remote URL by parsing .git/config directly.
+/* Get origin remote URL by parsing the repo config directly.
  * Returns allocated string or NULL. Caller must free. */
 char *git_get_remote_url(const char *repo_path);
 
@@ -131,13 +173,11 @@ char *git_get_remote_url(const char *repo_path);
 char *git_remote_to_web_url(const char *remote);
 
 /* ============================================================================
- * Shell Escape (for non-libgit2 fallback)
+ * Shell Escape (for git subprocess fallbacks)
  * ============================================================================ */
 
-#ifndef HAVE_LIBGIT2
 /* Escape a path for safe use in shell single quotes: ' -> '\''
  * Returns: Newly allocated string (caller must free), or NULL on overflow. */
 char *shell_escape(const char *path);
-#endif
 
 #endif /* L_GIT_H */
@@ -0,0 +1,932 @@
+/*
+ * gitdiff.c - In-process `git diff --numstat` (index vs working tree)
+ *
+ * The status pass has already compared the index stat cache and content
+ * hashes, so every file handed in here is known to differ and only needs
+ * line counts. Anything unusual (split index, SHA-256 repos, objects only
+ * reachable through alternates, gitattributes or autocrlf, which can
+ * filter content or change how it diffs, and edits too scattered for the
+ * Myers search to finish cheaply) makes gitdiff_numstat fail so the
+ * caller can run git instead. The counts it does return are git's.
+ */
+
+#include "gitdiff.h"
+#include "git.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#define GITDIFF_MAX_OBJECT      (64 * 1024 * 1024)  /* Larger blobs go to git */
+#define GITDIFF_MAX_DELTA_DEPTH 4096
+#define GITDIFF_BINARY_PROBE    8000       /* Bytes git checks for NUL */
+#define GITDIFF_MAX_COST        100000000LL /* Myers steps before giving up */
+
+#define OBJ_BLOB      3
+#define OBJ_OFS_DELTA 6
+#define OBJ_REF_DELTA 7
+
+#define GIT_OID_RAWSZ 20
+
+/* ============================================================================
+ * Mapped Files
+ * ============================================================================ */
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+} MappedFile;
+
+static int map_file(const char *path, MappedFile *m) {
+    m->data = NULL;
+    m->len = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        m->data = p;
+        m->len = (size_t)st.st_size;
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_file(MappedFile *m) {
+    if (m->data) munmap(m->data, m->len);
+    m->data = NULL;
+    m->len = 0;
+}
+
+static uint32_t be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/* ============================================================================
+ * Index
+ * ============================================================================ */
+
+typedef struct {
+    const char *path;
+    uint32_t mode;
+    const unsigned char *oid;    /* Points into the mapped index */
+} IndexEntry;
+
+typedef struct {
+    MappedFile map;
+    IndexEntry *entries;         /* Stage-0 entries, sorted by path */
+    size_t count;
+    Arena paths;                 /* Version 4 paths (prefix-compressed on disk) */
+} GitIndex;
+
+static void index_free(GitIndex *index) {
+    unmap_file(&index->map);
+    free(index->entries);
+    arena_free(&index->paths);
+}
+
+static int index_load(const char *git_dir, GitIndex *index) {
+    memset(index, 0, sizeof(*index));
+    arena_init(&index->paths);
+
+    char path[PATH_MAX];
+    path_join(path, sizeof(path), git_dir, "index");
+    if (map_file(path, &index->map) != 0) return -1;
+
+    const unsigned char *p = index->map.data;
+    const unsigned char *end = p + index->map.len;
+    if (index->map.len < 12 + GIT_OID_RAWSZ || memcmp(p, "DIRC", 4) != 0) return -1;
+
+    uint32_t version = be32(p + 4);
+    uint32_t count = be32(p + 8);
+    if (version < 2 || version > 4 || count > index->map.len / 62) return -1;
+
+    index->entries = xmalloc((count ? count : 1) * sizeof(IndexEntry));
+    p += 12;
+
+    char prev[PATH_MAX];
+    size_t prev_len = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        /* ctime, mtime, dev, ino, mode, uid, gid, size, oid, flags */
+        const unsigned char *entry = p;
+        if (end - p < 62) return -1;
+        uint32_t mode = be32(p + 24);
+        const unsigned char *oid = p + 40;
+        unsigned int flags = ((unsigned int)p[60] << 8) | p[61];
+        size_t name_off = 62;
+        if (flags & 0x4000) {            /* Extended flags */
+            if (version < 3) return -1;
+            name_off += 2;
+        }
+        const unsigned char *name = entry + name_off;
+        if (name >= end) return -1;
+
+        const char *entry_path;
+        if (version == 4) {
+            /* Varint count of bytes to drop from the previous path, then
+             * the NUL-terminated suffix; no padding */
+            unsigned char c = *name++;
+            size_t strip = c & 127;
+            while (c & 128) {
+                if (name >= end) return -1;
+                c = *name++;
+                strip = ((strip + 1) << 7) | (c & 127);
+            }
+            const unsigned char *nul = memchr(name, '\0', (size_t)(end - name));
+            if (!nul) return -1;
+            size_t suffix = (size_t)(nul - name);
+            if (strip > prev_len || prev_len - strip + suffix >= sizeof(prev)) return -1;
+            prev_len -= strip;
+            memcpy(prev + prev_len, name, suffix);
+            prev_len += suffix;
+            prev[prev_len] = '\0';
+            entry_path = arena_strdup(&index->paths, prev);
+            p = nul + 1;
+        } else {
+            /* NUL-terminated path, entry padded to a multiple of 8 */
+            const unsigned char *nul = memchr(name, '\0', (size_t)(end - name));
+            if (!nul) return -1;
+            size_t entry_len = (name_off + (size_t)(nul - name) + 8) & ~(size_t)7;
+            if ((size_t)(end - entry) < entry_len) return -1;
+            entry_path = (const char *)name;
+            p = entry + entry_len;
+        }
+
+        /* Unmerged entries are shown as combined diffs, not counted here */
+        if (flags & 0x3000) continue;
+        index->entries[index->count++] = (IndexEntry){entry_path, mode, oid};
+    }
+
+    /* A split index keeps most entries in a shared file */
+    while (end - p >= 8 + GIT_OID_RAWSZ) {
+        if (memcmp(p, "link", 4) == 0) return -1;
+        uint32_t size = be32(p + 4);
+        if ((size_t)(end - p) - 8 < size) break;
+        p += 8 + size;
+    }
+    return 0;
+}
+
+static const IndexEntry *index_find(const GitIndex *index, const char *path) {
+    size_t lo = 0, hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(index->entries[mid].path, path);
+        if (cmp == 0) return &index->entries[mid];
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Object Database
+ * ============================================================================ */
+
+typedef struct {
+    MappedFile idx;
+    MappedFile pack;
+    uint32_t count;
+    const unsigned char *fanout;
+    const unsigned char *oids;
+    const unsigned char *offsets;
+    const unsigned char *offsets64;
+} GitPack;
+
+typedef struct {
+    char objects_dir[PATH_MAX];
+    GitPack *packs;
+    size_t pack_count;
+} GitOdb;
+
+/* Map a version 2 pack index and its pack. Returns 0 on success */
+static int pack_open(const char *idx_path, GitPack *pack) {
+    memset(pack, 0, sizeof(*pack));
+    if (map_file(idx_path, &pack->idx) != 0) return -1;
+
+    const unsigned char *p = pack->idx.data;
+    size_t len = pack->idx.len;
+    if (len < 8 + 256 * 4 || memcmp(p, "\377tOc", 4) != 0 || be32(p + 4) != 2) {
+        unmap_file(&pack->idx);
+        return -1;
+    }
+    pack->fanout = p + 8;
+    pack->count = be32(pack->fanout + 255 * 4);
+    size_t tables = 8 + 256 * 4 + (size_t)pack->count * (GIT_OID_RAWSZ + 4 + 4);
+    if (tables + 2 * GIT_OID_RAWSZ > len) {
+        unmap_file(&pack->idx);
+        return -1;
+    }
+    pack->oids = pack->fanout + 256 * 4;
+    pack->offsets = pack->oids + (size_t)pack->count * (GIT_OID_RAWSZ + 4);
+    pack->offsets64 = pack->offsets + (size_t)pack->count * 4;
+
+    char pack_path[PATH_MAX];
+    snprintf(pack_path, sizeof(pack_path), "%s", idx_path);
+    size_t plen = strlen(pack_path);
+    if (plen < 4 || plen + 1 >= sizeof(pack_path)) {
+        unmap_file(&pack->idx);
+        return -1;
+    }
+    memcpy(pack_path + plen - 4, ".pack", 6);
+
+    if (map_file(pack_path, &pack->pack) != 0 || pack->pack.len < 12 ||
+        memcmp(pack->pack.data, "PACK", 4) != 0) {
+        unmap_file(&pack->pack);
+        unmap_file(&pack->idx);
+        return -1;
+    }
+    return 0;
+}
+
+static void odb_open(const char *common_dir, GitOdb *odb) {
+    memset(odb, 0, sizeof(*odb));
+    path_join(odb->objects_dir, sizeof(odb->objects_dir), common_dir, "objects");
+
+    char pack_dir[PATH_MAX];
+    path_join(pack_dir, sizeof(pack_dir), odb->objects_dir, "pack");
+    DIR *dir = opendir(pack_dir);
+    if (!dir) return;
+
+    size_t cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len < 5 || strcmp(ent->d_name + len - 4, ".idx") != 0) continue;
+
+        char idx_path[PATH_MAX];
+        path_join(idx_path, sizeof(idx_path), pack_dir, ent->d_name);
+        GitPack pack;
+        if (pack_open(idx_path, &pack) != 0) continue;
+
+        if (odb->pack_count >= cap) {
+            cap = cap ? cap * 2 : 8;
+            odb->packs = xrealloc(odb->packs, cap * sizeof(GitPack));
+        }
+        odb->packs[odb->pack_count++] = pack;
+    }
+    closedir(dir);
+}
+
+static void odb_close(GitOdb *odb) {
+    for (size_t i = 0; i < odb->pack_count; i++) {
+        unmap_file(&odb->packs[i].pack);
+        unmap_file(&odb->packs[i].idx);
+    }
+    free(odb->packs);
+    odb->packs = NULL;
+    odb->pack_count = 0;
+}
+
+/* Offset of an object in a pack, or -1 if it isn't there */
+static int64_t pack_find(const GitPack *pack, const unsigned char *oid) {
+    uint32_t lo = oid[0] ? be32(pack->fanout + (oid[0] - 1) * 4) : 0;
+    uint32_t hi = be32(pack->fanout + oid[0] * 4);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(pack->oids + (size_t)mid * GIT_OID_RAWSZ, oid, GIT_OID_RAWSZ);
+        if (cmp == 0) {
+            uint32_t off = be32(pack->offsets + (size_t)mid * 4);
+            if (!(off & 0x80000000u)) return off;
+            /* Large offset: index into the 64-bit table */
+            size_t slot = (size_t)(off & 0x7fffffffu) * 8;
+            if (pack->offsets64 + slot + 8 > pack->idx.data + pack->idx.len) return -1;
+            uint64_t big = ((uint64_t)be32(pack->offsets64 + slot) << 32) |
+                           be32(pack->offsets64 + slot + 4);
+            return big > INT64_MAX ? -1 : (int64_t)big;
+        }
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+/* Inflate exactly out_len bytes from src. Returns allocated buffer or NULL */
+static unsigned char *zinflate(const unsigned char *src, size_t src_len, size_t out_len) {
+    /* One spare byte so a complete stream never stalls on a full buffer */
+    unsigned char *out = xmalloc(out_len + 1);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = src_len > UINT32_MAX ? UINT32_MAX : (uInt)src_len;
+    zs.next_out = out;
+    zs.avail_out = (uInt)(out_len + 1);
+    int ret = inflate(&zs, Z_FINISH);
+    size_t got = zs.total_out;
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END || got != out_len) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+static size_t delta_size(const unsigned char **p, const unsigned char *end) {
+    size_t value = 0;
+    int shift = 0;
+    unsigned char c;
+    do {
+        if (*p >= end || shift > 56) return (size_t)-1;
+        c = *(*p)++;
+        value |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return value;
+}
+
+/* Apply a pack delta to base. Returns allocated result or NULL */
+static unsigned char *delta_apply(const unsigned char *base, size_t base_len,
+                                  const unsigned char *delta, size_t delta_len,
+                                  size_t *out_len) {
+    const unsigned char *p = delta;
+    const unsigned char *end = delta + delta_len;
+    size_t src_len = delta_size(&p, end);
+    size_t dst_len = delta_size(&p, end);
+    if (src_len != base_len || dst_len > GITDIFF_MAX_OBJECT) return NULL;
+
+    unsigned char *out = xmalloc(dst_len + 1);
+    size_t pos = 0;
+    while (p < end) {
+        unsigned char c = *p++;
+        if (c & 0x80) {
+            /* Copy from base: offset and size bytes present per flag bit */
+            size_t off = 0, len = 0;
+            for (int i = 0; i < 4; i++) {
+                if (!(c & (1 << i))) continue;
+                if (p >= end) goto fail;
+                off |= (size_t)*p++ << (8 * i);
+            }
+            for (int i = 0; i < 3; i++) {
+                if (!(c & (0x10 << i))) continue;
+                if (p >= end) goto fail;
+                len |= (size_t)*p++ << (8 * i);
+            }
+            if (len == 0) len = 0x10000;
+            if (off > base_len || len > base_len - off || len > dst_len - pos) goto fail;
+            memcpy(out + pos, base + off, len);
+            pos += len;
+        } else if (c) {
+            /* Insert literal bytes */
+            if (c > (size_t)(end - p) || c > dst_len - pos) goto fail;
+            memcpy(out + pos, p, c);
+            p += c;
+            pos += c;
+        } else {
+            goto fail;  /* Reserved opcode */
+        }
+    }
+    if (pos != dst_len) goto fail;
+    *out_len = dst_len;
+    return out;
+
+fail:
+    free(out);
+    return NULL;
+}
+
+static unsigned char *odb_read(const GitOdb *odb, const unsigned char *oid, int depth,
+                               int *type, size_t *size);
+
+static unsigned char *pack_read(const GitOdb *odb, const GitPack *pack, uint64_t offset,
+                                int depth, int *type, size_t *size) {
+    if (depth > GITDIFF_MAX_DELTA_DEPTH || offset >= pack->pack.len) return NULL;
+
+    const unsigned char *p = pack->pack.data + offset;
+    const unsigned char *end = pack->pack.data + pack->pack.len;
+
+    /* Type in bits 4-6 of the first byte, size as a little-endian varint */
+    unsigned char c = *p++;
+    int obj_type = (c >> 4) & 7;
+    uint64_t obj_size = c & 15;
+    int shift = 4;
+    while (c & 0x80) {
+        if (p >= end || shift > 60) return NULL;
+        c = *p++;
+        obj_size |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    }
+    if (obj_size > GITDIFF_MAX_OBJECT) return NULL;
+
+    if (obj_type >= 1 && obj_type <= 4) {
+        *type = obj_type;
+        *size = (size_t)obj_size;
+        return zinflate(p, (size_t)(end - p), (size_t)obj_size);
+    }
+
+    unsigned char *base = NULL;
+    size_t base_len = 0;
+    if (obj_type == OBJ_OFS_DELTA) {
+        /* Base offset, relative to this object, big-endian with +1 per byte */
+        if (p >= end) return NULL;
+        c = *p++;
+        uint64_t rel = c & 127;
+        while (c & 128) {
+            if (p >= end || rel > (UINT64_MAX >> 8)) return NULL;
+            c = *p++;
+            rel = ((rel + 1) << 7) | (c & 127);
+        }
+        if (rel == 0 || rel > offset) return NULL;
+        base = pack_read(odb, pack, offset - rel, depth + 1, type, &base_len);
+    } else if (obj_type == OBJ_REF_DELTA) {
+        if (end - p < GIT_OID_RAWSZ) return NULL;
+        base = odb_read(odb, p, depth + 1, type, &base_len);
+        p += GIT_OID_RAWSZ;
+    }
+    if (!base) return NULL;
+
+    unsigned char *delta = zinflate(p, (size_t)(end - p), (size_t)obj_size);
+    unsigned char *out = delta ? delta_apply(base, base_len, delta, (size_t)obj_size, size) : NULL;
+    free(delta);
+    free(base);
+    return out;
+}
+
+static unsigned char *loose_read(const GitOdb *odb, const unsigned char *oid,
+                                 int *type, size_t *size) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char hex[2 * GIT_OID_RAWSZ + 1];
+    for (int i = 0; i < GIT_OID_RAWSZ; i++) {
+        hex[2 * i] = hex_digits[oid[i] >> 4];
+        hex[2 * i + 1] = hex_digits[oid[i] & 15];
+    }
+    hex[2 * GIT_OID_RAWSZ] = '\0';
+
+    char fan[3] = {hex[0], hex[1], '\0'};
+    char dir[PATH_MAX], path[PATH_MAX];
+    path_join(dir, sizeof(dir), odb->objects_dir, fan);
+    path_join(path, sizeof(path), dir, hex + 2);
+
+    MappedFile m;
+    if (map_file(path, &m) != 0) return NULL;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        unmap_file(&m);
+        return NULL;
+    }
+
+    /* Inflate the "<type> <size>\0" header first to learn the size */
+    unsigned char hdr[64];
+    zs.next_in = m.data;
+    zs.avail_in = (uInt)m.len;
+    zs.next_out = hdr;
+    zs.avail_out = sizeof(hdr);
+    int ret = inflate(&zs, Z_NO_FLUSH);
+    size_t have = sizeof(hdr) - zs.avail_out;
+    unsigned char *nul = memchr(hdr, '\0', have);
+    unsigned char *out = NULL;
+
+    if ((ret == Z_OK || ret == Z_STREAM_END) && nul) {
+        const char *h = (const char *)hdr;
+        const char *space = memchr(h, ' ', (size_t)(nul - hdr));
+        int obj_type = 0;
+        if (space) {
+            size_t tlen = (size_t)(space - h);
+            if (tlen == 4 && memcmp(h, "blob", 4) == 0) obj_type = OBJ_BLOB;
+            else if (tlen == 4 && memcmp(h, "tree", 4) == 0) obj_type = 2;
+            else if (tlen == 6 && memcmp(h, "commit", 6) == 0) obj_type = 1;
+            else if (tlen == 3 && memcmp(h, "tag", 3) == 0) obj_type = 4;
+        }
+        unsigned long long obj_size = space ? strtoull(space + 1, NULL, 10) : 0;
+        size_t body = have - (size_t)(nul + 1 - hdr);
+
+        if (obj_type && obj_size <= GITDIFF_MAX_OBJECT && body <= obj_size) {
+            out = xmalloc((size_t)obj_size + 1);
+            memcpy(out, nul + 1, body);
+            size_t got = body;
+            if (ret != Z_STREAM_END) {
+                zs.next_out = out + body;
+                zs.avail_out = (uInt)(obj_size - body + 1);
+                ret = inflate(&zs, Z_FINISH);
+                got = body + (size_t)(obj_size - body + 1) - zs.avail_out;
+            }
+            if (ret == Z_STREAM_END && got == obj_size) {
+                *type = obj_type;
+                *size = (size_t)obj_size;
+            } else {
+                free(out);
+                out = NULL;
+            }
+        }
+    }
+    inflateEnd(&zs);
+    unmap_file(&m);
+    return out;
+}
+
+static unsigned char *odb_read(const GitOdb *odb, const unsigned char *oid, int depth,
+                               int *type, size_t *size) {
+    for (size_t i = 0; i < odb->pack_count; i++) {
+        int64_t off = pack_find(&odb->packs[i], oid);
+        if (off >= 0) return pack_read(odb, &odb->packs[i], (uint64_t)off, depth, type, size);
+    }
+    return loose_read(odb, oid, type, size);
+}
+
+/* SHA-256 repositories use longer object ids than this reader handles */
+static int repo_is_sha256(const char *common_dir) {
+    char path[PATH_MAX];
+    path_join(path, sizeof(path), common_dir, "config");
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    char line[512];
+    int sha256 = 0;
+    while (!sha256 && fgets(line, sizeof(line), f)) {
+        if (strstr(line, "objectformat") && strstr(line, "sha256")) sha256 = 1;
+    }
+    fclose(f);
+    return sha256;
+}
+
+/* 1 if the file at path exists and mentions any of words (case-insensitive) */
+static int file_mentions(const char *path, const char *const *words) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+
+    char line[512];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        for (const char *const *w = words; *w && !found; w++)
+            found = strcasestr(line, *w) != NULL;
+    }
+    fclose(f);
+    return found;
+}
+
+/* Attributes can mark files binary, pick diff drivers or run clean
+ * filters, and autocrlf rewrites line endings before comparing, none of
+ * which this reader applies. Any sign of them sends the repo to git. */
+static int repo_has_attributes(const char *repo_path, const char *common_dir,
+                               const GitIndex *index) {
+    static const char *const config_words[] = {"attributesfile", "autocrlf", NULL};
+    char path[PATH_MAX];
+    struct stat st;
+
+    path_join(path, sizeof(path), repo_path, ".gitattributes");
+    if (lstat(path, &st) == 0) return 1;
+    path_join(path, sizeof(path), common_dir, "info/attributes");
+    if (stat(path, &st) == 0) return 1;
+    for (size_t i = 0; i < index->count; i++) {
+        const char *name = strrchr(index->entries[i].path, '/');
+        name = name ? name + 1 : index->entries[i].path;
+        if (strcmp(name, ".gitattributes") == 0) return 1;
+    }
+
+    const char *home = getenv("HOME");
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    if (xdg && xdg[0]) snprintf(path, sizeof(path), "%s/git/attributes", xdg);
+    else snprintf(path, sizeof(path), "%s/.config/git/attributes", home ? home : "");
+    if (stat(path, &st) == 0) return 1;
+
+    path_join(path, sizeof(path), common_dir, "config");
+    if (file_mentions(path, config_words)) return 1;
+    snprintf(path, sizeof(path), "%s/.gitconfig", home ? home : "");
+    if (file_mentions(path, config_words)) return 1;
+    return file_mentions("/etc/gitconfig", config_words);
+}
+
+/* ============================================================================
+ * Line Diff
+ * ============================================================================ */
+
+typedef struct {
+    const unsigned char *start;
+    size_t len;                  /* Including the newline, if any */
+    uint64_t hash;
+} Line;
+
+static long split_lines(const unsigned char *data, size_t len, Line **out) {
+    long count = 0;
+    for (const unsigned char *p = data, *end = data + len; p < end; count++) {
+        const unsigned char *nl = memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+
+    Line *lines = xmalloc((size_t)(count ? count : 1) * sizeof(Line));
+    const unsigned char *p = data;
+    for (long i = 0; i < count; i++) {
+        const unsigned char *nl = memchr(p, '\n', (size_t)(data + len - p));
+        const unsigned char *next = nl ? nl + 1 : data + len;
+        uint64_t hash = 14695981039346656037ULL;
+        for (const unsigned char *q = p; q < next; q++) {
+            hash ^= *q;
+            hash *= 1099511628211ULL;
+        }
+        lines[i] = (Line){p, (size_t)(next - p), hash};
+        p = next;
+    }
+    *out = lines;
+    return count;
+}
+
+static int line_eq(const Line *a, const Line *b) {
+    return a->hash == b->hash && a->len == b->len && memcmp(a->start, b->start, a->len) == 0;
+}
+
+/* Length of the shortest edit script (insertions + deletions) between two
+ * line arrays, by Myers' greedy O(ND) search. Only D is needed for a
+ * numstat, so no path is kept and space stays O(N + M). Returns -1 once
+ * the search passes GITDIFF_MAX_COST steps: git switches to heuristics
+ * there, whose counts this can't reproduce. */
+static long edit_distance(const Line *a, long n, const Line *b, long m) {
+    /* Common prefix and suffix never affect the result */
+    while (n > 0 && m > 0 && line_eq(a, b)) {
+        a++; b++; n--; m--;
+    }
+    while (n > 0 && m > 0 && line_eq(&a[n - 1], &b[m - 1])) {
+        n--; m--;
+    }
+    if (n == 0 || m == 0) return n + m;
+
+    long max = n + m;
+    long *v = xmalloc((size_t)(2 * max + 3) * sizeof(long));
+    long *vk = v + max + 1;
+    vk[1] = 0;
+
+    long long cost = 0;
+    for (long d = 0; d <= max; d++) {
+        for (long k = -d; k <= d; k += 2) {
+            long x = (k == -d || (k != d && vk[k - 1] < vk[k + 1])) ? vk[k + 1] : vk[k - 1] + 1;
+            long y = x - k;
+            while (x < n && y < m && line_eq(&a[x], &b[y])) {
+                x++;
+                y++;
+            }
+            vk[k] = x;
+            if (x >= n && y >= m) {
+                free(v);
+                return d;
+            }
+        }
+        cost += d + 1;
+        if (cost > GITDIFF_MAX_COST) break;
+    }
+    free(v);
+    return -1;
+}
+
+static int is_binary(const unsigned char *data, size_t len) {
+    size_t probe = len < GITDIFF_BINARY_PROBE ? len : GITDIFF_BINARY_PROBE;
+    return probe > 0 && memchr(data, '\0', probe) != NULL;
+}
+
+/* Diff one file. Returns 0 (stat filled in, possibly invalid) or -1 if the
+ * index blob can't be read or the diff is too costly, in which case the
+ * whole repo goes to git. */
+static int gitdiff_file(const char *repo_path, const GitIndex *index, const GitOdb *odb,
+                        GitDiffStat *stat) {
+    stat->added = 0;
+    stat->removed = 0;
+    stat->valid = 0;
+
+    /* Old side: the index blob (intent-to-add entries are empty) */
+    unsigned char *old = NULL;
+    size_t old_len = 0;
+    if (stat->status != 'A') {
+        const IndexEntry *ie = index_find(index, stat->path);
+        if (!ie) return 0;                               /* Unmerged */
+        if ((ie->mode & 0170000) == 0160000) return 0;   /* Submodule */
+        int type = 0;
+        old = odb_read(odb, ie->oid, 0, &type, &old_len);
+        if (!old || type != OBJ_BLOB) {
+            free(old);
+            return -1;
+        }
+    }
+
+    /* New side: the working tree file (or link target) */
+    MappedFile map = {NULL, 0};
+    char link[PATH_MAX];
+    const unsigned char *cur = NULL;
+    size_t cur_len = 0;
+    if (stat->status != 'D') {
+        char full_path[PATH_MAX];
+        path_join(full_path, sizeof(full_path), repo_path, stat->path);
+        struct stat st;
+        if (lstat(full_path, &st) != 0) {
+            free(old);
+            return 0;  /* Gone since status ran */
+        }
+        if (S_ISLNK(st.st_mode)) {
+            ssize_t n = readlink(full_path, link, sizeof(link));
+            if (n < 0) {
+                free(old);
+                return 0;
+            }
+            cur = (const unsigned char *)link;
+            cur_len = (size_t)n;
+        } else if (S_ISREG(st.st_mode)) {
+            if (st.st_size > GITDIFF_MAX_OBJECT) {
+                free(old);
+                return -1;
+            }
+            if (map_file(full_path, &map) != 0) {
+                free(old);
+                return 0;
+            }
+            cur = map.data;
+            cur_len = map.len;
+        } else {
+            free(old);
+            return 0;  /* Type change to a directory */
+        }
+    }
+
+    if (!is_binary(old, old_len) && !is_binary(cur, cur_len)) {
+        Line *a, *b;
+        long n = split_lines(old, old_len, &a);
+        long m = split_lines(cur, cur_len, &b);
+        long d = edit_distance(a, n, b, m);
+        free(a);
+        free(b);
+        if (d < 0) {
+            unmap_file(&map);
+            free(old);
+            return -1;
+        }
+        stat->added = (int)((d + (m - n)) / 2);
+        stat->removed = (int)((d - (m - n)) / 2);
+        stat->valid = 1;
+    }
+
+    unmap_file(&map);
+    free(old);
+    return 0;
+}
+
+/* ============================================================================
+ * Working Tree Check
+ * ============================================================================ */
+
+typedef struct {
+    const char **paths;          /* Full paths, in the arena */
+    unsigned char *is_dir;
+    size_t count;
+    size_t capacity;
+    Arena arena;
+} CheckList;
+
+static void check_add(CheckList *list, const char *repo_path, const char *rel,
+                      size_t rel_len, int is_dir) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->paths = xrealloc(list->paths, list->capacity * sizeof(char *));
+        list->is_dir = xrealloc(list->is_dir, list->capacity);
+    }
+    char full_path[PATH_MAX];
+    if (rel_len == 0) {
+        snprintf(full_path, sizeof(full_path), "%s", repo_path);
+    } else {
+        char sub[PATH_MAX];
+        if (rel_len >= sizeof(sub)) rel_len = sizeof(sub) - 1;
+        memcpy(sub, rel, rel_len);
+        sub[rel_len] = '\0';
+        path_join(full_path, sizeof(full_path), repo_path, sub);
+    }
+    list->paths[list->count] = arena_strdup(&list->arena, full_path);
+    list->is_dir[list->count] = (unsigned char)is_dir;
+    list->count++;
+}
+
+/* Queue the directories above rel, stopping at the first one that is also
+ * above prev (already queued). Paths arrive mostly sorted, so this keeps
+ * each directory to about one check without a set. */
+static void check_add_dirs(CheckList *list, const char *repo_path,
+                           const char *rel, const char *prev) {
+    const char *slash = strrchr(rel, '/');
+    size_t len = slash ? (size_t)(slash - rel) : 0;
+    for (;;) {
+        if (prev && (len == 0 || (strncmp(prev, rel, len) == 0 && prev[len] == '/')))
+            break;
+        check_add(list, repo_path, rel, len, 1);
+        if (len == 0) break;
+        while (len > 0 && rel[len - 1] != '/') len--;
+        if (len > 0) len--;  /* Drop the slash */
+    }
+}
+
+int gitdiff_worktree_changed(const char *repo_path, int64_t since_ns,
+                             const char *const *paths, size_t count) {
+    char git_dir[PATH_MAX], common_dir[PATH_MAX];
+    if (!git_resolve_dirs(repo_path, git_dir, sizeof(git_dir),
+                          common_dir, sizeof(common_dir))) {
+        return 1;
+    }
+
+    GitIndex index;
+    if (index_load(git_dir, &index) != 0) {
+        index_free(&index);
+        return 1;
+    }
+
+    CheckList list;
+    memset(&list, 0, sizeof(list));
+    arena_init(&list.arena);
+
+    /* Tracked files, and every directory holding one */
+    const char *prev = NULL;
+    for (size_t i = 0; i < index.count; i++) {
+        const IndexEntry *ie = &index.entries[i];
+        if ((ie->mode & 0170000) != 0160000)  /* Submodules are excluded */
+            check_add(&list, repo_path, ie->path, strlen(ie->path), 0);
+        check_add_dirs(&list, repo_path, ie->path, prev);
+        prev = ie->path;
+    }
+
+    /* Status entries and their directories: untracked and ignored files
+     * live outside the index, status collapses untracked directories into
+     * one entry, and an untracked .gitignore changes what status reports */
+    prev = NULL;
+    for (size_t i = 0; i < count; i++) {
+        check_add(&list, repo_path, paths[i], strlen(paths[i]), 0);
+        check_add_dirs(&list, repo_path, paths[i], prev);
+        prev = paths[i];
+    }
+    if (list.count == 0) check_add(&list, repo_path, "", 0, 1);
+
+    int changed = 0;
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < list.count; i++) {
+        int stop;
+        #pragma omp atomic read
+        stop = changed;
+        if (stop) continue;
+
+        struct stat st;
+        int found = list.is_dir[i] ? stat(list.paths[i], &st) == 0
+                                   : lstat(list.paths[i], &st) == 0;
+        /* A vanished file shows up as a change to its directory */
+        int hit = found ? (GET_MTIME_NS(st) >= since_ns || GET_CTIME_NS(st) >= since_ns)
+                        : list.is_dir[i];
+        if (hit) {
+            #pragma omp atomic write
+            changed = 1;
+        }
+    }
+
+    free(list.paths);
+    free(list.is_dir);
+    arena_free(&list.arena);
+    index_free(&index);
+    return changed;
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+int gitdiff_numstat(const char *repo_path, GitDiffStat *stats, size_t count) {
+    if (count == 0) return 0;
+
+    char git_dir[PATH_MAX], common_dir[PATH_MAX];
+    if (!git_resolve_dirs(repo_path, git_dir, sizeof(git_dir),
+                          common_dir, sizeof(common_dir)) ||
+        repo_is_sha256(common_dir)) {
+        return -1;
+    }
+
+    GitIndex index;
+    if (index_load(git_dir, &index) != 0 ||
+        repo_has_attributes(repo_path, common_dir, &index)) {
+        index_free(&index);
+        return -1;
+    }
+    GitOdb odb;
+    odb_open(common_dir, &odb);
+
+    /* Each file writes only its own slot, so no locking is needed here */
+    int failed = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < count; i++) {
+        int stop;
+        #pragma omp atomic read
+        stop = failed;
+        if (stop) continue;
+        if (gitdiff_file(repo_path, &index, &odb, &stats[i]) != 0) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+    }
+
+    odb_close(&odb);
+    index_free(&index);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * gitdiff.h - In-process `git diff --numstat` (index vs working tree)
+ *
+ * Reads the index and object database directly (loose objects and packs,
+ * including deltas) and counts changed lines with a Myers edit distance.
+ * Only files the status pass already reported as changed are diffed.
+ *
+ * The same index reader backs the working-tree check used to decide
+ * whether a saved git status is still current.
+ */
+
+#ifndef L_GITDIFF_H
+#define L_GITDIFF_H
+
+#include "common.h"
+
+/* One file to diff, and its result */
+typedef struct {
+    char *path;          /* Relative to the repo root */
+    char status;         /* Worktree status: 'M', 'D', or 'A' (intent-to-add) */
+    int added;
+    int removed;
+    int valid;           /* 0 for binary files, which numstat shows as "-" */
+} GitDiffStat;
+
+/* Fill in line stats for each entry, in parallel across files.
+ * Returns 0 on success, -1 if the repo can't be read natively (unsupported
+ * index or object format, missing objects, gitattributes or autocrlf in
+ * effect, or a diff too scattered to count exactly); the caller should
+ * then fall back to running git. */
+int gitdiff_numstat(const char *repo_path, GitDiffStat *stats, size_t count);
+
+/* Check whether anything status would see may have changed at or after
+ * since_ns: a tracked file, one of paths (status entries, relative to the
+ * repo root), or a directory holding either. Compares both ctime and mtime.
+ * Returns 1 if changed (or the index can't be read), 0 otherwise. */
+int gitdiff_worktree_changed(const char *repo_path, int64_t since_ns,
+                             const char *const *paths, size_t count);
+
+#endif /* L_GITDIFF_H */
@@ -0,0 +1,255 @@
+/*
+ * json.c - Machine-readable output (JSON array or NDJSON)
+ *
+ * One object per entry, written straight from the tree walk into the
+ * output buffer: no colors, icons or column passes. Fields mirror
+ * FileEntry; values that weren't computed are null. File names that
+ * aren't valid UTF-8 have the offending bytes replaced with U+FFFD.
+ *
+ * Filters (-g, -f, --min-size) need the finished tree to know which
+ * directories have visible children, so with a filter the tree is built
+ * first and then walked.
+ */
+
+#include "json.h"
+
+/* ============================================================================
+ * Record Buffer
+ * ============================================================================ */
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    const Config *cfg;
+    long records;                /* Records written so far (all trees) */
+} JsonWriter;
+
+static void jw_reserve(JsonWriter *w, size_t extra) {
+    if (w->len + extra <= w->capacity) return;
+    size_t new_cap = w->capacity ? w->capacity : 4096;
+    while (new_cap < w->len + extra) new_cap *= 2;
+    w->data = xrealloc(w->data, new_cap);
+    w->capacity = new_cap;
+}
+
+static void jw_putc(JsonWriter *w, char c) {
+    jw_reserve(w, 1);
+    w->data[w->len++] = c;
+}
+
+static void jw_puts(JsonWriter *w, const char *s) {
+    size_t n = strlen(s);
+    jw_reserve(w, n);
+    memcpy(w->data + w->len, s, n);
+    w->len += n;
+}
+
+static void jw_put_long(JsonWriter *w, const char *key, long long value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), ",\"%s\":%lld", key, value);
+    jw_puts(w, buf);
+}
+
+/* Integer field, or null when the value wasn't computed (negative) */
+static void jw_put_count(JsonWriter *w, const char *key, long long value) {
+    if (value >= 0) {
+        jw_put_long(w, key, value);
+    } else {
+        char buf[64];
+        snprintf(buf, sizeof(buf), ",\"%s\":null", key);
+        jw_puts(w, buf);
+    }
+}
+
+/* Length of the valid UTF-8 sequence at s, or 0 if it isn't one */
+static int utf8_sequence_len(const unsigned char *s) {
+    int len;
+    unsigned int cp;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) { len = 2; cp = s[0] & 0x1F; }
+    else if ((s[0] & 0xF0) == 0xE0)   { len = 3; cp = s[0] & 0x0F; }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) { len = 4; cp = s[0] & 0x07; }
+    else return 0;
+
+    for (int i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    /* Overlong forms, surrogates, beyond U+10FFFF */
+    if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+        (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+        return 0;
+    }
+    return len;
+}
+
+static void jw_put_string(JsonWriter *w, const char *str) {
+    const unsigned char *s = (const unsigned char *)str;
+    jw_putc(w, '"');
+    while (*s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            jw_putc(w, '\\');
+            jw_putc(w, (char)c);
+            s++;
+        } else if (c < 0x20) {
+            char esc[8];
+            switch (c) {
+                case '\n': jw_puts(w, "\\n"); break;
+                case '\t': jw_puts(w, "\\t"); break;
+                case '\r': jw_puts(w, "\\r"); break;
+                default:
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    jw_puts(w, esc);
+            }
+            s++;
+        } else if (c < 0x80) {
+            jw_putc(w, (char)c);
+            s++;
+        } else {
+            int len = utf8_sequence_len(s);
+            if (len == 0) {
+                jw_puts(w, "\\ufffd");
+                s++;
+            } else {
+                jw_reserve(w, (size_t)len);
+                memcpy(w->data + w->len, s, (size_t)len);
+                w->len += (size_t)len;
+                s += len;
+            }
+        }
+    }
+    jw_putc(w, '"');
+}
+
+static void jw_put_field(JsonWriter *w, const char *key, const char *value) {
+    jw_putc(w, ',');
+    jw_put_string(w, key);
+    jw_putc(w, ':');
+    if (value) {
+        jw_put_string(w, value);
+    } else {
+        jw_puts(w, "null");
+    }
+}
+
+/* ============================================================================
+ * Entry Records
+ * ============================================================================ */
+
+static const char *json_type_name(FileType type) {
+    switch (type) {
+        case FTYPE_DIR:            return "dir";
+        case FTYPE_FILE:           return "file";
+        case FTYPE_EXEC:           return "exec";
+        case FTYPE_DEVICE:         return "device";
+        case FTYPE_SOCKET:         return "socket";
+        case FTYPE_FIFO:           return "fifo";
+        case FTYPE_SYMLINK:        return "symlink";
+        case FTYPE_SYMLINK_DIR:    return "symlink_dir";
+        case FTYPE_SYMLINK_EXEC:   return "symlink_exec";
+        case FTYPE_SYMLINK_DEVICE: return "symlink_device";
+        case FTYPE_SYMLINK_SOCKET: return "symlink_socket";
+        case FTYPE_SYMLINK_FIFO:   return "symlink_fifo";
+        case FTYPE_SYMLINK_BROKEN: return "symlink_broken";
+        default:                   return "unknown";
+    }
+}
+
+static const char *json_content_name(ContentType type) {
+    switch (type) {
+        case CONTENT_TEXT:   return "text";
+        case CONTENT_IMAGE:  return "image";
+        case CONTENT_AUDIO:  return "audio";
+        case CONTENT_PDF:    return "pdf";
+        case CONTENT_BINARY: return "binary";
+        default:             return NULL;
+    }
+}
+
+static void json_write_entry(JsonWriter *w, const FileEntry *fe, int depth) {
+    w->len = 0;
+    if (w->cfg->output == OUTPUT_JSON) {
+        jw_puts(w, w->records == 0 ? "[\n" : ",\n");
+    }
+
+    jw_puts(w, "{\"path\":");
+    jw_put_string(w, fe->path);
+    jw_put_field(w, "name", fe->name);
+    jw_put_long(w, "depth", depth);
+    jw_put_field(w, "type", json_type_name(fe->type));
+    jw_put_count(w, "size", fe->size);
+    jw_put_count(w, "file_count", fe->file_count);
+    jw_put_count(w, "line_count", fe->line_count);
+    jw_put_count(w, "word_count", fe->word_count);
+    jw_put_field(w, "content_type", json_content_name(fe->content_type));
+    jw_put_long(w, "mtime", (long long)fe->mtime);
+    jw_put_field(w, "git_status", fe->git_status[0] ? fe->git_status : NULL);
+    jw_put_long(w, "diff_added", fe->diff_added);
+    jw_put_long(w, "diff_removed", fe->diff_removed);
+    jw_puts(w, fe->is_ignored ? ",\"ignored\":true" : ",\"ignored\":false");
+    if (fe->symlink_target) jw_put_field(w, "symlink_target", fe->symlink_target);
+    jw_putc(w, '}');
+    if (w->cfg->output == OUTPUT_NDJSON) jw_putc(w, '\n');
+
+    output_write(w->data, w->len);
+    w->records++;
+}
+
+/* ============================================================================
+ * Tree Walks
+ * ============================================================================ */
+
+static void json_visit(const TreeNode *node, int depth, int is_last, void *ctx) {
+    (void)is_last;
+    json_write_entry(ctx, &node->entry, depth);
+}
+
+/* Visible children of an already filtered tree, as print_tree_children */
+static void json_write_children(JsonWriter *w, const TreeNode *parent, int depth) {
+    for (size_t i = 0; i < parent->child_count; i++) {
+        const TreeNode *child = &parent->children[i];
+        if (!node_is_visible(child, w->cfg)) continue;
+        json_write_entry(w, &child->entry, depth + 1);
+        json_write_children(w, child, depth + 1);
+    }
+}
+
+static int json_has_visible_child(const TreeNode *parent, const Config *cfg) {
+    for (size_t i = 0; i < parent->child_count; i++) {
+        if (node_is_visible(&parent->children[i], cfg)) return 1;
+    }
+    return 0;
+}
+
+void json_print_trees(char **paths, int count, const Config *cfg) {
+    JsonWriter w = {NULL, 0, 0, cfg, 0};
+    TreeBuildOpts opts = config_to_build_opts(cfg);
+
+    for (int i = 0; i < count; i++) {
+        GitCache git;
+        git_cache_init(&git);
+
+        if (!is_filtering_active(cfg)) {
+            build_tree_streaming(paths[i], &opts, &git, json_visit, &w);
+        } else {
+            TreeNode *tree = build_tree(paths[i], &opts, &git, NULL);
+            if (cfg->git_only) compute_git_status_flags(tree, &git, cfg->show_hidden);
+            if (cfg->grep_pattern) compute_grep_flags(tree, cfg->grep_pattern);
+            /* Nothing matched: no root either, as the text output */
+            if (json_has_visible_child(tree, cfg)) {
+                json_write_entry(&w, &tree->entry, 0);
+                json_write_children(&w, tree, 0);
+            }
+            tree_node_free(tree);
+            free(tree);
+        }
+        git_cache_free(&git);
+    }
+
+    if (cfg->output == OUTPUT_JSON) {
+        output_write(w.records ? "\n]\n" : "[]\n", 3);
+    }
+    output_flush();
+    free(w.data);
+}
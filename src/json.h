@@ -0,0 +1,15 @@
+/*
+ * json.h - Machine-readable output (JSON array or NDJSON)
+ */
+
+#ifndef L_JSON_H
+#define L_JSON_H
+
+#include "ui.h"
+
+/* Write every entry under each path as one object per entry, in tree
+ * order, using cfg->output to choose a single array or one object per
+ * line. Without filters, records are written as the tree is walked. */
+void json_print_trees(char **paths, int count, const Config *cfg);
+
+#endif /* L_JSON_H */
@@ -11,6 +11,8 @@
 #include "ui.h"
 #include "daemon.h"
 #include "select.h"
+#include "json.h"
+#include "profile.h"
 
 #ifdef HAVE_LIBGIT2
 #include <git2.h>
@@ -76,6 +78,13 @@ static void print_usage(void) {
     printf("  -f, --filter PATTERN    Show only files/folders matching pattern (implies -at)\n");
     printf("  --min-size SIZE         Show only entries >= SIZE (e.g., 100M, 1G)\n");
     printf("  -i, --interactive       Interactive selection mode\n");
+    printf("  --stream                Print entries as directories are read\n");
+    printf("                          (fixed column widths; not with filters)\n");
+    printf("  --json                  Write entries as a JSON array\n");
+    printf("  --ndjson                Write entries as one JSON object per line\n");
+    printf("  --du-top N              List the N largest cached directories, from the\n");
+    printf("                          daemon's size cache without walking (-d limits depth)\n");
+    printf("  --profile               Print time per phase and cache hits to stderr\n");
     printf("\n");
     printf("Sorting:\n");
     printf("  -S                      Sort by size (largest first)\n");
@@ -94,6 +103,8 @@ typedef struct {
     const char *format;  /* -s, -l, --short, --long */
     const char *sort;    /* -S, -T, -N */
     const char *filter;  /* -f, --filter */
+    const char *output;  /* --json, --ndjson, --du-top */
+    int profile;         /* --profile, started once the options are valid */
 } OptionSet;
 
 static void check_conflict(const char **slot, const char *opt, const Config *cfg) {
@@ -216,11 +227,16 @@ static void parse_args(int argc, char **argv, Config *cfg,
             else if (MATCH_LONG("expand-all")) { cfg->expand_all = 1; }
             else if (MATCH_LONG("list"))       { cfg->list_mode = 1; }
             else if (MATCH_LONG("summary"))    { cfg->summary_mode = 1;
-                                                 cfg->max_depth = L_MAX_DEPTH;
                                                  cfg->long_format = 1; }
             else if (MATCH_LONG("no-icons"))   { cfg->no_icons = 1; }
             else if (MATCH_LONG("color-all")) { cfg->color_all = 1; }
             else if (MATCH_LONG("interactive")) { cfg->interactive = 1; }
+            else if (MATCH_LONG("stream"))     { cfg->stream = 1; }
+            else if (MATCH_LONG("json"))       { check_conflict(&set.output, "--json", cfg);
+                                                 cfg->output = OUTPUT_JSON; }
+            else if (MATCH_LONG("ndjson"))     { check_conflict(&set.output, "--ndjson", cfg);
+                                                 cfg->output = OUTPUT_NDJSON; }
+            else if (MATCH_LONG("profile"))    { set.profile = 1; }
             /* Options with arguments */
             else if ((val = match_opt_with_arg(arg, &i, argc, argv, 'd', "depth"))) {
                 check_conflict(&set.depth, "--depth", cfg);
@@ -235,6 +251,11 @@ static void parse_args(int argc, char **argv, Config *cfg,
             else if ((val = match_opt_with_arg(arg, &i, argc, argv, 0, "min-size"))) {
                 cfg->min_size = parse_size(val);
             }
+            else if ((val = match_opt_with_arg(arg, &i, argc, argv, 0, "du-top"))) {
+                check_conflict(&set.output, "--du-top", cfg);
+                cfg->du_top = parse_depth(val, "--du-top");
+                if (cfg->du_top == 0) die("--du-top requires a positive integer");
+            }
             else if (strcmp(arg, "--daemon") == 0 || strcmp(arg, "--version") == 0) {
                 fprintf(stderr, "%sError:%s %s must be the first argument\n",
                         CLR(cfg, COLOR_RED), RST(cfg), arg);
@@ -291,6 +312,29 @@ static void parse_args(int argc, char **argv, Config *cfg,
         }
     }
 
+    /* Structured output has no interactive or card layout, and records
+     * carry full paths, so there is no ancestry to show */
+    if (set.output && (cfg->interactive || cfg->summary_mode ||
+                       (cfg->show_ancestry && cfg->output != OUTPUT_TREE))) {
+        fprintf(stderr, "%sError:%s %s conflicts with %s\n",
+                CLR(cfg, COLOR_RED), RST(cfg), set.output,
+                cfg->interactive ? "--interactive" :
+                cfg->summary_mode ? "--summary" : "-p");
+        exit(1);
+    }
+
+    /* Rankings read the size cache only; there is no tree to filter */
+    if (cfg->du_top && (set.filter || cfg->git_only || cfg->min_size)) {
+        fprintf(stderr, "%sError:%s --du-top conflicts with %s\n",
+                CLR(cfg, COLOR_RED), RST(cfg),
+                set.filter ? set.filter : cfg->git_only ? "-g" : "--min-size");
+        exit(1);
+    }
+    /* Every level unless -d was given */
+    if (cfg->du_top && !set.depth) cfg->max_depth = -1;
+
+    if (set.profile) profile_start();
+
     if (*dir_count == 0) {
         *dirs = default_dirs;
         *dir_count = 1;
@@ -349,6 +393,9 @@ int main(int argc, char **argv) {
         .show_ancestry = 0,
         .color_all = 0,
         .interactive = 0,
+        .stream = 0,
+        .output = OUTPUT_TREE,
+        .du_top = 0,
         .is_tty = isatty(STDOUT_FILENO),
         .sort_by = SORT_NONE,
         .cwd = "",
@@ -356,7 +403,8 @@ int main(int argc, char **argv) {
         .script_dir = "",
         .grep_pattern = NULL,
         .min_size = 0,
-        .compute = COMPUTE_NONE
+        .compute = COMPUTE_NONE,
+        .deferred = COMPUTE_NONE
     };
 
     /* Initialize environment paths - prefer $PWD to preserve symlink paths */
@@ -412,6 +460,9 @@ int main(int argc, char **argv) {
     /* Set compute options based on mode */
     if (cfg.summary_mode) {
         cfg.compute = COMPUTE_SUMMARY;
+        /* Only the top level is built; print_summary walks the rest.
+         * Filters still need the whole tree to find deep matches. */
+        cfg.max_depth = is_filtering_active(&cfg) ? L_MAX_DEPTH : 1;
     } else if (cfg.long_format) {
         cfg.compute = COMPUTE_LONG;
     } else {
@@ -422,6 +473,21 @@ int main(int argc, char **argv) {
     if (cfg.sort_by == SORT_SIZE) cfg.compute.sizes = 1;
     if (cfg.min_size > 0) cfg.compute.sizes = 1;
 
+    /* Interactive mode draws the tree before measuring anything; select's
+     * workers fill these in behind it. Sorting or filtering by size still
+     * needs sizes while the tree is built. */
+    if (cfg.interactive) {
+        ComputeOpts *c = &cfg.compute;
+        cfg.deferred.file_counts = c->file_counts;
+        cfg.deferred.line_counts = c->line_counts;
+        cfg.deferred.media_info = c->media_info;
+        c->file_counts = c->line_counts = c->media_info = 0;
+        if (cfg.sort_by != SORT_SIZE && cfg.min_size == 0) {
+            cfg.deferred.sizes = c->sizes;
+            c->sizes = 0;
+        }
+    }
+
     /* Load icons */
     Icons icons;
     icons_init_defaults(&icons);
@@ -438,7 +504,8 @@ int main(int argc, char **argv) {
     shebangs_load(&shebangs, cfg.script_dir);
 
     /* Load size cache (only needed when computing sizes or file counts) */
-    if (cfg.compute.sizes || cfg.compute.file_counts) {
+    if (cfg.compute.sizes || cfg.compute.file_counts ||
+        cfg.deferred.sizes || cfg.deferred.file_counts) {
         cache_load();
     }
 
@@ -452,6 +519,28 @@ int main(int argc, char **argv) {
         }
     }
 
+    /* Size rankings come straight from the daemon's database */
+    if (cfg.du_top) {
+        for (int i = 0; i < dir_count; i++) {
+            if (i > 0) printf("\n");
+            if (print_largest_dirs(dirs[i], cfg.du_top, cfg.max_depth, &cfg) != 0) {
+                fprintf(stderr, "%sError:%s Cannot read the size cache "
+                        "(is the daemon running? see l --daemon status)\n",
+                        CLR(&cfg, COLOR_RED), RST(&cfg));
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /* Machine-readable output skips the presentation layer entirely */
+    if (cfg.output != OUTPUT_TREE) {
+        json_print_trees(dirs, dir_count, &cfg);
+        cache_unload();
+        content_cache_unload();
+        return 0;
+    }
+
     /* Auto-enable summary mode for single file arguments */
     if (dir_count == 1) {
         struct stat st;
@@ -467,6 +556,35 @@ int main(int argc, char **argv) {
     Column cols[NUM_COLUMNS];
     columns_init(cols);
 
+    /* Streaming: print each tree while it's walked, keeping only the
+     * current path's directory listings in memory */
+    if (can_stream(&cfg)) {
+        int diff_add_width = 0, diff_del_width = 0;
+        for (int i = 0; i < dir_count; i++) {
+            GitCache git;
+            git_cache_init(&git);
+            PrintContext ctx = {
+                .git = &git,
+                .icons = &icons,
+                .filetypes = &filetypes,
+                .shebangs = &shebangs,
+                .cfg = &cfg,
+                .columns = cfg.long_format ? cols : NULL,
+                .continuation = continuation,
+                .diff_add_width = diff_add_width,
+                .diff_del_width = diff_del_width,
+                .term_width = cfg.is_tty ? get_terminal_width() : 0
+            };
+            print_tree_streaming(dirs[i], &ctx);
+            diff_add_width = ctx.diff_add_width;
+            diff_del_width = ctx.diff_del_width;
+            git_cache_free(&git);
+        }
+        cache_unload();
+        content_cache_unload();
+        return 0;
+    }
+
     /* Build all trees first (computes column widths across all arguments) */
     TreeNode **trees = xmalloc(dir_count * sizeof(TreeNode *));
     GitCache *gits = xmalloc(dir_count * sizeof(GitCache));
@@ -533,6 +651,7 @@ int main(int argc, char **argv) {
         free(trees);
         free(gits);
         cache_unload();
+        content_cache_unload();
         return exit_code;
     }
     {
@@ -583,5 +702,6 @@ int main(int argc, char **argv) {
     free(gits);
 
     cache_unload();
+    content_cache_unload();
     return 0;
 }
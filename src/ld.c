@@ -2,22 +2,51 @@
  * ld.c - Simple periodic directory size cache daemon
  *
  * Periodically scans directories and caches sizes for large directories.
- * Skips network filesystems automatically.
+ * Skips network filesystems unless network_scan=1 is set in the config.
+ * Then each network mount is read by a team of network_threads of its
+ * own, and only every network_rescan scans; in between, its rows are
+ * carried over from the previous database.
+ *
+ * Scans are incremental: directories whose stamp is unchanged since the
+ * previous scan are not re-read. Contents can change without touching the
+ * parent directory (a file growing in place), so every full_rescan scans,
+ * and on manual refresh, the whole tree is walked from scratch.
+ *
+ * With watch=1 in the config, the daemon watches the cached directories
+ * between scans and rescans just the ones that change, updating their
+ * rows and ancestor totals in the main database in place.
+ *
+ * Clients ask it over a Unix socket for directories the cache doesn't
+ * cover (see query.h).
+ *
+ * Progress and costs are written to a metrics file in the Prometheus text
+ * format (cache_get_metrics_path) every few seconds during a scan and
+ * after each one, for node_exporter's textfile collector or any scraper.
  */
 
 #include "common.h"
 #include "cache.h"
 #include "scan.h"
+#include "watch.h"
+#include "query.h"
 #include <stdarg.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
 #include <omp.h>
 
 #define LOG_FILE "/tmp/l-cached.log"
-#define DAEMON_MAX_THREADS 4
+#define DAEMON_DEFAULT_THREADS 4   /* Cap on cores used unless threads= is set */
+#define WATCH_COALESCE_SECS 2   /* Collect events this long before rescanning */
+#define METRICS_INTERVAL_SECS 5 /* Metrics file refresh while a scan runs */
+#define METRICS_MAX_MOUNTS 64   /* Network mounts listed individually */
 
 static volatile sig_atomic_t g_shutdown = 0;
 static volatile sig_atomic_t g_refresh = 0;
+static long g_reused = 0;
+static int g_network_due = 1;   /* Read network mounts during this scan */
+static long g_threshold = 0;    /* Files a directory needs for a sizes row */
+static int g_quiet = 0;         /* Leave per-directory lines out of the log */
 
 /* ============================================================================
  * Logging
@@ -25,9 +54,10 @@ static volatile sig_atomic_t g_refresh = 0;
 
 static void log_msg(const char *level, const char *fmt, ...) {
     time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
+    struct tm tm;
+    localtime_r(&now, &tm);  /* Store callbacks log from scan threads */
     fprintf(stderr, "[%02d:%02d:%02d] %s: ",
-            tm->tm_hour, tm->tm_min, tm->tm_sec, level);
+            tm.tm_hour, tm.tm_min, tm.tm_sec, level);
     va_list args;
     va_start(args, fmt);
     vfprintf(stderr, fmt, args);
@@ -57,15 +87,419 @@ static void write_status(const char *status) {
     }
 }
 
+/* ============================================================================
+ * Metrics
+ * ============================================================================ */
+
+typedef struct {
+    char *path;
+    double seconds;             /* Wall time of the last read */
+    long files;
+    int carried;                /* Kept from the last read during this scan */
+} MountMetrics;
+
+/* Guarded by g_metrics_lock; written by the main thread, mount callbacks
+ * and the refresh thread */
+static struct {
+    int scanning;
+    struct timespec scan_start;
+    ScanProgress at_start;      /* Counters when this scan began */
+    long scans;                 /* Completed scans */
+    double last_seconds;
+    long last_dirs;             /* Directories visited by the last scan */
+    long last_files;
+    long cached;                /* sizes rows in the last saved database */
+    MountMetrics mounts[METRICS_MAX_MOUNTS];
+    int mount_count;
+} g_metrics;
+
+static pthread_mutex_t g_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_metrics_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_metrics_thread;
+static int g_metrics_running = 0;
+static int g_metrics_stopping = 0;
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void metric_head(FILE *f, const char *name, const char *type, const char *help) {
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void metric_long(FILE *f, const char *name, const char *type,
+                        const char *help, long value) {
+    metric_head(f, name, type, help);
+    fprintf(f, "%s %ld\n", name, value);
+}
+
+static void metric_double(FILE *f, const char *name, const char *type,
+                          const char *help, double value) {
+    metric_head(f, name, type, help);
+    fprintf(f, "%s %.6f\n", name, value);
+}
+
+/* Label value with \\, \" and newlines escaped */
+static void metric_label(FILE *f, const char *value) {
+    for (const char *p = value; *p; p++) {
+        if (*p == '\\' || *p == '"') fputc('\\', f);
+        if (*p == '\n') fputs("\\n", f);
+        else fputc(*p, f);
+    }
+}
+
+/* Per-mount series: one sample per network mount seen so far */
+static void metric_mounts(FILE *f, const char *name, const char *type,
+                          const char *help, int field) {
+    if (g_metrics.mount_count == 0) return;
+    metric_head(f, name, type, help);
+    for (int i = 0; i < g_metrics.mount_count; i++) {
+        const MountMetrics *m = &g_metrics.mounts[i];
+        fprintf(f, "%s{mount=\"", name);
+        metric_label(f, m->path);
+        if (field == 0) fprintf(f, "\"} %.6f\n", m->seconds);
+        else if (field == 1) fprintf(f, "\"} %ld\n", m->files);
+        else fprintf(f, "\"} %d\n", m->carried);
+    }
+}
+
+/* Client lookups recorded by cache_unload, as "HITS MISSES" */
+static void read_client_hits(long *hits, long *misses) {
+    char path[PATH_MAX];
+    cache_get_hits_path(path, sizeof(path));
+    *hits = *misses = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    if (fscanf(f, "%ld %ld", hits, misses) != 2) *hits = *misses = 0;
+    fclose(f);
+}
+
+/* Rewrite the metrics file (replaced by rename, so scrapers never see a
+ * partial one). Caller holds g_metrics_lock. */
+static void metrics_write(void) {
+    char path[PATH_MAX], temp[PATH_MAX + 8];
+    cache_get_metrics_path(path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE *f = fopen(temp, "w");
+    if (!f) return;
+
+    ScanProgress p, q;
+    scan_get_progress(&p);
+    scan_get_detached_progress(&q);
+    CacheWriteStats w;
+    cache_daemon_write_stats(&w);
+    long hits, misses;
+    read_client_hits(&hits, &misses);
+
+    /* The current scan so far, or the last one while idle */
+    double elapsed = g_metrics.last_seconds;
+    long dirs = g_metrics.last_dirs, files = g_metrics.last_files;
+    long remaining = 0;
+    if (g_metrics.scanning) {
+        elapsed = seconds_since(&g_metrics.scan_start);
+        dirs = p.dirs_read + p.dirs_reused -
+               g_metrics.at_start.dirs_read - g_metrics.at_start.dirs_reused;
+        files = p.files_read - g_metrics.at_start.files_read;
+        /* Estimated from the size of the last complete walk */
+        if (g_metrics.last_dirs > dirs) remaining = g_metrics.last_dirs - dirs;
+    }
+
+    metric_long(f, "l_cached_scanning", "gauge",
+                "1 while a scan is running", g_metrics.scanning);
+    metric_long(f, "l_cached_scans_total", "counter",
+                "Scans completed", g_metrics.scans);
+    metric_double(f, "l_cached_scan_seconds", "gauge",
+                  "Wall time of the running scan, or of the last one", elapsed);
+    metric_long(f, "l_cached_scan_dirs", "gauge",
+                "Directories visited by the running scan, or by the last one", dirs);
+    metric_long(f, "l_cached_scan_dirs_remaining", "gauge",
+                "Directories left in the running scan, estimated from the last one",
+                remaining);
+    metric_double(f, "l_cached_scan_dirs_per_second", "gauge",
+                  "Directories visited per second in the running or last scan",
+                  elapsed > 0 ? dirs / elapsed : 0);
+    metric_double(f, "l_cached_scan_files_per_second", "gauge",
+                  "Entries counted per second in the running or last scan",
+                  elapsed > 0 ? files / elapsed : 0);
+    metric_long(f, "l_cached_cached_dirs", "gauge",
+                "Directories in the last saved cache", g_metrics.cached);
+    metric_long(f, "l_cached_dirs_read_total", "counter",
+                "Directories listed from disk", p.dirs_read);
+    metric_long(f, "l_cached_dirs_reused_total", "counter",
+                "Directories reused unchanged from the previous scan", p.dirs_reused);
+    metric_long(f, "l_cached_files_read_total", "counter",
+                "Entries counted in directories listed from disk", p.files_read);
+    metric_long(f, "l_cached_query_dirs_read_total", "counter",
+                "Directories listed from disk for client queries", q.dirs_read);
+    metric_long(f, "l_cached_query_files_read_total", "counter",
+                "Entries counted for client queries", q.files_read);
+    metric_long(f, "l_cached_visited_entries", "gauge",
+                "Inodes in the running scan's visited set", p.visited_entries);
+    metric_long(f, "l_cached_visited_bytes", "gauge",
+                "Memory held by the running scan's visited set", p.visited_bytes);
+    metric_long(f, "l_cached_sqlite_transactions_total", "counter",
+                "Write transactions committed during scans", w.batches);
+    metric_long(f, "l_cached_sqlite_rows_total", "counter",
+                "Rows written during scans", w.rows);
+    metric_double(f, "l_cached_sqlite_write_seconds_total", "counter",
+                  "Time spent in write transactions", w.batch_seconds);
+    metric_double(f, "l_cached_sqlite_write_max_seconds", "gauge",
+                  "Longest write transaction", w.batch_max_seconds);
+    metric_double(f, "l_cached_sqlite_save_seconds", "gauge",
+                  "Time the last save took to build the tables and index",
+                  w.save_seconds);
+    metric_mounts(f, "l_cached_mount_read_seconds", "gauge",
+                  "Wall time of the last read of each network mount", 0);
+    metric_mounts(f, "l_cached_mount_files", "gauge",
+                  "Files found by the last read of each network mount", 1);
+    metric_mounts(f, "l_cached_mount_carried", "gauge",
+                  "1 if the running or last scan kept the mount's previous read", 2);
+    metric_long(f, "l_cached_client_size_hits_total", "counter",
+                "Directory sizes clients took from the cache", hits);
+    metric_long(f, "l_cached_client_size_misses_total", "counter",
+                "Directory sizes clients had to walk", misses);
+
+    if (fclose(f) != 0 || rename(temp, path) != 0) unlink(temp);
+}
+
+static MountMetrics *metrics_mount(const char *path) {
+    for (int i = 0; i < g_metrics.mount_count; i++) {
+        if (strcmp(g_metrics.mounts[i].path, path) == 0) return &g_metrics.mounts[i];
+    }
+    if (g_metrics.mount_count == METRICS_MAX_MOUNTS) return NULL;
+    MountMetrics *m = &g_metrics.mounts[g_metrics.mount_count++];
+    *m = (MountMetrics){xstrdup(path), 0, 0, 0};
+    return m;
+}
+
+/* Refresh the file periodically while a scan runs; the main thread
+ * writes it itself when scans start and end */
+static void *metrics_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_metrics_lock);
+    while (!g_metrics_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += METRICS_INTERVAL_SECS;
+        pthread_cond_timedwait(&g_metrics_cond, &g_metrics_lock, &deadline);
+        if (g_metrics.scanning && !g_metrics_stopping) metrics_write();
+    }
+    pthread_mutex_unlock(&g_metrics_lock);
+    return NULL;
+}
+
+static void metrics_scan_begin(void) {
+    pthread_mutex_lock(&g_metrics_lock);
+    g_metrics.scanning = 1;
+    clock_gettime(CLOCK_MONOTONIC, &g_metrics.scan_start);
+    scan_get_progress(&g_metrics.at_start);
+    for (int i = 0; i < g_metrics.mount_count; i++)
+        g_metrics.mounts[i].carried = 0;
+    metrics_write();
+    pthread_mutex_unlock(&g_metrics_lock);
+}
+
+/* complete is 0 for an interrupted scan, which mustn't set the estimate */
+static void metrics_scan_end(long cached, int complete) {
+    ScanProgress p;
+    scan_get_progress(&p);
+    pthread_mutex_lock(&g_metrics_lock);
+    g_metrics.scanning = 0;
+    if (complete) {
+        g_metrics.scans++;
+        g_metrics.last_seconds = seconds_since(&g_metrics.scan_start);
+        g_metrics.last_dirs = p.dirs_read + p.dirs_reused -
+                              g_metrics.at_start.dirs_read -
+                              g_metrics.at_start.dirs_reused;
+        g_metrics.last_files = p.files_read - g_metrics.at_start.files_read;
+        g_metrics.cached = cached;
+    }
+    metrics_write();
+    pthread_mutex_unlock(&g_metrics_lock);
+}
+
+/* Rewrite the file outside a scan (after watch-mode updates) */
+static void metrics_refresh(void) {
+    pthread_mutex_lock(&g_metrics_lock);
+    metrics_write();
+    pthread_mutex_unlock(&g_metrics_lock);
+}
+
+static void metrics_start(void) {
+    if (pthread_create(&g_metrics_thread, NULL, metrics_main, NULL) == 0)
+        g_metrics_running = 1;
+}
+
+static void metrics_stop(void) {
+    if (!g_metrics_running) return;
+    pthread_mutex_lock(&g_metrics_lock);
+    g_metrics_stopping = 1;
+    pthread_cond_signal(&g_metrics_cond);
+    pthread_mutex_unlock(&g_metrics_lock);
+    pthread_join(g_metrics_thread, NULL);
+    g_metrics_running = 0;
+}
+
 /* ============================================================================
  * Store Callback
  * ============================================================================ */
 
 static void store_callback(const char *path, off_t size, long count) {
-    if (cache_daemon_store(path, size, count) == 0)
+    if (cache_daemon_store(path, size, count) == 0 && !g_quiet)
         log_info("cached %s (%ld files)", path, count);
 }
 
+static int reuse_callback(const char *path, const struct stat *st,
+                          ScanDirState *state) {
+    if (!cache_daemon_reuse(path, st, state)) return 0;
+    g_reused++;
+    return 1;
+}
+
+static void state_callback(const char *path, const ScanDirState *state) {
+    cache_daemon_store_dir(path, state);
+}
+
+static int mount_callback(const char *path, ScanResult *result) {
+    CacheEntry entry;
+    if (!g_network_due && cache_daemon_carry(path, &entry)) {
+        *result = (ScanResult){(off_t)entry.size, (long)entry.file_count};
+        log_info("kept network mount %s from the last read", path);
+        pthread_mutex_lock(&g_metrics_lock);
+        MountMetrics *m = metrics_mount(path);
+        if (m) m->carried = 1;
+        pthread_mutex_unlock(&g_metrics_lock);
+        return 1;
+    }
+    log_info("reading network mount %s", path);
+    return 0;
+}
+
+static void mount_done_callback(const char *path, ScanResult result, double seconds) {
+    log_info("read network mount %s (%ld files, %.1fs)", path, result.file_count, seconds);
+    /* The next scans carry the mount from its root row, which the scan
+     * only wrote if the mount reached the threshold */
+    if (!g_shutdown && result.size >= 0 && result.file_count >= 0 &&
+        result.file_count < g_threshold)
+        store_callback(path, result.size, result.file_count);
+    pthread_mutex_lock(&g_metrics_lock);
+    MountMetrics *m = metrics_mount(path);
+    if (m) {
+        m->seconds = seconds;
+        m->files = result.file_count;
+    }
+    pthread_mutex_unlock(&g_metrics_lock);
+}
+
+/* ============================================================================
+ * Watch Mode
+ * ============================================================================ */
+
+static void add_watch_callback(const char *path, void *ctx) {
+    long *count = ctx;
+    if (watch_add(path) == 0) (*count)++;
+}
+
+/* Sort deepest-first: a path sorts after its ancestors, so reverse order
+ * updates children before the parents that absorb their deltas */
+static int cmp_path_desc(const void *a, const void *b) {
+    return strcmp(*(char *const *)b, *(char *const *)a);
+}
+
+/* Map each changed path to its nearest cached directory (FSEvents reports
+ * uncached subdirectories too), rescan those and fold deltas upward */
+static void apply_changes(WatchBatch *batch, long threshold) {
+    for (size_t i = 0; i < batch->count; i++) {
+        char *p = batch->paths[i];
+        CacheEntry entry;
+        char *slash;
+        while (!cache_daemon_live_get(p, &entry) &&
+               (slash = strrchr(p, '/')) != NULL && slash != p)
+            *slash = '\0';
+    }
+    qsort(batch->paths, batch->count, sizeof(char *), cmp_path_desc);
+
+    size_t updated = 0;
+    cache_daemon_live_begin();
+    for (size_t i = 0; i < batch->count && !g_shutdown; i++) {
+        const char *path = batch->paths[i];
+        if (i > 0 && strcmp(path, batch->paths[i - 1]) == 0) continue;
+
+        CacheEntry old;
+        if (!cache_daemon_live_get(path, &old)) continue;
+
+        /* A file changed in place leaves the directory stamp alone */
+        cache_daemon_live_invalidate(path);
+        ScanResult r = scan_directory_incremental(path, store_callback,
+                                                  reuse_callback, state_callback,
+                                                  (volatile int *)&g_shutdown,
+                                                  threshold);
+        if (g_shutdown) break;
+
+        if (r.size < 0) {
+            cache_daemon_live_remove(path);
+            cache_daemon_live_adjust(path, -(off_t)old.size, -(long)old.file_count);
+            log_info("removed %s", path);
+        } else {
+            cache_daemon_store(path, r.size, r.file_count);
+            cache_daemon_live_adjust(path, r.size - (off_t)old.size,
+                                     r.file_count - (long)old.file_count);
+        }
+        updated++;
+    }
+    cache_daemon_live_commit();
+    if (updated) {
+        log_info("updated %zu changed directories", updated);
+        metrics_refresh();
+    }
+}
+
+/* Watch cached directories until the next scan is due.
+ * Returns 0 if watching ran, -1 if unavailable (caller sleeps instead). */
+static int watch_until_next_scan(int seconds, long threshold) {
+    if (cache_daemon_live_open() != 0) {
+        log_error("watch: cannot open cache");
+        return -1;
+    }
+    if (watch_init() != 0) {
+        log_error("watch: not supported on this system");
+        cache_daemon_close();
+        return -1;
+    }
+
+    long watched = 0;
+    cache_daemon_live_foreach(add_watch_callback, &watched);
+    log_info("watching %ld directories", watched);
+
+    WatchBatch batch = {0};
+    time_t deadline = time(NULL) + seconds;
+    time_t batch_start = 0;
+    while (!g_shutdown && !g_refresh && time(NULL) < deadline) {
+        if (watch_poll(&batch, 1000) < 0) {
+            log_info("watch: events lost, rescanning");
+            watch_batch_clear(&batch);
+            break;
+        }
+        if (batch.count == 0) continue;
+        if (!batch_start) batch_start = time(NULL);
+        if (time(NULL) - batch_start >= WATCH_COALESCE_SECS) {
+            apply_changes(&batch, threshold);
+            watch_batch_clear(&batch);
+            batch_start = 0;
+        }
+    }
+    if (batch.count && !g_shutdown)
+        apply_changes(&batch, threshold);
+
+    watch_batch_free(&batch);
+    watch_close();
+    cache_daemon_close();
+    return 0;
+}
+
 /* ============================================================================
  * Signal Handling
  * ============================================================================ */
@@ -88,10 +522,20 @@ int main(int argc, char *argv[]) {
     (void)argc;
     (void)argv;
 
-    int max_threads = omp_get_num_procs();
-    if (max_threads > DAEMON_MAX_THREADS)
-        max_threads = DAEMON_MAX_THREADS;
-    omp_set_num_threads(max_threads);
+    int threads = config_get_threads();
+    if (threads == 0) {
+        threads = omp_get_num_procs();
+        if (threads > DAEMON_DEFAULT_THREADS)
+            threads = DAEMON_DEFAULT_THREADS;
+    }
+    omp_set_num_threads(threads);
+    if (config_get_work_stealing())
+        scan_set_scheduler(SCAN_SCHED_STEAL);
+    int network_scan = config_get_network_scan();
+    scan_set_network(network_scan ? SCAN_NET_WIDE : SCAN_NET_SKIP,
+                     config_get_network_threads(), mount_callback,
+                     mount_done_callback);
+    g_quiet = config_get_quiet();
 
     signal(SIGINT, handle_shutdown);
     signal(SIGTERM, handle_shutdown);
@@ -99,7 +543,23 @@ int main(int argc, char *argv[]) {
 
     int scan_interval = config_get_interval();
     long threshold = config_get_threshold();
-    log_info("starting (scan interval: %ds)", scan_interval);
+    g_threshold = threshold;
+    int full_rescan = config_get_full_rescan();
+    int network_rescan = config_get_network_rescan();
+    int watch = config_get_watch();
+    log_info("starting (scan interval: %ds, %d threads, %s scheduler)",
+             scan_interval, threads,
+             config_get_work_stealing() ? "work-stealing" : "task");
+    if (network_scan)
+        log_info("network mounts: %d reads in flight, re-read every %d scans",
+                 config_get_network_threads(), network_rescan);
+
+    int scans_since_full = 0;
+    int scans_since_network = 0;
+    int force_full = 1;
+    metrics_start();
+    if (query_serve_start((volatile int *)&g_shutdown) != 0)
+        log_error("query socket unavailable; clients will walk misses themselves");
 
     while (!g_shutdown) {
         rotate_log();
@@ -113,34 +573,52 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
+        int full = force_full || scans_since_full >= full_rescan;
+        g_network_due = force_full || scans_since_network >= network_rescan;
+        g_reused = 0;
+
         write_status("scanning");
-        log_info("scanning /...");
-        ScanResult r = scan_directory("/", store_callback, NULL,
-                                       (volatile int *)&g_shutdown, threshold);
+        metrics_scan_begin();
+        log_info("scanning / (%s)...", full ? "full" : "incremental");
+        ScanResult r = scan_directory_incremental("/", store_callback,
+                                                  full ? NULL : reuse_callback,
+                                                  state_callback,
+                                                  (volatile int *)&g_shutdown,
+                                                  threshold);
         log_info("  /: %ld files, %lld bytes", r.file_count, (long long)r.size);
-
-        /* Get count before save (save closes the db) */
-        int cached = cache_daemon_count();
+        if (!full)
+            log_info("  %ld unchanged directories reused", g_reused);
 
         /* Atomic replace: temp db -> final db */
         if (cache_daemon_save() != 0)
             log_error("cache save failed");
+        int cached = cache_daemon_count();
+
+        scans_since_full = full ? 1 : scans_since_full + 1;
+        scans_since_network = g_network_due ? 1 : scans_since_network + 1;
+        force_full = 0;
 
+        metrics_scan_end(cached, !g_shutdown);
         time_t elapsed = time(NULL) - start;
         log_info("scan complete (%lds, %d cached)", elapsed, cached);
         char status_buf[32];
         snprintf(status_buf, sizeof(status_buf), "idle %ld", (long)elapsed);
         write_status(status_buf);
 
-        for (int i = 0; i < scan_interval && !g_shutdown && !g_refresh; i++)
-            sleep(1);
+        if (!watch || watch_until_next_scan(scan_interval, threshold) != 0) {
+            for (int i = 0; i < scan_interval && !g_shutdown && !g_refresh; i++)
+                sleep(1);
+        }
 
         if (g_refresh) {
             log_info("manual refresh requested");
             g_refresh = 0;
+            force_full = 1;
         }
     }
 
+    query_serve_stop();
+    metrics_stop();
     cache_daemon_close();
     log_info("shutdown");
     return 0;
@@ -0,0 +1,94 @@
+/*
+ * profile.c - Per-phase timings and cache counters (--profile)
+ */
+
+#include "profile.h"
+#include "common.h"
+#include <time.h>
+#include <sys/resource.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int g_profile = 0;
+
+static int64_t g_start_ns;
+static int64_t g_phase_ns[PROF_PHASE_COUNT];
+static long g_phase_calls[PROF_PHASE_COUNT];
+static long g_counters[PROF_COUNTER_COUNT];
+
+static const char *const PHASE_NAMES[PROF_PHASE_COUNT] = {
+    "git", "read", "dir stats", "content", "format", "write"
+};
+
+int64_t profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return TIMESPEC_NS(ts);
+}
+
+void profile_add(ProfPhase phase, int64_t start) {
+    int64_t elapsed = profile_now() - start;
+    #pragma omp atomic
+    g_phase_ns[phase] += elapsed;
+    #pragma omp atomic
+    g_phase_calls[phase]++;
+}
+
+void profile_count(ProfCounter counter) {
+    #pragma omp atomic
+    g_counters[counter]++;
+}
+
+static void profile_counter_row(const char *name, ProfCounter hit, ProfCounter miss) {
+    long hits = g_counters[hit], misses = g_counters[miss];
+    if (hits + misses == 0) return;
+    fprintf(stderr, "  %-12s %8ld %8ld %7.1f%%\n", name, hits, misses,
+            100.0 * (double)hits / (double)(hits + misses));
+}
+
+static void profile_report(void) {
+    double wall_ms = (double)(profile_now() - g_start_ns) / 1e6;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    double rss_mb = (double)ru.ru_maxrss / (1024 * 1024);  /* bytes */
+#else
+    double rss_mb = (double)ru.ru_maxrss / 1024;           /* kilobytes */
+#endif
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+
+    fprintf(stderr, "profile: %.1f ms wall, %.1f ms user, %.1f ms sys, "
+            "%.1f MB peak RSS (whole process), %d thread%s\n", wall_ms,
+            ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3,
+            ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3,
+            rss_mb, threads, threads == 1 ? "" : "s");
+    fprintf(stderr, "  %-12s %10s %8s\n", "phase", "ms", "calls");
+    for (int i = 0; i < PROF_PHASE_COUNT; i++) {
+        if (g_phase_calls[i] == 0) continue;
+        fprintf(stderr, "  %-12s %10.1f %8ld\n", PHASE_NAMES[i],
+                (double)g_phase_ns[i] / 1e6, g_phase_calls[i]);
+    }
+
+    int any = 0;
+    for (int i = 0; i < PROF_COUNTER_COUNT; i++) any |= g_counters[i] != 0;
+    if (any) {
+        fprintf(stderr, "  %-12s %8s %8s %8s\n", "cache", "hits", "misses", "hit");
+        profile_counter_row("sizes", PROF_SIZE_HIT, PROF_SIZE_MISS);
+        profile_counter_row("content", PROF_CONTENT_HIT, PROF_CONTENT_MISS);
+        profile_counter_row("git status", PROF_STATUS_HIT, PROF_STATUS_MISS);
+    }
+    fprintf(stderr, "  faults %ld minor, %ld major; context switches %ld voluntary, "
+            "%ld involuntary\n", ru.ru_minflt, ru.ru_majflt, ru.ru_nvcsw, ru.ru_nivcsw);
+}
+
+void profile_start(void) {
+    if (g_profile) return;
+    g_profile = 1;
+    g_start_ns = profile_now();
+    atexit(profile_report);
+}
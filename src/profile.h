@@ -0,0 +1,56 @@
+/*
+ * profile.h - Per-phase timings and cache counters (--profile)
+ *
+ * Phases are timed where they run, so work done on worker threads adds up
+ * across threads and can exceed the wall time. Memory is the process's peak
+ * RSS only: phases interleave per entry, so it isn't split between them.
+ * Nothing is recorded unless profile_start was called; the macros cost one
+ * branch otherwise.
+ */
+
+#ifndef L_PROFILE_H
+#define L_PROFILE_H
+
+#include <stdint.h>
+
+typedef enum {
+    PROF_GIT,           /* git_populate_repo: status, ignores, diff stats */
+    PROF_READ,          /* Directory listings and their per-entry lstat */
+    PROF_DIR_STATS,     /* get_dir_stats_cached: cache lookup or walk */
+    PROF_CONTENT,       /* fileinfo_compute_content: line counts, media */
+    PROF_FORMAT,        /* format_entry: one call per line */
+    PROF_WRITE,         /* output_flush: one call per chunk written */
+    PROF_PHASE_COUNT
+} ProfPhase;
+
+typedef enum {
+    PROF_SIZE_HIT,      /* Directory sizes from the daemon's cache */
+    PROF_SIZE_MISS,     /* ... walked instead */
+    PROF_CONTENT_HIT,   /* Line counts and media info from the content cache */
+    PROF_CONTENT_MISS,
+    PROF_STATUS_HIT,    /* Git status restored from a snapshot */
+    PROF_STATUS_MISS,
+    PROF_COUNTER_COUNT
+} ProfCounter;
+
+extern int g_profile;
+
+/* Start recording; the report is written to stderr at exit */
+void profile_start(void);
+
+/* Monotonic clock in nanoseconds */
+int64_t profile_now(void);
+
+/* Add the time since start (from profile_now) to phase (thread-safe) */
+void profile_add(ProfPhase phase, int64_t start);
+
+/* Bump a counter (thread-safe) */
+void profile_count(ProfCounter counter);
+
+#define PROFILE_BEGIN() (g_profile ? profile_now() : 0)
+#define PROFILE_END(phase, start) \
+    do { if (g_profile) profile_add((phase), (start)); } while (0)
+#define PROFILE_COUNT(counter) \
+    do { if (g_profile) profile_count(counter); } while (0)
+
+#endif /* L_PROFILE_H */
@@ -0,0 +1,53 @@
+/*
+ * query.h - Size queries from clients to the daemon over a Unix socket
+ *
+ * Cached sizes are read straight from the snapshot index (see cache.h).
+ * This covers the misses: instead of every client walking an uncached
+ * directory itself, it asks l-cached to walk it. Concurrent requests for
+ * the same path share one walk, so users listing the same tree at once
+ * don't repeat the work.
+ *
+ * The protocol is one text line each way, then progress and a result:
+ *
+ *   client: SCAN <path>\n          absolute, symlinks resolved
+ *   daemon: PART <size> <count>\n  zero or more, as direct subdirectories
+ *                                  finish (a lower bound on the total), and
+ *                                  at least every QUERY_KEEPALIVE seconds
+ *                                  while the walk runs
+ *           DONE <size> <count>\n  the total, then the connection closes
+ *           FAIL\n                 can't walk it here; walk it locally
+ *           BUSY\n                 too many walks running; walk it locally
+ */
+
+#ifndef L_QUERY_H
+#define L_QUERY_H
+
+#include "cache.h"
+
+#define QUERY_MAX_JOBS     4     /* Concurrent walks; more get BUSY */
+#define QUERY_IDLE_TIMEOUT 30    /* Seconds a client waits between lines */
+#define QUERY_KEEPALIVE    5     /* Most seconds between PART lines */
+
+/* ============================================================================
+ * Client
+ * ============================================================================ */
+
+/* Ask the daemon for path's totals. Returns 0 and fills out, or -1 if the
+ * caller should walk it itself: the daemon isn't running (remembered for
+ * the rest of the process), refused, or path is a leaf directory that is
+ * cheaper to read than to ask about. Thread-safe. */
+int query_scan(const char *path, DirStats *out);
+
+/* ============================================================================
+ * Daemon
+ * ============================================================================ */
+
+/* Start serving on the socket from a thread of its own. Walks stop early
+ * once *shutdown is set. Returns 0 on success, -1 if the socket can't be
+ * created (clients then walk misses themselves). */
+int query_serve_start(volatile int *shutdown);
+
+/* Stop accepting, wait for running walks and remove the socket */
+void query_serve_stop(void);
+
+#endif /* L_QUERY_H */
@@ -0,0 +1,503 @@
+/*
+ * query_daemon.c - Daemon side of the query socket (see query.h)
+ *
+ * One thread polls the listening socket and every client: it reads
+ * requests as they arrive, so a client that never writes holds up no one,
+ * and sends the PART lines. A request joins the running job for the same
+ * path or goes to an idle worker, which answers it from the snapshot index
+ * if it can and walks the path otherwise. Finished walks aren't kept: a
+ * directory's own stamp says nothing about changes further down, so a
+ * repeat walks again. The server thread never touches the filesystem or
+ * the index, so neither a hung mount nor an index reload holds up other
+ * clients. Workers live as long as the server, so their OpenMP teams are
+ * reused rather than started for every walk. Walks look up subdirectories
+ * in the snapshot index like client walks do, and add each direct
+ * subdirectory of the requested path to the job's partial totals as it
+ * finishes. All sockets are non-blocking, so a client that stops reading
+ * never holds up a walk.
+ */
+
+#include "query.h"
+#include "scan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0   /* macOS sets SO_NOSIGPIPE on each socket instead */
+#endif
+
+#define QUERY_BACKLOG        64
+#define QUERY_READ_TIMEOUT   1     /* Seconds a client gets to send its request */
+#define QUERY_PART_INTERVAL  250   /* Milliseconds between PART lines */
+
+typedef struct {
+    pthread_t thread;           /* Worker that runs this slot's walks */
+    pthread_mutex_t lock;       /* Guards everything below */
+    pthread_cond_t cond;        /* Signalled when a walk is handed over */
+    int active;                 /* Walk in progress */
+    int quit;
+    char path[PATH_MAX];
+    size_t path_len;
+    int *fds;                   /* Clients waiting for the result */
+    size_t fd_count;
+    size_t fd_cap;
+    ScanResult partial;         /* Direct subdirectories finished so far */
+    int partial_sent;           /* partial is what the clients last got */
+    struct timespec last_part;
+} QueryJob;
+
+/* A connection whose request hasn't fully arrived */
+typedef struct {
+    int fd;                     /* -1 if the slot is free */
+    size_t used;
+    struct timespec accepted;
+    char line[PATH_MAX + 16];
+} QueryConn;
+
+static QueryJob g_jobs[QUERY_MAX_JOBS];
+static QueryConn g_conns[QUERY_BACKLOG];   /* Server thread only */
+static int64_t g_index_stamp = -1;  /* Database mtime when the index was loaded */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;  /* Before any job lock */
+/* Held for reading by workers while they use the snapshot index, and for
+ * writing to reload it */
+static pthread_rwlock_t g_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static pthread_t g_server;
+static int g_running = 0;
+static int g_stopping = 0;
+static int g_listen_fd = -1;
+static int g_threads = 1;
+static volatile int *g_shutdown = NULL;
+
+/* ============================================================================
+ * Replies
+ * ============================================================================ */
+
+static void reply(int fd, const char *line) {
+    size_t len = strlen(line);
+    ssize_t sent = send(fd, line, len, MSG_NOSIGNAL);
+    (void)sent;  /* A client that hung up just misses its answer */
+}
+
+static void reply_result(int fd, const char *verb, ScanResult r) {
+    char line[96];
+    snprintf(line, sizeof(line), "%s %lld %ld\n", verb, (long long)r.size, r.file_count);
+    reply(fd, line);
+}
+
+/* ============================================================================
+ * Walks
+ * ============================================================================ */
+
+static double seconds_between(const struct timespec *a, const struct timespec *b) {
+    return (double)(b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* Store callback of every walk (threshold 0, so called for each finished
+ * directory): directories directly below a job's path add to its partial
+ * totals, which the server thread sends on */
+static void job_store(const char *path, off_t size, long count) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return;
+    size_t parent_len = slash == path ? 1 : (size_t)(slash - path);
+
+    for (int i = 0; i < QUERY_MAX_JOBS; i++) {
+        QueryJob *job = &g_jobs[i];
+        pthread_mutex_lock(&job->lock);
+        if (job->active && job->path_len == parent_len &&
+            memcmp(job->path, path, parent_len) == 0) {
+            job->partial.size += size;
+            job->partial.file_count += count;
+            job->partial_sent = 0;
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+/* Reload the snapshot index if the daemon saved since it was loaded.
+ * Caller holds g_index_lock for writing. */
+static void index_refresh(void) {
+    char db_path[PATH_MAX];
+    cache_get_path(db_path, sizeof(db_path));
+    struct stat st;
+    int64_t stamp = stat(db_path, &st) == 0 ? GET_MTIME_NS(st) : 0;
+    if (stamp == g_index_stamp) return;
+    cache_unload();
+    cache_load();
+    g_index_stamp = stamp;
+}
+
+static void *job_main(void *arg) {
+    QueryJob *job = arg;
+#ifdef _OPENMP
+    omp_set_num_threads(g_threads);  /* New threads start from the defaults */
+#endif
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        while (!job->active && !job->quit)
+            pthread_cond_wait(&job->cond, &job->lock);
+        if (!job->active) break;
+        pthread_mutex_unlock(&job->lock);
+
+        /* Pick up a newer snapshot unless another walk is reading this
+         * one; it is reloaded once none is */
+        if (pthread_rwlock_trywrlock(&g_index_lock) == 0) {
+            index_refresh();
+            pthread_rwlock_unlock(&g_index_lock);
+        }
+        pthread_rwlock_rdlock(&g_index_lock);
+
+        ScanResult r = {-1, 0};
+        CacheEntry cached;
+        if (cache_lookup(job->path, &cached)) {
+            r = (ScanResult){(off_t)cached.size, (long)cached.file_count};
+        } else {
+            /* Paths on a network (or virtual) filesystem are left to the
+             * client, which reads them itself. Checked here, not by the
+             * server thread, so a hung mount holds up this walk alone. */
+            int dirfd = open(job->path, O_RDONLY | O_DIRECTORY);
+            int local = dirfd >= 0 && fd_fs_kind(dirfd) == FS_LOCAL;
+            if (dirfd >= 0) close(dirfd);
+
+            /* Detached from the daemon's own scan: network mounts below
+             * path are read inline, as the client's walk would, and the
+             * mount callbacks that feed the scan database never run */
+            if (local)
+                r = scan_directory_detached(job->path, job_store,
+                                            cache_lookup_wrapper, g_shutdown, 0);
+        }
+        pthread_rwlock_unlock(&g_index_lock);
+        int ok = r.size >= 0 && !*g_shutdown;
+
+        pthread_mutex_lock(&g_lock);
+        pthread_mutex_lock(&job->lock);
+        job->active = 0;
+        int *fds = job->fds;
+        size_t fd_count = job->fd_count;
+        job->fds = NULL;
+        job->fd_count = 0;
+        job->fd_cap = 0;
+        pthread_mutex_unlock(&job->lock);
+        pthread_mutex_unlock(&g_lock);
+
+        /* The clients are no longer the job's, so no lock is needed */
+        for (size_t i = 0; i < fd_count; i++) {
+            if (ok) reply_result(fds[i], "DONE", r);
+            else reply(fds[i], "FAIL\n");
+            close(fds[i]);
+        }
+        free(fds);
+        pthread_mutex_lock(&job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/* Caller holds job->lock */
+static int job_add_fd(QueryJob *job, int fd) {
+    if (job->fd_count == job->fd_cap) {
+        size_t cap = job->fd_cap ? job->fd_cap * 2 : 8;
+        int *fds = realloc(job->fds, cap * sizeof(int));
+        if (!fds) return -1;
+        job->fds = fds;
+        job->fd_cap = cap;
+    }
+    job->fds[job->fd_count++] = fd;
+    return 0;
+}
+
+/* Join path's running job or start one. Takes fd. */
+static void job_submit(const char *path, int fd) {
+    pthread_mutex_lock(&g_lock);
+
+    QueryJob *free_slot = NULL;
+    for (int i = 0; i < QUERY_MAX_JOBS; i++) {
+        QueryJob *job = &g_jobs[i];
+        pthread_mutex_lock(&job->lock);
+        if (job->active && strcmp(job->path, path) == 0) {
+            int joined = job_add_fd(job, fd) == 0;
+            if (joined && job->partial.file_count > 0)
+                reply_result(fd, "PART", job->partial);
+            pthread_mutex_unlock(&job->lock);
+            pthread_mutex_unlock(&g_lock);
+            if (!joined) {
+                reply(fd, "BUSY\n");
+                close(fd);
+            }
+            return;
+        }
+        if (!job->active && !free_slot) free_slot = job;
+        pthread_mutex_unlock(&job->lock);
+    }
+    if (!free_slot) {
+        pthread_mutex_unlock(&g_lock);
+        reply(fd, "BUSY\n");
+        close(fd);
+        return;
+    }
+
+    QueryJob *job = free_slot;
+    pthread_mutex_lock(&job->lock);
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->path_len = strlen(job->path);
+    job->partial = (ScanResult){0, 0};
+    job->partial_sent = 1;
+    clock_gettime(CLOCK_MONOTONIC, &job->last_part);
+    job->fd_count = 0;
+    if (job_add_fd(job, fd) == 0) {
+        job->active = 1;
+        pthread_cond_signal(&job->cond);
+    } else {
+        reply(fd, "BUSY\n");
+        close(fd);
+    }
+    pthread_mutex_unlock(&job->lock);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/* ============================================================================
+ * Connections
+ * ============================================================================ */
+
+static int peer_is_self(int fd) {
+#ifdef __linux__
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+           cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+/* Send each running job's partial totals to its clients, at most every
+ * QUERY_PART_INTERVAL and at least every QUERY_KEEPALIVE seconds, so a
+ * client waiting on one large subdirectory still hears from the walk */
+static void jobs_send_parts(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (int i = 0; i < QUERY_MAX_JOBS; i++) {
+        QueryJob *job = &g_jobs[i];
+        pthread_mutex_lock(&job->lock);
+        double idle = seconds_between(&job->last_part, &now);
+        if (job->active && (idle >= QUERY_KEEPALIVE ||
+                            (!job->partial_sent && idle * 1000 >= QUERY_PART_INTERVAL))) {
+            job->last_part = now;
+            job->partial_sent = 1;
+            for (size_t j = 0; j < job->fd_count; j++)
+                reply_result(job->fds[j], "PART", job->partial);
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+/* Parse "SCAN <path>" into path - returns 0 on success */
+static int parse_request(const char *line, char *path, size_t len) {
+    if (strncmp(line, "SCAN /", 6) != 0) return -1;
+    const char *p = line + 5;
+    size_t plen = strlen(p);
+    while (plen > 1 && p[plen - 1] == '/') plen--;
+    if (plen >= len) return -1;
+    memcpy(path, p, plen);
+    path[plen] = '\0';
+    return 0;
+}
+
+/* Take a new connection into a free slot */
+static void conn_accept(QueryConn *conn) {
+    int fd = accept(g_listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    if (!peer_is_self(fd) || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+        close(fd);
+        return;
+    }
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    conn->fd = fd;
+    conn->used = 0;
+    clock_gettime(CLOCK_MONOTONIC, &conn->accepted);
+}
+
+/* Read what has arrived of a request. Once the line is complete the
+ * connection is handed on and the slot freed; a malformed or closed
+ * request is dropped. */
+static void conn_read(QueryConn *conn) {
+    ssize_t n = recv(conn->fd, conn->line + conn->used,
+                     sizeof(conn->line) - 1 - conn->used, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n > 0) {
+        conn->used += (size_t)n;
+        conn->line[conn->used] = '\0';
+        char *nl = strchr(conn->line, '\n');
+        if (!nl && conn->used < sizeof(conn->line) - 1) return;
+
+        char path[PATH_MAX];
+        if (nl) *nl = '\0';
+        if (nl && parse_request(conn->line, path, sizeof(path)) == 0) {
+            job_submit(path, conn->fd);
+            conn->fd = -1;
+            return;
+        }
+    }
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+static void *server_main(void *arg) {
+    (void)arg;
+    struct pollfd pfds[QUERY_BACKLOG + 1];
+    int slots[QUERY_BACKLOG + 1];
+    for (;;) {
+        int stopping;
+        pthread_mutex_lock(&g_lock);
+        stopping = g_stopping;
+        pthread_mutex_unlock(&g_lock);
+        if (stopping || *g_shutdown) break;
+
+        /* Give up on requests that are taking too long to arrive */
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int n = 0;
+        QueryConn *free_conn = NULL;
+        for (int i = 0; i < QUERY_BACKLOG; i++) {
+            QueryConn *conn = &g_conns[i];
+            if (conn->fd >= 0 && seconds_between(&conn->accepted, &now) > QUERY_READ_TIMEOUT) {
+                close(conn->fd);
+                conn->fd = -1;
+            }
+            if (conn->fd < 0) {
+                if (!free_conn) free_conn = conn;
+                continue;
+            }
+            pfds[n] = (struct pollfd){conn->fd, POLLIN, 0};
+            slots[n++] = i;
+        }
+        /* With every slot taken, new connections wait in the backlog */
+        if (free_conn) {
+            pfds[n] = (struct pollfd){g_listen_fd, POLLIN, 0};
+            slots[n++] = -1;
+        }
+
+        int ready = poll(pfds, (nfds_t)n, QUERY_PART_INTERVAL);
+        if (ready < 0 && errno != EINTR) break;
+        for (int i = 0; ready > 0 && i < n; i++) {
+            if (!pfds[i].revents) continue;
+            if (slots[i] < 0) conn_accept(free_conn);
+            else conn_read(&g_conns[slots[i]]);
+        }
+        jobs_send_parts();
+    }
+    for (int i = 0; i < QUERY_BACKLOG; i++) {
+        if (g_conns[i].fd >= 0) close(g_conns[i].fd);
+        g_conns[i].fd = -1;
+    }
+    return NULL;
+}
+
+/* Let the first count workers finish their walks, then join them */
+static void jobs_stop(int count) {
+    for (int i = 0; i < count; i++) {
+        QueryJob *job = &g_jobs[i];
+        pthread_mutex_lock(&job->lock);
+        job->quit = 1;
+        pthread_cond_signal(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+    }
+    for (int i = 0; i < count; i++) {
+        QueryJob *job = &g_jobs[i];
+        pthread_join(job->thread, NULL);
+        free(job->fds);
+        job->fds = NULL;
+        job->fd_cap = 0;
+        pthread_cond_destroy(&job->cond);
+        pthread_mutex_destroy(&job->lock);
+    }
+}
+
+int query_serve_start(volatile int *shutdown) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    char path[PATH_MAX];
+    cache_get_socket_path(path, sizeof(path));
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+
+    /* On a first run nothing has created the cache directory yet */
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/.cache", home ? home : "/tmp");
+    mkdir(dir, 0755);
+    snprintf(dir, sizeof(dir), "%s/.cache/l", home ? home : "/tmp");
+    mkdir(dir, 0755);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path);  /* Left behind by a daemon that didn't shut down cleanly */
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        chmod(path, 0600) != 0 || listen(fd, QUERY_BACKLOG) != 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    g_listen_fd = fd;
+    g_shutdown = shutdown;
+    for (int i = 0; i < QUERY_BACKLOG; i++) g_conns[i].fd = -1;
+    g_stopping = 0;
+#ifdef _OPENMP
+    g_threads = omp_get_max_threads();
+#endif
+    int started = 0;
+    for (; started < QUERY_MAX_JOBS; started++) {
+        QueryJob *job = &g_jobs[started];
+        pthread_mutex_init(&job->lock, NULL);
+        pthread_cond_init(&job->cond, NULL);
+        job->quit = 0;
+        if (pthread_create(&job->thread, NULL, job_main, job) != 0) {
+            pthread_cond_destroy(&job->cond);
+            pthread_mutex_destroy(&job->lock);
+            break;
+        }
+    }
+    if (started < QUERY_MAX_JOBS ||
+        pthread_create(&g_server, NULL, server_main, NULL) != 0) {
+        jobs_stop(started);
+        close(fd);
+        unlink(path);
+        g_listen_fd = -1;
+        return -1;
+    }
+    g_running = 1;
+    return 0;
+}
+
+void query_serve_stop(void) {
+    if (!g_running) return;
+    pthread_mutex_lock(&g_lock);
+    g_stopping = 1;
+    pthread_mutex_unlock(&g_lock);
+    pthread_join(g_server, NULL);
+    close(g_listen_fd);
+    g_listen_fd = -1;
+    char path[PATH_MAX];
+    cache_get_socket_path(path, sizeof(path));
+    unlink(path);
+
+    jobs_stop(QUERY_MAX_JOBS);
+    cache_unload();
+    g_index_stamp = -1;
+    g_running = 0;
+}
@@ -2,8 +2,19 @@
  * scan.c - Shared directory scanning with parallel processing
  *
  * Uses getattrlistbulk on macOS for faster metadata fetching.
- * Falls back to readdir+fstatat on Linux/other platforms.
- * Both paths use OMP task-based parallelism for subdirectories.
+ * On Linux, reads raw getdents64 records and only stats entries whose
+ * d_type does not already decide how they count (statx for blocks only).
+ * Falls back to readdir+fstatat on other platforms.
+ *
+ * Subdirectories are scanned in parallel either as OMP tasks (default) or
+ * by a work-stealing scheduler over per-thread deques (scan_set_scheduler).
+ *
+ * Network mounts can be left out, or handed to a work-stealing team of
+ * their own (scan_set_network). Reads there wait on the server rather
+ * than the CPU, so that team is sized for the round trips in flight
+ * against the mount, not for the cores, and each directory is listed in
+ * full before its entries are stat'ed, which lets the client answer the
+ * stats from the attributes READDIRPLUS brought back with the listing.
  */
 
 #include "scan.h"
@@ -12,73 +23,234 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sched.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef __APPLE__
 #include <sys/attr.h>
 #include <sys/vnode.h>
 #define ATTR_BUF_SIZE (128 * 1024)
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#define DENTS_BUF_SIZE (128 * 1024)
 #endif
 
+/* Updated with atomics; one increment per directory, not per entry.
+ * Detached walks (scan_directory_detached) count into their own set. */
+static ScanProgress g_progress;
+static ScanProgress g_detached_progress;
+
+static void progress_add(long *counter, long n) {
+    #pragma omp atomic
+    *counter += n;
+}
+
 /* ============================================================================
  * Visited inode set - prevents double-counting firmlinks and bind mounts
+ *
+ * Open addressing over flat slot arrays (no per-directory allocation),
+ * split into shards by hash so concurrent tasks rarely share a lock.
  * ============================================================================ */
 
-#define VISITED_BUCKETS 4096
+#define VISITED_SHARDS        64     /* Power of two */
+#define VISITED_SHARD_INITIAL 1024   /* Slots per shard, power of two */
 
-typedef struct VisitedNode {
+typedef struct {
     dev_t dev;
     ino_t ino;
-    struct VisitedNode *next;
-} VisitedNode;
+    int used;
+} VisitedSlot;
+
+typedef struct {
+    VisitedSlot *slots;
+    size_t capacity;
+    size_t count;
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+} VisitedShard;
 
 typedef struct {
-    VisitedNode *buckets[VISITED_BUCKETS];
+    VisitedShard shards[VISITED_SHARDS];
+    int enabled;                /* 0 when no directory can be reached twice */
+    ScanProgress *progress;     /* Where the scan's counters go */
 } VisitedSet;
 
-static void visited_init(VisitedSet *set) {
-    memset(set->buckets, 0, sizeof(set->buckets));
+#ifdef __linux__
+/* Bind mounts show up in mountinfo as a filesystem mounted more than once
+ * or mounted from a subdirectory (root field other than "/"). Without
+ * either, each directory has exactly one path and tracking can be skipped. */
+static int visited_needed(void) {
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (!f) return 1;
+
+    unsigned *devs = NULL;
+    size_t count = 0, cap = 0;
+    int needed = 0;
+    char line[4096];
+    while (!needed && fgets(line, sizeof(line), f)) {
+        unsigned major, minor;
+        char root[PATH_MAX];
+        if (sscanf(line, "%*d %*d %u:%u %4095s", &major, &minor, root) != 3) {
+            needed = 1;
+            break;
+        }
+        if (strcmp(root, "/") != 0) {
+            needed = 1;
+            break;
+        }
+        unsigned dev = (major << 20) | minor;
+        for (size_t i = 0; i < count; i++) {
+            if (devs[i] == dev) {
+                needed = 1;
+                break;
+            }
+        }
+        if (count >= cap) {
+            cap = cap ? cap * 2 : 64;
+            unsigned *new_devs = realloc(devs, cap * sizeof(unsigned));
+            if (!new_devs) {
+                needed = 1;
+                break;
+            }
+            devs = new_devs;
+        }
+        devs[count++] = dev;
+    }
+    free(devs);
+    fclose(f);
+    return needed;
+}
+#else
+/* macOS firmlinks (and unknown platforms) always need tracking */
+static int visited_needed(void) {
+    return 1;
+}
+#endif
+
+#define VISITED_RECHECK_SECS 60
+
+/* Clients start a scan per directory listed, so the mount table is
+ * consulted at most once a minute */
+static int visited_needed_cached(void) {
+    static int needed = 1;
+    static time_t checked = 0;
+    int result;
+    #pragma omp critical(visited_mounts)
+    {
+        time_t now = time(NULL);
+        if (!checked || now - checked >= VISITED_RECHECK_SECS) {
+            needed = visited_needed();
+            checked = now;
+        }
+        result = needed;
+    }
+    return result;
+}
+
+static void visited_init(VisitedSet *set, ScanProgress *progress) {
+    memset(set, 0, sizeof(*set));
+    set->enabled = visited_needed_cached();
+    set->progress = progress;
+#ifdef _OPENMP
+    for (int i = 0; i < VISITED_SHARDS; i++)
+        omp_init_lock(&set->shards[i].lock);
+#endif
+}
+
+static uint64_t visited_hash(dev_t dev, ino_t ino) {
+    /* splitmix64 finalizer over both keys */
+    uint64_t h = (uint64_t)ino ^ ((uint64_t)dev * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/* Insert without checking for growth - caller holds the shard lock */
+static VisitedSlot *visited_probe(VisitedShard *shard, uint64_t h,
+                                  dev_t dev, ino_t ino) {
+    size_t mask = shard->capacity - 1;
+    size_t i = (size_t)h & mask;
+    while (shard->slots[i].used &&
+           !(shard->slots[i].dev == dev && shard->slots[i].ino == ino))
+        i = (i + 1) & mask;
+    return &shard->slots[i];
 }
 
-static unsigned visited_hash(dev_t dev, ino_t ino) {
-    return (unsigned)((dev * 2654435761u) ^ (ino * 2246822519u)) % VISITED_BUCKETS;
+/* Double the shard when it passes 3/4 load - returns 0 on success */
+static int visited_grow(VisitedShard *shard, ScanProgress *progress) {
+    size_t new_cap = shard->capacity ? shard->capacity * 2 : VISITED_SHARD_INITIAL;
+    VisitedSlot *new_slots = calloc(new_cap, sizeof(VisitedSlot));
+    if (!new_slots) return -1;
+
+    VisitedShard grown = *shard;
+    grown.slots = new_slots;
+    grown.capacity = new_cap;
+    for (size_t i = 0; i < shard->capacity; i++) {
+        VisitedSlot *old = &shard->slots[i];
+        if (old->used)
+            *visited_probe(&grown, visited_hash(old->dev, old->ino),
+                           old->dev, old->ino) = *old;
+    }
+    free(shard->slots);
+    shard->slots = new_slots;
+    progress_add(&progress->visited_bytes,
+                 (long)((new_cap - shard->capacity) * sizeof(VisitedSlot)));
+    shard->capacity = new_cap;
+    return 0;
 }
 
 /* Returns 1 if already visited, 0 if new (and inserts it) */
 static int visited_check_and_insert(VisitedSet *set, dev_t dev, ino_t ino) {
-    unsigned h = visited_hash(dev, ino);
+    if (!set->enabled) return 0;
+
+    uint64_t h = visited_hash(dev, ino);
+    /* High bits pick the shard, low bits the slot, so they stay independent */
+    VisitedShard *shard = &set->shards[(h >> 48) & (VISITED_SHARDS - 1)];
     int found = 0;
 
-    #pragma omp critical(visited_set)
-    {
-        VisitedNode *n = set->buckets[h];
-        while (n) {
-            if (n->dev == dev && n->ino == ino) {
-                found = 1;
-                break;
-            }
-            n = n->next;
-        }
-        if (!found) {
-            VisitedNode *node = malloc(sizeof(VisitedNode));
-            if (node) {
-                node->dev = dev;
-                node->ino = ino;
-                node->next = set->buckets[h];
-                set->buckets[h] = node;
-            }
-        }
+#ifdef _OPENMP
+    omp_set_lock(&shard->lock);
+#endif
+    if (shard->count + 1 > shard->capacity / 4 * 3 &&
+        visited_grow(shard, set->progress) != 0) {
+        /* Out of memory: treat as new rather than drop the directory */
+#ifdef _OPENMP
+        omp_unset_lock(&shard->lock);
+#endif
+        return 0;
+    }
+    VisitedSlot *slot = visited_probe(shard, h, dev, ino);
+    if (slot->used) {
+        found = 1;
+    } else {
+        slot->dev = dev;
+        slot->ino = ino;
+        slot->used = 1;
+        shard->count++;
+        progress_add(&set->progress->visited_entries, 1);
     }
+#ifdef _OPENMP
+    omp_unset_lock(&shard->lock);
+#endif
     return found;
 }
 
 static void visited_free(VisitedSet *set) {
-    for (int i = 0; i < VISITED_BUCKETS; i++) {
-        VisitedNode *n = set->buckets[i];
-        while (n) {
-            VisitedNode *next = n->next;
-            free(n);
-            n = next;
-        }
+    for (int i = 0; i < VISITED_SHARDS; i++) {
+        progress_add(&set->progress->visited_entries, -(long)set->shards[i].count);
+        progress_add(&set->progress->visited_bytes,
+                     -(long)(set->shards[i].capacity * sizeof(VisitedSlot)));
+        free(set->shards[i].slots);
+#ifdef _OPENMP
+        omp_destroy_lock(&set->shards[i].lock);
+#endif
     }
 }
 
@@ -93,78 +265,110 @@ typedef struct {
     volatile int *shutdown;
     long threshold;
     VisitedSet *visited;
+    scan_reuse_fn reuse_fn;
+    scan_state_fn state_fn;
+    ScanNetworkMode network_mode;
+    ScanProgress *progress;
+    int network;                /* Inside a network mount's own team */
 } ScanContext;
 
 #define MAX_SCAN_DEPTH 128
 
-static ScanResult scan_impl(const char *path, int depth,
-                            const ScanContext *ctx);
+static ScanScheduler g_scheduler = SCAN_SCHED_TASKS;
+static ScanNetworkMode g_network_mode = SCAN_NET_INLINE;
+static int g_network_threads = 1;
+static scan_mount_fn g_mount_fn = NULL;
+static scan_mount_done_fn g_mount_done_fn = NULL;
 
-/* Common setup for scan_impl - returns dirfd on success, -1 to skip, -2 on error */
+/* Subdirectories found in one directory, stored as names relative to it.
+ * names is a single buffer of NUL-terminated names (the ScanDirState.subdirs
+ * format), so a directory costs one growing allocation however many
+ * subdirectories it has. Full paths are only built when needed. */
+typedef struct {
+    char *names;
+    size_t len;
+    size_t cap;
+    size_t count;
+} SubdirList;
+
+#define SUBDIR_NAMES_INITIAL 1024
+
+/* Append a name to the list (drops it on OOM) */
+static void scan_add_subdir(SubdirList *list, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (list->len + len > list->cap) {
+        size_t new_cap = list->cap ? list->cap * 2 : SUBDIR_NAMES_INITIAL;
+        while (new_cap < list->len + len) new_cap *= 2;
+        char *new_names = realloc(list->names, new_cap);
+        if (!new_names) return;
+        list->names = new_names;
+        list->cap = new_cap;
+    }
+    memcpy(list->names + list->len, name, len);
+    list->len += len;
+    list->count++;
+}
+
+/* Build parent/name into buf (parent NULL means name is already a path).
+ * Returns -1 if the result doesn't fit. */
+static int scan_join(char *buf, size_t len, const char *parent, const char *name) {
+    int n;
+    if (!parent) {
+        n = snprintf(buf, len, "%s", name);
+    } else {
+        size_t plen = strlen(parent);
+        int need_slash = (plen > 0 && parent[plen - 1] != '/');
+        n = snprintf(buf, len, need_slash ? "%s/%s" : "%s%s", parent, name);
+    }
+    return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
+
+#define SCAN_SETUP_SKIP   (-1)
+#define SCAN_SETUP_ERROR  (-2)
+#define SCAN_SETUP_MOUNT  (-3)   /* Network mount for scan_network_mount */
+
+/* Common setup for scan_visit - returns dirfd on success or a
+ * SCAN_SETUP_* code. *is_network is set for directories on network mounts. */
 static int scan_setup(const char *path, struct stat *dir_st, int depth,
-                      const ScanContext *ctx) {
-    if (ctx->shutdown && *ctx->shutdown) return -1;
-    if (depth >= MAX_SCAN_DEPTH) return -1;
+                      const ScanContext *ctx, int *is_network) {
+    if (ctx->shutdown && *ctx->shutdown) return SCAN_SETUP_SKIP;
+    if (depth >= MAX_SCAN_DEPTH) return SCAN_SETUP_SKIP;
 
     int dirfd = open(path, O_RDONLY | O_DIRECTORY);
-    if (dirfd < 0) return -2;
+    if (dirfd < 0) return SCAN_SETUP_ERROR;
 
-    if (path_is_virtual_fs(path)) {
+    FsKind kind = fd_fs_kind(dirfd);
+    *is_network = kind == FS_NETWORK;
+    if (kind == FS_VIRTUAL || (*is_network && ctx->network_mode == SCAN_NET_SKIP)) {
         close(dirfd);
-        return -1;
+        return SCAN_SETUP_SKIP;
+    }
+    /* Before the visited check: the mount's own scan records the root */
+    if (*is_network && ctx->network_mode == SCAN_NET_WIDE && !ctx->network) {
+        close(dirfd);
+        return SCAN_SETUP_MOUNT;
     }
 
     if (fstat(dirfd, dir_st) != 0) {
         close(dirfd);
-        return -2;
+        return SCAN_SETUP_ERROR;
     }
 
     if (visited_check_and_insert(ctx->visited, dir_st->st_dev, dir_st->st_ino)) {
         close(dirfd);
         /* Cache duplicates at 0 so live-scan fallbacks find them */
-        if (ctx->store_fn) {
-            #pragma omp critical
-            ctx->store_fn(path, 0, 0);
-        }
-        return -1;
+        if (ctx->store_fn) ctx->store_fn(path, 0, 0);
+        return SCAN_SETUP_SKIP;
     }
 
     return dirfd;
 }
 
-/* Process subdirectories with OMP tasks, accumulating into result */
-static void scan_process_subdirs(char **subdirs, size_t subdir_count,
-                                 int depth, const ScanContext *ctx,
-                                 int skip_file_count, ScanResult *result) {
-    if (subdir_count == 0) return;
-
-    ScanResult *sub_stats = malloc(subdir_count * sizeof(ScanResult));
-    if (sub_stats) {
-        for (size_t i = 0; i < subdir_count; i++) {
-            /* Check cache first if available */
-            off_t cached_size;
-            long cached_count;
-            if (ctx->cache_fn && ctx->cache_fn(subdirs[i], &cached_size, &cached_count)) {
-                sub_stats[i].size = cached_size;
-                sub_stats[i].file_count = cached_count;
-            } else {
-                #pragma omp task shared(sub_stats) firstprivate(i, depth, ctx)
-                sub_stats[i] = scan_impl(subdirs[i], depth, ctx);
-            }
-        }
-        #pragma omp taskwait
-
-        for (size_t i = 0; i < subdir_count; i++) {
-            if (sub_stats[i].size >= 0) result->size += sub_stats[i].size;
-            if (!skip_file_count && sub_stats[i].file_count >= 0)
-                result->file_count += sub_stats[i].file_count;
-            free(subdirs[i]);
-        }
-        free(sub_stats);
-    } else {
-        for (size_t i = 0; i < subdir_count; i++) free(subdirs[i]);
-    }
-    free(subdirs);
+/* Add a finished subdirectory's totals to its parent's result */
+static void scan_accumulate(ScanResult *result, ScanResult sub, int skip_file_count) {
+    if (sub.size >= 0) result->size += sub.size;
+    if (!skip_file_count && sub.file_count >= 0)
+        result->file_count += sub.file_count;
 }
 
 /* Finalize scan result: optionally store and handle skip_file_count */
@@ -172,53 +376,133 @@ static void scan_finalize(const char *path, const ScanContext *ctx,
                           int skip_file_count, ScanResult *result) {
     if (ctx->store_fn && !skip_file_count &&
         result->file_count >= ctx->threshold && strcmp(path, "/") != 0) {
-        #pragma omp critical
         ctx->store_fn(path, result->size, result->file_count);
     }
     if (skip_file_count) result->file_count = -1;
 }
 
-/* Common teardown for scan_impl */
-static void scan_teardown(const char *path, char **subdirs, size_t subdir_count,
-                          int depth, const ScanContext *ctx,
-                          int skip_file_count, ScanResult *result) {
-    scan_process_subdirs(subdirs, subdir_count, depth + 1,
-                         ctx, skip_file_count, result);
-    scan_finalize(path, ctx, skip_file_count, result);
+/* Record a freshly read directory for the next incremental scan.
+ * result holds the directory's own contribution (before subdirs are summed). */
+static void scan_record_state(const char *path, const struct stat *dir_st,
+                              const SubdirList *list,
+                              const ScanContext *ctx, const ScanResult *result) {
+    if (!ctx->state_fn) return;
+    /* An interrupted read is incomplete; never let it be reused */
+    if (ctx->shutdown && *ctx->shutdown) return;
+
+    ScanDirState state;
+    scan_state_stamp(&state, dir_st);
+    state.own_size = result->size;
+    state.own_count = result->file_count;
+    /* The list is already in the recorded format */
+    state.subdirs = list->names;
+    state.subdirs_len = list->len;
+
+    ctx->state_fn(path, &state);
 }
 
-ScanResult scan_directory(const char *path,
-                          scan_store_fn store_fn,
-                          scan_cache_fn cache_fn,
-                          volatile int *shutdown,
-                          long threshold) {
-    ScanResult result;
-    VisitedSet visited;
-    visited_init(&visited);
-    ScanContext ctx = {store_fn, cache_fn, shutdown, threshold, &visited};
+/* If the directory's stamp matches the previous scan, take its own
+ * contribution and subdirectory list from the recorded state instead of
+ * reading it. Returns 1 if result and list were filled. */
+static int scan_try_reuse(const char *path, const struct stat *dir_st,
+                          const ScanContext *ctx, ScanResult *result,
+                          SubdirList *list) {
+    if (!ctx->reuse_fn) return 0;
 
-    #pragma omp parallel
-    #pragma omp single
-    {
-        result = scan_impl(path, 0, &ctx);
+    ScanDirState state;
+    int found;
+    #pragma omp critical(scan_reuse)
+    found = ctx->reuse_fn(path, dir_st, &state);
+    if (!found) return 0;
+
+    /* Carry the state forward so the next scan can reuse it again */
+    if (ctx->state_fn) ctx->state_fn(path, &state);
+
+    /* The recorded names become the subdirectory list as-is */
+    *list = (SubdirList){state.subdirs, state.subdirs_len, state.subdirs_len, 0};
+    for (size_t off = 0; off < list->len; off += strlen(list->names + off) + 1)
+        list->count++;
+
+    *result = (ScanResult){state.own_size, state.own_count};
+    return 1;
+}
+
+/* Look up all of a directory's subdirectories in the cache in one pass,
+ * before any of them is scanned. Hits are summed into result and dropped
+ * from the list, so only misses are left to schedule. */
+static void scan_probe_cached(const char *path, SubdirList *list,
+                              const ScanContext *ctx, int skip_file_count,
+                              ScanResult *result) {
+    if (!ctx->cache_fn || list->count == 0) return;
+
+    /* The parent prefix is written once; names are swapped in behind it */
+    char sub_path[PATH_MAX];
+    if (scan_join(sub_path, sizeof(sub_path), path, "") != 0) return;
+    size_t base = strlen(sub_path);
+
+    size_t kept_len = 0, kept_count = 0;
+    for (size_t off = 0; off < list->len; ) {
+        const char *name = list->names + off;
+        size_t len = strlen(name) + 1;
+        off += len;
+
+        off_t cached_size;
+        long cached_count;
+        if (base + len <= sizeof(sub_path)) {
+            memcpy(sub_path + base, name, len);
+            if (ctx->cache_fn(sub_path, &cached_size, &cached_count)) {
+                scan_accumulate(result, (ScanResult){cached_size, cached_count},
+                                skip_file_count);
+                continue;
+            }
+        }
+        memmove(list->names + kept_len, name, len);
+        kept_len += len;
+        kept_count++;
     }
+    list->len = kept_len;
+    list->count = kept_count;
+}
 
-    visited_free(&visited);
-    return result;
+void scan_state_stamp(ScanDirState *state, const struct stat *st) {
+    state->dev = st->st_dev;
+    state->ino = st->st_ino;
+    state->mtime_ns = GET_MTIME_NS(*st);
+    state->ctime_ns = GET_CTIME_NS(*st);
 }
 
-#ifdef __APPLE__
-/* macOS: use getattrlistbulk for faster metadata fetching */
-static ScanResult scan_impl(const char *path, int depth,
-                            const ScanContext *ctx) {
-    struct stat dir_st;
+void scan_set_scheduler(ScanScheduler scheduler) {
+    g_scheduler = scheduler;
+}
 
-    int dirfd = scan_setup(path, &dir_st, depth, ctx);
-    if (dirfd == -1) return (ScanResult){0, 0};
-    if (dirfd == -2) return (ScanResult){-1, -1};
+void scan_set_network(ScanNetworkMode mode, int threads, scan_mount_fn mount_fn,
+                      scan_mount_done_fn done_fn) {
+    g_network_mode = mode;
+    g_network_threads = threads > 0 ? threads : 1;
+    g_mount_fn = mount_fn;
+    g_mount_done_fn = done_fn;
+#ifdef _OPENMP
+    /* A mount's team is nested inside the scan that reached it */
+    if (mode == SCAN_NET_WIDE && omp_get_max_active_levels() < 2)
+        omp_set_max_active_levels(2);
+#endif
+}
 
-    ScanResult result = {dir_st.st_blocks * 512, 0};
-    int skip_file_count = path_is_git_dir(path);
+/* ============================================================================
+ * Directory readers
+ *
+ * scan_read_entries reads one open directory, adding its direct entries to
+ * result and collecting its subdirectories into list. It always closes
+ * dirfd and returns 0, or -1 if the directory could not be read.
+ * is_network marks a directory on a network mount.
+ * ============================================================================ */
+
+#ifdef __APPLE__
+/* macOS: use getattrlistbulk for faster metadata fetching */
+static int scan_read_entries(int dirfd, int is_network, const ScanContext *ctx,
+                             int skip_file_count, ScanResult *result,
+                             SubdirList *list) {
+    (void)is_network;
 
     struct attrlist attrList = {0};
     attrList.bitmapcount = ATTR_BIT_MAP_COUNT;
@@ -230,13 +514,9 @@ static ScanResult scan_impl(const char *path, int depth,
     char *attrBuf = malloc(ATTR_BUF_SIZE);
     if (!attrBuf) {
         close(dirfd);
-        return (ScanResult){-1, -1};
+        return -1;
     }
 
-    char **subdirs = NULL;
-    size_t subdir_count = 0;
-    size_t subdir_cap = 0;
-
     int count;
     while ((count = getattrlistbulk(dirfd, &attrList, attrBuf, ATTR_BUF_SIZE, 0)) > 0) {
         if (ctx->shutdown && *ctx->shutdown) break;
@@ -269,31 +549,11 @@ static ScanResult scan_impl(const char *path, int depth,
 
             if (!PATH_IS_DOT_OR_DOTDOT(name)) {
                 if (obj_type == VREG || obj_type == VLNK) {
-                    result.size += alloc_size;
-                    if (!skip_file_count) result.file_count++;
+                    result->size += alloc_size;
+                    if (!skip_file_count) result->file_count++;
                 } else if (obj_type == VDIR) {
-                    result.size += alloc_size;
-                    char *full = malloc(PATH_MAX);
-                    if (full) {
-                        size_t plen = strlen(path);
-                        int need_slash = (plen > 0 && path[plen - 1] != '/');
-                        snprintf(full, PATH_MAX, need_slash ? "%s/%s" : "%s%s",
-                                 path, name);
-
-                        if (subdir_count >= subdir_cap) {
-                            size_t new_cap = subdir_cap ? subdir_cap * 2 : 16;
-                            char **new_subdirs = realloc(subdirs, new_cap * sizeof(char *));
-                            if (!new_subdirs) {
-                                free(full);
-                            } else {
-                                subdir_cap = new_cap;
-                                subdirs = new_subdirs;
-                                subdirs[subdir_count++] = full;
-                            }
-                        } else {
-                            subdirs[subdir_count++] = full;
-                        }
-                    }
+                    result->size += alloc_size;
+                    scan_add_subdir(list, name);
                 }
             }
             ptr += length;
@@ -302,35 +562,144 @@ static ScanResult scan_impl(const char *path, int depth,
 
     free(attrBuf);
     close(dirfd);
+    return 0;
+}
 
-    scan_teardown(path, subdirs, subdir_count, depth,
-                  ctx, skip_file_count, &result);
-    return result;
+#elif defined(__linux__)
+/* Linux: getdents64 + d_type, statx only where blocks are needed */
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* Fetch type and allocated size of an entry - returns 0 on success */
+static int scan_stat_entry(int dirfd, const char *name, int sync_flags,
+                           mode_t *mode, off_t *bytes) {
+#ifdef STATX_BLOCKS
+    struct statx stx;
+    if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | sync_flags,
+              STATX_TYPE | STATX_BLOCKS, &stx) != 0)
+        return -1;
+    *mode = stx.stx_mode;
+    *bytes = (off_t)stx.stx_blocks * 512;
+#else
+    (void)sync_flags;
+    struct stat st;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return -1;
+    *mode = st.st_mode;
+    *bytes = st.st_blocks * 512;
+#endif
+    return 0;
+}
+
+/* Add one run of getdents64 records to result and list */
+static void scan_add_dents(int dirfd, const char *buf, size_t len, int sync_flags,
+                           int skip_file_count, ScanResult *result,
+                           SubdirList *list) {
+    for (size_t off = 0; off < len; ) {
+        const struct linux_dirent64 *d = (const struct linux_dirent64 *)(buf + off);
+        off += d->d_reclen;
+        if (PATH_IS_DOT_OR_DOTDOT(d->d_name)) continue;
+
+        /* Symlinks only count; fifos, sockets and devices don't count */
+        if (d->d_type == DT_LNK) {
+            if (!skip_file_count) result->file_count++;
+            continue;
+        }
+        if (d->d_type != DT_REG && d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+            continue;
+
+        mode_t mode;
+        off_t bytes;
+        if (scan_stat_entry(dirfd, d->d_name, sync_flags, &mode, &bytes) != 0)
+            continue;
+
+        if (S_ISDIR(mode)) {
+            result->size += bytes;
+            scan_add_subdir(list, d->d_name);
+        } else if (S_ISREG(mode)) {
+            result->size += bytes;
+            if (!skip_file_count) result->file_count++;
+        } else if (S_ISLNK(mode)) {
+            if (!skip_file_count) result->file_count++;
+        }
+    }
 }
 
+/* Read the whole listing into *buf (DENTS_BUF_SIZE to start), growing it
+ * as needed. Returns the bytes of records read; a failed read or
+ * allocation ends the listing early, as a failed getdents does below. */
+static size_t scan_read_listing(int dirfd, char **buf, const ScanContext *ctx) {
+    size_t len = 0, cap = DENTS_BUF_SIZE;
+    for (;;) {
+        if (cap - len < DENTS_BUF_SIZE) {
+            char *grown = realloc(*buf, cap * 2);
+            if (!grown) break;
+            *buf = grown;
+            cap *= 2;
+        }
+        long nread = syscall(SYS_getdents64, dirfd, *buf + len, cap - len);
+        if (nread <= 0) break;
+        len += (size_t)nread;
+        if (ctx->shutdown && *ctx->shutdown) break;
+    }
+    return len;
+}
+
+static int scan_read_entries(int dirfd, int is_network, const ScanContext *ctx,
+                             int skip_file_count, ScanResult *result,
+                             SubdirList *list) {
+    char *buf = malloc(DENTS_BUF_SIZE);
+    if (!buf) {
+        close(dirfd);
+        return -1;
+    }
+
+    /* Cached attributes are good enough on network mounts; don't make the
+     * server revalidate every entry */
+#ifdef AT_STATX_DONT_SYNC
+    int sync_flags = is_network ? AT_STATX_DONT_SYNC : 0;
 #else
-/* Linux/other: use readdir + fstatat */
-static ScanResult scan_impl(const char *path, int depth,
-                            const ScanContext *ctx) {
-    struct stat dir_st;
+    int sync_flags = 0;
+#endif
 
-    int dirfd = scan_setup(path, &dir_st, depth, ctx);
-    if (dirfd == -1) return (ScanResult){0, 0};
-    if (dirfd == -2) return (ScanResult){-1, -1};
+    if (is_network) {
+        /* List everything before the first stat, so the stats are served
+         * from the attributes that came back with the listing */
+        size_t len = scan_read_listing(dirfd, &buf, ctx);
+        if (!(ctx->shutdown && *ctx->shutdown))
+            scan_add_dents(dirfd, buf, len, sync_flags, skip_file_count,
+                           result, list);
+    } else {
+        long nread;
+        while ((nread = syscall(SYS_getdents64, dirfd, buf, DENTS_BUF_SIZE)) > 0) {
+            if (ctx->shutdown && *ctx->shutdown) break;
+            scan_add_dents(dirfd, buf, (size_t)nread, sync_flags, skip_file_count,
+                           result, list);
+        }
+    }
+    free(buf);
+    close(dirfd);
+    return 0;
+}
 
-    ScanResult result = {dir_st.st_blocks * 512, 0};
-    int skip_file_count = path_is_git_dir(path);
+#else
+/* Other platforms: use readdir + fstatat */
+static int scan_read_entries(int dirfd, int is_network, const ScanContext *ctx,
+                             int skip_file_count, ScanResult *result,
+                             SubdirList *list) {
+    (void)is_network;
 
     DIR *dir = fdopendir(dirfd);
     if (!dir) {
         close(dirfd);
-        return (ScanResult){-1, -1};
+        return -1;
     }
 
-    char **subdirs = NULL;
-    size_t subdir_count = 0;
-    size_t subdir_cap = 0;
-
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
         if (ctx->shutdown && *ctx->shutdown) break;
@@ -342,43 +711,525 @@ static ScanResult scan_impl(const char *path, int depth,
         if (fstatat(dirfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
             if (S_ISDIR(st.st_mode)) {
                 is_dir = 1;
-                result.size += st.st_blocks * 512;
+                result->size += st.st_blocks * 512;
             } else if (S_ISREG(st.st_mode)) {
-                result.size += st.st_blocks * 512;
-                if (!skip_file_count) result.file_count++;
+                result->size += st.st_blocks * 512;
+                if (!skip_file_count) result->file_count++;
             } else if (S_ISLNK(st.st_mode)) {
-                if (!skip_file_count) result.file_count++;
+                if (!skip_file_count) result->file_count++;
             }
         }
 
-        if (is_dir) {
-            char *full = malloc(PATH_MAX);
-            if (full) {
-                size_t plen = strlen(path);
-                int need_slash = (plen > 0 && path[plen - 1] != '/');
-                snprintf(full, PATH_MAX, need_slash ? "%s/%s" : "%s%s",
-                         path, entry->d_name);
-
-                if (subdir_count >= subdir_cap) {
-                    size_t new_cap = subdir_cap ? subdir_cap * 2 : 16;
-                    char **new_subdirs = realloc(subdirs, new_cap * sizeof(char *));
-                    if (!new_subdirs) {
-                        free(full);
-                    } else {
-                        subdir_cap = new_cap;
-                        subdirs = new_subdirs;
-                        subdirs[subdir_count++] = full;
-                    }
-                } else {
-                    subdirs[subdir_count++] = full;
-                }
-            }
-        }
+        if (is_dir) scan_add_subdir(list, entry->d_name);
     }
     closedir(dir);
+    return 0;
+}
+#endif
+
+static ScanResult scan_network_mount(const char *path, const ScanContext *ctx);
+
+/* Read (or reuse) one directory. On return 1, result holds its own
+ * contribution and list its uncached subdirectories (caller frees
+ * list->names, then finalizes once subdirectory totals are summed in).
+ * On return 0, result is already final: skipped, unreadable, or a
+ * network mount scanned as a whole. */
+static int scan_visit(const char *path, int depth, const ScanContext *ctx,
+                      ScanResult *result, SubdirList *list,
+                      int *skip_file_count) {
+    struct stat dir_st;
+    int is_network = 0;
+
+    int dirfd = scan_setup(path, &dir_st, depth, ctx, &is_network);
+    if (dirfd == SCAN_SETUP_SKIP) {
+        *result = (ScanResult){0, 0};
+        return 0;
+    }
+    if (dirfd == SCAN_SETUP_ERROR) {
+        *result = (ScanResult){-1, -1};
+        return 0;
+    }
+    if (dirfd == SCAN_SETUP_MOUNT) {
+        *result = scan_network_mount(path, ctx);
+        return 0;
+    }
+
+    *skip_file_count = path_is_git_dir(path);
+    if (scan_try_reuse(path, &dir_st, ctx, result, list)) {
+        close(dirfd);
+        progress_add(&ctx->progress->dirs_reused, 1);
+    } else {
+        *result = (ScanResult){dir_st.st_blocks * 512, 0};
+        *list = (SubdirList){NULL, 0, 0, 0};
+        if (scan_read_entries(dirfd, is_network, ctx, *skip_file_count,
+                              result, list) != 0) {
+            free(list->names);
+            *result = (ScanResult){-1, -1};
+            return 0;
+        }
+        scan_record_state(path, &dir_st, list, ctx, result);
+        progress_add(&ctx->progress->dirs_read, 1);
+        progress_add(&ctx->progress->files_read, result->file_count);
+    }
+
+    scan_probe_cached(path, list, ctx, *skip_file_count, result);
+    return 1;
+}
+
+/* ============================================================================
+ * Task scheduler - one OMP task per uncached subdirectory
+ * ============================================================================ */
+
+static ScanResult scan_impl(const char *parent, const char *name, int depth,
+                            const ScanContext *ctx);
+
+/* Scan subdirectories with OMP tasks, accumulating into result. Tasks
+ * point into path and the list's names, both of which outlive the taskwait.
+ * Frees the list. */
+static void scan_process_subdirs(const char *path, SubdirList *list,
+                                 int depth, const ScanContext *ctx,
+                                 int skip_file_count, ScanResult *result) {
+    if (list->count == 0) {
+        free(list->names);
+        return;
+    }
+
+    ScanResult *sub_stats = malloc(list->count * sizeof(ScanResult));
+    if (sub_stats) {
+        const char *name = list->names;
+        for (size_t i = 0; i < list->count; i++, name += strlen(name) + 1) {
+            #pragma omp task shared(sub_stats) firstprivate(i, name, path, depth, ctx)
+            sub_stats[i] = scan_impl(path, name, depth, ctx);
+        }
+        #pragma omp taskwait
+
+        for (size_t i = 0; i < list->count; i++)
+            scan_accumulate(result, sub_stats[i], skip_file_count);
+        free(sub_stats);
+    }
+    free(list->names);
+}
+
+static ScanResult scan_impl(const char *parent, const char *name, int depth,
+                            const ScanContext *ctx) {
+    char path[PATH_MAX];
+    if (scan_join(path, sizeof(path), parent, name) != 0)
+        return (ScanResult){-1, -1};
 
-    scan_teardown(path, subdirs, subdir_count, depth,
-                  ctx, skip_file_count, &result);
+    ScanResult result;
+    SubdirList list;
+    int skip_file_count = 0;
+    if (!scan_visit(path, depth, ctx, &result, &list, &skip_file_count))
+        return result;
+
+    scan_process_subdirs(path, &list, depth + 1, ctx, skip_file_count, &result);
+    scan_finalize(path, ctx, skip_file_count, &result);
     return result;
 }
+
+/* ============================================================================
+ * Work-stealing scheduler
+ *
+ * Each thread owns a deque of pending directories. The owner pushes and
+ * pops at the bottom (depth-first, so a parent's data stays hot) and idle
+ * threads steal from the top, where the oldest and usually largest
+ * subtrees sit. A directory is finished by whichever thread completes its
+ * last child, which finalizes it and carries its total up to the parent.
+ *
+ * Subdirectories are only published to the deque while some thread is
+ * hungry or the deque is nearly empty; the rest are scanned inline by the
+ * thread that found them, so the many tiny directories of trees like
+ * node_modules don't each pay for a task.
+ * ============================================================================ */
+
+#define STEAL_MIN_QUEUED   4    /* Publish subdirs while the deque is shorter */
+#define STEAL_INLINE_DEPTH 32   /* Max nested inline scans (bounds the stack) */
+#define STEAL_DEQUE_INITIAL 64
+#define STEAL_SPIN_ROUNDS  64   /* Yields before an idle thread starts sleeping */
+#define STEAL_IDLE_SLEEP_NS 100000
+
+#ifndef _OPENMP
+#define omp_get_max_threads() 1
+#define omp_get_num_threads() 1
+#define omp_get_thread_num()  0
+#define omp_in_parallel()     0
+#endif
+
+typedef struct ScanNode {
+    struct ScanNode *parent;
+    struct ScanNode *next;      /* Inline queue link */
+    ScanResult result;          /* Own contribution plus finished subdirs */
+    long pending;               /* Unfinished subdirs, +1 while being read */
+    int depth;
+    int skip_file_count;
+    int visited;                /* 0 if skipped/unreadable (no finalize) */
+    char path[];
+} ScanNode;
+
+typedef struct {
+    ScanNode **items;
+    size_t top;                 /* Steal end */
+    size_t bottom;              /* Owner end */
+    size_t capacity;
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+} StealDeque;
+
+typedef struct {
+    const ScanContext *ctx;
+    StealDeque *deques;
+    int nthreads;
+    int idle;                   /* Threads currently looking for work */
+    int done;                   /* Set once the root directory finishes */
+    ScanResult result;
+} StealSched;
+
+static void deque_lock(StealDeque *dq) {
+#ifdef _OPENMP
+    omp_set_lock(&dq->lock);
+#else
+    (void)dq;
 #endif
+}
+
+static void deque_unlock(StealDeque *dq) {
+#ifdef _OPENMP
+    omp_unset_lock(&dq->lock);
+#else
+    (void)dq;
+#endif
+}
+
+/* Push at the owner end - returns -1 on OOM (caller scans inline) */
+static int deque_push(StealDeque *dq, ScanNode *node) {
+    int rc = 0;
+    deque_lock(dq);
+    if (dq->bottom == dq->capacity) {
+        if (dq->top > 0) {
+            /* Reclaim space freed by steals before growing */
+            memmove(dq->items, dq->items + dq->top,
+                    (dq->bottom - dq->top) * sizeof(ScanNode *));
+            dq->bottom -= dq->top;
+            dq->top = 0;
+        } else {
+            size_t new_cap = dq->capacity ? dq->capacity * 2 : STEAL_DEQUE_INITIAL;
+            ScanNode **new_items = realloc(dq->items, new_cap * sizeof(ScanNode *));
+            if (!new_items) rc = -1;
+            else {
+                dq->items = new_items;
+                dq->capacity = new_cap;
+            }
+        }
+    }
+    if (rc == 0) dq->items[dq->bottom++] = node;
+    deque_unlock(dq);
+    return rc;
+}
+
+/* Take from the owner end (own == 1) or the steal end */
+static ScanNode *deque_take(StealDeque *dq, int own) {
+    ScanNode *node = NULL;
+    deque_lock(dq);
+    if (dq->bottom > dq->top) {
+        node = own ? dq->items[--dq->bottom] : dq->items[dq->top++];
+        if (dq->bottom == dq->top) dq->bottom = dq->top = 0;
+    }
+    deque_unlock(dq);
+    return node;
+}
+
+static size_t deque_size(StealDeque *dq) {
+    deque_lock(dq);
+    size_t size = dq->bottom - dq->top;
+    deque_unlock(dq);
+    return size;
+}
+
+static ScanNode *steal_node_new(ScanNode *parent, const char *name) {
+    char path[PATH_MAX];
+    if (scan_join(path, sizeof(path), parent ? parent->path : NULL, name) != 0)
+        return NULL;
+    size_t len = strlen(path) + 1;
+    ScanNode *node = malloc(sizeof(ScanNode) + len);
+    if (!node) return NULL;
+    memset(node, 0, sizeof(ScanNode));
+    node->parent = parent;
+    node->depth = parent ? parent->depth + 1 : 0;
+    memcpy(node->path, path, len);
+    return node;
+}
+
+/* Drop one reference to node. The last one finalizes it and hands its
+ * total to the parent, which may finish in turn. */
+static void steal_release(StealSched *s, ScanNode *node) {
+    while (node) {
+        long left;
+        #pragma omp flush
+        #pragma omp atomic capture
+        left = --node->pending;
+        if (left > 0) return;
+        #pragma omp flush
+
+        if (node->visited)
+            scan_finalize(node->path, s->ctx, node->skip_file_count, &node->result);
+
+        ScanNode *parent = node->parent;
+        ScanResult sub = node->result;
+        free(node);
+
+        if (!parent) {
+            s->result = sub;
+            #pragma omp flush
+            #pragma omp atomic write
+            s->done = 1;
+            return;
+        }
+        if (sub.size >= 0) {
+            #pragma omp atomic
+            parent->result.size += sub.size;
+        }
+        if (!parent->skip_file_count && sub.file_count >= 0) {
+            #pragma omp atomic
+            parent->result.file_count += sub.file_count;
+        }
+        node = parent;
+    }
+}
+
+static void steal_run(StealSched *s, ScanNode *node, int inline_depth) {
+    const ScanContext *ctx = s->ctx;
+    StealDeque *own = &s->deques[omp_get_thread_num()];
+
+    SubdirList list;
+    node->pending = 1;
+    if (!scan_visit(node->path, node->depth, ctx, &node->result, &list,
+                    &node->skip_file_count)) {
+        steal_release(s, node);
+        return;
+    }
+    node->visited = 1;
+    node->pending += (long)list.count;
+
+    /* Publish what other threads can use; keep the rest for ourselves */
+    ScanNode *inline_head = NULL, **inline_tail = &inline_head;
+    const char *name = list.names;
+    for (size_t i = 0; i < list.count; i++, name += strlen(name) + 1) {
+        ScanNode *child = steal_node_new(node, name);
+        if (!child) {
+            /* Path too long or OOM: count it as unreadable */
+            steal_release(s, node);
+            continue;
+        }
+        int idle;
+        #pragma omp atomic read
+        idle = s->idle;
+        int publish = idle > 0 || inline_depth >= STEAL_INLINE_DEPTH ||
+                      deque_size(own) < STEAL_MIN_QUEUED;
+        if (!publish || deque_push(own, child) != 0) {
+            *inline_tail = child;
+            inline_tail = &child->next;
+        }
+    }
+    free(list.names);
+
+    while (inline_head) {
+        ScanNode *child = inline_head;
+        inline_head = child->next;
+        steal_run(s, child, inline_depth + 1);
+    }
+    steal_release(s, node);
+}
+
+static ScanNode *steal_find(StealSched *s, int self, unsigned *seed) {
+    ScanNode *node = deque_take(&s->deques[self], 1);
+    if (node || s->nthreads == 1) return node;
+
+    *seed = *seed * 1103515245u + 12345u;
+    int start = (int)((*seed >> 16) % (unsigned)s->nthreads);
+    for (int i = 0; i < s->nthreads && !node; i++) {
+        int victim = (start + i) % s->nthreads;
+        if (victim != self) node = deque_take(&s->deques[victim], 0);
+    }
+    return node;
+}
+
+static void steal_worker(StealSched *s) {
+    int self = omp_get_thread_num();
+    unsigned seed = (unsigned)self * 2654435761u + 1;
+    int hungry = 0;
+    int misses = 0;
+
+    for (;;) {
+        ScanNode *node = steal_find(s, self, &seed);
+        if (node) {
+            if (hungry) {
+                #pragma omp atomic
+                s->idle--;
+                hungry = 0;
+            }
+            misses = 0;
+            steal_run(s, node, 0);
+            continue;
+        }
+
+        if (!hungry) {
+            #pragma omp atomic
+            s->idle++;
+            hungry = 1;
+        }
+        int done;
+        #pragma omp atomic read
+        done = s->done;
+        if (done) break;
+
+        /* Back off so idle threads don't starve busy ones of a core */
+        if (++misses < STEAL_SPIN_ROUNDS) {
+            sched_yield();
+        } else {
+            struct timespec pause = {0, STEAL_IDLE_SLEEP_NS};
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+/* Run the work-stealing scheduler over path with a team of max_threads */
+static ScanResult steal_scan(const char *path, const ScanContext *ctx,
+                             int max_threads) {
+    StealSched s = {ctx, NULL, 1, 0, 0, {0, 0}};
+    s.deques = calloc((size_t)max_threads, sizeof(StealDeque));
+    ScanNode *root = steal_node_new(NULL, path);
+    if (!s.deques || !root) {
+        free(s.deques);
+        free(root);
+        return (ScanResult){-1, -1};
+    }
+#ifdef _OPENMP
+    for (int i = 0; i < max_threads; i++)
+        omp_init_lock(&s.deques[i].lock);
+#endif
+    deque_push(&s.deques[0], root);
+
+    #pragma omp parallel num_threads(max_threads)
+    {
+        #pragma omp single
+        s.nthreads = omp_get_num_threads();
+        steal_worker(&s);
+    }
+
+    for (int i = 0; i < max_threads; i++) {
+        free(s.deques[i].items);
+#ifdef _OPENMP
+        omp_destroy_lock(&s.deques[i].lock);
+#endif
+    }
+    free(s.deques);
+    return s.result;
+}
+
+/* ============================================================================
+ * Entry points
+ * ============================================================================ */
+
+/* A network mount reached by a SCAN_NET_WIDE scan. The scan that found it
+ * waits here while a team of g_network_threads works through the mount,
+ * so one mount never has more reads in flight than that. Its subtree is
+ * the team's own; mounts below it are read as part of it. */
+static ScanResult scan_network_mount(const char *path, const ScanContext *ctx) {
+    if (g_mount_fn) {
+        ScanResult result;
+        int filled;
+        /* Shares the previous scan's database with the reuse lookups */
+        #pragma omp critical(scan_reuse)
+        filled = g_mount_fn(path, &result);
+        if (filled) return result;
+    }
+
+    ScanContext mount_ctx = *ctx;
+    mount_ctx.network = 1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ScanResult result = steal_scan(path, &mount_ctx, g_network_threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (g_mount_done_fn) {
+        g_mount_done_fn(path, result, (double)(end.tv_sec - start.tv_sec) +
+                                      (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+    return result;
+}
+
+static ScanResult scan_run(const char *path, ScanContext *ctx) {
+    ScanResult result;
+    VisitedSet visited;
+    visited_init(&visited, ctx->progress);
+    ctx->visited = &visited;
+
+    if (g_scheduler == SCAN_SCHED_STEAL) {
+        result = steal_scan(path, ctx, omp_get_max_threads());
+    } else if (omp_in_parallel()) {
+        /* Called from a task (the client's tree build): spawn into that
+         * team rather than a nested region, which would get one thread */
+        result = scan_impl(NULL, path, 0, ctx);
+    } else {
+        #pragma omp parallel
+        #pragma omp single
+        {
+            result = scan_impl(NULL, path, 0, ctx);
+        }
+    }
+
+    visited_free(&visited);
+    return result;
+}
+
+static void progress_read(ScanProgress *p, ScanProgress *out) {
+    #pragma omp atomic read
+    out->dirs_read = p->dirs_read;
+    #pragma omp atomic read
+    out->dirs_reused = p->dirs_reused;
+    #pragma omp atomic read
+    out->files_read = p->files_read;
+    #pragma omp atomic read
+    out->visited_entries = p->visited_entries;
+    #pragma omp atomic read
+    out->visited_bytes = p->visited_bytes;
+}
+
+void scan_get_progress(ScanProgress *out) {
+    progress_read(&g_progress, out);
+}
+
+void scan_get_detached_progress(ScanProgress *out) {
+    progress_read(&g_detached_progress, out);
+}
+
+ScanResult scan_directory(const char *path,
+                          scan_store_fn store_fn,
+                          scan_cache_fn cache_fn,
+                          volatile int *shutdown,
+                          long threshold) {
+    ScanContext ctx = {store_fn, cache_fn, shutdown, threshold, NULL,
+                       NULL, NULL, g_network_mode, &g_progress, 0};
+    return scan_run(path, &ctx);
+}
+
+ScanResult scan_directory_detached(const char *path,
+                                   scan_store_fn store_fn,
+                                   scan_cache_fn cache_fn,
+                                   volatile int *shutdown,
+                                   long threshold) {
+    ScanContext ctx = {store_fn, cache_fn, shutdown, threshold, NULL,
+                       NULL, NULL, SCAN_NET_INLINE, &g_detached_progress, 0};
+    return scan_run(path, &ctx);
+}
+
+ScanResult scan_directory_incremental(const char *path,
+                                      scan_store_fn store_fn,
+                                      scan_reuse_fn reuse_fn,
+                                      scan_state_fn state_fn,
+                                      volatile int *shutdown,
+                                      long threshold) {
+    ScanContext ctx = {store_fn, NULL, shutdown, threshold, NULL,
+                       reuse_fn, state_fn, g_network_mode, &g_progress, 0};
+    return scan_run(path, &ctx);
+}
@@ -5,22 +5,104 @@
 #ifndef SCAN_H
 #define SCAN_H
 
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 typedef struct {
     off_t size;
     long file_count;
 } ScanResult;
 
-/* Callback to store results for a directory (can be NULL) */
+/* Callback to store results for a directory (can be NULL)
+ * Called concurrently from scan threads; must be thread-safe */
 typedef void (*scan_store_fn)(const char *path, off_t size, long count);
 
 /* Callback to lookup cached results (can be NULL)
  * Returns 1 if found and populates size/count, 0 otherwise */
 typedef int (*scan_cache_fn)(const char *path, off_t *size, long *count);
 
+/* Per-directory state recorded for incremental rescans.
+ *
+ * own_size/own_count cover only what the directory itself contributes
+ * (its own blocks plus its direct non-directory entries); subdirectory
+ * totals are summed on top during the walk. subdirs holds the names of
+ * the child directories, each NUL-terminated, back to back. */
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    off_t own_size;
+    long own_count;
+    char *subdirs;
+    size_t subdirs_len;
+} ScanDirState;
+
+/* Callback to fetch the previous state of a directory (can be NULL)
+ * Returns 1 if st matches the recorded stamp and populates state (the
+ * caller frees state->subdirs), 0 if the directory must be re-read */
+typedef int (*scan_reuse_fn)(const char *path, const struct stat *st,
+                             ScanDirState *state);
+
+/* Callback to record the state of a directory for the next scan (can be NULL)
+ * Called concurrently from scan threads; must be thread-safe */
+typedef void (*scan_state_fn)(const char *path, const ScanDirState *state);
+
+/* Fill the stamp fields of a ScanDirState from a stat result */
+void scan_state_stamp(ScanDirState *state, const struct stat *st);
+
+/* How subdirectories are spread across threads */
+typedef enum {
+    SCAN_SCHED_TASKS,   /* One OMP task per subdirectory (default) */
+    SCAN_SCHED_STEAL    /* Per-thread work-stealing deques, small dirs inline */
+} ScanScheduler;
+
+/* Select the scheduler used by subsequent scans (process-wide) */
+void scan_set_scheduler(ScanScheduler scheduler);
+
+/* How directories on network filesystems (NFS, Lustre, GPFS, ...) are read */
+typedef enum {
+    SCAN_NET_INLINE,    /* Like any other directory (default) */
+    SCAN_NET_SKIP,      /* Not at all: a network mount counts as empty */
+    SCAN_NET_WIDE       /* Each mount by a team of its own, sized for latency */
+} ScanNetworkMode;
+
+/* Callback run where a SCAN_NET_WIDE scan enters a network mount (can be NULL)
+ * Returns 1 if it filled result from elsewhere, so the mount isn't read,
+ * 0 to scan it. Called from scan threads, one at a time */
+typedef int (*scan_mount_fn)(const char *path, ScanResult *result);
+
+/* Callback run once a network mount's team has finished reading it (can
+ * be NULL), with its totals and the wall time the read took */
+typedef void (*scan_mount_done_fn)(const char *path, ScanResult result,
+                                   double seconds);
+
+/* Select how subsequent scans treat network mounts (process-wide).
+ * threads bounds the concurrent directory reads against one mount. */
+void scan_set_network(ScanNetworkMode mode, int threads, scan_mount_fn mount_fn,
+                      scan_mount_done_fn done_fn);
+
+/* Running totals over every scan in this process, for progress reports.
+ * The counters only grow; visited_* cover the visited sets currently
+ * allocated (empty between scans). */
+typedef struct {
+    long dirs_read;             /* Directories listed from disk */
+    long dirs_reused;           /* Taken from the previous scan's state */
+    long files_read;            /* Entries counted in directories read */
+    long visited_entries;       /* Inodes in the visited sets */
+    long visited_bytes;         /* Memory held by their slot arrays */
+} ScanProgress;
+
+/* Snapshot the progress counters (safe from any thread, mid-scan) */
+void scan_get_progress(ScanProgress *out);
+
+/* The same counters for walks made with scan_directory_detached, which
+ * are left out of scan_get_progress */
+void scan_get_detached_progress(ScanProgress *out);
+
 /* Scan a directory tree and return total size/count.
- * Uses OMP task-based parallelism for speed.
+ * Runs on the OMP thread team with the selected scheduler.
  *
  * store_fn: called for each directory meeting threshold (can be NULL)
  * cache_fn: called to check cache before scanning a directory (can be NULL)
@@ -33,4 +115,29 @@ ScanResult scan_directory(const char *path,
                           volatile int *shutdown,
                           long threshold);
 
+/* Like scan_directory, for walks that run beside the process's own scans:
+ * network mounts are read inline whatever scan_set_network selected, so
+ * the totals match a plain walk and no mount callback runs. Progress goes
+ * to scan_get_detached_progress. */
+ScanResult scan_directory_detached(const char *path,
+                                   scan_store_fn store_fn,
+                                   scan_cache_fn cache_fn,
+                                   volatile int *shutdown,
+                                   long threshold);
+
+/* Like scan_directory, but reuses the recorded contents of directories
+ * whose (dev, ino, mtime, ctime) stamp is unchanged instead of re-reading
+ * them. Subdirectories are still visited, so a change anywhere below is
+ * picked up and summed into every ancestor.
+ *
+ * reuse_fn: looks up the previous state of a directory (can be NULL)
+ * state_fn: records the state of every fully-read directory (can be NULL)
+ */
+ScanResult scan_directory_incremental(const char *path,
+                                      scan_store_fn store_fn,
+                                      scan_reuse_fn reuse_fn,
+                                      scan_state_fn state_fn,
+                                      volatile int *shutdown,
+                                      long threshold);
+
 #endif /* SCAN_H */
@@ -3,6 +3,9 @@
  */
 
 #include "select.h"
+#include "cache.h"
+#include <errno.h>
+#include <pthread.h>
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
@@ -167,12 +170,16 @@ static void collapsed_toggle(CollapsedSet *set, const char *path) {
  * Selection State
  * ============================================================================ */
 
+#define COLUMN_WIDTH_LIMIT 32    /* Column formatters fill at most 31 chars */
+
 /* Info stored for each flattened node */
 typedef struct {
     TreeNode *node;
     int depth;
     int has_visible_children;
     int continuation[L_MAX_DEPTH];  /* Copy of continuation state at this node */
+    unsigned char widths[NUM_COLUMNS];  /* Column widths counted for this row */
+    int measured_done;           /* widths were taken after its metadata landed */
 } FlatNode;
 
 typedef struct {
@@ -184,16 +191,16 @@ typedef struct {
     int term_rows;         /* Terminal height */
     int visible_lines;     /* Lines currently displayed */
     int first_render;      /* Is this the first render? */
+    /* Rows per column width, so widths follow the flattened rows without
+     * re-measuring all of them when a subtree comes or goes */
+    int width_counts[NUM_COLUMNS][COLUMN_WIDTH_LIMIT];
+    char **frame;          /* Text of each displayed line, status line last */
+    int frame_offset;      /* scroll_offset the frame was drawn at */
 } SelectState;
 
 static void state_init(SelectState *state) {
-    state->items = NULL;
-    state->count = 0;
-    state->capacity = 0;
-    state->cursor = 0;
-    state->scroll_offset = 0;
+    memset(state, 0, sizeof(*state));
     state->term_rows = 24;
-    state->visible_lines = 0;
     state->first_render = 1;
 }
 
@@ -202,15 +209,17 @@ static void state_clear(SelectState *state) {
     /* Keep capacity and allocated memory for reuse */
 }
 
+static void state_reserve(SelectState *state, int count) {
+    if (count <= state->capacity) return;
+    int new_cap = state->capacity ? state->capacity : 256;
+    while (new_cap < count) new_cap *= 2;
+    state->items = xrealloc(state->items, (size_t)new_cap * sizeof(FlatNode));
+    state->capacity = new_cap;
+}
+
 static void state_add(SelectState *state, TreeNode *node, int depth,
                       int has_visible_children, int *continuation) {
-    if (state->count >= state->capacity) {
-        int new_cap = state->capacity ? state->capacity * 2 : 256;
-        FlatNode *new_items = realloc(state->items, new_cap * sizeof(FlatNode));
-        if (!new_items) return;  /* Out of memory - skip this node */
-        state->items = new_items;
-        state->capacity = new_cap;
-    }
+    state_reserve(state, state->count + 1);
     FlatNode *item = &state->items[state->count];
     item->node = node;
     item->depth = depth;
@@ -224,6 +233,11 @@ static void state_free(SelectState *state) {
     state->items = NULL;
     state->count = 0;
     state->capacity = 0;
+    if (state->frame) {
+        for (int i = 0; i < state->visible_lines; i++) free(state->frame[i]);
+        free(state->frame);
+        state->frame = NULL;
+    }
 }
 
 /* ============================================================================
@@ -309,21 +323,109 @@ static void flatten_all(SelectState *state, TreeNode **trees, int tree_count,
     }
 }
 
-/* Recalculate column widths based on visible (flattened) items only */
-static void recalculate_columns(SelectState *state, Column *cols, const Icons *icons) {
-    if (!cols) return;  /* No columns in short format */
-    /* Reset to minimum widths */
-    for (int i = 0; i < NUM_COLUMNS; i++) {
-        cols[i].width = 1;
+/* Count a row's column widths into the histogram; deferred columns of a
+ * row the workers haven't reached hold the one-cell COLUMN_PENDING */
+static void row_measure(SelectState *state, FlatNode *item, const Column *cols,
+                        const Icons *icons, const Config *cfg) {
+    char buf[COLUMN_WIDTH_LIMIT];
+    int pending = item->node->meta_state != META_DONE;
+    for (int c = 0; c < NUM_COLUMNS; c++) {
+        int len = 1;
+        if (!pending || !column_is_deferred(c, cfg)) {
+            cols[c].format(&item->node->entry, icons, buf, sizeof(buf));
+            len = (int)strlen(buf);
+        }
+        item->widths[c] = (unsigned char)len;
+        state->width_counts[c][len]++;
+    }
+    item->measured_done = !pending;
+}
+
+static void row_unmeasure(SelectState *state, const FlatNode *item) {
+    for (int c = 0; c < NUM_COLUMNS; c++) {
+        state->width_counts[c][item->widths[c]]--;
+    }
+}
+
+/* Set each column to its widest counted row (at least 1) */
+static void columns_apply(const SelectState *state, Column *cols) {
+    for (int c = 0; c < NUM_COLUMNS; c++) {
+        int w = COLUMN_WIDTH_LIMIT - 1;
+        while (w > 1 && state->width_counts[c][w] == 0) w--;
+        cols[c].width = w;
     }
-    /* Update based on visible items */
+}
+
+/* Count every flattened row's widths afresh */
+static void measure_rows(SelectState *state, const Column *cols, const Icons *icons,
+                         const Config *cfg) {
+    memset(state->width_counts, 0, sizeof(state->width_counts));
     for (int i = 0; i < state->count; i++) {
-        columns_update_widths(cols, &state->items[i].node->entry, icons);
+        row_measure(state, &state->items[i], cols, icons, cfg);
     }
 }
 
+/* Re-measure rows whose deferred metadata landed after they were counted */
+static void refresh_columns(SelectState *state, Column *cols, const Icons *icons,
+                            const Config *cfg) {
+    if (!cols) return;
+    for (int i = 0; i < state->count; i++) {
+        FlatNode *item = &state->items[i];
+        if (!item->measured_done && item->node->meta_state == META_DONE) {
+            row_unmeasure(state, item);
+            row_measure(state, item, cols, icons, cfg);
+        }
+    }
+    columns_apply(state, cols);
+}
+
+/* Replace the rows under index with what its node shows now (none if it's
+ * collapsed), leaving the rest of the flattened list as it is */
+static void splice_subtree(SelectState *state, int index, const Config *cfg,
+                           CollapsedSet *collapsed, Column *cols, const Icons *icons) {
+    FlatNode *item = &state->items[index];
+    int end = index + 1;
+    while (end < state->count && state->items[end].depth > item->depth) end++;
+
+    SelectState sub;
+    state_init(&sub);
+    int continuation[L_MAX_DEPTH];
+    memcpy(continuation, item->continuation, sizeof(continuation));
+    item->has_visible_children = count_visible_children(item->node, cfg, collapsed) > 0;
+    if (item->node->child_count > 0 && !collapsed_contains(collapsed, item->node->entry.path)) {
+        flatten_children(&sub, item->node, item->depth, continuation, cfg, collapsed);
+    }
+
+    if (cols) {
+        for (int i = index + 1; i < end; i++) row_unmeasure(state, &state->items[i]);
+    }
+
+    int removed = end - index - 1;
+    state_reserve(state, state->count - removed + sub.count);
+    memmove(&state->items[index + 1 + sub.count], &state->items[end],
+            (size_t)(state->count - end) * sizeof(FlatNode));
+    if (sub.count > 0) {
+        memcpy(&state->items[index + 1], sub.items, (size_t)sub.count * sizeof(FlatNode));
+    }
+    state->count += sub.count - removed;
+
+    if (cols) {
+        for (int i = index + 1; i < index + 1 + sub.count; i++) {
+            row_measure(state, &state->items[i], cols, icons, cfg);
+        }
+        columns_apply(state, cols);
+    }
+    state_free(&sub);
+}
+
 /* ============================================================================
  * Rendering
+ *
+ * The view is drawn inline below the prompt, so rows are addressed relative
+ * to the status line the terminal cursor rests on. The previous frame is
+ * kept and only rows whose text changed are rewritten; a one-row scroll
+ * deletes a line at one edge and inserts one at the other, which scrolls
+ * the rows between in the terminal instead of resending them.
  * ============================================================================ */
 
 static void get_terminal_size(int *rows) {
@@ -335,13 +437,11 @@ static void get_terminal_size(int *rows) {
     }
 }
 
-static void render_line(SelectState *state, int index, int is_selected,
-                        PrintContext *ctx, CollapsedSet *collapsed) {
+/* Format row index as print_entry would print it; returns its length */
+static int format_row(SelectState *state, int index, int is_selected,
+                      PrintContext *ctx, CollapsedSet *collapsed, char *line) {
     FlatNode *item = &state->items[index];
 
-    /* Clear line */
-    printf("\r\033[K");
-
     /* Set up the line prefix (cursor indicator) */
     static char prefix_buf[64];
     const char *cursor_icon = ctx->icons->cursor[0] ? ctx->icons->cursor : ">";
@@ -370,9 +470,51 @@ static void render_line(SelectState *state, int index, int is_selected,
     line_ctx.line_prefix = prefix;
     line_ctx.continuation = ctx->continuation;
     line_ctx.selected = is_selected;
+    line_ctx.meta_pending = item->node->meta_state != META_DONE;
+
+    return format_entry(&item->node->entry, item->depth, is_expanded, has_visible,
+                        &line_ctx, line);
+}
 
-    /* Call the real print_entry */
-    print_entry(&item->node->entry, item->depth, is_expanded, has_visible, &line_ctx);
+static void view_puts(const char *s) {
+    output_write(s, strlen(s));
+}
+
+/* Move the terminal cursor from display row *at to row */
+static void view_move(int *at, int row) {
+    char seq[16];
+    if (row < *at) {
+        snprintf(seq, sizeof(seq), "\033[%dA", *at - row);
+        view_puts(seq);
+    } else if (row > *at) {
+        snprintf(seq, sizeof(seq), "\033[%dB", row - *at);
+        view_puts(seq);
+    }
+    *at = row;
+}
+
+/* Scroll display rows [0, rows) by one (up if dir > 0) in the terminal and
+ * in the frame, leaving a blank row at the edge that came into view. The
+ * lines below are pulled up by the delete and pushed back by the insert. */
+static void view_scroll(SelectState *state, int *at, int rows, int dir) {
+    char **frame = state->frame;
+    if (dir > 0) {
+        view_move(at, 0);
+        view_puts("\033[M");
+        view_move(at, rows - 1);
+        view_puts("\033[L");
+        free(frame[0]);
+        memmove(&frame[0], &frame[1], (size_t)(rows - 1) * sizeof(char *));
+        frame[rows - 1] = xstrdup("");
+    } else {
+        view_move(at, rows - 1);
+        view_puts("\033[M");
+        view_move(at, 0);
+        view_puts("\033[L");
+        free(frame[rows - 1]);
+        memmove(&frame[1], &frame[0], (size_t)(rows - 1) * sizeof(char *));
+        frame[0] = xstrdup("");
+    }
 }
 
 static void render_view(SelectState *state, PrintContext *ctx, CollapsedSet *collapsed, int files_only) {
@@ -387,44 +529,260 @@ static void render_view(SelectState *state, PrintContext *ctx, CollapsedSet *col
         state->scroll_offset = state->cursor - max_visible + 1;
     }
 
-    /* Move cursor up to top of our display area (if not first render) */
-    int old_visible = state->visible_lines;
-    if (!state->first_render && old_visible > 1) {
-        printf("\033[%dA", old_visible - 1);
-    }
-    state->first_render = 0;
-
-    /* Render visible lines */
     int end = state->scroll_offset + max_visible;
     if (end > state->count) end = state->count;
-    int new_visible = (end - state->scroll_offset) + 1;  /* +1 for status */
+    int rows = end - state->scroll_offset;
+    int new_visible = rows + 1;  /* +1 for status */
+    int old_visible = state->visible_lines;
 
-    for (int i = state->scroll_offset; i < end; i++) {
-        render_line(state, i, i == state->cursor, ctx, collapsed);
-    }
+    char status[256];
+    snprintf(status, sizeof(status), "%s[j/k] %s  [f] %s  [h/l] fold  [o] open  [y] yank  [Enter] select  [q] quit%s",
+             COLOR_GREY, files_only ? "files" : "move", files_only ? "all" : "files", COLOR_RESET);
+
+    char line[ENTRY_BUF_SIZE];
+    if (state->first_render || old_visible != new_visible) {
+        /* Shape changed: redraw every line from the top */
+        if (!state->first_render && old_visible > 1) {
+            char seq[16];
+            snprintf(seq, sizeof(seq), "\033[%dA", old_visible - 1);
+            view_puts(seq);
+        }
+        state->first_render = 0;
 
-    /* Status line */
-    if (files_only) {
-        printf("\r\033[K%s[j/k] files  [f] all  [h/l] fold  [o] open  [y] yank  [Enter] select  [q] quit%s",
-               COLOR_GREY, COLOR_RESET);
+        if (state->frame) {
+            for (int i = 0; i < old_visible; i++) free(state->frame[i]);
+        }
+        state->frame = xrealloc(state->frame, (size_t)new_visible * sizeof(char *));
+
+        for (int r = 0; r < rows; r++) {
+            int i = state->scroll_offset + r;
+            format_row(state, i, i == state->cursor, ctx, collapsed, line);
+            state->frame[r] = xstrdup(line);
+            view_puts("\r\033[K");
+            view_puts(line);
+            view_puts("\n");
+        }
+        state->frame[rows] = xstrdup(status);
+        view_puts("\r\033[K");
+        view_puts(status);
+
+        /* Clear any extra lines from previous render (when tree shrinks) */
+        if (old_visible > new_visible) {
+            for (int i = 0; i < old_visible - new_visible; i++) {
+                view_puts("\n\033[K");
+            }
+            /* Move back up to status line position */
+            char seq[16];
+            snprintf(seq, sizeof(seq), "\033[%dA", old_visible - new_visible);
+            view_puts(seq);
+        }
     } else {
-        printf("\r\033[K%s[j/k] move  [f] files  [h/l] fold  [o] open  [y] yank  [Enter] select  [q] quit%s",
-               COLOR_GREY, COLOR_RESET);
-    }
+        int at = rows;  /* The cursor rests on the status line */
+        int shift = state->scroll_offset - state->frame_offset;
+        if ((shift == 1 || shift == -1) && rows > 1) {
+            view_scroll(state, &at, rows, shift);
+        }
 
-    /* Clear any extra lines from previous render (when tree shrinks) */
-    if (old_visible > new_visible) {
-        for (int i = 0; i < old_visible - new_visible; i++) {
-            printf("\n\033[K");
+        for (int r = 0; r <= rows; r++) {
+            const char *text = status;
+            if (r < rows) {
+                int i = state->scroll_offset + r;
+                format_row(state, i, i == state->cursor, ctx, collapsed, line);
+                text = line;
+            }
+            if (strcmp(state->frame[r], text) == 0) continue;
+            view_move(&at, r);
+            view_puts("\r\033[K");
+            view_puts(text);
+            free(state->frame[r]);
+            state->frame[r] = xstrdup(text);
         }
-        /* Move back up to status line position */
-        printf("\033[%dA", old_visible - new_visible);
+        view_move(&at, rows);
     }
 
-    fflush(stdout);
+    output_flush();
 
     /* Track how many lines we printed */
     state->visible_lines = new_visible;
+    state->frame_offset = state->scroll_offset;
+}
+
+/* ============================================================================
+ * Background Metadata
+ *
+ * The tree is built without cfg->deferred (sizes, file and line counts),
+ * so the first screen draws at once. Worker threads fill those in, taking
+ * rows in the order the last render asked for: the cursor, the rest of the
+ * viewport outwards from it, then everything else that's flattened. The
+ * main loop holds the lock except while it waits for a key, so results
+ * land between renders; each batch wakes it through a pipe to redraw.
+ * ============================================================================ */
+
+#define META_MAX_WORKERS   8
+#define META_REDRAW_MS     30   /* Minimum gap between redraws for results */
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_t threads[META_MAX_WORKERS];
+    int thread_count;            /* 0 when nothing is deferred */
+    ComputeOpts compute;
+    TreeNode **queue;            /* Rows wanted, most wanted first */
+    int queue_len;
+    int queue_pos;               /* Next row to hand out */
+    int queue_cap;
+    int wake_fds[2];             /* Written when a result lands */
+    int wake_pending;            /* A wake byte is unread */
+    int stopping;
+} MetaPool;
+
+static void *meta_worker(void *arg) {
+    MetaPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        TreeNode *node = NULL;
+        while (!node && pool->queue_pos < pool->queue_len) {
+            TreeNode *next = pool->queue[pool->queue_pos++];
+            if (next->meta_state == META_PENDING) node = next;
+        }
+        if (!node) {
+            /* Out of work: write what was queued for the content cache */
+            pthread_mutex_unlock(&pool->lock);
+            content_cache_flush();
+            pthread_mutex_lock(&pool->lock);
+            if (!pool->stopping && pool->queue_pos >= pool->queue_len)
+                pthread_cond_wait(&pool->work, &pool->lock);
+            continue;
+        }
+
+        /* Measure a private copy so rendering never sees a half update */
+        node->meta_state = META_RUNNING;
+        FileEntry fe = node->entry;
+        pthread_mutex_unlock(&pool->lock);
+
+        tree_compute_entry_meta(&fe, &pool->compute);
+
+        pthread_mutex_lock(&pool->lock);
+        node->entry.size = fe.size;
+        node->entry.file_count = fe.file_count;
+        node->entry.line_count = fe.line_count;
+        node->entry.word_count = fe.word_count;
+        node->entry.content_type = fe.content_type;
+        node->meta_state = META_DONE;
+        if (!pool->wake_pending) {
+            ssize_t r = write(pool->wake_fds[1], "", 1);
+            pool->wake_pending = (r == 1);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Start workers if anything was deferred. Returns with the lock held by
+ * the caller (the main loop), as every other pool function expects. */
+static void meta_pool_start(MetaPool *pool, const Config *cfg) {
+    memset(pool, 0, sizeof(*pool));
+    pool->wake_fds[0] = pool->wake_fds[1] = -1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_mutex_lock(&pool->lock);
+
+    const ComputeOpts *c = &cfg->deferred;
+    if (!(c->sizes || c->file_counts || c->line_counts || c->media_info)) return;
+    if (pipe(pool->wake_fds) != 0) return;
+    pool->compute = *c;
+
+    /* Line counts wait on I/O more than CPU, so use at least two */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int want = cpus < 2 ? 2 : cpus > META_MAX_WORKERS ? META_MAX_WORKERS : (int)cpus;
+    for (int i = 0; i < want; i++) {
+        if (pthread_create(&pool->threads[i], NULL, meta_worker, pool) != 0) break;
+        pool->thread_count++;
+    }
+}
+
+static void meta_pool_stop(MetaPool *pool) {
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    if (pool->wake_fds[0] >= 0) {
+        close(pool->wake_fds[0]);
+        close(pool->wake_fds[1]);
+    }
+    content_cache_flush();
+    free(pool->queue);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static void meta_queue_add(MetaPool *pool, const SelectState *state, int index) {
+    TreeNode *node = state->items[index].node;
+    if (node->meta_state == META_PENDING) pool->queue[pool->queue_len++] = node;
+}
+
+/* Reorder the queue around what the last render showed */
+static void meta_pool_prioritize(MetaPool *pool, const SelectState *state) {
+    if (pool->thread_count == 0 || state->count == 0) return;
+    if (pool->queue_cap < state->count) {
+        pool->queue_cap = state->count;
+        pool->queue = xrealloc(pool->queue, (size_t)pool->queue_cap * sizeof(TreeNode *));
+    }
+    pool->queue_len = 0;
+    pool->queue_pos = 0;
+
+    int first = state->scroll_offset;
+    int end = first + state->visible_lines - 1;  /* Minus the status line */
+    if (end > state->count) end = state->count;
+    int cursor = state->cursor;
+
+    meta_queue_add(pool, state, cursor);
+    for (int d = 1; cursor + d < end || cursor - d >= first; d++) {
+        if (cursor + d < end) meta_queue_add(pool, state, cursor + d);
+        if (cursor - d >= first) meta_queue_add(pool, state, cursor - d);
+    }
+    /* Rows below the viewport are the likeliest to be scrolled to next */
+    for (int i = end; i < state->count; i++) meta_queue_add(pool, state, i);
+    for (int i = 0; i < first; i++) meta_queue_add(pool, state, i);
+
+    if (pool->queue_len > 0) pthread_cond_broadcast(&pool->work);
+}
+
+/* Wait for a key, redrawing as results arrive (at most every
+ * META_REDRAW_MS, so a burst of cache hits doesn't flood the terminal) */
+static void meta_wait_for_key(MetaPool *pool, SelectState *state, PrintContext *ctx,
+                              CollapsedSet *collapsed, int files_only) {
+    if (pool->thread_count == 0) return;
+
+    int throttled = 0;
+    for (;;) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        if (!throttled) FD_SET(pool->wake_fds[0], &fds);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = META_REDRAW_MS * 1000 };
+
+        pthread_mutex_unlock(&pool->lock);
+        int nfds = (pool->wake_fds[0] > STDIN_FILENO ? pool->wake_fds[0] : STDIN_FILENO) + 1;
+        int rc = select(nfds, &fds, NULL, NULL, throttled ? &tv : NULL);
+        pthread_mutex_lock(&pool->lock);
+
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        throttled = 0;
+        if (FD_ISSET(STDIN_FILENO, &fds)) return;
+        if (rc > 0 && FD_ISSET(pool->wake_fds[0], &fds)) {
+            char c;
+            if (read(pool->wake_fds[0], &c, 1) == 1) pool->wake_pending = 0;
+            refresh_columns(state, ctx->columns, ctx->icons, ctx->cfg);
+            render_view(state, ctx, collapsed, files_only);
+            throttled = 1;
+        }
+    }
 }
 
 /* ============================================================================
@@ -548,6 +906,9 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
         return NULL;
     }
 
+    /* Widths from the build stand until the rows change */
+    if (ctx->columns) measure_rows(&state, ctx->columns, ctx->icons, ctx->cfg);
+
     /* Get terminal size */
     get_terminal_size(&state.term_rows);
 
@@ -557,6 +918,9 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
     render_ctx.line_prefix = NULL;
     render_ctx.term_width = get_terminal_width();
 
+    MetaPool pool;
+    meta_pool_start(&pool, ctx->cfg);
+
     /* Enter raw mode and render */
     term_enable_raw();
     render_view(&state, &render_ctx, &collapsed, files_only);
@@ -567,6 +931,8 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
         /* Safety check - exit if tree becomes empty */
         if (state.count == 0) break;
 
+        meta_pool_prioritize(&pool, &state);
+        meta_wait_for_key(&pool, &state, &render_ctx, &collapsed, files_only);
         KeyPress key = term_read_key();
         FlatNode *current = &state.items[state.cursor];
 
@@ -598,17 +964,8 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
                     (current->node->child_count > 0 || current->node->was_expanded)) {
                     /* Collapse this directory (including empty expanded dirs) */
                     collapsed_toggle(&collapsed, current->node->entry.path);
-                    const char *cur_path = current->node->entry.path;
-                    flatten_all(&state, trees, tree_count, ctx->cfg, &collapsed);
-                    recalculate_columns(&state, ctx->columns, ctx->icons);
-                    /* Find the cursor position again */
-                    state.cursor = 0;  /* Default to first item */
-                    for (int i = 0; i < state.count; i++) {
-                        if (strcmp(state.items[i].node->entry.path, cur_path) == 0) {
-                            state.cursor = i;
-                            break;
-                        }
-                    }
+                    splice_subtree(&state, state.cursor, ctx->cfg, &collapsed,
+                                   ctx->columns, ctx->icons);
                     render_view(&state, &render_ctx, &collapsed, files_only);
                 }
                 break;
@@ -627,17 +984,8 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
                         /* Already expanded (including empty dirs), nothing to do */
                         break;
                     }
-                    const char *cur_path = current->node->entry.path;
-                    flatten_all(&state, trees, tree_count, ctx->cfg, &collapsed);
-                    recalculate_columns(&state, ctx->columns, ctx->icons);
-                    /* Find the cursor position again */
-                    state.cursor = 0;  /* Default to first item */
-                    for (int i = 0; i < state.count; i++) {
-                        if (strcmp(state.items[i].node->entry.path, cur_path) == 0) {
-                            state.cursor = i;
-                            break;
-                        }
-                    }
+                    splice_subtree(&state, state.cursor, ctx->cfg, &collapsed,
+                                   ctx->columns, ctx->icons);
                     render_view(&state, &render_ctx, &collapsed, files_only);
                 }
                 break;
@@ -674,17 +1022,8 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
                         tree_expand_node_from_config(current->node, ctx->columns, ctx->git,
                                          ctx->cfg, ctx->icons);
                     }
-                    const char *cur_path = current->node->entry.path;
-                    flatten_all(&state, trees, tree_count, ctx->cfg, &collapsed);
-                    recalculate_columns(&state, ctx->columns, ctx->icons);
-                    /* Find the cursor position again */
-                    state.cursor = 0;  /* Default to first item */
-                    for (int i = 0; i < state.count; i++) {
-                        if (strcmp(state.items[i].node->entry.path, cur_path) == 0) {
-                            state.cursor = i;
-                            break;
-                        }
-                    }
+                    splice_subtree(&state, state.cursor, ctx->cfg, &collapsed,
+                                   ctx->columns, ctx->icons);
                     render_view(&state, &render_ctx, &collapsed, files_only);
                 } else {
                     /* Open file: use system handler for binary, EDITOR for text */
@@ -707,6 +1046,7 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
                         snprintf(cmd, sizeof(cmd), "%s \"%s\"", editor,
                                  current->node->entry.path);
                     }
+                    meta_pool_stop(&pool);
                     if (system(cmd)) { /* ignore */ }
 
                     state_free(&state);
@@ -736,6 +1076,7 @@ char *select_run(TreeNode **trees, int tree_count, PrintContext *ctx) {
     }
 
 cleanup:
+    meta_pool_stop(&pool);
     printf("\r\033[K\n");
     term_disable_raw();
     state_free(&state);
@@ -4,8 +4,19 @@
 
 #include "tree.h"
 #include "cache.h"
+#include "profile.h"
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
+#include <sys/statvfs.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_max_threads() 1
+#define omp_get_thread_num()  0
+#endif
 
 /* ============================================================================
  * File List Management
@@ -15,6 +26,7 @@ void file_list_init(FileList *list) {
     list->entries = NULL;
     list->count = 0;
     list->capacity = 0;
+    arena_init(&list->paths);
 }
 
 void file_list_add(FileList *list, FileEntry *entry) {
@@ -26,11 +38,30 @@ void file_list_add(FileList *list, FileEntry *entry) {
 }
 
 void file_entry_free(FileEntry *entry) {
-    free(entry->path);
+    if (!entry->path_in_arena) free(entry->path);
     free(entry->symlink_target);
-    free(entry->branch);
-    free(entry->tag);
-    free(entry->remote);
+    free(entry->type_stats);
+    if (entry->repo) {
+        free(entry->repo->branch);
+        free(entry->repo->tag);
+        free(entry->repo->remote);
+        free(entry->repo);
+    }
+}
+
+RepoInfo *file_entry_repo(FileEntry *entry) {
+    if (!entry->repo) {
+        entry->repo = xmalloc(sizeof(RepoInfo));
+        memset(entry->repo, 0, sizeof(RepoInfo));
+    }
+    return entry->repo;
+}
+
+/* Remote and tag of the repo at path, shown with the root's name */
+static void entry_load_repo_refs(FileEntry *entry, const char *path) {
+    RepoInfo *ri = file_entry_repo(entry);
+    ri->remote = git_get_remote_url(path);
+    ri->tag = git_get_latest_tag(path, &ri->tag_distance);
 }
 
 void file_list_free(FileList *list) {
@@ -41,66 +72,245 @@ void file_list_free(FileList *list) {
     list->entries = NULL;
     list->count = 0;
     list->capacity = 0;
+    arena_free(&list->paths);
 }
 
 /* ============================================================================
  * Sorting
  * ============================================================================ */
 
-static int entry_cmp_name(const void *a, const void *b) {
-    const FileEntry *ea = a, *eb = b;
-    return strcasecmp(ea->name, eb->name);
+/* Listings are ordered through small keys rather than by moving entries:
+ * one pass sorts by name, an optional second by size or time with the
+ * name order breaking ties, and the entries are then permuted once. */
+typedef struct {
+    const char *name;
+    int64_t key;                 /* Size or mtime (second pass) */
+    size_t rank;                 /* Position in name order (second pass) */
+    size_t index;                /* Position in the unsorted list */
+} SortKey;
+
+static int sort_key_cmp_name(const void *a, const void *b) {
+    const SortKey *ka = a, *kb = b;
+    int c = strcasecmp(ka->name, kb->name);
+    if (c) return c;
+    return (ka->index > kb->index) - (ka->index < kb->index);
 }
 
-static int entry_cmp_size(const void *a, const void *b) {
-    const FileEntry *ea = a, *eb = b;
-    if (eb->size > ea->size) return 1;
-    if (eb->size < ea->size) return -1;
-    return 0;
+/* Larger values first, equal ones in name order */
+static int sort_key_cmp_desc(const void *a, const void *b) {
+    const SortKey *ka = a, *kb = b;
+    if (ka->key != kb->key) return ka->key < kb->key ? 1 : -1;
+    return (ka->rank > kb->rank) - (ka->rank < kb->rank);
 }
 
-static int entry_cmp_time(const void *a, const void *b) {
-    const FileEntry *ea = a, *eb = b;
-    if (eb->mtime > ea->mtime) return 1;
-    if (eb->mtime < ea->mtime) return -1;
-    return 0;
+static void sort_file_list(FileList *list, SortMode mode, int reverse) {
+    size_t n = list->count;
+    if (n < 2) return;
+
+    SortKey *keys = xmalloc(n * sizeof(SortKey));
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (SortKey){list->entries[i].name, 0, 0, i};
+    }
+    qsort(keys, n, sizeof(SortKey), sort_key_cmp_name);
+
+    if (mode == SORT_SIZE || mode == SORT_TIME) {
+        for (size_t i = 0; i < n; i++) {
+            const FileEntry *fe = &list->entries[keys[i].index];
+            keys[i].key = (mode == SORT_SIZE) ? (int64_t)fe->size : (int64_t)fe->mtime;
+            keys[i].rank = i;
+        }
+        qsort(keys, n, sizeof(SortKey), sort_key_cmp_desc);
+    }
+
+    FileEntry *sorted = xmalloc(n * sizeof(FileEntry));
+    for (size_t i = 0; i < n; i++) {
+        sorted[i] = list->entries[keys[reverse ? n - 1 - i : i].index];
+    }
+    free(keys);
+    free(list->entries);
+    list->entries = sorted;
+    list->capacity = n;
 }
 
-static void reverse_file_list(FileList *list) {
-    for (size_t i = 0; i < list->count / 2; i++) {
-        FileEntry tmp = list->entries[i];
-        list->entries[i] = list->entries[list->count - 1 - i];
-        list->entries[list->count - 1 - i] = tmp;
+/* ============================================================================
+ * Content Analysis (line counts, media info)
+ * ============================================================================ */
+
+/* Only regular files (or links to them) have stable content to cache */
+static int entry_is_content_file(const FileEntry *fe) {
+    return S_ISREG(fe->mode) &&
+           (fe->type == FTYPE_FILE || fe->type == FTYPE_EXEC ||
+            fe->type == FTYPE_SYMLINK || fe->type == FTYPE_SYMLINK_EXEC);
+}
+
+static ContentKey entry_content_key(const FileEntry *fe) {
+    return (ContentKey){fe->dev, fe->ino, fe->size, fe->mtime_ns};
+}
+
+/* Fill content fields from the content cache - returns 1 on a hit */
+static int content_from_cache(FileEntry *fe, int mode) {
+    ContentKey key = entry_content_key(fe);
+    ContentInfo info;
+    if (!content_cache_lookup(&key, mode, &info)) return 0;
+    fe->content_type = (ContentType)info.content_type;
+    fe->line_count = info.line_count;
+    fe->word_count = info.word_count;
+    return 1;
+}
+
+static void content_to_cache(const FileEntry *fe, int mode) {
+    ContentKey key = entry_content_key(fe);
+    ContentInfo info = {fe->content_type, fe->line_count, fe->word_count};
+    content_cache_store(&key, mode, &info);
+}
+
+/* ============================================================================
+ * Access Checks
+ * ============================================================================ */
+
+/* The IDs access(2) checks against (real, not effective) */
+typedef struct {
+    uid_t uid;
+    gid_t gid;
+    gid_t *groups;
+    int group_count;
+} Creds;
+
+static Creds g_creds;
+static pthread_once_t g_creds_once = PTHREAD_ONCE_INIT;
+
+static void creds_load(void) {
+    g_creds.uid = getuid();
+    g_creds.gid = getgid();
+    int n = getgroups(0, NULL);
+    if (n > 0) {
+        g_creds.groups = xmalloc((size_t)n * sizeof(gid_t));
+        n = getgroups(n, g_creds.groups);
     }
+    g_creds.group_count = n > 0 ? n : 0;
 }
 
-static void sort_file_list(FileList *list, SortMode mode, int reverse) {
-    if (list->count == 0) return;
+static int creds_in_group(const Creds *creds, gid_t gid) {
+    if (gid == creds->gid) return 1;
+    for (int i = 0; i < creds->group_count; i++) {
+        if (creds->groups[i] == gid) return 1;
+    }
+    return 0;
+}
 
-    int (*cmp)(const void *, const void *) = NULL;
-    switch (mode) {
-        case SORT_NAME: cmp = entry_cmp_name; break;
-        case SORT_SIZE: cmp = entry_cmp_size; break;
-        case SORT_TIME: cmp = entry_cmp_time; break;
-        default: return;
+/* Same answer as access(R_OK) == 0 && access(W_OK) != 0, from stat data:
+ * the owner, group or other bits apply (first match only), root may read
+ * and write anything, and files and directories on a read-only mount
+ * aren't writable. ACLs aren't consulted. */
+static int mode_is_readonly(const struct stat *st, int read_only_fs) {
+    pthread_once(&g_creds_once, creds_load);
+    const Creds *creds = &g_creds;
+
+    int can_read = 1, can_write = 1;
+    if (creds->uid != 0) {
+        mode_t bits = st->st_uid == creds->uid ? st->st_mode >> 6 :
+                      creds_in_group(creds, st->st_gid) ? st->st_mode >> 3 :
+                      st->st_mode;
+        can_read = (bits & S_IROTH) != 0;
+        can_write = (bits & S_IWOTH) != 0;
     }
+    if (read_only_fs && (S_ISREG(st->st_mode) || S_ISDIR(st->st_mode))) can_write = 0;
+    return can_read && !can_write;
+}
 
-    qsort(list->entries, list->count, sizeof(FileEntry), cmp);
-    if (reverse) reverse_file_list(list);
+/* ============================================================================
+ * Parallel Loops
+ *
+ * build_tree runs as OpenMP tasks, one per subdirectory. A loop inside one
+ * of them joins that team as a taskloop: a nested parallel region would be
+ * given a single thread. Outside a build a loop gets a team of its own.
+ * ============================================================================ */
+
+typedef void (*tree_loop_fn)(size_t i, void *ctx);
+
+static void tree_parallel_for(size_t count, tree_loop_fn fn, void *ctx) {
+#ifdef _OPENMP
+    if (omp_in_parallel()) {
+        #pragma omp taskloop grainsize(1)
+        for (size_t i = 0; i < count; i++) fn(i, ctx);
+        return;
+    }
+#endif
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < count; i++) fn(i, ctx);
 }
 
 /* ============================================================================
  * Directory Reading
  * ============================================================================ */
 
-int read_directory(const char *dir_path, FileList *list,
-                   const TreeBuildOpts *opts) {
-    DIR *dir = opendir(dir_path);
-    if (!dir) return -1;
+typedef struct {
+    FileList *list;
+    const ComputeOpts *compute;
+    const char *content_cached;  /* Per entry: served from the content cache */
+} EntryMetaCtx;
+
+static void entry_compute_meta(size_t i, void *arg) {
+    const EntryMetaCtx *ctx = arg;
+    const ComputeOpts *c = ctx->compute;
+    FileEntry *fe = &ctx->list->entries[i];
+    int is_dir = (fe->type == FTYPE_DIR || fe->type == FTYPE_SYMLINK_DIR);
+    int is_file = (fe->type == FTYPE_FILE || fe->type == FTYPE_EXEC ||
+                  fe->type == FTYPE_SYMLINK || fe->type == FTYPE_SYMLINK_EXEC);
+
+    if (is_dir && (c->sizes || c->file_counts)) {
+        DirStats stats = get_dir_stats_cached(fe->path);
+        if (c->sizes) fe->size = stats.size;
+        if (c->file_counts) fe->file_count = stats.file_count;
+    } else if (is_file && (c->line_counts || c->media_info) &&
+               !ctx->content_cached[i]) {
+        fileinfo_compute_content(fe, c->line_counts, c->media_info);
+    }
+}
+
+void tree_compute_entry_meta(FileEntry *fe, const ComputeOpts *c) {
+    if (fe->size < 0) return;  /* Virtual filesystem: nothing to measure */
+    int is_dir = (fe->type == FTYPE_DIR || fe->type == FTYPE_SYMLINK_DIR);
+    int is_file = (fe->type == FTYPE_FILE || fe->type == FTYPE_EXEC ||
+                  fe->type == FTYPE_SYMLINK || fe->type == FTYPE_SYMLINK_EXEC);
+
+    if (is_dir && (c->sizes || c->file_counts)) {
+        DirStats stats = get_dir_stats_cached(fe->path);
+        if (c->sizes) fe->size = stats.size;
+        if (c->file_counts) fe->file_count = stats.file_count;
+    } else if (is_file && (c->line_counts || c->media_info)) {
+        int mode = CONTENT_MODE(c->line_counts, c->media_info);
+        int cacheable = entry_is_content_file(fe);
+        if (cacheable && content_from_cache(fe, mode)) return;
+        fileinfo_compute_content(fe, c->line_counts, c->media_info);
+        if (cacheable) content_to_cache(fe, mode);
+    }
+}
 
-    int is_virtual_fs = path_is_virtual_fs(dir_path);
+/* Read the open directory dir (at dir_path) into list. Entries are looked
+ * up relative to its fd, so each costs one lookup of its own name rather
+ * than of every component of its path. dir_real is the directory's
+ * resolved path when the caller already knows it (NULL to resolve it). */
+static int read_directory_at(DIR *dir, const char *dir_path, const char *dir_real,
+                             FileList *list, const TreeBuildOpts *opts) {
+    int dir_fd = dirfd(dir);
+    int is_virtual_fs = fd_is_virtual_fs(dir_fd);
     const ComputeOpts *c = &opts->compute;
 
+    /* Resolve the directory once: an entry that isn't a symlink resolves
+     * to dir_real/name, so printing needn't walk each path again. This
+     * also covers the flags the printer would otherwise get from access() */
+    char resolved[PATH_MAX];
+    if (!dir_real && realpath(dir_path, resolved)) dir_real = resolved;
+    int have_real = dir_real != NULL;
+    int real_is_path = have_real && strcmp(dir_real, dir_path) == 0;
+
+    struct stat dir_st;
+    struct statvfs dir_vfs;
+    int have_dir_info = fstat(dir_fd, &dir_st) == 0 && fstatvfs(dir_fd, &dir_vfs) == 0;
+    int read_only_fs = have_dir_info && (dir_vfs.f_flag & ST_RDONLY);
+
+    int64_t read_start = PROFILE_BEGIN();
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
         if (PATH_IS_DOT_OR_DOTDOT(entry->d_name)) continue;
@@ -111,7 +321,8 @@ int read_directory(const char *dir_path, FileList *list,
 
         FileEntry fe;
         memset(&fe, 0, sizeof(fe));
-        fe.path = xstrdup(full_path);
+        fe.path = arena_strdup(&list->paths, full_path);
+        fe.path_in_arena = 1;
         fe.name = strrchr(fe.path, '/');
         fe.name = fe.name ? fe.name + 1 : fe.path;
         fe.line_count = -1;
@@ -119,48 +330,80 @@ int read_directory(const char *dir_path, FileList *list,
         fe.file_count = -1;
 
         struct stat st;
-        fe.type = detect_file_type(full_path, &st, &fe.symlink_target);
+        fe.type = detect_file_type_at(dir_fd, entry->d_name, full_path, &st,
+                                      &fe.symlink_target);
         fe.mode = st.st_mode;
         fe.dev = st.st_dev;
+        fe.ino = st.st_ino;
         fe.mtime = GET_MTIME(st);
+        fe.mtime_ns = GET_MTIME_NS(st);
         fe.size = is_virtual_fs ? -1 : st.st_size;
 
+        /* Symlinks (and entries lstat couldn't read) resolve elsewhere */
+        if (fe.type != FTYPE_UNKNOWN && fe.type < FTYPE_SYMLINK) {
+            if (real_is_path) {
+                fe.real_path = fe.path;
+            } else if (have_real) {
+                char real_path[PATH_MAX];
+                path_join(real_path, sizeof(real_path), dir_real, entry->d_name);
+                fe.real_path = arena_strdup(&list->paths, real_path);
+            }
+            /* Mount points carry their own read-only flag */
+            if (have_dir_info && st.st_dev == dir_st.st_dev) {
+                fe.has_access = 1;
+                fe.is_readonly = mode_is_readonly(&st, read_only_fs);
+            }
+        }
+
         file_list_add(list, &fe);
     }
-    closedir(dir);
+    PROFILE_END(PROF_READ, read_start);
+
+    /* Unchanged files are served from the content cache without being
+     * opened; only misses are analyzed below */
+    int content_mode = CONTENT_MODE(c->line_counts, c->media_info);
+    char *content_cached = NULL;
+    if (list->count > 0 && !is_virtual_fs && (c->line_counts || c->media_info)) {
+        content_cached = xmalloc(list->count);
+        for (size_t i = 0; i < list->count; i++) {
+            FileEntry *fe = &list->entries[i];
+            content_cached[i] = entry_is_content_file(fe) &&
+                                content_from_cache(fe, content_mode);
+        }
+    }
 
     /* Compute metadata in parallel if requested */
     int need_parallel = !is_virtual_fs &&
         (c->sizes || c->file_counts || c->line_counts || c->media_info);
     if (list->count > 0 && need_parallel) {
-        #pragma omp parallel for schedule(dynamic)
+        EntryMetaCtx ctx = {list, c, content_cached};
+        tree_parallel_for(list->count, entry_compute_meta, &ctx);
+    }
+
+    if (content_cached) {
         for (size_t i = 0; i < list->count; i++) {
-            FileEntry *fe = &list->entries[i];
-            int is_dir = (fe->type == FTYPE_DIR || fe->type == FTYPE_SYMLINK_DIR);
-            int is_file = (fe->type == FTYPE_FILE || fe->type == FTYPE_EXEC ||
-                          fe->type == FTYPE_SYMLINK || fe->type == FTYPE_SYMLINK_EXEC);
-
-            if (is_dir && (c->sizes || c->file_counts)) {
-                DirStats stats = get_dir_stats_cached(fe->path);
-                if (c->sizes) fe->size = stats.size;
-                if (c->file_counts) fe->file_count = stats.file_count;
-            } else if (is_file && (c->line_counts || c->media_info)) {
-                fileinfo_compute_content(fe, c->line_counts, c->media_info);
-            }
+            if (!content_cached[i] && entry_is_content_file(&list->entries[i]))
+                content_to_cache(&list->entries[i], content_mode);
         }
+        content_cache_flush();
+        free(content_cached);
     }
 
-    /* Sort */
-    qsort(list->entries, list->count, sizeof(FileEntry), entry_cmp_name);
-    if (opts->sort_by != SORT_NONE && opts->sort_by != SORT_NAME) {
-        sort_file_list(list, opts->sort_by, opts->sort_reverse);
-    } else if (opts->sort_reverse) {
-        reverse_file_list(list);
-    }
+    /* Sort: by name, then by size or time when asked */
+    sort_file_list(list, opts->sort_by, opts->sort_reverse);
 
     return 0;
 }
 
+int read_directory(const char *dir_path, FileList *list,
+                   const TreeBuildOpts *opts) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) return -1;
+    int rc = read_directory_at(dir, dir_path, NULL, list, opts);
+    closedir(dir);
+    return rc;
+}
+
 /* ============================================================================
  * Tree Node Management
  * ============================================================================ */
@@ -171,6 +414,7 @@ void tree_node_free(TreeNode *node) {
         tree_node_free(&node->children[i]);
     }
     free(node->children);
+    arena_free(&node->child_paths);
     file_entry_free(&node->entry);
 }
 
@@ -182,13 +426,22 @@ int node_is_directory(const TreeNode *node) {
  * Tree Building
  * ============================================================================ */
 
+/* Child directories are probed relative to the listing's open fd (dir is
+ * the child's name) so a probe resolves two components, not a full path;
+ * AT_FDCWD with a full path works for the root. */
+
 /* Check if directory has a .gitignore containing a line with just "*" */
-static int has_ignore_all_gitignore(const char *dir_path) {
+static int has_ignore_all_gitignore(int dir_fd, const char *dir) {
     char gitignore_path[PATH_MAX];
-    snprintf(gitignore_path, sizeof(gitignore_path), "%s/.gitignore", dir_path);
-
-    FILE *fp = fopen(gitignore_path, "r");
-    if (!fp) return 0;
+    path_join(gitignore_path, sizeof(gitignore_path), dir, ".gitignore");
+
+    int fd = openat(dir_fd, gitignore_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    FILE *fp = fdopen(fd, "r");
+    if (!fp) {
+        close(fd);
+        return 0;
+    }
 
     char line[256];
     int found = 0;
@@ -208,6 +461,14 @@ static int has_ignore_all_gitignore(const char *dir_path) {
     return found;
 }
 
+/* Check if directory holds .git (a directory, or a file for worktrees) */
+static int dir_has_git(int dir_fd, const char *dir) {
+    char git_path[PATH_MAX];
+    path_join(git_path, sizeof(git_path), dir, ".git");
+    struct stat st;
+    return fstatat(dir_fd, git_path, &st, 0) == 0;
+}
+
 static int should_skip_dir(const char *name, int is_ignored, int skip_gitignored) {
     if (is_ignored && skip_gitignored) return 1;
     if (strcmp(name, ".git") == 0) return 1;
@@ -215,36 +476,59 @@ static int should_skip_dir(const char *name, int is_ignored, int skip_gitignored
 }
 
 static void apply_git_status(FileEntry *fe, GitCache *git, int compute_diff) {
-    GitStatusNode *git_node = git_cache_get_node(git, fe->path);
-    if (git_node) {
-        strncpy(fe->git_status, git_node->status, sizeof(fe->git_status) - 1);
+    char status[3];
+    int added, removed;
+    if (git_cache_copy(git, fe->path, status, &added, &removed)) {
+        strncpy(fe->git_status, status, sizeof(fe->git_status) - 1);
         fe->git_status[sizeof(fe->git_status) - 1] = '\0';
         if (compute_diff) {
-            fe->diff_added = git_node->lines_added;
-            fe->diff_removed = git_node->lines_removed;
+            fe->diff_added = added;
+            fe->diff_removed = removed;
         }
     }
 }
 
-/* Find git repo roots in a file list and mark them.
- * Returns array of repo paths to populate (caller must free).
+typedef struct {
+    FileList *list;
+    const int *is_git_repo_root;
+} RepoInfoCtx;
+
+static void repo_load_info(size_t i, void *arg) {
+    const RepoInfoCtx *ctx = arg;
+    if (!ctx->is_git_repo_root[i]) return;
+    FileEntry *fe = &ctx->list->entries[i];
+    entry_load_repo_refs(fe, fe->path);
+}
+
+typedef struct {
+    GitCache *git;
+    char **repos;
+    int compute_diff;
+} RepoPopulateCtx;
+
+static void repo_populate(size_t i, void *arg) {
+    const RepoPopulateCtx *ctx = arg;
+    git_populate_repo(ctx->git, ctx->repos[i], ctx->compute_diff);
+}
+
+/* Find git repo roots in a file list read from the open directory dir_fd
+ * and mark them. Returns array of repo paths to populate (caller must free).
  * Sets is_git_repo_root[i] and is_submodule[i] for each entry. */
-static char **find_git_repo_roots(FileList *list, int in_git_repo,
+static char **find_git_repo_roots(FileList *list, int dir_fd, int in_git_repo,
                                    int *is_git_repo_root, int *is_submodule,
                                    size_t *out_count) {
     char **git_repos = NULL;
-    size_t count = 0;
+    size_t count = 0, roots = 0;
 
     for (size_t i = 0; i < list->count; i++) {
         is_git_repo_root[i] = 0;
         is_submodule[i] = 0;
         FileEntry *fe = &list->entries[i];
         if ((fe->type == FTYPE_DIR || fe->type == FTYPE_SYMLINK_DIR) &&
-            strcmp(fe->name, ".git") != 0 && path_is_git_root(fe->path)) {
+            strcmp(fe->name, ".git") != 0 && dir_has_git(dir_fd, fe->name)) {
             is_git_repo_root[i] = 1;
             fe->is_git_root = 1;
-            fe->remote = git_get_remote_url(fe->path);
-            fe->tag = git_get_latest_tag(fe->path);
+            roots++;
             if (in_git_repo) {
                 is_submodule[i] = 1;
             } else {
@@ -254,6 +538,13 @@ static char **find_git_repo_roots(FileList *list, int in_git_repo,
         }
     }
 
+    /* Remote and tag per repo. Reads are in-process and tags are cached
+     * per HEAD, but a miss can still walk history, so spread repos out. */
+    if (roots > 0) {
+        RepoInfoCtx ctx = {list, is_git_repo_root};
+        tree_parallel_for(list->count, repo_load_info, &ctx);
+    }
+
     *out_count = count;
     return git_repos;
 }
@@ -268,45 +559,56 @@ static int all_children_ignored(TreeNode *children, size_t child_count) {
     return 1;
 }
 
-static void build_tree_children(TreeNode *parent, int depth,
-                                 const TreeBuildOpts *opts, GitCache *git,
-                                 int in_git_repo, int parent_is_ignored) {
-    if (depth >= opts->max_depth) return;
-    if (access(parent->entry.path, R_OK) != 0) return;
-
+/* Read one directory level into parent->children, with git status and
+ * ignore flags set, without recursing. Returns the per-child repo root
+ * flags (caller frees), or NULL if there is nothing to descend into. */
+static int *tree_read_children(TreeNode *parent, int depth,
+                               const TreeBuildOpts *opts, GitCache *git,
+                               int in_git_repo, int parent_is_ignored) {
+    if (depth >= opts->max_depth) return NULL;
+
+    /* Unreadable directories stay collapsed */
+    DIR *dir = opendir(parent->entry.path);
+    if (!dir) {
+        if (errno != EACCES) parent->was_expanded = 1;
+        return NULL;
+    }
     parent->was_expanded = 1;
 
     FileList list;
     file_list_init(&list);
-    if (read_directory(parent->entry.path, &list, opts) != 0) {
-        file_list_free(&list);
-        return;
-    }
+    read_directory_at(dir, parent->entry.path, parent->entry.real_path, &list, opts);
     if (list.count == 0) {
+        closedir(dir);
         file_list_free(&list);
-        return;
+        return NULL;
     }
+    int dir_fd = dirfd(dir);
 
     /* Find git repo roots */
     int *is_git_repo_root = xmalloc(list.count * sizeof(int));
     int *is_submodule = xmalloc(list.count * sizeof(int));
     size_t git_repo_count = 0;
-    char **git_repos = opts->compute.git_status
-        ? find_git_repo_roots(&list, in_git_repo, is_git_repo_root, is_submodule, &git_repo_count)
-        : NULL;
+    char **git_repos = NULL;
+    if (opts->compute.git_status) {
+        git_repos = find_git_repo_roots(&list, dir_fd, in_git_repo, is_git_repo_root,
+                                        is_submodule, &git_repo_count);
+    } else {
+        memset(is_git_repo_root, 0, list.count * sizeof(int));
+        memset(is_submodule, 0, list.count * sizeof(int));
+    }
 
     /* Populate git repos */
     if (git_repos) {
-        #pragma omp parallel for schedule(dynamic)
-        for (size_t i = 0; i < git_repo_count; i++) {
-            git_populate_repo(git, git_repos[i], opts->compute.git_diff);
-        }
+        RepoPopulateCtx ctx = {git, git_repos, opts->compute.git_diff};
+        tree_parallel_for(git_repo_count, repo_populate, &ctx);
         free(git_repos);
     }
 
     /* Allocate children */
     parent->children = xmalloc(list.count * sizeof(TreeNode));
     parent->child_count = list.count;
+    parent->child_paths = list.paths;  /* Children keep their arena paths */
 
     for (size_t i = 0; i < list.count; i++) {
         TreeNode *child = &parent->children[i];
@@ -314,11 +616,6 @@ static void build_tree_children(TreeNode *parent, int depth,
         child->entry = list.entries[i];
         /* Mark mount boundaries (different filesystem than parent) */
         child->entry.is_mount_point = (child->entry.dev != parent->entry.dev);
-    }
-
-    /* Set git status and recurse */
-    for (size_t i = 0; i < list.count; i++) {
-        TreeNode *child = &parent->children[i];
 
         if (opts->compute.git_status) {
             apply_git_status(&child->entry, git, opts->compute.git_diff);
@@ -332,35 +629,68 @@ static void build_tree_children(TreeNode *parent, int depth,
 
         /* Check if directory has .gitignore with "*" (ignores all contents) */
         if (!child->entry.is_ignored && node_is_directory(child)) {
-            child->entry.is_ignored = has_ignore_all_gitignore(child->entry.path);
+            child->entry.is_ignored = has_ignore_all_gitignore(dir_fd, child->entry.name);
         }
+    }
+
+    closedir(dir);
+    free(is_submodule);
+    free(list.entries);
+    return is_git_repo_root;
+}
 
-        if (node_is_directory(child) && !should_skip_dir(child->entry.name, child->entry.is_ignored, opts->skip_gitignored) &&
-            !(opts->skip_fn && opts->skip_fn(&child->entry, opts->skip_ctx))) {
-            int child_in_git_repo = in_git_repo || is_git_repo_root[i];
-            build_tree_children(child, depth + 1, opts, git, child_in_git_repo, child->entry.is_ignored);
+static int tree_should_descend(const TreeNode *child, const TreeBuildOpts *opts) {
+    return node_is_directory(child) &&
+           !should_skip_dir(child->entry.name, child->entry.is_ignored, opts->skip_gitignored) &&
+           !(opts->skip_fn && opts->skip_fn(&child->entry, opts->skip_ctx));
+}
 
-            /* Mark directory as ignored if all children are ignored */
-            if (!child->entry.is_ignored && child->child_count > 0 &&
-                all_children_ignored(child->children, child->child_count)) {
-                child->entry.is_ignored = 1;
-            }
+/* Settle a directory's flags once its children are loaded */
+static void tree_finish_dir(TreeNode *child, const TreeBuildOpts *opts, GitCache *git) {
+    /* Mark directory as ignored if all children are ignored */
+    if (!child->entry.is_ignored && child->child_count > 0 &&
+        all_children_ignored(child->children, child->child_count)) {
+        child->entry.is_ignored = 1;
+    }
 
-            if (opts->compute.git_diff) {
-                child->entry.diff_removed = git_deleted_lines_direct(git, child->entry.path);
-            }
+    if (opts->compute.git_diff) {
+        child->entry.diff_removed = git_deleted_lines_direct(git, child->entry.path);
+    }
+}
+
+/* Each subdirectory is built by its own task, straight into the slot the
+ * parent's sorted listing gave it, so the result doesn't depend on which
+ * finishes first. Directories at the depth limit have nothing to read and
+ * run inline. */
+static void build_tree_children(TreeNode *parent, int depth,
+                                 const TreeBuildOpts *opts, GitCache *git,
+                                 int in_git_repo, int parent_is_ignored) {
+    int *is_git_repo_root = tree_read_children(parent, depth, opts, git,
+                                               in_git_repo, parent_is_ignored);
+    if (!is_git_repo_root) return;
+
+    for (size_t i = 0; i < parent->child_count; i++) {
+        TreeNode *child = &parent->children[i];
+        if (!tree_should_descend(child, opts)) continue;
+
+        int child_in_git_repo = in_git_repo || is_git_repo_root[i];
+        #pragma omp task firstprivate(child, child_in_git_repo) if(depth + 1 < opts->max_depth)
+        {
+            build_tree_children(child, depth + 1, opts, git, child_in_git_repo,
+                                child->entry.is_ignored);
+            tree_finish_dir(child, opts, git);
         }
     }
+    #pragma omp taskwait
 
     free(is_git_repo_root);
-    free(is_submodule);
-    free(list.entries);
 }
 
-TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
-                     GitCache *git, const Icons *icons) {
-    (void)icons;  /* Reserved for future use */
-
+/* Create the root node for path, with its own metadata and git status.
+ * Sets *in_git_repo and fills git_root if path is inside a repository. */
+static TreeNode *tree_make_root(const char *path, const TreeBuildOpts *opts,
+                                GitCache *git, int *in_git_repo,
+                                char *git_root, size_t git_root_len) {
     char abs_path[PATH_MAX];
     if (opts->cwd) {
         path_get_abspath(path, abs_path, opts->cwd);
@@ -369,9 +699,8 @@ TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
         abs_path[sizeof(abs_path) - 1] = '\0';
     }
 
-    char git_root[PATH_MAX];
-    int in_git_repo = git_find_root(abs_path, git_root, sizeof(git_root));
-    if (in_git_repo && opts->compute.git_status) {
+    *in_git_repo = git_find_root(abs_path, git_root, git_root_len);
+    if (*in_git_repo && opts->compute.git_status) {
         git_populate_repo(git, git_root, opts->compute.git_diff);
     }
 
@@ -389,7 +718,9 @@ TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
     root->entry.symlink_target = symlink_target;
     root->entry.mode = st.st_mode;
     root->entry.dev = st.st_dev;
+    root->entry.ino = st.st_ino;
     root->entry.mtime = GET_MTIME(st);
+    root->entry.mtime_ns = GET_MTIME_NS(st);
     root->entry.line_count = -1;
     root->entry.word_count = -1;
     root->entry.file_count = -1;
@@ -402,7 +733,15 @@ TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
     root->entry.size = is_virtual_fs ? -1 : st.st_size;
 
     if (!is_virtual_fs && is_file && (opts->compute.line_counts || opts->compute.media_info)) {
-        fileinfo_compute_content(&root->entry, opts->compute.line_counts, opts->compute.media_info);
+        int mode = CONTENT_MODE(opts->compute.line_counts, opts->compute.media_info);
+        int cacheable = entry_is_content_file(&root->entry);
+        if (!cacheable || !content_from_cache(&root->entry, mode)) {
+            fileinfo_compute_content(&root->entry, opts->compute.line_counts, opts->compute.media_info);
+            if (cacheable) {
+                content_to_cache(&root->entry, mode);
+                content_cache_flush();
+            }
+        }
     }
 
     if (!is_virtual_fs && is_dir &&
@@ -418,20 +757,33 @@ TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
 
     root->entry.is_ignored = (root->entry.git_status[0] && strcmp(root->entry.git_status, "!!") == 0) ||
                               strcmp(root->entry.name, ".git") == 0 ||
-                              (in_git_repo && git_path_in_ignored(git, abs_path, git_root));
+                              (*in_git_repo && git_path_in_ignored(git, abs_path, git_root));
 
     /* Check if directory has .gitignore with "*" (ignores all contents) */
     if (!root->entry.is_ignored && is_dir) {
-        root->entry.is_ignored = has_ignore_all_gitignore(abs_path);
+        root->entry.is_ignored = has_ignore_all_gitignore(AT_FDCWD, abs_path);
     }
 
-    if (is_dir && in_git_repo && strcmp(abs_path, git_root) == 0) {
+    if (is_dir && *in_git_repo && strcmp(abs_path, git_root) == 0) {
         root->entry.is_git_root = 1;
-        root->entry.remote = git_get_remote_url(abs_path);
-        root->entry.tag = git_get_latest_tag(abs_path);
+        entry_load_repo_refs(&root->entry, abs_path);
     }
 
-    if (is_dir) {
+    return root;
+}
+
+TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
+                     GitCache *git, const Icons *icons) {
+    (void)icons;  /* Reserved for future use */
+
+    char git_root[PATH_MAX];
+    int in_git_repo;
+    TreeNode *root = tree_make_root(path, opts, git, &in_git_repo,
+                                    git_root, sizeof(git_root));
+
+    if (node_is_directory(root)) {
+        #pragma omp parallel
+        #pragma omp single
         build_tree_children(root, 0, opts, git, in_git_repo, root->entry.is_ignored);
 
         /* Mark root as ignored if all children are ignored */
@@ -450,19 +802,20 @@ void tree_expand_node(TreeNode *node, const TreeBuildOpts *opts,
 
     if (node->child_count > 0) return;
     if (!node_is_directory(node)) return;
-    if (access(node->entry.path, R_OK) != 0) return;
+
+    DIR *dir = opendir(node->entry.path);
+    if (!dir) return;
 
     FileList list;
     file_list_init(&list);
-    if (read_directory(node->entry.path, &list, opts) != 0) {
-        file_list_free(&list);
-        return;
-    }
+    read_directory_at(dir, node->entry.path, node->entry.real_path, &list, opts);
     if (list.count == 0) {
+        closedir(dir);
         file_list_free(&list);
         node->was_expanded = 1;  /* Mark as expanded even if empty */
         return;
     }
+    int dir_fd = dirfd(dir);
 
     char git_root[PATH_MAX];
     int in_git_repo = git_find_root(node->entry.path, git_root, sizeof(git_root));
@@ -474,7 +827,8 @@ void tree_expand_node(TreeNode *node, const TreeBuildOpts *opts,
     int *is_submodule = xmalloc(list.count * sizeof(int));
     size_t git_repo_count = 0;
     char **git_repos = opts->compute.git_status
-        ? find_git_repo_roots(&list, in_git_repo, is_git_repo_root, is_submodule, &git_repo_count)
+        ? find_git_repo_roots(&list, dir_fd, in_git_repo, is_git_repo_root, is_submodule,
+                              &git_repo_count)
         : NULL;
 
     /* Populate git repos (no parallelism for single-node expansion) */
@@ -487,6 +841,7 @@ void tree_expand_node(TreeNode *node, const TreeBuildOpts *opts,
 
     node->children = xmalloc(list.count * sizeof(TreeNode));
     node->child_count = list.count;
+    node->child_paths = list.paths;  /* Children keep their arena paths */
 
     for (size_t i = 0; i < list.count; i++) {
         TreeNode *child = &node->children[i];
@@ -511,12 +866,170 @@ void tree_expand_node(TreeNode *node, const TreeBuildOpts *opts,
         }
     }
 
+    closedir(dir);
     free(is_git_repo_root);
     free(is_submodule);
     free(list.entries);
     node->was_expanded = 1;
 }
 
+/* ============================================================================
+ * Streaming Tree Walk
+ * ============================================================================ */
+
+/* Visit parent's (already loaded) children in order. Each directory child
+ * has its own children read before it is visited, so has-children and
+ * ignore flags are known when it's printed; its subtree is released as
+ * soon as it has been walked. */
+static void stream_tree_children(TreeNode *parent, const int *is_git_repo_root,
+                                 int depth, const TreeBuildOpts *opts,
+                                 GitCache *git, int in_git_repo,
+                                 tree_visit_fn visit, void *ctx) {
+    for (size_t i = 0; i < parent->child_count; i++) {
+        TreeNode *child = &parent->children[i];
+        int child_in_git_repo = in_git_repo || is_git_repo_root[i];
+        int *grandchild_roots = NULL;
+
+        if (tree_should_descend(child, opts)) {
+            grandchild_roots = tree_read_children(child, depth + 1, opts, git,
+                                                  child_in_git_repo, child->entry.is_ignored);
+            tree_finish_dir(child, opts, git);
+        }
+
+        visit(child, depth + 1, i == parent->child_count - 1, ctx);
+
+        if (grandchild_roots) {
+            stream_tree_children(child, grandchild_roots, depth + 1, opts, git,
+                                 child_in_git_repo, visit, ctx);
+            free(grandchild_roots);
+        }
+        tree_node_free(child);
+        memset(child, 0, sizeof(TreeNode));
+    }
+}
+
+void build_tree_streaming(const char *path, const TreeBuildOpts *opts,
+                          GitCache *git, tree_visit_fn visit, void *ctx) {
+    char git_root[PATH_MAX];
+    int in_git_repo;
+    TreeNode *root = tree_make_root(path, opts, git, &in_git_repo,
+                                    git_root, sizeof(git_root));
+
+    int *is_git_repo_root = NULL;
+    if (node_is_directory(root)) {
+        is_git_repo_root = tree_read_children(root, 0, opts, git, in_git_repo,
+                                              root->entry.is_ignored);
+        if (!root->entry.is_ignored && root->child_count > 0 &&
+            all_children_ignored(root->children, root->child_count)) {
+            root->entry.is_ignored = 1;
+        }
+    }
+
+    visit(root, 0, 1, ctx);
+
+    if (is_git_repo_root) {
+        stream_tree_children(root, is_git_repo_root, 0, opts, git, in_git_repo, visit, ctx);
+        free(is_git_repo_root);
+    }
+    tree_node_free(root);
+    free(root);
+}
+
+/* ============================================================================
+ * Type Statistics Walk
+ * ============================================================================ */
+
+typedef struct {
+    const TreeBuildOpts *opts;
+    GitCache *git;
+    const FileTypes *ft;
+    const Shebangs *sb;
+    TypeTally *tallies;          /* One per thread, merged at the end */
+} TypeWalk;
+
+static int entry_counts_as_file(const FileEntry *fe) {
+    return fe->type == FTYPE_FILE || fe->type == FTYPE_EXEC ||
+           fe->type == FTYPE_SYMLINK || fe->type == FTYPE_SYMLINK_EXEC;
+}
+
+/* Tally node's children and recurse into its directories, one task per
+ * directory. Ignored entries are skipped with their whole subtree. A
+ * listing this walk had to read is freed once its subtree is counted. */
+static void type_walk_children(TreeNode *node, int depth, int in_git_repo,
+                               const TypeWalk *w) {
+    int *is_git_repo_root = NULL;
+    int was_expanded = node->was_expanded;
+    if (node->child_count == 0) {
+        is_git_repo_root = tree_read_children(node, depth, w->opts, w->git,
+                                              in_git_repo, node->entry.is_ignored);
+        if (!is_git_repo_root) return;
+    }
+
+    /* Tasks are tied, so this thread's tally is only ever used by it */
+    TypeTally *tally = &w->tallies[omp_get_thread_num()];
+
+    for (size_t i = 0; i < node->child_count; i++) {
+        TreeNode *child = &node->children[i];
+        const FileEntry *fe = &child->entry;
+        if (fe->is_ignored) continue;
+
+        if (entry_counts_as_file(fe)) {
+            type_tally_add(tally, get_file_type_name(fe->path, w->ft, w->sb),
+                           fe->line_count, fe->content_type);
+        } else if (tree_should_descend(child, w->opts)) {
+            int child_in_git_repo = in_git_repo || fe->is_git_root;
+            #pragma omp task firstprivate(child, child_in_git_repo) if(depth + 1 < w->opts->max_depth)
+            type_walk_children(child, depth + 1, child_in_git_repo, w);
+        }
+    }
+    #pragma omp taskwait
+
+    if (is_git_repo_root) {
+        for (size_t i = 0; i < node->child_count; i++) {
+            tree_node_free(&node->children[i]);
+        }
+        free(node->children);
+        arena_free(&node->child_paths);
+        node->children = NULL;
+        node->child_count = 0;
+        node->was_expanded = was_expanded;
+        free(is_git_repo_root);
+    }
+}
+
+void tree_compute_type_stats(TreeNode *node, const TreeBuildOpts *opts, GitCache *git,
+                             const FileTypes *ft, const Shebangs *sb) {
+    FileEntry *fe = &node->entry;
+    free(fe->type_stats);
+    fe->type_stats = NULL;
+    if (!node_is_directory(node) || fe->is_ignored) return;
+
+    /* Per-directory totals aren't needed, only each file's own data */
+    TreeBuildOpts walk_opts = *opts;
+    walk_opts.compute.sizes = 0;
+    walk_opts.compute.file_counts = 0;
+    walk_opts.compute.git_diff = 0;
+
+    int threads = omp_get_max_threads();
+    TypeTally *tallies = xmalloc((size_t)threads * sizeof(TypeTally));
+    for (int i = 0; i < threads; i++) type_tally_init(&tallies[i]);
+
+    char git_root[PATH_MAX];
+    int in_git_repo = git_find_root(fe->path, git_root, sizeof(git_root));
+
+    TypeWalk w = {&walk_opts, git, ft, sb, tallies};
+    #pragma omp parallel
+    #pragma omp single
+    type_walk_children(node, 0, in_git_repo, &w);
+
+    for (int i = 1; i < threads; i++) type_tally_merge(&tallies[0], &tallies[i]);
+    if (tallies[0].stats.total_files > 0) {
+        fe->type_stats = xmalloc(sizeof(TypeStats));
+        *fe->type_stats = tallies[0].stats;
+    }
+    free(tallies);
+}
+
 /* ============================================================================
  * Ancestry Tree Building
  * ============================================================================ */
@@ -560,8 +1073,7 @@ static TreeNode *build_ancestor_node(const char *path, const TreeBuildOpts *opts
 
     if ((type == FTYPE_DIR || type == FTYPE_SYMLINK_DIR) && path_is_git_root(path)) {
         node->entry.is_git_root = 1;
-        node->entry.remote = git_get_remote_url(path);
-        node->entry.tag = git_get_latest_tag(path);
+        entry_load_repo_refs(&node->entry, path);
     }
 
     return node;
@@ -33,32 +33,53 @@ typedef struct {
 
 /* ============================================================================
  * File Entry - Represents a single filesystem entry
+ *
+ * Entries are copied and sorted by the million in big trees, so data that
+ * only a few of them carry lives in side records behind a pointer.
  * ============================================================================ */
 
+/* Git repository details (git roots only) */
+typedef struct {
+    char *branch;                /* Current branch name */
+    char *tag;                   /* Latest tag, if any */
+    int tag_distance;            /* Commits since tag (0 if at tag) */
+    char *remote;                /* Remote URL */
+    char short_hash[8];          /* Abbreviated commit hash */
+    char commit_count[32];       /* Number of commits */
+    int has_upstream;            /* 1 if origin/<branch> exists */
+    int out_of_sync;             /* 1 if local and remote differ */
+    int ahead;                   /* Commits ahead of upstream */
+    int behind;                  /* Commits behind upstream */
+    GitSummary repo_status;      /* Repo-wide dirty status */
+} RepoInfo;
+
 typedef struct FileEntry {
     /* --- Identity --- */
     char *path;                  /* Display path (may be relative) */
     char *name;                  /* Filename component */
     char *symlink_target;        /* Target if symlink, NULL otherwise */
+    const char *real_path;       /* Resolved path (path itself or in the same
+                                    arena), NULL if not resolved during the build */
     FileType type;               /* Detected file type (C, Python, etc.) */
+    int path_in_arena;           /* 1 if path is owned by a list/node Arena */
 
     /* --- Basic metadata --- */
     mode_t mode;
     dev_t dev;                   /* Device ID (for mount boundary detection) */
+    ino_t ino;                   /* Inode (content cache key) */
     off_t size;                  /* File size or directory total */
     time_t mtime;                /* Last modification time */
+    int64_t mtime_ns;            /* Same, in nanoseconds (content cache key) */
     long file_count;             /* Number of files (directories only) */
     int is_mount_point;          /* 1 if on different filesystem than parent */
+    int has_access;              /* 1 if is_readonly was derived from the mode */
+    int is_readonly;             /* Readable but not writable by this process */
 
     /* --- Content analysis --- */
     ContentType content_type;    /* text/binary/image/etc. */
     int line_count;              /* -1 if not computed */
     int word_count;              /* -1 if not computed */
 
-    /* --- Type statistics (directories only, requires type_stats) --- */
-    TypeStats type_stats;        /* Line breakdown by file type */
-    int has_type_stats;          /* 1 if type_stats is valid */
-
     /* --- Git file status --- */
     int is_ignored;              /* In .gitignore */
     int is_git_root;             /* Is a git repository root */
@@ -69,20 +90,13 @@ typedef struct FileEntry {
     /* --- Git directory status (aggregated from children) --- */
     GitSummary git_dir_status;   /* Aggregated status for directory contents */
     int has_git_dir_status;      /* 1 if git_dir_status is valid */
+    int has_git_repo_info;       /* 1 if every repo field is valid */
 
-    /* --- Git repository info (git roots only, requires git_repo_info) --- */
-    char *branch;                /* Current branch name */
-    char *tag;                   /* Latest tag, if any */
-    int tag_distance;            /* Commits since tag (0 if at tag) */
-    char *remote;                /* Remote URL */
-    char short_hash[8];          /* Abbreviated commit hash */
-    char commit_count[32];       /* Number of commits */
-    int has_upstream;            /* 1 if origin/<branch> exists */
-    int out_of_sync;             /* 1 if local and remote differ */
-    int ahead;                   /* Commits ahead of upstream */
-    int behind;                  /* Commits behind upstream */
-    GitSummary repo_status;      /* Repo-wide dirty status */
-    int has_git_repo_info;       /* 1 if repo info fields are valid */
+    /* --- Side records (owned, NULL when absent) --- */
+    TypeStats *type_stats;       /* Line breakdown by file type (directories,
+                                    requires type_stats) */
+    RepoInfo *repo;              /* Repository details (git roots; remote and
+                                    tag from the build, the rest on demand) */
 } FileEntry;
 
 /* ============================================================================
@@ -93,11 +107,15 @@ typedef struct {
     FileEntry *entries;
     size_t count;
     size_t capacity;
+    Arena paths;                 /* Entry paths (handed to the parent node) */
 } FileList;
 
 void file_list_init(FileList *list);
 void file_list_add(FileList *list, FileEntry *entry);
 void file_entry_free(FileEntry *entry);
+
+/* The entry's repo record, allocated empty on first use */
+RepoInfo *file_entry_repo(FileEntry *entry);
 void file_list_free(FileList *list);
 
 /* ============================================================================
@@ -108,11 +126,19 @@ typedef struct TreeNode {
     FileEntry entry;
     struct TreeNode *children;
     size_t child_count;
+    Arena child_paths;           /* Owns the children's entry paths */
     int has_git_status;
     int matches_grep;
     int was_expanded;
+    int meta_state;              /* Deferred metadata (interactive): MetaState */
 } TreeNode;
 
+typedef enum {
+    META_PENDING,                /* Not computed yet (zero, as built) */
+    META_RUNNING,                /* Claimed by a worker */
+    META_DONE
+} MetaState;
+
 void tree_node_free(TreeNode *node);
 
 /* ============================================================================
@@ -150,6 +176,12 @@ typedef struct {
 int read_directory(const char *dir_path, FileList *list,
                    const TreeBuildOpts *opts);
 
+/* Fill in the parts of fe that c asks for and the build left out: size
+ * and file count for a directory, line count or media info for a file
+ * (through the content cache). Thread-safe as long as fe is private to
+ * the caller; queued cache entries are written by content_cache_flush. */
+void tree_compute_entry_meta(FileEntry *fe, const ComputeOpts *c);
+
 /* Build a complete tree from a path */
 TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
                      GitCache *git, const Icons *icons);
@@ -158,6 +190,25 @@ TreeNode *build_tree(const char *path, const TreeBuildOpts *opts,
 TreeNode *build_ancestry_tree(const char *path, const TreeBuildOpts *opts,
                               GitCache *git, const Icons *icons);
 
+/* Called for each node of a streaming build, in display order. The node's
+ * direct children are loaded; is_last is set for the last child of its
+ * parent (and for the root). */
+typedef void (*tree_visit_fn)(const TreeNode *node, int depth, int is_last, void *ctx);
+
+/* Build a tree depth-first, handing each node to visit as soon as its
+ * directory has been read and freeing each subtree once walked, so memory
+ * grows with depth rather than tree size. The "all children ignored" check
+ * for a directory only looks one level down. */
+void build_tree_streaming(const char *path, const TreeBuildOpts *opts,
+                          GitCache *git, tree_visit_fn visit, void *ctx);
+
+/* Count the non-ignored files under node by type into fe->type_stats
+ * (left NULL if none were found), down to opts->max_depth. Listings already in
+ * the tree are used as they are; deeper directories are read in parallel
+ * and released once counted, so the tree passed in can be shallow. */
+void tree_compute_type_stats(TreeNode *node, const TreeBuildOpts *opts, GitCache *git,
+                             const FileTypes *ft, const Shebangs *sb);
+
 /* Expand a single node's children (lazy loading) */
 void tree_expand_node(TreeNode *node, const TreeBuildOpts *opts,
                       GitCache *git, const Icons *icons);
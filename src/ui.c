@@ -4,6 +4,7 @@
 
 #include "ui.h"
 #include "cache.h"
+#include "profile.h"
 #include <dirent.h>
 #include <ctype.h>
 #include <fnmatch.h>
@@ -12,6 +13,8 @@
 #include <sys/mman.h>
 #include <stdarg.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <errno.h>
 
 /* ============================================================================
  * Path Wrappers (using Config)
@@ -230,6 +233,13 @@ void columns_init(Column *cols) {
     cols[COL_TIME].format = col_format_time;
 }
 
+int column_is_deferred(int col, const Config *cfg) {
+    const ComputeOpts *d = &cfg->deferred;
+    if (col == COL_SIZE) return d->sizes;
+    if (col == COL_LINES) return d->file_counts || d->line_counts || d->media_info;
+    return 0;
+}
+
 void columns_update_widths(Column *cols, const FileEntry *fe, const Icons *icons) {
     char buf[32];
     for (int i = 0; i < NUM_COLUMNS; i++) {
@@ -445,6 +455,94 @@ const char *get_git_indicator(GitCache *cache, const char *path,
 }
 
 
+/* ============================================================================
+ * Output Buffer
+ * ============================================================================ */
+
+/* Tree output is formatted straight into large chunks and written with one
+ * writev once they fill, instead of a stdio write per line */
+#define OUT_CHUNK_SIZE  (64 * 1024)
+#define OUT_MAX_CHUNKS  16
+
+typedef struct {
+    char *chunks[OUT_MAX_CHUNKS];
+    size_t lens[OUT_MAX_CHUNKS];
+    int count;                   /* Chunks in use; the last is being filled */
+} OutBuf;
+
+static OutBuf g_out;
+
+void output_flush(void) {
+    int64_t start = PROFILE_BEGIN();
+    fflush(stdout);  /* Keep order with anything printed through stdio */
+
+    struct iovec iov[OUT_MAX_CHUNKS];
+    int n = 0;
+    for (int i = 0; i < g_out.count; i++) {
+        if (g_out.lens[i] == 0) continue;
+        iov[n].iov_base = g_out.chunks[i];
+        iov[n].iov_len = g_out.lens[i];
+        n++;
+    }
+
+    struct iovec *v = iov;
+    while (n > 0) {
+        ssize_t written = writev(STDOUT_FILENO, v, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;  /* Reader went away; drop the rest */
+        }
+        while (n > 0 && (size_t)written >= v->iov_len) {
+            written -= (ssize_t)v->iov_len;
+            v++;
+            n--;
+        }
+        if (n > 0) {
+            v->iov_base = (char *)v->iov_base + written;
+            v->iov_len -= (size_t)written;
+        }
+    }
+
+    for (int i = 0; i < g_out.count; i++) g_out.lens[i] = 0;
+    g_out.count = 0;
+    PROFILE_END(PROF_WRITE, start);
+}
+
+/* Room for one formatted line and its newline */
+static char *out_line_begin(void) {
+    if (g_out.count > 0 &&
+        OUT_CHUNK_SIZE - g_out.lens[g_out.count - 1] > ENTRY_BUF_SIZE) {
+        return g_out.chunks[g_out.count - 1] + g_out.lens[g_out.count - 1];
+    }
+    if (g_out.count == OUT_MAX_CHUNKS) output_flush();
+    if (!g_out.chunks[g_out.count]) g_out.chunks[g_out.count] = xmalloc(OUT_CHUNK_SIZE);
+    g_out.lens[g_out.count] = 0;
+    return g_out.chunks[g_out.count++];
+}
+
+static void out_line_end(int len) {
+    char *line = g_out.chunks[g_out.count - 1] + g_out.lens[g_out.count - 1];
+    line[len] = '\n';
+    g_out.lens[g_out.count - 1] += (size_t)len + 1;
+}
+
+void output_write(const char *data, size_t len) {
+    while (len > 0) {
+        if (g_out.count == 0 || g_out.lens[g_out.count - 1] == OUT_CHUNK_SIZE) {
+            if (g_out.count == OUT_MAX_CHUNKS) output_flush();
+            if (!g_out.chunks[g_out.count]) g_out.chunks[g_out.count] = xmalloc(OUT_CHUNK_SIZE);
+            g_out.lens[g_out.count++] = 0;
+        }
+        size_t *used = &g_out.lens[g_out.count - 1];
+        size_t n = OUT_CHUNK_SIZE - *used;
+        if (n > len) n = len;
+        memcpy(g_out.chunks[g_out.count - 1] + *used, data, n);
+        *used += n;
+        data += n;
+        len -= n;
+    }
+}
+
 /* ============================================================================
  * Tree Printing
  * ============================================================================ */
@@ -453,9 +551,6 @@ const char *get_git_indicator(GitCache *cache, const char *path,
 static int visible_strlen(const char *s);
 static char *truncate_visible(const char *s, int max_visible_len);
 
-/* Buffer size for print_entry line assembly */
-#define ENTRY_BUF_SIZE 8192
-
 /* Append formatted text to a buffer, advancing pos. Silently stops if full. */
 #define EMIT(buf, pos, size, ...) do { \
     int _n = snprintf((buf) + (pos), (size) - (pos), __VA_ARGS__); \
@@ -483,14 +578,20 @@ static void emit_prefix(char *buf, int *pos, int size, int depth, int *continuat
     EMIT(buf, *pos, size, "%s", COLOR_RESET);
 }
 
-void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visible_children, const PrintContext *ctx) {
-    char abs_path[PATH_MAX];
-    get_realpath(fe->path, abs_path, ctx->cfg);
+int format_entry(const FileEntry *fe, int depth, int was_expanded,
+                 int has_visible_children, const PrintContext *ctx,
+                 char *line) {
+    int64_t start = PROFILE_BEGIN();
+    char abs_path_buf[PATH_MAX];
+    const char *abs_path = fe->real_path;
+    if (!abs_path) {
+        get_realpath(fe->path, abs_path_buf, ctx->cfg);
+        abs_path = abs_path_buf;
+    }
 
     int is_cwd = (strcmp(abs_path, ctx->cfg->cwd) == 0);
     int is_hidden = (fe->name[0] == '.');
 
-    char line[ENTRY_BUF_SIZE];
     int pos = 0;
 
     /* Print optional line prefix (used for interactive selection cursor) */
@@ -501,10 +602,18 @@ void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visib
     if (ctx->cfg->long_format && ctx->columns) {
         char col_buf[32];
         for (int i = 0; i < NUM_COLUMNS; i++) {
-            ctx->columns[i].format(fe, ctx->icons, col_buf, sizeof(col_buf));
-            EMIT(line, pos, ENTRY_BUF_SIZE, "%s%*s%s", CLR(ctx->cfg, COLOR_GREY), ctx->columns[i].width, col_buf, RST(ctx->cfg));
+            /* Until the workers get to it, the build's values (st_size,
+             * no counts) would pass for real ones */
+            int pending = ctx->meta_pending && column_is_deferred(i, ctx->cfg);
+            if (pending) {
+                EMIT(line, pos, ENTRY_BUF_SIZE, "%s%*s%s%s", CLR(ctx->cfg, COLOR_GREY),
+                     ctx->columns[i].width - 1, "", COLUMN_PENDING, RST(ctx->cfg));
+            } else {
+                ctx->columns[i].format(fe, ctx->icons, col_buf, sizeof(col_buf));
+                EMIT(line, pos, ENTRY_BUF_SIZE, "%s%*s%s", CLR(ctx->cfg, COLOR_GREY), ctx->columns[i].width, col_buf, RST(ctx->cfg));
+            }
             if (i == COL_LINES) {
-                const char *count_icon = get_count_icon(fe, ctx->icons);
+                const char *count_icon = pending ? "" : get_count_icon(fe, ctx->icons);
                 if (count_icon[0]) {
                     EMIT(line, pos, ENTRY_BUF_SIZE, " %s%s%s", CLR(ctx->cfg, COLOR_GREY), count_icon, RST(ctx->cfg));
                 } else {
@@ -549,7 +658,8 @@ void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visib
 
     emit_prefix(line, &pos, ENTRY_BUF_SIZE, depth, ctx->continuation, ctx->cfg);
 
-    int is_readonly = (access(fe->path, W_OK) != 0 && access(fe->path, R_OK) == 0);
+    int is_readonly = fe->has_access ? fe->is_readonly :
+                      (access(fe->path, W_OK) != 0 && access(fe->path, R_OK) == 0);
     int is_dir = (fe->type == FTYPE_DIR || fe->type == FTYPE_SYMLINK_DIR);
     if (!ctx->cfg->no_icons && is_readonly && !is_dir) {
         EMIT(line, pos, ENTRY_BUF_SIZE, "%s%s%s ", CLR(ctx->cfg, COLOR_YELLOW), ctx->icons->readonly, RST(ctx->cfg));
@@ -605,7 +715,8 @@ void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visib
     const char *style = is_hidden ? CLR(ctx->cfg, STYLE_ITALIC) : "";
 
     if (!ctx->cfg->no_icons) {
-        int is_binary = (fe->file_count < 0 && fe->line_count == -1);
+        int is_binary = (fe->file_count < 0 && fe->line_count == -1 &&
+                         !(ctx->meta_pending && column_is_deferred(COL_LINES, ctx->cfg)));
         int is_dir = (fe->type == FTYPE_DIR || fe->type == FTYPE_SYMLINK_DIR);
         int is_expanded = is_dir ? was_expanded : 0;
         int is_root = (fe->path[0] == '/' && fe->path[1] == '\0');
@@ -630,14 +741,15 @@ void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visib
     if (is_dir && fe->is_git_root) {
         GitBranchInfo gi;
         if (git_get_branch_info(fe->path, &gi)) {
-            if (fe->tag) {
-                EMIT(line, pos, ENTRY_BUF_SIZE, " %s%s%s%s %s(%s)%s", CLR(ctx->cfg, COLOR_GREY), CLR(ctx->cfg, STYLE_ITALIC), gi.branch, RST(ctx->cfg), CLR(ctx->cfg, COLOR_GREY), fe->tag, RST(ctx->cfg));
+            const char *tag = fe->repo ? fe->repo->tag : NULL;
+            if (tag) {
+                EMIT(line, pos, ENTRY_BUF_SIZE, " %s%s%s%s %s(%s)%s", CLR(ctx->cfg, COLOR_GREY), CLR(ctx->cfg, STYLE_ITALIC), gi.branch, RST(ctx->cfg), CLR(ctx->cfg, COLOR_GREY), tag, RST(ctx->cfg));
             } else {
                 EMIT(line, pos, ENTRY_BUF_SIZE, " %s%s%s%s", CLR(ctx->cfg, COLOR_GREY), CLR(ctx->cfg, STYLE_ITALIC), gi.branch, RST(ctx->cfg));
             }
             if (gi.has_upstream) {
                 const char *cloud_color = gi.out_of_sync ? COLOR_RED : COLOR_GREY;
-                char *web_url = git_remote_to_web_url(fe->remote);
+                char *web_url = git_remote_to_web_url(fe->repo ? fe->repo->remote : NULL);
                 if (web_url && ctx->cfg->is_tty) {
                     EMIT(line, pos, ENTRY_BUF_SIZE, " %s\033]8;;%s\033\\%s\033]8;;\033\\%s", CLR(ctx->cfg, cloud_color), web_url, ctx->icons->git_upstream, RST(ctx->cfg));
                 } else {
@@ -677,11 +789,26 @@ void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visib
     /* Truncate to terminal width if set */
     if (ctx->term_width > 0 && visible_strlen(line) > ctx->term_width) {
         char *truncated = truncate_visible(line, ctx->term_width);
-        printf("%s\n", truncated);
+        pos = (int)strlen(truncated);
+        memcpy(line, truncated, (size_t)pos + 1);
         free(truncated);
-    } else {
-        printf("%s\n", line);
     }
+    PROFILE_END(PROF_FORMAT, start);
+    return pos;
+}
+
+void print_entry(const FileEntry *fe, int depth, int was_expanded, int has_visible_children, const PrintContext *ctx) {
+    char line[ENTRY_BUF_SIZE];
+    format_entry(fe, depth, was_expanded, has_visible_children, ctx, line);
+    printf("%s\n", line);
+}
+
+/* Same as print_entry, into the output buffer */
+static void emit_entry(const FileEntry *fe, int depth, int was_expanded,
+                       int has_visible_children, const PrintContext *ctx) {
+    char *line = out_line_begin();
+    int len = format_entry(fe, depth, was_expanded, has_visible_children, ctx, line);
+    out_line_end(len);
 }
 
 static void print_tree_children(const TreeNode *parent, int depth, PrintContext *ctx);
@@ -724,13 +851,14 @@ void print_tree_node(const TreeNode *node, int depth, PrintContext *ctx) {
                 }
             }
 
-            print_entry(&child->entry, depth, child->was_expanded, has_visible_children, ctx);
+            emit_entry(&child->entry, depth, child->was_expanded, has_visible_children, ctx);
 
             if (child->child_count > 0) {
                 print_tree_children(child, depth, ctx);
             }
         }
         free(visible_indices);
+        output_flush();
         return;
     }
 
@@ -748,11 +876,12 @@ void print_tree_node(const TreeNode *node, int depth, PrintContext *ctx) {
         }
     }
 
-    print_entry(&node->entry, depth, node->was_expanded, has_visible_children, ctx);
+    emit_entry(&node->entry, depth, node->was_expanded, has_visible_children, ctx);
 
     if (node->child_count > 0) {
         print_tree_children(node, depth, ctx);
     }
+    output_flush();
 }
 
 static void print_tree_children(const TreeNode *parent, int depth, PrintContext *ctx) {
@@ -792,7 +921,7 @@ static void print_tree_children(const TreeNode *parent, int depth, PrintContext
             }
         }
 
-        print_entry(&child->entry, depth + 1, child->was_expanded, has_visible_children, ctx);
+        emit_entry(&child->entry, depth + 1, child->was_expanded, has_visible_children, ctx);
 
         if (child->child_count > 0) {
             print_tree_children(child, depth + 1, ctx);
@@ -802,6 +931,65 @@ static void print_tree_children(const TreeNode *parent, int depth, PrintContext
     free(visible_indices);
 }
 
+/* ============================================================================
+ * Streaming Output
+ * ============================================================================ */
+
+/* Widest value each column usually takes ("1023K", "9.9K", "59m ago"),
+ * so entries found after the first line rarely overflow */
+#define STREAM_SIZE_WIDTH  5
+#define STREAM_LINES_WIDTH 4
+#define STREAM_TIME_WIDTH  7
+
+int can_stream(const Config *cfg) {
+    return cfg->stream && !cfg->interactive && !cfg->summary_mode &&
+           !cfg->show_ancestry && !is_filtering_active(cfg);
+}
+
+/* Fix column widths before the first line goes out */
+static void stream_size_columns(const TreeNode *root, PrintContext *ctx) {
+    if (!ctx->cfg->long_format || !ctx->columns) return;
+
+    Column *cols = ctx->columns;
+    if (cols[COL_SIZE].width < STREAM_SIZE_WIDTH) cols[COL_SIZE].width = STREAM_SIZE_WIDTH;
+    if (cols[COL_LINES].width < STREAM_LINES_WIDTH) cols[COL_LINES].width = STREAM_LINES_WIDTH;
+    if (cols[COL_TIME].width < STREAM_TIME_WIDTH) cols[COL_TIME].width = STREAM_TIME_WIDTH;
+
+    columns_update_widths(cols, &root->entry, ctx->icons);
+    for (size_t i = 0; i < root->child_count; i++) {
+        columns_update_widths(cols, &root->children[i].entry, ctx->icons);
+    }
+
+    int max_added, max_removed;
+    git_diff_bounds(ctx->git, &max_added, &max_removed);
+    if (max_added > 0 && count_digits(max_added) > ctx->diff_add_width)
+        ctx->diff_add_width = count_digits(max_added);
+    if (max_removed > 0 && count_digits(max_removed) > ctx->diff_del_width)
+        ctx->diff_del_width = count_digits(max_removed);
+}
+
+static void stream_visit(const TreeNode *node, int depth, int is_last, void *arg) {
+    PrintContext *ctx = arg;
+
+    if (depth == 0) {
+        stream_size_columns(node, ctx);
+        /* List mode prints a directory's contents, not the directory */
+        if (ctx->cfg->list_mode && node->entry.type == FTYPE_DIR) return;
+    } else {
+        ctx->continuation[depth - 1] = !is_last;
+    }
+    emit_entry(&node->entry, depth, node->was_expanded, node->child_count > 0, ctx);
+
+    /* Directories are where the walk may stall, so send what's ready */
+    if (node->child_count > 0) output_flush();
+}
+
+void print_tree_streaming(const char *path, PrintContext *ctx) {
+    TreeBuildOpts opts = config_to_build_opts(ctx->cfg);
+    build_tree_streaming(path, &opts, ctx->git, stream_visit, ctx);
+    output_flush();
+}
+
 /* ============================================================================
  * Summary Mode - Card Layout
  * ============================================================================ */
@@ -1004,10 +1192,12 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
     int is_cwd = (strcmp(fe->path, cfg->cwd) == 0);
     int is_hidden = (fe->name[0] == '.');
 
-    /* Compute extended data if not already done.
-     * Summary mode always counts all files (including hidden) to match file_count. */
-    if (is_dir && !fe->has_type_stats) {
-        fileinfo_compute_type_stats(fe, node, ctx->filetypes, ctx->shebangs, 1);
+    /* Compute extended data if not already done. The tree only holds the
+     * top level; the type breakdown walks the rest of it on its own. */
+    if (is_dir && !fe->type_stats) {
+        TreeBuildOpts opts = config_to_build_opts(cfg);
+        opts.max_depth = L_MAX_DEPTH;
+        tree_compute_type_stats(node, &opts, ctx->git, ctx->filetypes, ctx->shebangs);
     }
 
     char abs_path[PATH_MAX];
@@ -1023,6 +1213,9 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
         fileinfo_compute_git_repo_info(fe, ctx->git);
     }
 
+    const RepoInfo *ri = fe->has_git_repo_info ? fe->repo : NULL;
+    TypeStats *stats = fe->type_stats;
+
     Card card;
     card_init(&card);
 
@@ -1034,32 +1227,32 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
     const char *icon = cfg->no_icons ? "" : get_icon(ctx->icons, fe->type, node->was_expanded, is_locked, is_binary, fe->name);
     const char *icon_space = cfg->no_icons ? "" : " ";
 
-    if (fe->has_git_repo_info && fe->branch) {
-        if (fe->has_upstream) {
-            const char *cloud_color = fe->out_of_sync ? COLOR_RED : COLOR_GREY;
+    if (ri && ri->branch) {
+        if (ri->has_upstream) {
+            const char *cloud_color = ri->out_of_sync ? COLOR_RED : COLOR_GREY;
             char ahead_behind[64] = "";
             int ab_pos = 0;
-            if (fe->ahead > 0)
-                ab_pos += snprintf(ahead_behind + ab_pos, sizeof(ahead_behind) - ab_pos, " %s+%d%s", CLR(cfg, COLOR_RED), fe->ahead, RST(cfg));
-            if (fe->behind > 0)
-                ab_pos += snprintf(ahead_behind + ab_pos, sizeof(ahead_behind) - ab_pos, " %s-%d%s", CLR(cfg, COLOR_RED), fe->behind, RST(cfg));
-            char *web_url = git_remote_to_web_url(fe->remote);
+            if (ri->ahead > 0)
+                ab_pos += snprintf(ahead_behind + ab_pos, sizeof(ahead_behind) - ab_pos, " %s+%d%s", CLR(cfg, COLOR_RED), ri->ahead, RST(cfg));
+            if (ri->behind > 0)
+                ab_pos += snprintf(ahead_behind + ab_pos, sizeof(ahead_behind) - ab_pos, " %s-%d%s", CLR(cfg, COLOR_RED), ri->behind, RST(cfg));
+            char *web_url = git_remote_to_web_url(ri->remote);
             if (web_url && cfg->is_tty) {
                 card_add(&card, "%s%s%s%s%s%s%s %s%s%s%s %s\033]8;;%s\033\\%s\033]8;;\033\\%s%s",
                          color, icon, icon_space, style, fe->name, RST(cfg), "",
-                         CLR(cfg, COLOR_GREY), CLR(cfg, STYLE_ITALIC), fe->branch, RST(cfg),
+                         CLR(cfg, COLOR_GREY), CLR(cfg, STYLE_ITALIC), ri->branch, RST(cfg),
                          CLR(cfg, cloud_color), web_url, ctx->icons->git_upstream, RST(cfg), ahead_behind);
             } else {
                 card_add(&card, "%s%s%s%s%s%s%s %s%s%s%s %s%s%s%s",
                          color, icon, icon_space, style, fe->name, RST(cfg), "",
-                         CLR(cfg, COLOR_GREY), CLR(cfg, STYLE_ITALIC), fe->branch, RST(cfg),
+                         CLR(cfg, COLOR_GREY), CLR(cfg, STYLE_ITALIC), ri->branch, RST(cfg),
                          CLR(cfg, cloud_color), ctx->icons->git_upstream, RST(cfg), ahead_behind);
             }
             free(web_url);
         } else {
             card_add(&card, "%s%s%s%s%s%s%s %s%s%s%s",
                      color, icon, icon_space, style, fe->name, RST(cfg), "",
-                     CLR(cfg, COLOR_GREY), CLR(cfg, STYLE_ITALIC), fe->branch, RST(cfg));
+                     CLR(cfg, COLOR_GREY), CLR(cfg, STYLE_ITALIC), ri->branch, RST(cfg));
         }
     } else {
         card_add(&card, "%s%s%s%s%s%s", color, icon, icon_space, style, fe->name, RST(cfg));
@@ -1098,13 +1291,13 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
     card_add(&card, "%sSize:%s     %s", CLR(cfg, COLOR_GREY), RST(cfg), size_buf);
 
     /* File type breakdown table (directories only) */
-    if (is_dir && fe->has_type_stats && fe->type_stats.count > 0) {
-        type_stats_sort(&fe->type_stats);
+    if (is_dir && stats && stats->count > 0) {
+        type_stats_sort(stats);
 
         /* Calculate column widths */
         int max_name_len = 0, max_files_len = 0, max_lines_len = 0;
-        for (int i = 0; i < fe->type_stats.count; i++) {
-            TypeStat *ts = &fe->type_stats.entries[i];
+        for (int i = 0; i < stats->count; i++) {
+            TypeStat *ts = &stats->entries[i];
             int nlen = (int)strlen(ts->name);
             if (nlen > max_name_len) max_name_len = nlen;
             char tmp[32];
@@ -1119,9 +1312,9 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
         }
         /* Check totals width and ensure headers fit */
         char tmp[32];
-        format_count(fe->type_stats.total_files, tmp, sizeof(tmp));
+        format_count(stats->total_files, tmp, sizeof(tmp));
         if ((int)strlen(tmp) > max_files_len) max_files_len = (int)strlen(tmp);
-        format_count(fe->type_stats.total_lines, tmp, sizeof(tmp));
+        format_count(stats->total_lines, tmp, sizeof(tmp));
         if ((int)strlen(tmp) > max_lines_len) max_lines_len = (int)strlen(tmp);
         if (max_name_len < 5) max_name_len = 5;   /* At least "Total" */
         if (max_files_len < 5) max_files_len = 5;  /* At least "Files" */
@@ -1132,8 +1325,8 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
                  max_name_len, "", max_files_len, "Files", max_lines_len, "Lines", RST(cfg));
 
         /* Per-type rows */
-        for (int i = 0; i < fe->type_stats.count; i++) {
-            TypeStat *ts = &fe->type_stats.entries[i];
+        for (int i = 0; i < stats->count; i++) {
+            TypeStat *ts = &stats->entries[i];
             char files_buf[32], lines_buf[32];
             format_count(ts->file_count, files_buf, sizeof(files_buf));
             if (ts->has_lines) {
@@ -1148,9 +1341,9 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
 
         /* Total row */
         char total_files[32], total_lines[32];
-        format_count(fe->type_stats.total_files, total_files, sizeof(total_files));
-        if (fe->type_stats.total_lines > 0) {
-            format_count(fe->type_stats.total_lines, total_lines, sizeof(total_lines));
+        format_count(stats->total_files, total_files, sizeof(total_files));
+        if (stats->total_lines > 0) {
+            format_count(stats->total_lines, total_lines, sizeof(total_lines));
         } else {
             snprintf(total_lines, sizeof(total_lines), "-");
         }
@@ -1207,34 +1400,34 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
     card_add(&card, "%sModified:%s %s (%s)", CLR(cfg, COLOR_GREY), RST(cfg), time_buf, rel_buf);
 
     /* Git info (for git repositories) */
-    if (fe->has_git_repo_info) {
+    if (ri) {
         card_add_empty(&card);
 
-        if (fe->branch) {
-            if (fe->short_hash[0]) {
+        if (ri->branch) {
+            if (ri->short_hash[0]) {
                 card_add(&card, "%sBranch:%s   %s %s(%s)%s", CLR(cfg, COLOR_GREY), RST(cfg),
-                         fe->branch, CLR(cfg, COLOR_GREY), fe->short_hash, RST(cfg));
+                         ri->branch, CLR(cfg, COLOR_GREY), ri->short_hash, RST(cfg));
             } else {
-                card_add(&card, "%sBranch:%s   %s", CLR(cfg, COLOR_GREY), RST(cfg), fe->branch);
+                card_add(&card, "%sBranch:%s   %s", CLR(cfg, COLOR_GREY), RST(cfg), ri->branch);
             }
         }
-        if (fe->commit_count[0]) {
-            card_add(&card, "%sCommits:%s  %s", CLR(cfg, COLOR_GREY), RST(cfg), fe->commit_count);
+        if (ri->commit_count[0]) {
+            card_add(&card, "%sCommits:%s  %s", CLR(cfg, COLOR_GREY), RST(cfg), ri->commit_count);
         }
-        if (fe->tag) {
-            if (fe->tag_distance > 0) {
+        if (ri->tag) {
+            if (ri->tag_distance > 0) {
                 card_add(&card, "%sTag:%s      %s %s(+%d)%s", CLR(cfg, COLOR_GREY), RST(cfg),
-                         fe->tag, CLR(cfg, COLOR_GREY), fe->tag_distance, RST(cfg));
+                         ri->tag, CLR(cfg, COLOR_GREY), ri->tag_distance, RST(cfg));
             } else {
-                card_add(&card, "%sTag:%s      %s", CLR(cfg, COLOR_GREY), RST(cfg), fe->tag);
+                card_add(&card, "%sTag:%s      %s", CLR(cfg, COLOR_GREY), RST(cfg), ri->tag);
             }
         }
-        if (fe->remote) {
-            card_add(&card, "%sRemote:%s   %s", CLR(cfg, COLOR_GREY), RST(cfg), fe->remote);
+        if (ri->remote) {
+            card_add(&card, "%sRemote:%s   %s", CLR(cfg, COLOR_GREY), RST(cfg), ri->remote);
         }
 
         /* Dirty status */
-        GitSummary *summary = &fe->repo_status;
+        const GitSummary *summary = &ri->repo_status;
         if (summary->modified || summary->untracked || summary->staged || summary->deleted) {
             char status_buf[128] = "";
             int pos = 0;
@@ -1294,3 +1487,47 @@ void print_summary(TreeNode *node, PrintContext *ctx) {
     card_print(&card, cfg);
     printf("\n");
 }
+
+/* ============================================================================
+ * Size Rankings
+ * ============================================================================ */
+
+int print_largest_dirs(const char *path, int limit, int max_depth, const Config *cfg) {
+    char real[PATH_MAX];
+    get_realpath(path, real, cfg);
+
+    CacheRow *rows;
+    int count = cache_query_largest(real, max_depth, limit, &rows);
+    if (count < 0) return -1;
+
+    char abbrev[PATH_MAX];
+    abbreviate_home(real, abbrev, sizeof(abbrev), cfg);
+    if (count == 0) {
+        printf("%sNo cached directories under %s.%s\n",
+               CLR(cfg, COLOR_RED), abbrev, RST(cfg));
+        return 0;
+    }
+
+    char buf[32];
+    int size_width = 0, count_width = 0;
+    for (int i = 0; i < count; i++) {
+        format_size((off_t)rows[i].size, buf, sizeof(buf));
+        if ((int)strlen(buf) > size_width) size_width = (int)strlen(buf);
+        format_count((long)rows[i].file_count, buf, sizeof(buf));
+        if ((int)strlen(buf) > count_width) count_width = (int)strlen(buf);
+    }
+
+    const char *color = get_file_color(FTYPE_DIR, 0, 0, cfg->is_tty, cfg->color_all);
+    for (int i = 0; i < count; i++) {
+        char size_buf[32], count_buf[32];
+        format_size((off_t)rows[i].size, size_buf, sizeof(size_buf));
+        format_count((long)rows[i].file_count, count_buf, sizeof(count_buf));
+        abbreviate_home(rows[i].path, abbrev, sizeof(abbrev), cfg);
+        printf("%s%*s  %*s%s  %s%s%s\n", CLR(cfg, COLOR_GREY),
+               size_width, size_buf, count_width, count_buf, RST(cfg),
+               color, abbrev, RST(cfg));
+    }
+
+    cache_rows_free(rows, count);
+    return 0;
+}
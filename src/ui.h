@@ -13,6 +13,12 @@
  * Display Configuration
  * ============================================================================ */
 
+typedef enum {
+    OUTPUT_TREE,
+    OUTPUT_JSON,                 /* One JSON array of entry objects */
+    OUTPUT_NDJSON                /* One JSON object per line */
+} OutputFormat;
+
 typedef struct {
     int max_depth;
     int show_hidden;
@@ -27,6 +33,9 @@ typedef struct {
     int show_ancestry;
     int color_all;
     int interactive;
+    int stream;                  /* Print as directories are read */
+    OutputFormat output;
+    int du_top;                  /* Largest cached directories (0 = off) */
     int is_tty;
     SortMode sort_by;
     char cwd[PATH_MAX];
@@ -35,6 +44,7 @@ typedef struct {
     const char *grep_pattern;
     off_t min_size;              /* Minimum size filter (0 = disabled) */
     ComputeOpts compute;        /* What metadata to compute */
+    ComputeOpts deferred;       /* Left to background workers (interactive) */
 } Config;
 
 /* ============================================================================
@@ -57,8 +67,13 @@ typedef struct {
 #define COL_LINES 1
 #define COL_TIME  2
 
+/* Drawn in a deferred column until its row has been measured; one cell */
+#define COLUMN_PENDING "\xe2\x80\xa6"
+
 /* Column functions */
 void columns_init(Column *cols);
+/* Whether column col is filled in by background workers (cfg->deferred) */
+int column_is_deferred(int col, const Config *cfg);
 void columns_update_widths(Column *cols, const FileEntry *fe, const Icons *icons);
 void columns_recalculate_visible(Column *cols, TreeNode **trees, int tree_count,
                                  const Icons *icons, const Config *cfg);
@@ -88,6 +103,7 @@ typedef struct {
     const char *line_prefix;
     int selected;
     int term_width;
+    int meta_pending;           /* Deferred columns not filled in yet (interactive) */
 } PrintContext;
 
 /* ============================================================================
@@ -101,11 +117,42 @@ int node_is_visible(const TreeNode *node, const Config *cfg);
  * Printing Functions
  * ============================================================================ */
 
+#define ENTRY_BUF_SIZE  8192     /* Longest line format_entry assembles */
+
 void print_tree_node(const TreeNode *node, int depth, PrintContext *ctx);
+
+/* Format one entry as print_entry prints it into line (ENTRY_BUF_SIZE
+ * bytes, no newline) and return its length */
+int format_entry(const FileEntry *fe, int depth, int was_expanded,
+                 int has_visible_children, const PrintContext *ctx, char *line);
 void print_entry(const FileEntry *fe, int depth, int was_expanded,
                  int has_visible_children, const PrintContext *ctx);
 void print_summary(TreeNode *node, PrintContext *ctx);
 
+/* Print the limit largest directories the daemon cached under path, at
+ * most max_depth levels down (-1 for any), from the size cache alone.
+ * Returns 0, or -1 if the size cache can't be read. */
+int print_largest_dirs(const char *path, int limit, int max_depth, const Config *cfg);
+
+/* Whether a listing can be printed while it's built (no filters, summary,
+ * ancestry or interactive mode, which all need the finished tree) */
+int can_stream(const Config *cfg);
+
+/* Build and print the tree at path in one pass (see build_tree_streaming).
+ * Column widths are fixed up front from typical maxima and the first
+ * level; ctx->diff_*_width are raised to fit the root repository. */
+void print_tree_streaming(const char *path, PrintContext *ctx);
+
+/* ============================================================================
+ * Buffered Output
+ * ============================================================================ */
+
+/* Append to the stdout buffer (written with writev as it fills) */
+void output_write(const char *data, size_t len);
+
+/* Write out everything buffered, after flushing stdio */
+void output_flush(void);
+
 /* ============================================================================
  * Git Status Indicator
  * ============================================================================ */
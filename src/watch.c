@@ -0,0 +1,238 @@
+/*
+ * watch.c - Filesystem change notifications for the daemon
+ *
+ * Linux: one inotify watch per cached directory. Only IN_CLOSE_WRITE is
+ * used for content changes (not IN_MODIFY) so files held open for append,
+ * like the daemon's own log, don't trigger a rescan on every write.
+ *
+ * macOS: a single FSEvents stream over the cached directories. FSEvents
+ * is recursive and reports the directory an event happened in.
+ */
+
+#include "watch.h"
+#include "common.h"
+
+#ifdef __APPLE__
+#include <CoreServices/CoreServices.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+/* ============================================================================
+ * Batch Helpers
+ * ============================================================================ */
+
+static void batch_add(WatchBatch *batch, const char *path) {
+    if (batch->count >= batch->capacity) {
+        size_t new_cap = batch->capacity ? batch->capacity * 2 : 64;
+        batch->paths = xrealloc(batch->paths, new_cap * sizeof(char *));
+        batch->capacity = new_cap;
+    }
+    batch->paths[batch->count++] = xstrdup(path);
+}
+
+void watch_batch_clear(WatchBatch *batch) {
+    for (size_t i = 0; i < batch->count; i++)
+        free(batch->paths[i]);
+    batch->count = 0;
+}
+
+void watch_batch_free(WatchBatch *batch) {
+    watch_batch_clear(batch);
+    free(batch->paths);
+    batch->paths = NULL;
+    batch->capacity = 0;
+}
+
+#ifdef __APPLE__
+/* ============================================================================
+ * macOS: FSEvents
+ * ============================================================================ */
+
+#define WATCH_LATENCY 1.0  /* Seconds FSEvents may coalesce events for */
+
+static CFMutableArrayRef w_paths = NULL;
+static FSEventStreamRef w_stream = NULL;
+static WatchBatch *w_pending = NULL;
+static int w_added = 0;
+static int w_lost = 0;
+
+static void watch_callback(ConstFSEventStreamRef stream, void *info,
+                           size_t num_events, void *event_paths,
+                           const FSEventStreamEventFlags flags[],
+                           const FSEventStreamEventId ids[]) {
+    (void)stream;
+    (void)info;
+    (void)ids;
+    char **paths = event_paths;
+    for (size_t i = 0; i < num_events; i++) {
+        if (flags[i] & (kFSEventStreamEventFlagMustScanSubDirs |
+                        kFSEventStreamEventFlagUserDropped |
+                        kFSEventStreamEventFlagKernelDropped)) {
+            w_lost = 1;
+            continue;
+        }
+        if (!w_pending) continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s", paths[i]);
+        size_t len = strlen(path);
+        if (len > 1 && path[len - 1] == '/') path[len - 1] = '\0';
+        batch_add(w_pending, path);
+        w_added++;
+    }
+}
+
+int watch_init(void) {
+    watch_close();
+    w_paths = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
+    return w_paths ? 0 : -1;
+}
+
+int watch_add(const char *path) {
+    if (!w_paths || w_stream) return -1;
+    CFStringRef str = CFStringCreateWithCString(NULL, path, kCFStringEncodingUTF8);
+    if (!str) return -1;
+    CFArrayAppendValue(w_paths, str);
+    CFRelease(str);
+    return 0;
+}
+
+int watch_poll(WatchBatch *batch, int timeout_ms) {
+    if (!w_paths || CFArrayGetCount(w_paths) == 0) return -1;
+
+    /* Stream is created on first poll, once all paths have been added */
+    if (!w_stream) {
+        w_stream = FSEventStreamCreate(NULL, watch_callback, NULL, w_paths,
+                                       kFSEventStreamEventIdSinceNow,
+                                       WATCH_LATENCY,
+                                       kFSEventStreamCreateFlagNone);
+        if (!w_stream) return -1;
+        FSEventStreamScheduleWithRunLoop(w_stream, CFRunLoopGetCurrent(),
+                                         kCFRunLoopDefaultMode);
+        if (!FSEventStreamStart(w_stream)) {
+            watch_close();
+            return -1;
+        }
+    }
+
+    w_pending = batch;
+    w_added = 0;
+    CFRunLoopRunInMode(kCFRunLoopDefaultMode, timeout_ms / 1000.0, true);
+    w_pending = NULL;
+
+    if (w_lost) {
+        w_lost = 0;
+        return -1;
+    }
+    return w_added;
+}
+
+void watch_close(void) {
+    if (w_stream) {
+        FSEventStreamStop(w_stream);
+        FSEventStreamInvalidate(w_stream);
+        FSEventStreamRelease(w_stream);
+        w_stream = NULL;
+    }
+    if (w_paths) {
+        CFRelease(w_paths);
+        w_paths = NULL;
+    }
+    w_lost = 0;
+}
+
+#elif defined(__linux__)
+/* ============================================================================
+ * Linux: inotify
+ * ============================================================================ */
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_CLOSE_WRITE | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+static int w_fd = -1;
+static char **w_paths = NULL;   /* Indexed by watch descriptor */
+static size_t w_cap = 0;
+
+int watch_init(void) {
+    watch_close();
+    w_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return w_fd >= 0 ? 0 : -1;
+}
+
+int watch_add(const char *path) {
+    if (w_fd < 0) return -1;
+    int wd = inotify_add_watch(w_fd, path, WATCH_MASK);
+    if (wd < 0) return -1;
+
+    if ((size_t)wd >= w_cap) {
+        size_t new_cap = w_cap ? w_cap : 1024;
+        while (new_cap <= (size_t)wd) new_cap *= 2;
+        w_paths = xrealloc(w_paths, new_cap * sizeof(char *));
+        memset(w_paths + w_cap, 0, (new_cap - w_cap) * sizeof(char *));
+        w_cap = new_cap;
+    }
+    free(w_paths[wd]);
+    w_paths[wd] = xstrdup(path);
+    return 0;
+}
+
+int watch_poll(WatchBatch *batch, int timeout_ms) {
+    if (w_fd < 0) return -1;
+
+    struct pollfd pfd = {w_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int added = 0;
+    ssize_t len;
+    while ((len = read(w_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) return -1;
+            if (ev->wd < 0 || (size_t)ev->wd >= w_cap || !w_paths[ev->wd])
+                continue;
+
+            if (ev->mask & IN_IGNORED) {
+                /* Watch removed (directory deleted or unmounted) */
+                free(w_paths[ev->wd]);
+                w_paths[ev->wd] = NULL;
+                continue;
+            }
+            batch_add(batch, w_paths[ev->wd]);
+            added++;
+        }
+    }
+    return added;
+}
+
+void watch_close(void) {
+    if (w_fd >= 0) {
+        close(w_fd);
+        w_fd = -1;
+    }
+    for (size_t i = 0; i < w_cap; i++)
+        free(w_paths[i]);
+    free(w_paths);
+    w_paths = NULL;
+    w_cap = 0;
+}
+
+#else
+/* ============================================================================
+ * Other platforms: unsupported (daemon falls back to periodic scans)
+ * ============================================================================ */
+
+int watch_init(void) { return -1; }
+int watch_add(const char *path) { (void)path; return -1; }
+int watch_poll(WatchBatch *batch, int timeout_ms) {
+    (void)batch;
+    (void)timeout_ms;
+    return -1;
+}
+void watch_close(void) {}
+
+#endif
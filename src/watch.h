@@ -0,0 +1,39 @@
+/*
+ * watch.h - Filesystem change notifications for the daemon
+ *
+ * inotify on Linux, FSEvents on macOS. Reports directories whose contents
+ * changed so the daemon can rescan just those and update the cache in place.
+ */
+
+#ifndef L_WATCH_H
+#define L_WATCH_H
+
+#include <stddef.h>
+
+/* Changed directory paths collected by watch_poll */
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} WatchBatch;
+
+/* Start a watch session - returns 0 on success, -1 if unsupported/failed */
+int watch_init(void);
+
+/* Watch a directory - returns 0 on success, -1 on failure (e.g. the
+ * inotify watch limit was reached) */
+int watch_add(const char *path);
+
+/* Wait up to timeout_ms for changes and append changed directories to
+ * batch. Returns the number of paths added, or -1 if events were lost
+ * and the caller should fall back to a scan. */
+int watch_poll(WatchBatch *batch, int timeout_ms);
+
+/* Stop watching and release all watches */
+void watch_close(void);
+
+/* Free paths collected in a batch (the batch can be reused afterwards) */
+void watch_batch_clear(WatchBatch *batch);
+void watch_batch_free(WatchBatch *batch);
+
+#endif /* L_WATCH_H */